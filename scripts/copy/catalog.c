@@ -0,0 +1,1033 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <spawn.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "copy.h"
+
+extern char **environ;
+
+// 产物索引 <CATALOG> 是只追加的文本日志，每个复制的文件一行，字段以制表符分隔：
+//   日期 目标 规则 标记 文件 大小 SHA-256 提交
+// 字段中的制表符、换行和反斜杠转义为 \t \n \\；没有标记时为空，提交未知时为 -
+// <CATALOG>.idx 是几组排序后的记录偏移：按 (目标名, 目标, 标记, 日期倒序, 文件)、摘要、
+// 标记、日期和文件名，查询时在 mmap 的日志上二分查找；索引之后追加的记录（如中途失败）
+// 由查询顺序扫描补上。只有规则编号或不含固定前缀的文件名模式时无法利用索引，扫描整个日志
+#define CATALOG_HEADER "# copy catalog v1\n"
+#define INDEX_MAGIC "OWCATIX2"
+#define MANIFEST_FILE "manifest.json"
+#define SUMS_FILE "sha256sums"
+#define FIELD_COUNT 8
+
+enum { F_DATE, F_TARGET, F_RULE, F_MARKER, F_FILE, F_SIZE, F_HASH, F_COMMIT };
+
+// 比较的层级：目标名、目标、标记、日期（新的在前）、文件
+enum { KEY_BASE = 1, KEY_TARGET, KEY_MARKER, KEY_DATE, KEY_FILE };
+
+// 索引中各组偏移的排列方式，顺序与 .idx 中的存放顺序一致
+enum { BY_KEY, BY_HASH, BY_MARKER, BY_DATE, BY_NAME, INDEX_COUNT };
+
+typedef struct {
+    const char *p;
+    size_t len;
+} Field;
+
+// 日志中的一条记录，字段指向 mmap 的日志（仍是转义后的形式）
+typedef struct {
+    Field f[FIELD_COUNT];
+    uint64_t offset;
+} Record;
+
+typedef struct {
+    char magic[8];
+    uint64_t log_size;      // 索引覆盖的日志长度
+    uint64_t count;
+} IndexHeader;
+
+typedef struct {
+    const char *log;
+    size_t log_size;
+    void *index_map;
+    size_t index_size;
+    const uint64_t *by[INDEX_COUNT];
+    size_t count;
+    uint64_t indexed;
+} Catalog;
+
+typedef struct {
+    Record *items;
+    size_t count;
+    size_t capacity;
+} RecordList;
+
+// 查询条件，字符串已按日志的规则转义
+typedef struct {
+    Field target;
+    bool target_full;       // 含 / 时比较完整的目标目录，否则只比较最后一段
+    Field marker;
+    Field date;
+    Field hash;
+    Field name_prefix;      // 文件名模式中通配符之前的固定部分，用于文件名索引
+    char rule[16];
+    const char *file;
+    bool all;
+} QueryKeys;
+
+static void write_field(FILE *fp, const char *s) {
+    for (; *s; s++) {
+        switch (*s) {
+            case '\t': fputs("\\t", fp); break;
+            case '\n': fputs("\\n", fp); break;
+            case '\\': fputs("\\\\", fp); break;
+            default: fputc(*s, fp);
+        }
+    }
+}
+
+static char* escape_dup(const char *s) {
+    char *buffer = NULL;
+    size_t size = 0;
+    FILE *fp = open_memstream(&buffer, &size);
+    if (fp == NULL) return NULL;
+    write_field(fp, s);
+    if (fclose(fp) != 0) {
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+static char* field_unescape(Field f) {
+    char *s = malloc(f.len + 1);
+    if (s == NULL) return NULL;
+    size_t n = 0;
+    for (size_t i = 0; i < f.len; i++) {
+        char c = f.p[i];
+        if (c == '\\' && i + 1 < f.len) {
+            c = f.p[++i];
+            if (c == 't') c = '\t';
+            else if (c == 'n') c = '\n';
+        }
+        s[n++] = c;
+    }
+    s[n] = '\0';
+    return s;
+}
+
+static void write_record(FILE *fp, const char *date, const char *target, const char *rule,
+                         const char *marker, const char *file, unsigned long long size,
+                         const char *hash, const char *commit) {
+    write_field(fp, date);
+    fputc('\t', fp);
+    write_field(fp, target);
+    fputc('\t', fp);
+    write_field(fp, rule);
+    fputc('\t', fp);
+    write_field(fp, marker != NULL ? marker : "");
+    fputc('\t', fp);
+    write_field(fp, file);
+    fprintf(fp, "\t%llu\t", size);
+    write_field(fp, hash);
+    fputc('\t', fp);
+    write_field(fp, commit != NULL && commit[0] != '\0' ? commit : "-");
+    fputc('\n', fp);
+}
+
+static Field field_of(const char *s) {
+    return (Field){ s, strlen(s) };
+}
+
+static int field_cmp(Field a, Field b) {
+    size_t n = a.len < b.len ? a.len : b.len;
+    int r = n > 0 ? memcmp(a.p, b.p, n) : 0;
+    if (r != 0) return r;
+    return a.len < b.len ? -1 : a.len > b.len;
+}
+
+static Field field_base(Field f) {
+    for (size_t i = f.len; i > 0; i--) {
+        if (f.p[i - 1] == '/') return (Field){ f.p + i, f.len - i };
+    }
+    return f;
+}
+
+static int key_cmp(const Record *a, const Record *b, int depth) {
+    int r = field_cmp(field_base(a->f[F_TARGET]), field_base(b->f[F_TARGET]));
+    if (r != 0 || depth < KEY_TARGET) return r;
+    r = field_cmp(a->f[F_TARGET], b->f[F_TARGET]);
+    if (r != 0 || depth < KEY_MARKER) return r;
+    r = field_cmp(a->f[F_MARKER], b->f[F_MARKER]);
+    if (r != 0 || depth < KEY_DATE) return r;
+    r = field_cmp(b->f[F_DATE], a->f[F_DATE]);
+    if (r != 0 || depth < KEY_FILE) return r;
+    return field_cmp(a->f[F_FILE], b->f[F_FILE]);
+}
+
+// 同一文件重复复制时，后追加的记录在前
+static int compare_by_key(const void *a, const void *b) {
+    const Record *x = a, *y = b;
+    int r = key_cmp(x, y, KEY_FILE);
+    if (r != 0) return r;
+    return x->offset > y->offset ? -1 : x->offset < y->offset;
+}
+
+static int compare_by_hash(const void *a, const void *b) {
+    const Record *x = a, *y = b;
+    int r = field_cmp(x->f[F_HASH], y->f[F_HASH]);
+    if (r != 0) return r;
+    r = field_cmp(y->f[F_DATE], x->f[F_DATE]);
+    if (r != 0) return r;
+    return x->offset > y->offset ? -1 : x->offset < y->offset;
+}
+
+static int compare_by_marker(const void *a, const void *b) {
+    const Record *x = a, *y = b;
+    int r = field_cmp(x->f[F_MARKER], y->f[F_MARKER]);
+    return r != 0 ? r : compare_by_key(a, b);
+}
+
+static int compare_by_date(const void *a, const void *b) {
+    const Record *x = a, *y = b;
+    int r = field_cmp(x->f[F_DATE], y->f[F_DATE]);
+    return r != 0 ? r : compare_by_key(a, b);
+}
+
+static int compare_by_name(const void *a, const void *b) {
+    const Record *x = a, *y = b;
+    int r = field_cmp(field_base(x->f[F_FILE]), field_base(y->f[F_FILE]));
+    return r != 0 ? r : compare_by_key(a, b);
+}
+
+static int (*const index_compare[INDEX_COUNT])(const void*, const void*) = {
+    compare_by_key, compare_by_hash, compare_by_marker, compare_by_date, compare_by_name
+};
+
+// 解析 offset 处的一行；注释、不完整的行（正在追加）和格式错误的行返回 false
+static bool record_parse(const Catalog *cat, uint64_t offset, Record *rec) {
+    if (offset >= cat->log_size || (offset > 0 && cat->log[offset - 1] != '\n')) return false;
+    const char *p = cat->log + offset;
+    const char *end = memchr(p, '\n', cat->log_size - offset);
+    if (end == NULL || *p == '#') return false;
+    for (int i = 0; i < FIELD_COUNT; i++) {
+        const char *stop = i < FIELD_COUNT - 1 ? memchr(p, '\t', (size_t)(end - p)) : end;
+        if (stop == NULL) return false;
+        rec->f[i] = (Field){ p, (size_t)(stop - p) };
+        p = stop + 1;
+    }
+    if (memchr(rec->f[F_COMMIT].p, '\t', rec->f[F_COMMIT].len) != NULL) return false;
+    rec->offset = offset;
+    return true;
+}
+
+static uint64_t next_line(const Catalog *cat, uint64_t offset) {
+    const char *end = memchr(cat->log + offset, '\n', cat->log_size - offset);
+    return end != NULL ? (uint64_t)(end - cat->log) + 1 : cat->log_size;
+}
+
+static int record_list_add(RecordList *list, const Record *rec) {
+    if (list->count >= list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        Record *items = realloc(list->items, capacity * sizeof(Record));
+        if (items == NULL) return -1;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = *rec;
+    return 0;
+}
+
+static char* catalog_file(const char *catalog, const char *suffix) {
+    char *path = NULL;
+    if (asprintf(&path, "%s%s", catalog, suffix) < 0) return NULL;
+    return path;
+}
+
+// 文件不存在或为空时 *map 为 NULL 并返回 0
+static int map_file(const char *path, void **map, size_t *size) {
+    *map = NULL;
+    *size = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT ? 0 : -1;
+    struct stat st;
+    int result = fstat(fd, &st);
+    if (result == 0 && st.st_size > 0) {
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            result = -1;
+        } else {
+            *map = data;
+            *size = (size_t)st.st_size;
+        }
+    }
+    close(fd);
+    return result;
+}
+
+static void catalog_close(Catalog *cat) {
+    if (cat->log != NULL) munmap((void*)cat->log, cat->log_size);
+    if (cat->index_map != NULL) munmap(cat->index_map, cat->index_size);
+    memset(cat, 0, sizeof(*cat));
+}
+
+// 映射日志和索引；日志不存在时为空目录，索引无效或与日志不符时忽略（查询退回顺序扫描）
+static int catalog_open(const char *catalog, Catalog *cat) {
+    memset(cat, 0, sizeof(*cat));
+    void *log;
+    if (map_file(catalog, &log, &cat->log_size) != 0) {
+        log_error("无法读取产物索引: %s", catalog);
+        return -1;
+    }
+    cat->log = log;
+    if (log == NULL) return 0;
+
+    char *index_path = catalog_file(catalog, ".idx");
+    void *map = NULL;
+    if (index_path == NULL || map_file(index_path, &map, &cat->index_size) != 0 || map == NULL) {
+        free(index_path);
+        return 0;
+    }
+    free(index_path);
+
+    const IndexHeader *header = map;
+    bool valid = cat->index_size >= sizeof(IndexHeader) &&
+                 memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->log_size <= cat->log_size &&
+                 header->count <= (cat->index_size - sizeof(IndexHeader)) / (INDEX_COUNT * sizeof(uint64_t)) &&
+                 cat->index_size == sizeof(IndexHeader) + header->count * INDEX_COUNT * sizeof(uint64_t);
+    if (!valid) {
+        munmap(map, cat->index_size);
+        cat->index_size = 0;
+        return 0;
+    }
+    cat->index_map = map;
+    cat->indexed = header->log_size;
+    cat->count = (size_t)header->count;
+    for (int i = 0; i < INDEX_COUNT; i++) cat->by[i] = (const uint64_t*)(header + 1) + i * cat->count;
+    return 0;
+}
+
+static int catalog_lock(const char *catalog) {
+    char *path = catalog_file(catalog, ".lock");
+    if (path == NULL) return -1;
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    free(path);
+    if (fd < 0) return -1;
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+static void catalog_unlock(int fd) {
+    if (fd >= 0) close(fd);
+}
+
+// 按 cmp 归并已排序的旧索引和新记录
+static size_t merge_offsets(const Catalog *cat, const uint64_t *old, size_t old_count,
+                            const Record *added, size_t added_count,
+                            int (*cmp)(const void*, const void*), uint64_t *out) {
+    size_t i = 0, j = 0, n = 0;
+    Record rec;
+    bool have = false;
+    while (i < old_count || j < added_count) {
+        if (!have && i < old_count) {
+            if (!record_parse(cat, old[i], &rec)) {
+                i++;
+                continue;
+            }
+            have = true;
+        }
+        if (have && (j >= added_count || cmp(&rec, &added[j]) <= 0)) {
+            out[n++] = rec.offset;
+            have = false;
+            i++;
+        } else {
+            out[n++] = added[j++].offset;
+        }
+    }
+    return n;
+}
+
+static int index_write(const char *catalog, uint64_t log_size, uint64_t *const *by, size_t count) {
+    char *path = catalog_file(catalog, ".idx");
+    char *tmp = catalog_file(catalog, ".idx.tmp");
+    int result = -1;
+    FILE *fp = tmp != NULL ? fopen(tmp, "w") : NULL;
+    if (fp != NULL) {
+        IndexHeader header = { .log_size = log_size, .count = count };
+        memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+        for (int i = 0; i < INDEX_COUNT && ok; i++) ok = fwrite(by[i], sizeof(uint64_t), count, fp) == count;
+        if (fclose(fp) != 0) ok = false;
+        if (ok && rename(tmp, path) == 0) result = 0;
+        else unlink(tmp);
+    }
+    if (result != 0) log_error("无法写入产物索引: %s.idx", catalog);
+    free(path);
+    free(tmp);
+    return result;
+}
+
+// 把索引之后追加的记录排序并归并进索引，复杂度与记录数成线性（新记录的排序除外）
+static int index_update(const char *catalog) {
+    Catalog cat;
+    if (catalog_open(catalog, &cat) != 0) return -1;
+    if (cat.index_map != NULL && cat.indexed == cat.log_size) {
+        catalog_close(&cat);
+        return 0;
+    }
+
+    RecordList added = {0};
+    int result = 0;
+    for (uint64_t offset = cat.indexed; offset < cat.log_size; offset = next_line(&cat, offset)) {
+        Record rec;
+        if (record_parse(&cat, offset, &rec) && record_list_add(&added, &rec) != 0) {
+            result = -1;
+            break;
+        }
+    }
+
+    size_t total = cat.count + added.count;
+    uint64_t *by[INDEX_COUNT] = {0};
+    for (int i = 0; i < INDEX_COUNT && result == 0; i++) {
+        by[i] = malloc((total + 1) * sizeof(uint64_t));
+        if (by[i] == NULL) result = -1;
+    }
+    if (result == 0) {
+        size_t count = 0;
+        bool consistent = true;
+        for (int i = 0; i < INDEX_COUNT; i++) {
+            if (added.count > 1) qsort(added.items, added.count, sizeof(Record), index_compare[i]);
+            size_t n = merge_offsets(&cat, cat.by[i], cat.count, added.items, added.count,
+                                     index_compare[i], by[i]);
+            if (i > 0 && n != count) consistent = false;
+            count = n;
+        }
+        if (!consistent) {
+            // 旧索引中两组偏移对不上，说明索引已损坏，整体重建
+            log_warning("产物索引损坏，重新生成: %s.idx", catalog);
+            char *index_path = catalog_file(catalog, ".idx");
+            if (index_path != NULL) unlink(index_path);
+            free(index_path);
+            result = 1;
+        } else {
+            result = index_write(catalog, cat.log_size, by, count);
+        }
+    }
+
+    for (int i = 0; i < INDEX_COUNT; i++) free(by[i]);
+    free(added.items);
+    catalog_close(&cat);
+    return result == 1 ? index_update(catalog) : result;
+}
+
+// 源文件所在 git 仓库的当前提交，不在仓库中或没有 git 时返回 NULL
+static char* source_commit(const char *dir) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) return NULL;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    char *argv[] = { "git", "-C", (char*)dir, "rev-parse", "--verify", "-q", "HEAD", NULL };
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, "git", &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    char buffer[128];
+    size_t len = 0;
+    while (spawned == 0 && len < sizeof(buffer) - 1) {
+        ssize_t n = read(fds[0], buffer + len, sizeof(buffer) - 1 - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+    }
+    close(fds[0]);
+    if (spawned != 0) return NULL;
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return NULL;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return NULL;
+
+    buffer[len] = '\0';
+    buffer[strcspn(buffer, "\n")] = '\0';
+    len = strlen(buffer);
+    if (len != 40 && len != 64) return NULL;
+    if (strspn(buffer, "0123456789abcdef") != len) return NULL;
+    return strdup(buffer);
+}
+
+void catalog_resolve_commits(CopyPlan *plan) {
+    // 同一规则的源文件通常在同一个仓库中，每条规则只查询一次
+    int *rules = malloc((plan->job_count + 1) * sizeof(int));
+    char **commits = malloc((plan->job_count + 1) * sizeof(char*));
+    size_t count = 0;
+    if (rules == NULL || commits == NULL) {
+        free(rules);
+        free(commits);
+        return;
+    }
+
+    for (size_t i = 0; i < plan->job_count; i++) {
+        CopyJob *job = &plan->jobs[i];
+        if (job->result != 0 || job->superseded || job->commit != NULL) continue;
+
+        size_t k = 0;
+        while (k < count && rules[k] != job->rule_id) k++;
+        if (k == count) {
+            char *dir = strdup(job->src);
+            if (dir == NULL) continue;
+            char *slash = strrchr(dir, '/');
+            if (slash == dir) slash[1] = '\0';
+            else if (slash != NULL) *slash = '\0';
+            rules[count] = job->rule_id;
+            commits[count] = source_commit(slash != NULL ? dir : ".");
+            count++;
+            free(dir);
+        }
+        if (commits[k] != NULL) job->commit = strdup(commits[k]);
+    }
+
+    for (size_t k = 0; k < count; k++) free(commits[k]);
+    free(rules);
+    free(commits);
+}
+
+static int catalog_prepare_dir(const char *catalog) {
+    char *dir = strdup(catalog);
+    if (dir == NULL) return -1;
+    char *slash = strrchr(dir, '/');
+    int result = 0;
+    if (slash != NULL && slash != dir) {
+        *slash = '\0';
+        result = ensure_directory_exists(dir);
+    }
+    free(dir);
+    return result;
+}
+
+static int write_all(int fd, const char *buffer, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, buffer, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buffer += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+int catalog_append(const char *catalog, const CopyPlan *plan, const char *date, const char *marker) {
+    char *buffer = NULL;
+    size_t size = 0;
+    FILE *fp = open_memstream(&buffer, &size);
+    if (fp == NULL) return -1;
+
+    size_t records = 0;
+    for (size_t i = 0; i < plan->job_count; i++) {
+        const CopyJob *job = &plan->jobs[i];
+        if (job->result != 0 || job->superseded) continue;
+        const char *dir = plan->outputs[job->output].dir;
+        size_t prefix = strlen(dir);
+        if (strncmp(job->dst, dir, prefix) != 0 || job->dst[prefix] != '/' ||
+            manifest_own_file(job->dst + prefix + 1)) {
+            continue;
+        }
+
+        char rule[16];
+        snprintf(rule, sizeof(rule), "%d", job->rule_id);
+        write_record(fp, date, plan->outputs[job->output].target, rule, marker, job->dst + prefix + 1,
+                     job->size, job->hash, job->commit);
+        records++;
+    }
+    if (fclose(fp) != 0) {
+        free(buffer);
+        return -1;
+    }
+    if (records == 0) {
+        free(buffer);
+        return 0;
+    }
+
+    int result = -1;
+    int lock = catalog_prepare_dir(catalog) == 0 ? catalog_lock(catalog) : -1;
+    if (lock >= 0) {
+        // 追加前日志长度为 0 时先写文件头；追加在锁内完成，索引总是停在完整的行之后
+        int fd = open(catalog, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 &&
+            (st.st_size > 0 || write_all(fd, CATALOG_HEADER, strlen(CATALOG_HEADER)) == 0) &&
+            write_all(fd, buffer, size) == 0) {
+            result = 0;
+        }
+        if (fd >= 0 && close(fd) != 0) result = -1;
+        if (result != 0) log_error("无法写入产物索引: %s", catalog);
+        if (result == 0) result = index_update(catalog);
+    } else {
+        log_error("无法锁定产物索引: %s", catalog);
+    }
+    catalog_unlock(lock);
+    free(buffer);
+
+    if (result == 0) log_info("已记录到产物索引: %s (%zu 个文件)", catalog, records);
+    return result;
+}
+
+// 在 offsets 中查找第一条不小于（upper 时为大于）probe 的记录
+static size_t search(const Catalog *cat, const uint64_t *offsets, const Record *probe,
+                     int depth, bool upper) {
+    size_t low = 0, high = cat->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        Record rec;
+        int r = record_parse(cat, offsets[mid], &rec) ? key_cmp(&rec, probe, depth) : -1;
+        if (r < 0 || (upper && r == 0)) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+static bool record_match(const Record *rec, const QueryKeys *keys) {
+    if (keys->target.p != NULL) {
+        Field target = keys->target_full ? rec->f[F_TARGET] : field_base(rec->f[F_TARGET]);
+        if (field_cmp(target, keys->target) != 0) return false;
+    }
+    if (keys->marker.p != NULL && field_cmp(rec->f[F_MARKER], keys->marker) != 0) return false;
+    if (keys->date.p != NULL && field_cmp(rec->f[F_DATE], keys->date) != 0) return false;
+    if (keys->rule[0] != '\0' && field_cmp(rec->f[F_RULE], field_of(keys->rule)) != 0) return false;
+    if (keys->hash.p != NULL && (rec->f[F_HASH].len < keys->hash.len ||
+                                 memcmp(rec->f[F_HASH].p, keys->hash.p, keys->hash.len) != 0)) {
+        return false;
+    }
+    if (keys->file != NULL) {
+        char *file = field_unescape(rec->f[F_FILE]);
+        if (file == NULL) return false;
+        // 模式不含 / 时只匹配文件名
+        const char *name = file;
+        if (strchr(keys->file, '/') == NULL) {
+            const char *slash = strrchr(file, '/');
+            if (slash != NULL) name = slash + 1;
+        }
+        bool matched = fnmatch(keys->file, name, 0) == 0;
+        free(file);
+        if (!matched) return false;
+    }
+    return true;
+}
+
+// 查找一个 (目标, 标记) 分组中的记录；不列出所有日期时，只取有匹配文件的最新日期
+static int scan_group(const Catalog *cat, size_t start, Record *group, const QueryKeys *keys,
+                      RecordList *found) {
+    int depth = KEY_MARKER;
+    if (keys->date.p != NULL) {
+        group->f[F_DATE] = keys->date;
+        depth = KEY_DATE;
+        start = search(cat, cat->by[BY_KEY], group, depth, false);
+    }
+
+    Field latest = { NULL, 0 };
+    for (size_t i = start; i < cat->count; i++) {
+        Record rec;
+        if (!record_parse(cat, cat->by[BY_KEY][i], &rec)) continue;
+        if (key_cmp(&rec, group, depth) != 0) break;
+        if (!keys->all && latest.p != NULL && field_cmp(rec.f[F_DATE], latest) != 0) break;
+        if (!record_match(&rec, keys)) continue;
+        if (record_list_add(found, &rec) != 0) return -1;
+        if (latest.p == NULL) latest = rec.f[F_DATE];
+    }
+    return 0;
+}
+
+// 指定目标时在按目标排序的索引中二分查找，逐个 (目标, 标记) 分组跳转
+static int query_target(const Catalog *cat, const QueryKeys *keys, RecordList *found) {
+    Record probe;
+    memset(&probe, 0, sizeof(probe));
+    probe.f[F_TARGET] = keys->target;
+    int depth = keys->target_full ? KEY_TARGET : KEY_BASE;
+
+    size_t i = search(cat, cat->by[BY_KEY], &probe, depth, false);
+    while (i < cat->count) {
+        Record rec;
+        if (!record_parse(cat, cat->by[BY_KEY][i], &rec)) {
+            i++;
+            continue;
+        }
+        if (key_cmp(&rec, &probe, depth) != 0) break;
+
+        Record group = rec;
+        if (keys->marker.p != NULL) {
+            // 直接跳到该目标下指定标记的分组，之后跳到下一个目标
+            group.f[F_MARKER] = keys->marker;
+            size_t start = search(cat, cat->by[BY_KEY], &group, KEY_MARKER, false);
+            if (scan_group(cat, start, &group, keys, found) != 0) return -1;
+            i = search(cat, cat->by[BY_KEY], &group, KEY_TARGET, true);
+        } else {
+            if (scan_group(cat, i, &group, keys, found) != 0) return -1;
+            i = search(cat, cat->by[BY_KEY], &group, KEY_MARKER, true);
+        }
+    }
+    return 0;
+}
+
+// 记录与查询条件在某个索引排序字段上的比较，小于 0 表示记录排在匹配范围之前
+typedef int (*RangeCmp)(const Record *rec, const QueryKeys *keys);
+
+static int prefix_cmp(Field value, Field prefix) {
+    if (value.len > prefix.len) value.len = prefix.len;
+    return field_cmp(value, prefix);
+}
+
+static int hash_range(const Record *rec, const QueryKeys *keys) {
+    return prefix_cmp(rec->f[F_HASH], keys->hash);
+}
+
+static int marker_range(const Record *rec, const QueryKeys *keys) {
+    return field_cmp(rec->f[F_MARKER], keys->marker);
+}
+
+static int date_range(const Record *rec, const QueryKeys *keys) {
+    return field_cmp(rec->f[F_DATE], keys->date);
+}
+
+static int name_range(const Record *rec, const QueryKeys *keys) {
+    return prefix_cmp(field_base(rec->f[F_FILE]), keys->name_prefix);
+}
+
+// 在 offsets 中二分查找 cmp 为 0 的连续范围，逐条检查其余条件
+static int query_range(const Catalog *cat, const uint64_t *offsets, RangeCmp cmp,
+                       const QueryKeys *keys, RecordList *found) {
+    size_t low = 0, high = cat->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        Record rec;
+        int r = record_parse(cat, offsets[mid], &rec) ? cmp(&rec, keys) : -1;
+        if (r < 0) low = mid + 1;
+        else high = mid;
+    }
+    for (size_t i = low; i < cat->count; i++) {
+        Record rec;
+        if (!record_parse(cat, offsets[i], &rec)) continue;
+        if (cmp(&rec, keys) != 0) break;
+        if (record_match(&rec, keys) && record_list_add(found, &rec) != 0) return -1;
+    }
+    return 0;
+}
+
+// 顺序扫描 from 之后的日志
+static int query_scan(const Catalog *cat, uint64_t from, const QueryKeys *keys, RecordList *found) {
+    for (uint64_t offset = from; offset < cat->log_size; offset = next_line(cat, offset)) {
+        Record rec;
+        if (record_parse(cat, offset, &rec) && record_match(&rec, keys) &&
+            record_list_add(found, &rec) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 文件名模式中第一个通配符之前的部分；模式含 / 时 * 可以跨目录，不使用文件名索引
+static char* name_prefix(const char *pattern) {
+    if (pattern == NULL || strchr(pattern, '/') != NULL) return NULL;
+    char *prefix = strndup(pattern, strcspn(pattern, "*?[\\"));
+    if (prefix != NULL && prefix[0] == '\0') {
+        free(prefix);
+        return NULL;
+    }
+    return prefix;
+}
+
+static Field query_field(const char *value, char **owned) {
+    *owned = NULL;
+    if (value == NULL) return (Field){ NULL, 0 };
+    *owned = escape_dup(value);
+    return *owned != NULL ? field_of(*owned) : (Field){ NULL, 0 };
+}
+
+int catalog_query(const char *catalog, const CatalogQuery *query) {
+    Catalog cat;
+    if (catalog_open(catalog, &cat) != 0) return -1;
+    if (cat.log == NULL) {
+        log_warning("产物索引为空: %s", catalog);
+        return 1;
+    }
+
+    QueryKeys keys;
+    memset(&keys, 0, sizeof(keys));
+    char *owned[5];
+    char *target = query->target != NULL ? strdup(query->target) : NULL;
+    if (target != NULL) {
+        size_t len = strlen(target);
+        while (len > 1 && target[len - 1] == '/') target[--len] = '\0';
+        keys.target_full = strchr(target, '/') != NULL;
+    }
+    keys.target = query_field(target, &owned[0]);
+    keys.marker = query_field(query->marker, &owned[1]);
+    keys.date = query_field(query->date, &owned[2]);
+    keys.hash = query_field(query->hash, &owned[3]);
+    char *prefix = name_prefix(query->file);
+    keys.name_prefix = query_field(prefix, &owned[4]);
+    free(prefix);
+    if (query->rule_id >= 0) snprintf(keys.rule, sizeof(keys.rule), "%d", query->rule_id);
+    keys.file = query->file;
+    keys.all = query->all;
+
+    RecordList found = {0};
+    int result;
+    bool indexed = true;
+    if (keys.hash.p != NULL) {
+        result = query_range(&cat, cat.by[BY_HASH], hash_range, &keys, &found);
+    } else if (keys.target.p != NULL) {
+        result = query_target(&cat, &keys, &found);
+    } else if (keys.date.p != NULL) {
+        result = query_range(&cat, cat.by[BY_DATE], date_range, &keys, &found);
+    } else if (keys.marker.p != NULL) {
+        result = query_range(&cat, cat.by[BY_MARKER], marker_range, &keys, &found);
+    } else if (keys.name_prefix.p != NULL) {
+        result = query_range(&cat, cat.by[BY_NAME], name_range, &keys, &found);
+    } else {
+        // 只有规则编号或文件名模式以通配符开头时无法利用索引，扫描整个日志
+        log_warning("查询条件没有可用的索引，顺序扫描产物索引: %s", catalog);
+        indexed = false;
+        result = query_scan(&cat, 0, &keys, &found);
+    }
+    if (result == 0 && indexed) {
+        result = query_scan(&cat, cat.indexed, &keys, &found);
+    }
+
+    // 合并索引和日志末尾的结果：同一文件只保留最后一次记录，
+    // 不列出所有日期时每个 (目标, 标记) 只保留最新的日期
+    size_t shown = 0;
+    if (result == 0) {
+        if (found.count > 1) qsort(found.items, found.count, sizeof(Record), compare_by_key);
+        const Record *group = NULL;
+        for (size_t i = 0; i < found.count; i++) {
+            const Record *rec = &found.items[i];
+            if (i > 0 && key_cmp(rec, &found.items[i - 1], KEY_FILE) == 0) continue;
+            if (group == NULL || key_cmp(rec, group, KEY_MARKER) != 0) group = rec;
+            if (!keys.all && field_cmp(rec->f[F_DATE], group->f[F_DATE]) != 0) continue;
+
+            const Field *f = rec->f;
+            bool marked = f[F_MARKER].len > 0;
+            printf("%.*s\t%.*s\t%.*s\t%.*s\t%.*s\t%.*s\t%.*s/%.*s%s%.*s/%.*s\n",
+                   (int)f[F_DATE].len, f[F_DATE].p,
+                   marked ? (int)f[F_MARKER].len : 1, marked ? f[F_MARKER].p : "-",
+                   (int)f[F_RULE].len, f[F_RULE].p,
+                   (int)f[F_SIZE].len, f[F_SIZE].p,
+                   (int)f[F_HASH].len, f[F_HASH].p,
+                   (int)f[F_COMMIT].len, f[F_COMMIT].p,
+                   (int)f[F_TARGET].len, f[F_TARGET].p,
+                   (int)f[F_DATE].len, f[F_DATE].p,
+                   marked ? "/" : "", (int)f[F_MARKER].len, f[F_MARKER].p,
+                   (int)f[F_FILE].len, f[F_FILE].p);
+            shown++;
+        }
+        if (shown == 0) {
+            log_warning("没有找到匹配的产物");
+            result = 1;
+        }
+    }
+
+    free(found.items);
+    for (int i = 0; i < 5; i++) free(owned[i]);
+    free(target);
+    catalog_close(&cat);
+    return result;
+}
+
+static char* join_path(const char *dir, const char *name) {
+    char *path = NULL;
+    if (asprintf(&path, "%s/%s", dir, name) < 0) return NULL;
+    return path;
+}
+
+// 从一个输出目录的 manifest.json（旧的目录只有 sha256sums）恢复记录
+static size_t rebuild_output(FILE *out, const char *target, const char *date, const char *marker,
+                             const char *dir) {
+    size_t count = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+
+    char *path = join_path(dir, MANIFEST_FILE);
+    FILE *fp = path != NULL ? fopen(path, "r") : NULL;
+    free(path);
+    if (fp != NULL) {
+        while (getline(&line, &line_cap, fp) != -1) {
+            char *file = manifest_string(line, "path");
+            char *hash = file != NULL ? manifest_string(line, "sha256") : NULL;
+            char *commit = hash != NULL ? manifest_string(line, "commit") : NULL;
+            long long size = 0, rule_id = 0;
+            char rule[24] = "-";
+            if (manifest_number(line, "rule", &rule_id)) snprintf(rule, sizeof(rule), "%lld", rule_id);
+            if (hash != NULL && manifest_number(line, "size", &size)) {
+                write_record(out, date, target, rule, marker, file, (unsigned long long)size, hash, commit);
+                count++;
+            }
+            free(file);
+            free(hash);
+            free(commit);
+        }
+        fclose(fp);
+        free(line);
+        return count;
+    }
+
+    path = join_path(dir, SUMS_FILE);
+    fp = path != NULL ? fopen(path, "r") : NULL;
+    free(path);
+    if (fp == NULL) return 0;
+    while (getline(&line, &line_cap, fp) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        char *name = strchr(line, ' ');
+        if (name == NULL) continue;
+        *name++ = '\0';
+        if (*name == '*' || *name == ' ') name++;
+        char *file_path = join_path(dir, name);
+        struct stat st;
+        bool found = file_path != NULL && stat(file_path, &st) == 0;
+        free(file_path);
+        if (!found) continue;
+        write_record(out, date, target, "-", marker, name, (unsigned long long)st.st_size, line, NULL);
+        count++;
+    }
+    fclose(fp);
+    free(line);
+    return count;
+}
+
+static bool is_directory(const char *path) {
+    struct stat st;
+    return lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// 日期目录本身是未标记的输出目录，其中带 manifest.json 的子目录是标记目录
+static size_t rebuild_target(FILE *out, const char *target) {
+    struct dirent **dates;
+    int date_count = scandir(target, &dates, NULL, alphasort);
+    if (date_count < 0) return 0;
+
+    size_t count = 0;
+    for (int i = 0; i < date_count; i++) {
+        const char *date = dates[i]->d_name;
+        char *dir = gc_is_date_name(date) ? join_path(target, date) : NULL;
+        if (dir == NULL || !is_directory(dir)) {
+            free(dir);
+            continue;
+        }
+
+        count += rebuild_output(out, target, date, "", dir);
+        struct dirent **markers;
+        int marker_count = scandir(dir, &markers, NULL, alphasort);
+        for (int j = 0; j < marker_count; j++) {
+            const char *marker = markers[j]->d_name;
+            char *sub = join_path(dir, marker);
+            char *manifest = sub != NULL ? join_path(sub, MANIFEST_FILE) : NULL;
+            if (manifest != NULL && strcmp(marker, ".") != 0 && strcmp(marker, "..") != 0 &&
+                is_directory(sub) && access(manifest, F_OK) == 0) {
+                count += rebuild_output(out, target, date, marker, sub);
+            }
+            free(sub);
+            free(manifest);
+            free(markers[j]);
+        }
+        if (marker_count >= 0) free(markers);
+        free(dir);
+    }
+    for (int i = 0; i < date_count; i++) free(dates[i]);
+    free(dates);
+    return count;
+}
+
+int catalog_rebuild(const char *catalog, const char **targets, size_t target_count) {
+    if (catalog_prepare_dir(catalog) != 0) return -1;
+    int lock = catalog_lock(catalog);
+    if (lock < 0) {
+        log_error("无法锁定产物索引: %s", catalog);
+        return -1;
+    }
+
+    char *tmp = catalog_file(catalog, ".tmp");
+    char *index_path = catalog_file(catalog, ".idx");
+    FILE *out = tmp != NULL ? fopen(tmp, "w") : NULL;
+    int result = out != NULL && index_path != NULL ? 0 : -1;
+    size_t count = 0;
+    char **escaped = calloc(target_count + 1, sizeof(char*));
+    if (escaped == NULL) result = -1;
+
+    if (result == 0) {
+        fputs(CATALOG_HEADER, out);
+        for (size_t i = 0; i < target_count; i++) {
+            char *target = strdup(targets[i]);
+            if (target == NULL) continue;
+            size_t len = strlen(target);
+            while (len > 1 && target[len - 1] == '/') target[--len] = '\0';
+            escaped[i] = escape_dup(target);
+            free(target);
+        }
+
+        // 保留不属于这些目标的记录（其他配置可能共用同一个产物索引）
+        Catalog old;
+        if (catalog_open(catalog, &old) == 0) {
+            for (uint64_t offset = 0; offset < old.log_size; offset = next_line(&old, offset)) {
+                Record rec;
+                if (!record_parse(&old, offset, &rec)) continue;
+                bool rebuilt = false;
+                for (size_t i = 0; i < target_count && !rebuilt; i++) {
+                    rebuilt = escaped[i] != NULL && field_cmp(rec.f[F_TARGET], field_of(escaped[i])) == 0;
+                }
+                if (!rebuilt) {
+                    fwrite(old.log + offset, 1, next_line(&old, offset) - offset, out);
+                    count++;
+                }
+            }
+            catalog_close(&old);
+        }
+
+        for (size_t i = 0; i < target_count; i++) {
+            char *target = strdup(targets[i]);
+            if (target == NULL) continue;
+            size_t len = strlen(target);
+            while (len > 1 && target[len - 1] == '/') target[--len] = '\0';
+            count += rebuild_target(out, target);
+            free(target);
+        }
+    }
+
+    if (out != NULL && fclose(out) != 0) result = -1;
+    // 先删除旧索引再替换日志，查询不会用旧索引的偏移读新日志
+    if (result == 0) {
+        unlink(index_path);
+        if (rename(tmp, catalog) != 0) result = -1;
+    }
+    if (result != 0) {
+        if (tmp != NULL) unlink(tmp);
+        log_error("无法写入产物索引: %s", catalog);
+    } else {
+        result = index_update(catalog);
+    }
+    catalog_unlock(lock);
+
+    if (result == 0) log_info("已重建产物索引: %s (%zu 个文件)", catalog, count);
+    for (size_t i = 0; escaped != NULL && i < target_count; i++) free(escaped[i]);
+    free(escaped);
+    free(tmp);
+    free(index_path);
+    return result;
+}
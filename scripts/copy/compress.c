@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <zlib.h>
+
+#include "copy.h"
+#include "../utils/treecopy.h"
+
+#define GZIP_LEVEL 6
+#define ZSTD_LEVEL "-6"
+
+extern char **environ;
+
+// 已经是压缩格式的文件再压缩几乎没有收益，直接复制
+static const char *compressed_suffixes[] = {
+    ".gz", ".tgz", ".xz", ".txz", ".zst", ".bz2", ".lz4", ".lzma", ".zip", ".7z",
+    ".ipk", ".apk", ".bin", ".squashfs", ".itb", ".fit", NULL
+};
+
+const char* compress_suffix(CopyCompress type) {
+    switch (type) {
+        case COMPRESS_GZIP: return ".gz";
+        case COMPRESS_ZSTD: return ".zst";
+        default: return "";
+    }
+}
+
+int compress_parse(const char *name, CopyCompress *type) {
+    if (strcmp(name, "gz") == 0 || strcmp(name, "gzip") == 0) {
+        *type = COMPRESS_GZIP;
+    } else if (strcmp(name, "zstd") == 0 || strcmp(name, "zst") == 0) {
+        *type = COMPRESS_ZSTD;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+bool compress_skip(const char *path) {
+    size_t len = strlen(path);
+    for (int i = 0; compressed_suffixes[i] != NULL; i++) {
+        size_t suffix_len = strlen(compressed_suffixes[i]);
+        if (len > suffix_len && strcasecmp(path + len - suffix_len, compressed_suffixes[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool compress_available(CopyCompress type) {
+    if (type != COMPRESS_ZSTD) return true;
+
+    const char *path = getenv("PATH");
+    if (path == NULL) return false;
+    char *dirs = strdup(path);
+    bool found = false;
+    char *save = NULL;
+    for (char *dir = dirs ? strtok_r(dirs, ":", &save) : NULL; dir != NULL && !found;
+         dir = strtok_r(NULL, ":", &save)) {
+        char *candidate = NULL;
+        if (asprintf(&candidate, "%s/zstd", dir) >= 0) {
+            found = access(candidate, X_OK) == 0;
+            free(candidate);
+        }
+    }
+    free(dirs);
+    return found;
+}
+
+static ssize_t read_full(int fd, unsigned char *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, buffer + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+static int write_full(int fd, const unsigned char *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, buffer + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+// 压缩结果：输入和输出的摘要、字节数
+typedef struct {
+    Sha256Ctx in_ctx;
+    Sha256Ctx out_ctx;
+    unsigned long long in_bytes;
+    unsigned long long out_bytes;
+    unsigned long long *progress;   // 已读取的源字节数，供进度显示
+} CompressResult;
+
+static void result_add_input(CompressResult *result, const unsigned char *data, size_t len) {
+    sha256_update(&result->in_ctx, data, len);
+    result->in_bytes += len;
+    if (result->progress != NULL) __atomic_add_fetch(result->progress, len, __ATOMIC_RELAXED);
+}
+
+// ---- gzip：每个块压缩成独立的 gzip 成员，拼接后仍是合法的 gzip 文件（与 pigz 相同） ----
+
+typedef struct {
+    unsigned char *in;
+    size_t in_len;
+    unsigned char *out;
+    size_t out_len;
+    size_t out_capacity;
+    bool compressed;
+} GzipBlock;
+
+static int gzip_block(GzipBlock *block) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // windowBits 15 + 16 输出 gzip 头和尾
+    if (deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+
+    size_t bound = deflateBound(&stream, block->in_len) + 32;
+    if (block->out_capacity < bound) {
+        unsigned char *out = realloc(block->out, bound);
+        if (out == NULL) {
+            deflateEnd(&stream);
+            return -1;
+        }
+        block->out = out;
+        block->out_capacity = bound;
+    }
+
+    stream.next_in = block->in;
+    stream.avail_in = (uInt)block->in_len;
+    stream.next_out = block->out;
+    stream.avail_out = (uInt)block->out_capacity;
+    int status = deflate(&stream, Z_FINISH);
+    block->out_len = block->out_capacity - stream.avail_out;
+    deflateEnd(&stream);
+    return status == Z_STREAM_END ? 0 : -1;
+}
+
+// 流水线：当前线程读取，压缩线程并行压缩各块，写入线程按顺序写出
+typedef struct {
+    GzipBlock *slots;
+    size_t slot_count;
+    size_t read_seq;        // 已读入的块数
+    size_t compress_seq;    // 下一个待压缩的块
+    size_t write_seq;       // 下一个待写出的块
+    bool eof;
+    int error;
+    int out_fd;
+    CompressResult *result;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} GzipPipeline;
+
+static void* gzip_compressor(void *arg) {
+    GzipPipeline *pipeline = arg;
+
+    pthread_mutex_lock(&pipeline->lock);
+    for (;;) {
+        while (!pipeline->error && pipeline->compress_seq == pipeline->read_seq && !pipeline->eof) {
+            pthread_cond_wait(&pipeline->cond, &pipeline->lock);
+        }
+        if (pipeline->error || pipeline->compress_seq == pipeline->read_seq) break;
+
+        GzipBlock *block = &pipeline->slots[pipeline->compress_seq % pipeline->slot_count];
+        pipeline->compress_seq++;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        int status = gzip_block(block);
+
+        pthread_mutex_lock(&pipeline->lock);
+        if (status != 0) pipeline->error = -1;
+        block->compressed = true;
+        pthread_cond_broadcast(&pipeline->cond);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+static void* gzip_writer(void *arg) {
+    GzipPipeline *pipeline = arg;
+
+    pthread_mutex_lock(&pipeline->lock);
+    for (;;) {
+        GzipBlock *block = &pipeline->slots[pipeline->write_seq % pipeline->slot_count];
+        while (!pipeline->error && !(pipeline->write_seq < pipeline->read_seq && block->compressed) &&
+               !(pipeline->eof && pipeline->write_seq == pipeline->read_seq)) {
+            pthread_cond_wait(&pipeline->cond, &pipeline->lock);
+        }
+        if (pipeline->error || pipeline->write_seq == pipeline->read_seq) break;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        int status = write_full(pipeline->out_fd, block->out, block->out_len);
+        sha256_update(&pipeline->result->out_ctx, block->out, block->out_len);
+        pipeline->result->out_bytes += block->out_len;
+
+        pthread_mutex_lock(&pipeline->lock);
+        if (status != 0) pipeline->error = -1;
+        block->compressed = false;
+        pipeline->write_seq++;
+        pthread_cond_broadcast(&pipeline->cond);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+static int gzip_stream_serial(int in_fd, int out_fd, CompressResult *result) {
+    GzipBlock block;
+    memset(&block, 0, sizeof(block));
+    block.in = malloc(COMPRESS_BLOCK_SIZE);
+    int status = block.in != NULL ? 0 : -1;
+
+    for (size_t seq = 0; status == 0; seq++) {
+        ssize_t n = read_full(in_fd, block.in, COMPRESS_BLOCK_SIZE);
+        if (n < 0) {
+            status = -1;
+            break;
+        }
+        // 空文件也输出一个空的 gzip 成员
+        if (n == 0 && seq > 0) break;
+
+        block.in_len = (size_t)n;
+        result_add_input(result, block.in, block.in_len);
+        if (gzip_block(&block) != 0 || write_full(out_fd, block.out, block.out_len) != 0) {
+            status = -1;
+            break;
+        }
+        sha256_update(&result->out_ctx, block.out, block.out_len);
+        result->out_bytes += block.out_len;
+        if (n < COMPRESS_BLOCK_SIZE) break;
+    }
+
+    free(block.in);
+    free(block.out);
+    return status;
+}
+
+static int gzip_stream(int in_fd, int out_fd, int threads, CompressResult *result) {
+    if (threads < 2) return gzip_stream_serial(in_fd, out_fd, result);
+
+    GzipPipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.slot_count = (size_t)threads * 2;
+    pipeline.slots = calloc(pipeline.slot_count, sizeof(GzipBlock));
+    pthread_t *compressors = malloc((size_t)threads * sizeof(pthread_t));
+    if (pipeline.slots == NULL || compressors == NULL) {
+        free(pipeline.slots);
+        free(compressors);
+        return gzip_stream_serial(in_fd, out_fd, result);
+    }
+    pipeline.out_fd = out_fd;
+    pipeline.result = result;
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.cond, NULL);
+
+    pthread_t writer;
+    bool writer_started = pthread_create(&writer, NULL, gzip_writer, &pipeline) == 0;
+    int started = 0;
+    for (int i = 0; writer_started && i < threads; i++) {
+        if (pthread_create(&compressors[i], NULL, gzip_compressor, &pipeline) != 0) break;
+        started++;
+    }
+
+    int status;
+    if (started == 0) {
+        // 线程创建失败：还没有读入任何数据，结束已启动的写入线程后单线程压缩
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.eof = true;
+        pthread_cond_broadcast(&pipeline.cond);
+        pthread_mutex_unlock(&pipeline.lock);
+        if (writer_started) pthread_join(writer, NULL);
+        status = gzip_stream_serial(in_fd, out_fd, result);
+    } else {
+        for (;;) {
+            pthread_mutex_lock(&pipeline.lock);
+            // 环形缓冲区中该位置的上一块写出后才能复用
+            while (!pipeline.error && pipeline.read_seq - pipeline.write_seq >= pipeline.slot_count) {
+                pthread_cond_wait(&pipeline.cond, &pipeline.lock);
+            }
+            bool failed = pipeline.error != 0;
+            pthread_mutex_unlock(&pipeline.lock);
+            if (failed) break;
+
+            GzipBlock *block = &pipeline.slots[pipeline.read_seq % pipeline.slot_count];
+            if (block->in == NULL) block->in = malloc(COMPRESS_BLOCK_SIZE);
+            ssize_t n = block->in != NULL ? read_full(in_fd, block->in, COMPRESS_BLOCK_SIZE) : -1;
+            bool last = n < COMPRESS_BLOCK_SIZE;
+            if (n >= 0 && !(n == 0 && pipeline.read_seq > 0)) {
+                block->in_len = (size_t)n;
+                result_add_input(result, block->in, block->in_len);
+            }
+
+            pthread_mutex_lock(&pipeline.lock);
+            if (n < 0) {
+                pipeline.error = -1;
+            } else if (!(n == 0 && pipeline.read_seq > 0)) {
+                pipeline.read_seq++;
+            }
+            if (last) pipeline.eof = true;
+            pthread_cond_broadcast(&pipeline.cond);
+            pthread_mutex_unlock(&pipeline.lock);
+            if (last) break;
+        }
+
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.eof = true;
+        pthread_cond_broadcast(&pipeline.cond);
+        pthread_mutex_unlock(&pipeline.lock);
+        for (int i = 0; i < started; i++) pthread_join(compressors[i], NULL);
+        pthread_join(writer, NULL);
+        status = pipeline.error;
+    }
+
+    for (size_t i = 0; i < pipeline.slot_count; i++) {
+        free(pipeline.slots[i].in);
+        free(pipeline.slots[i].out);
+    }
+    free(pipeline.slots);
+    free(compressors);
+    pthread_mutex_destroy(&pipeline.lock);
+    pthread_cond_destroy(&pipeline.cond);
+    return status;
+}
+
+// ---- zstd：没有链接 libzstd，通过管道交给 zstd -T<线程数>，它自己按块并行压缩 ----
+
+typedef struct {
+    int from_fd;
+    int out_fd;
+    CompressResult *result;
+    int status;
+} ZstdDrain;
+
+// 读取 zstd 的输出写入目标文件，同时计算输出摘要
+static void* zstd_drain(void *arg) {
+    ZstdDrain *drain = arg;
+    unsigned char *buffer = malloc(COMPRESS_BLOCK_SIZE);
+    drain->status = buffer != NULL ? 0 : -1;
+
+    while (buffer != NULL) {
+        ssize_t n = read(drain->from_fd, buffer, COMPRESS_BLOCK_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n < 0) drain->status = -1;
+            break;
+        }
+        if (drain->status == 0 && write_full(drain->out_fd, buffer, (size_t)n) != 0) {
+            drain->status = -1;
+        }
+        sha256_update(&drain->result->out_ctx, buffer, (size_t)n);
+        drain->result->out_bytes += (unsigned long long)n;
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+static int zstd_stream(int in_fd, int out_fd, int threads, CompressResult *result) {
+    int to_child[2], from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) != 0) return -1;
+    if (pipe2(from_child, O_CLOEXEC) != 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return -1;
+    }
+    char thread_arg[32];
+    snprintf(thread_arg, sizeof(thread_arg), "-T%d", threads > 0 ? threads : 1);
+    char *argv[] = { "zstd", "-q", "-c", ZSTD_LEVEL, thread_arg, NULL };
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, to_child[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, from_child[1], STDOUT_FILENO);
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, "zstd", &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(to_child[0]);
+    close(from_child[1]);
+    if (spawned != 0) {
+        close(to_child[1]);
+        close(from_child[0]);
+        errno = spawned;
+        return -1;
+    }
+
+    ZstdDrain drain = { .from_fd = from_child[0], .out_fd = out_fd, .result = result, .status = 0 };
+    pthread_t drain_thread;
+    bool drain_started = pthread_create(&drain_thread, NULL, zstd_drain, &drain) == 0;
+
+    int status = drain_started ? 0 : -1;
+    unsigned char *buffer = status == 0 ? malloc(COMPRESS_BLOCK_SIZE) : NULL;
+    if (buffer == NULL) status = -1;
+    while (status == 0) {
+        ssize_t n = read_full(in_fd, buffer, COMPRESS_BLOCK_SIZE);
+        if (n < 0 || (n > 0 && write_full(to_child[1], buffer, (size_t)n) != 0)) {
+            status = -1;
+            break;
+        }
+        result_add_input(result, buffer, (size_t)n);
+        if (n < COMPRESS_BLOCK_SIZE) break;
+    }
+    free(buffer);
+    close(to_child[1]);
+
+    if (drain_started) {
+        pthread_join(drain_thread, NULL);
+        if (drain.status != 0) status = -1;
+    }
+    close(from_child[0]);
+
+    int wait_status = 0;
+    pid_t waited;
+    while ((waited = waitpid(pid, &wait_status, 0)) < 0 && errno == EINTR) {}
+    if (waited < 0) {
+        status = -1;
+    } else if (!WIFEXITED(wait_status) || WEXITSTATUS(wait_status) != 0) {
+        status = -1;
+    }
+    return status;
+}
+
+int compress_file(const CopyJob *job, int threads, char in_hex[SHA256_HEX_SIZE],
+                  char out_hex[SHA256_HEX_SIZE], unsigned long long *in_bytes,
+                  unsigned long long *out_bytes, unsigned long long *progress) {
+    char *tmp_path = NULL;
+    int in = open(job->src, O_RDONLY);
+    int out = in >= 0 ? open_temp_file(job->dst, &tmp_path) : -1;
+    if (out < 0) {
+        if (in >= 0) close(in);
+        free(tmp_path);
+        return -1;
+    }
+
+    CompressResult result;
+    memset(&result, 0, sizeof(result));
+    sha256_init(&result.in_ctx);
+    sha256_init(&result.out_ctx);
+    result.progress = progress;
+
+    int status = job->compress == COMPRESS_ZSTD ?
+        zstd_stream(in, out, threads, &result) : gzip_stream(in, out, threads, &result);
+
+    if (status == 0) {
+        struct timespec times[2] = { job->st.st_atim, job->st.st_mtim };
+        if (fchmod(out, job->st.st_mode & 07777) != 0 || futimens(out, times) != 0) status = -1;
+    }
+    if (close(out) != 0) status = -1;
+    close(in);
+
+    if (status == 0 && rename(tmp_path, job->dst) != 0) status = -1;
+    if (status != 0) {
+        int error = errno;
+        unlink(tmp_path);
+        errno = error;
+    }
+    free(tmp_path);
+
+    if (status == 0) {
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        sha256_final(&result.in_ctx, digest);
+        sha256_to_hex(digest, in_hex);
+        sha256_final(&result.out_ctx, digest);
+        sha256_to_hex(digest, out_hex);
+        *in_bytes += result.in_bytes;
+        *out_bytes += result.out_bytes;
+    }
+    return status;
+}
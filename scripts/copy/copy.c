@@ -1,199 +1,67 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <time.h>
-#include <glob.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <ctype.h>
 #include <getopt.h>
-#include "../utils/utils.h"
+#include <signal.h>
+#include "copy.h"
 
-#define MAX_LINE_LENGTH 1024
 #define MAX_PATH_LENGTH 4096
-#define MAX_VARIABLES 100
 #define MAX_RULES 1000
-
-// 日志级别
-typedef enum {
-    LOG_ERROR,
-    LOG_WARNING,
-    LOG_INFO,
-    LOG_SUCCESS
-} LogLevel;
-
-// 变量结构
-typedef struct {
-    char name[50];
-    char value[MAX_PATH_LENGTH];
-} Variable;
-
-// 复制规则结构
-typedef struct {
-    int id;
-    char source[MAX_PATH_LENGTH];
-    char target[MAX_PATH_LENGTH];
-} CopyRule;
+// 进度刷新间隔：终端上原地刷新，非终端时每次输出一行日志，间隔更长
+#define PROGRESS_TTY_INTERVAL_MS 200
+#define PROGRESS_LOG_INTERVAL_MS 10000
 
 // 全局变量
-Variable variables[MAX_VARIABLES];
-int var_count = 0;
+VarEnv *variables = NULL;
 CopyRule rules[MAX_RULES];
 int rule_count = 0;
-int total_files = 0;
-int copied_files = 0;
+bool progress_tty = false;
+int copy_jobs = 0;          // 复制线程数，0 表示根据目标存储自动决定
+CopyPlan copy_plan;         // 所有规则匹配到的文件，统一交给线程池复制
+DirTreeCache source_cache;  // 含 ** 的规则共享的目录遍历结果
+int walk_jobs = 1;          // 遍历源目录的线程数
+bool quiet_config = false;  // 查询时不打印配置解析日志，输出只有查询结果
 
-// 日志函数
-void log_message(LogLevel level, const char* message, const char* module) {
-    const char* level_str[] = {"ERROR", "WARNING", "INFO", "SUCCESS"};
-    time_t now = time(NULL);
-    char timestr[20];
-    strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    
-    printf("[%s] [%s] [%s] %s\n", timestr, level_str[level], module, message);
-}
-
-// 检查是否是目录
-int is_directory(const char* path) {
-    struct stat st;
-    if (stat(path, &st) != 0) return 0;
-    return S_ISDIR(st.st_mode);
-}
-
-// 创建目录（包括父目录）
-int create_directory(const char* path) {
-    char tmp[MAX_PATH_LENGTH];
-    char *p = NULL;
-    size_t len;
-    
-    snprintf(tmp, sizeof(tmp), "%s", path);
-    len = strlen(tmp);
-    
-    if (tmp[len - 1] == '/') {
-        tmp[len - 1] = 0;
-    }
-    
-    for (p = tmp + 1; *p; p++) {
-        if (*p == '/') {
-            *p = 0;
-            if (mkdir(tmp, 0755) != 0 && errno != EEXIST) {
-                return -1;
-            }
-            *p = '/';
-        }
-    }
-    
-    if (mkdir(tmp, 0755) != 0 && errno != EEXIST) {
-        return -1;
+// 变量替换函数，返回新分配的字符串
+char* replace_variables(const char* str) {
+    char* result = varenv_expand(variables, str);
+    if (result == NULL) {
+        log_error("变量替换失败: 内存不足");
+        exit(1);
     }
-    
-    return 0;
+    return result;
 }
 
-// 递归删除目录
-int remove_directory(const char* path) {
-    char command[MAX_PATH_LENGTH + 10];
-    snprintf(command, sizeof(command), "rm -rf \"%s\"", path);
-    
-    // log_message(LOG_INFO, command, "删除目录");
-    log_info(command);
-    
-    int result = system(command);
-    if (result != 0) {
-        // log_message(LOG_ERROR, "删除目录失败", "删除操作");
-        log_error("删除目录失败");
-        return -1;
-    }
-    
-    return 0;
-}
-
-// 执行系统命令并返回结果
-int execute_command(const char* command) {
-    return system(command);
-}
-
-// 使用系统命令复制文件或目录（先删除目标，再复制）
-int copy_with_system_command(const char* src, const char* dst) {
-    char copy_command[MAX_PATH_LENGTH * 2 + 50];
-    
-    // 确保目标目录的父目录存在
-    char* last_slash = strrchr(dst, '/');
-    if (last_slash) {
-        *last_slash = 0;
-        if (create_directory(dst) != 0) {
-            // log_message(LOG_ERROR, "创建目标目录失败", "复制操作");
-            log_error("创建目标目录失败");
-            return -1;
-        }
-        *last_slash = '/';
-    }
-    
-    // 如果目标存在，先删除
-    if (file_exists(dst)) {
-        // log_message(LOG_WARNING, "目标已存在，正在删除...", "复制操作");
-        log_warning("目标已存在，正在删除...");
-        if (remove_directory(dst) != 0) {
-            log_error("删除已存在目标失败");
-            return -1;
-        }
-    }
-    
-    // 构建复制命令
-    if (is_directory(src)) {
-        // 复制目录
-        snprintf(copy_command, sizeof(copy_command), "cp -r \"%s\" \"%s\"", src, dst);
-    } else {
-        // 复制文件
-        snprintf(copy_command, sizeof(copy_command), "cp \"%s\" \"%s\"", src, dst);
-    }
-    
-    // log_message(LOG_INFO, copy_command, "执行复制命令");
-    log_info(copy_command);
-    
-    // 执行复制命令
-    int result = execute_command(copy_command);
-    if (result != 0) {
-        log_error("复制命令执行失败");
-        return -1;
-    }
-    
-    return 0;
-}
-
-// 变量替换函数
-void replace_variables(char* str) {
-    for (int i = 0; i < var_count; i++) {
-        char pattern[60];
-        snprintf(pattern, sizeof(pattern), "${%s}", variables[i].name);
+// 解析规则的标志列，例如 "gz" 或 "zstd"
+static void parse_rule_flags(CopyRule* rule, char* flags) {
+    char* save = NULL;
+    for (char* flag = strtok_r(flags, ",", &save); flag != NULL; flag = strtok_r(NULL, ",", &save)) {
+        flag = trim_whitespace(flag);
+        if (flag[0] == '\0') continue;
         
-        char* pos = strstr(str, pattern);
-        while (pos != NULL) {
-            // 计算新字符串长度
-            size_t new_len = strlen(str) - strlen(pattern) + strlen(variables[i].value) + 1;
-            if (new_len > MAX_PATH_LENGTH) {
-                log_error("变量替换后字符串过长");
-                return;
+        CopyCompress compress;
+        if (compress_parse(flag, &compress) == 0) {
+            if (!compress_available(compress)) {
+                log_warning("规则 %d: 找不到 zstd 命令，改用 gzip 压缩", rule->id);
+                compress = COMPRESS_GZIP;
             }
-            
-            // 创建新字符串
-            char new_str[MAX_PATH_LENGTH];
-            size_t prefix_len = pos - str;
-            
-            strncpy(new_str, str, prefix_len);
-            new_str[prefix_len] = 0;
-            
-            strcat(new_str, variables[i].value);
-            strcat(new_str, pos + strlen(pattern));
-            
-            // 复制回原字符串
-            strncpy(str, new_str, MAX_PATH_LENGTH);
-            
-            // 查找下一个匹配
-            pos = strstr(str, pattern);
+            rule->compress = compress;
+        } else if (strcmp(flag, "delta") == 0) {
+            rule->delta = true;
+        } else if (strcmp(flag, "sync") == 0) {
+            rule->sync = true;
+        } else if (strcmp(flag, "feed") == 0) {
+            rule->feed = true;
+        } else {
+            log_warning("规则 %d: 未知标志 %s", rule->id, flag);
         }
     }
 }
@@ -202,15 +70,20 @@ void replace_variables(char* str) {
 int parse_config_file(const char* config_path) {
     FILE* fp = fopen(config_path, "r");
     if (!fp) {
-        // log_message(LOG_ERROR, "无法打开配置文件", "配置解析");
         log_error("无法打开配置文件");
-        
         return -1;
     }
     
-    char line[MAX_LINE_LENGTH];
+    variables = varenv_new();
+    if (variables == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    
+    char *line = NULL;
+    size_t line_cap = 0;
     
-    while (fgets(line, sizeof(line), fp)) {
+    while (getline(&line, &line_cap, fp) != -1) {
         // 移除换行符
         line[strcspn(line, "\n")] = 0;
         
@@ -234,23 +107,19 @@ int parse_config_file(const char* config_path) {
             char* value = trim_whitespace(value_start);
             
             // 去除值周围的引号
-            if (value[0] == '"' && value[strlen(value)-1] == '"') {
+            if (strlen(value) >= 2 && value[0] == '"' && value[strlen(value)-1] == '"') {
                 value[strlen(value)-1] = 0;
                 value++;
             }
             
             // 保存变量
-            if (var_count < MAX_VARIABLES) {
-                strncpy(variables[var_count].name, name, sizeof(variables[var_count].name));
-                strncpy(variables[var_count].value, value, sizeof(variables[var_count].value));
-                var_count++;
-                
-                // log_message(LOG_INFO, name, "变量定义");
-                log_info("变量定义: %s", name);
-                // log_message(LOG_INFO, value, "变量值");
-                log_info("变量值: %s", value);
+            if (varenv_set(variables, name, value) == 0) {
+                if (!quiet_config) {
+                    log_info("变量定义: %s", name);
+                    log_info("变量值: %s", value);
+                }
             } else {
-                log_warning("变量数量超过最大值");
+                log_warning("保存变量失败: %s", name);
             }
             
             continue;
@@ -265,6 +134,10 @@ int parse_config_file(const char* config_path) {
                 *first_semicolon = 0;
                 *second_semicolon = 0;
                 
+                // 可选的第四列：逗号分隔的标志
+                char* flags = strchr(second_semicolon + 1, ';');
+                if (flags != NULL) *flags++ = 0;
+                
                 int id = atoi(trim_whitespace(line));
                 char* source = trim_whitespace(first_semicolon + 1);
                 char* target = trim_whitespace(second_semicolon + 1);
@@ -272,14 +145,19 @@ int parse_config_file(const char* config_path) {
                 // 保存规则
                 if (rule_count < MAX_RULES) {
                     rules[rule_count].id = id;
-                    strncpy(rules[rule_count].source, source, sizeof(rules[rule_count].source));
-                    strncpy(rules[rule_count].target, target, sizeof(rules[rule_count].target));
+                    rules[rule_count].source = strdup(source);
+                    rules[rule_count].target = strdup(target);
+                    rules[rule_count].compress = COMPRESS_NONE;
+                    rules[rule_count].delta = false;
+                    rules[rule_count].sync = false;
+                    rules[rule_count].feed = false;
+                    if (flags != NULL) parse_rule_flags(&rules[rule_count], flags);
                     rule_count++;
                     
-                    // log_message(LOG_INFO, source, "源路径");
-                    log_info("源路径: %s", source);
-                    // log_message(LOG_INFO, target, "目标路径");
-                    log_info("目标路径: %s", target);
+                    if (!quiet_config) {
+                        log_info("源路径: %s", source);
+                        log_info("目标路径: %s", target);
+                    }
                 } else {
                     log_warning("规则数量超过最大值");
                 }
@@ -287,101 +165,125 @@ int parse_config_file(const char* config_path) {
         }
     }
     
+    free(line);
     fclose(fp);
     
+    // 所有变量定义只展开一次，之后每条规则单遍替换
+    if (varenv_resolve(variables) > 0) {
+        log_warning("配置文件中存在循环引用的变量，相关引用将保留原样");
+    }
+    
     // 对所有规则进行变量替换
     for (int i = 0; i < rule_count; i++) {
-        replace_variables(rules[i].source);
-        replace_variables(rules[i].target);
+        char* source = replace_variables(rules[i].source);
+        char* target = replace_variables(rules[i].target);
+        free(rules[i].source);
+        free(rules[i].target);
+        rules[i].source = source;
+        rules[i].target = target;
         
-        // log_message(LOG_INFO, rules[i].source, "替换后源路径");
+        // 去掉目标结尾的 /，复制、产物目录和查询使用同一个目标路径
+        size_t target_len = strlen(target);
+        while (target_len > 1 && target[target_len - 1] == '/') target[--target_len] = '\0';
+        
+        if (quiet_config) continue;
         log_info("替换后源路径: %s", rules[i].source);
-        // log_message(LOG_INFO, rules[i].target, "替换后目标路径");
         log_info("替换后目标路径: %s", rules[i].target);
     }
     
     return 0;
 }
 
-// 更新进度显示
-void update_progress(int current, int total, const char* message) {
-    int width = 50;
-    float percentage = (float)current / total;
-    int pos = width * percentage;
-    
-    printf("\r%s [", message);
-    for (int i = 0; i < width; i++) {
-        if (i < pos) printf("=");
-        else if (i == pos) printf(">");
-        else printf(" ");
-    }
-    printf("] %d/%d", current, total);
-    fflush(stdout);
-    
-    if (current == total) printf("\n");
+// copy.conf 中的 CATALOG，未配置时返回 NULL
+static const char* catalog_path(void) {
+    const char* catalog = varenv_get(variables, "CATALOG");
+    return catalog != NULL && catalog[0] != '\0' ? catalog : NULL;
+}
+
+// 所有规则的目标目录，多条规则可能复制到同一个目标目录
+static size_t collect_targets(const char** targets) {
+    size_t target_count = 0;
+    for (int i = 0; i < rule_count; i++) {
+        bool seen = false;
+        for (size_t j = 0; j < target_count && !seen; j++) {
+            seen = strcmp(targets[j], rules[i].target) == 0;
+        }
+        if (!seen) targets[target_count++] = rules[i].target;
+    }
+    return target_count;
+}
+
+// 更新进度显示：终端上原地刷新进度条，输出重定向（如 CI 日志）时定期打印一行日志
+void update_progress(const CopyProgress* progress, bool final) {
+    double seconds = progress->elapsed_ns / 1e9;
+    double done_mb = progress->bytes_done / 1048576.0;
+    double total_mb = progress->total_bytes / 1048576.0;
+    double rate = seconds > 0 ? done_mb / seconds : 0;
+    double fraction = progress->total_bytes > 0 ? (double)progress->bytes_done / progress->total_bytes :
+                      progress->total_files > 0 ? (double)progress->files_done / progress->total_files : 1;
+    if (fraction > 1) fraction = 1;
+    long eta = rate > 0 ? (long)((total_mb - done_mb) / rate + 0.5) : 0;
+    if (final || eta < 0) eta = 0;
+    
+    if (progress_tty) {
+        int width = 30;
+        int pos = (int)(width * fraction);
+        printf("\r复制%s [", final ? "完成" : "中");
+        for (int i = 0; i < width; i++) {
+            if (i < pos) printf("=");
+            else if (i == pos) printf(">");
+            else printf(" ");
+        }
+        printf("] %3d%% %zu/%zu 个文件 %.1f/%.1f MB %.1f MB/s 剩余 %02ld:%02ld ",
+               (int)(fraction * 100), progress->files_done, progress->total_files,
+               done_mb, total_mb, rate, eta / 60, eta % 60);
+        if (final) printf("\n");
+        fflush(stdout);
+    } else if (!final) {
+        log_info("复制进度: %d%% (%zu/%zu 个文件, %.1f/%.1f MB, %.1f MB/s, 剩余 %ld 秒)",
+                 (int)(fraction * 100), progress->files_done, progress->total_files,
+                 done_mb, total_mb, rate, eta);
+    }
 }
 
 // 执行复制操作
 int execute_copy_rule(const CopyRule* rule, const char* marker, const char* date) {
     int files_copied = 0;
     
-    // 使用glob扩展源路径
-    glob_t glob_result;
-    if (glob(rule->source, GLOB_TILDE, NULL, &glob_result) == 0) {
-        for (size_t i = 0; i < glob_result.gl_pathc; i++) {
-            const char* source_path = glob_result.gl_pathv[i];
-            
-            // 确定目标路径
-            char target_path[MAX_PATH_LENGTH];
-            
-            // 添加日期目录
-            char dated_target[MAX_PATH_LENGTH];
-            snprintf(dated_target, sizeof(dated_target), "%s/%s", rule->target, date);
-            
-            // 如果指定了标记，添加到目标路径
-            if (marker && marker[0] != '\0') {
-                snprintf(target_path, sizeof(target_path), "%s/%s", dated_target, marker);
-            } else {
-                // 修复：不要添加额外的斜杠
-                strncpy(target_path, dated_target, sizeof(target_path));
-            }
+    // 展开源路径模式（含 ** 的模式共享同一次目录遍历）
+    SourceList sources = {0};
+    if (source_expand(rule->source, &source_cache, walk_jobs, &sources) == 0) {
+        // 输出目录 <目标>/<日期>[/<标记>]，用于生成校验清单
+        char* output_dir = copy_output_dir(rule, date, marker);
+        int output = output_dir != NULL ? copy_plan_output(&copy_plan, output_dir, rule->target) : -1;
+        copy_plan.excludes = sources.excludes;
+        copy_plan.exclude_count = sources.exclude_count;
+        for (size_t i = 0; output >= 0 && i < sources.count; i++) {
+            const char* source_path = sources.items[i].path;
             
             // 确定最终的目标路径
             char final_target_path[MAX_PATH_LENGTH];
-            const char* filename = strrchr(source_path, '/');
-            if (filename) filename++;
-            else filename = source_path;
+            const char* filename = sources.items[i].name;
+            snprintf(final_target_path, sizeof(final_target_path), "%s/%s", output_dir, filename);
             
-            // 检查目标路径是否以斜杠结尾
-            size_t target_len = strlen(target_path);
-            if (target_len > 0 && target_path[target_len - 1] == '/') {
-                snprintf(final_target_path, sizeof(final_target_path), "%s%s", target_path, filename);
-            } else {
-                snprintf(final_target_path, sizeof(final_target_path), "%s/%s", target_path, filename);
-            }
-            
-            // 使用系统命令复制
-            if (copy_with_system_command(source_path, final_target_path) == 0) {
-                char success_msg[MAX_PATH_LENGTH + 50];
-                snprintf(success_msg, sizeof(success_msg), "复制成功: %s -> %s", 
-                        source_path, final_target_path);
-                log_success(success_msg);
+            // 加入复制计划，文件内容稍后由线程池统一复制
+            size_t planned = copy_plan.job_count;
+            if (copy_plan_add(&copy_plan, source_path, final_target_path, rule, output) == 0) {
+                log_info("复制: %s -> %s (%zu 个文件)", source_path, final_target_path,
+                         copy_plan.job_count - planned);
                 files_copied++;
             } else {
-                char error_msg[MAX_PATH_LENGTH + 50];
-                snprintf(error_msg, sizeof(error_msg), "复制失败: %s -> %s", 
-                        source_path, final_target_path);
-                log_error(error_msg);
+                log_error("复制失败: %s -> %s", source_path, final_target_path);
             }
-            
-            total_files++;
         }
-        globfree(&glob_result);
+        copy_plan.excludes = NULL;
+        copy_plan.exclude_count = 0;
+        free(output_dir);
     } else {
-        // log_error("无法扩展源路径");
+        log_error("展开源路径失败: %s", rule->source);
     }
+    source_list_free(&sources);
     
-    copied_files += files_copied;
     return files_copied;
 }
 
@@ -418,7 +320,8 @@ int parse_rule_ids(const char* rule_str, int* rule_ids, int max_ids) {
 }
 
 // 主复制函数
-int copy_build_artifacts(const char* config_path, const char* rule_str, const char* marker, const char* date) {
+int copy_build_artifacts(const char* config_path, const char* rule_str, const char* marker, const char* date,
+                         const char* watch_file) {
     log_info("开始复制构建产物");
     
     if (date && date[0] != '\0') {
@@ -433,7 +336,8 @@ int copy_build_artifacts(const char* config_path, const char* rule_str, const ch
         log_info(marker_msg);
     }
     
-    time_t start_time = time(NULL);
+    uint64_t start_time = copy_now_ns();
+    copy_plan_init(&copy_plan);
     
     if (!file_exists(config_path)) {
         log_error("复制配置文件不存在");
@@ -451,6 +355,14 @@ int copy_build_artifacts(const char* config_path, const char* rule_str, const ch
         return 1;
     }
     
+    // 配置了 STORE 时文件内容写入内容寻址存储，目标位置只创建链接
+    const char* store = varenv_get(variables, "STORE");
+    if (store != NULL && store[0] != '\0') {
+        if (store_init(store) != 0) return 1;
+        copy_plan.store = store;
+        log_info("使用内容存储: %s", store);
+    }
+    
     // 解析规则ID
     int rule_ids[100];
     int rule_id_count = 0;
@@ -477,28 +389,24 @@ int copy_build_artifacts(const char* config_path, const char* rule_str, const ch
         }
     }
     
-    // 执行复制操作
+    // 源目录遍历主要等待元数据读取，线程数按 CPU 数决定
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    walk_jobs = copy_jobs > 0 ? copy_jobs : (cpus > 0 ? (int)cpus : 1);
+    
+    // 选出要执行的规则
+    const CopyRule* selected[MAX_RULES];
+    size_t selected_count = 0;
     if (execute_all) {
-        // 执行所有规则
         for (int i = 0; i < rule_count; i++) {
-            char rule_msg[50];
-            snprintf(rule_msg, sizeof(rule_msg), "执行规则 %d", rules[i].id);
-            log_info(rule_msg);
-            
-            execute_copy_rule(&rules[i], marker, date);
+            selected[selected_count++] = &rules[i];
         }
     } else {
-        // 执行指定规则
         for (int i = 0; i < rule_id_count; i++) {
             int rule_found = 0;
             
             for (int j = 0; j < rule_count; j++) {
                 if (rules[j].id == rule_ids[i]) {
-                    char rule_msg[50];
-                    snprintf(rule_msg, sizeof(rule_msg), "执行规则 %d", rules[j].id);
-                    log_info(rule_msg);
-                    
-                    execute_copy_rule(&rules[j], marker, date);
+                    selected[selected_count++] = &rules[j];
                     rule_found = 1;
                     break;
                 }
@@ -512,26 +420,189 @@ int copy_build_artifacts(const char* config_path, const char* rule_str, const ch
         }
     }
     
-    time_t end_time = time(NULL);
-    int duration = (int)(end_time - start_time);
+    const char* targets[MAX_RULES];
+    for (size_t i = 0; i < selected_count; i++) {
+        targets[i] = selected[i]->target;
+    }
+    int jobs = copy_jobs > 0 ? copy_jobs : default_copy_jobs(targets, selected_count);
+    CopyTotals totals;
+    bool failed = false;
+    
+    if (watch_file != NULL) {
+        // 边构建边复制：文件写完即复制，构建完成标记出现后补齐剩余文件
+        log_info("监视模式，使用 %d 个复制线程", jobs);
+        CopyWatch watch = {
+            .rules = selected, .rule_count = selected_count, .marker = marker, .date = date,
+            .done_file = watch_file, .jobs = jobs, .walk_jobs = walk_jobs
+        };
+        // 中断时所有任务已标记为取代，下面的差分、清单和产物索引都会跳过
+        if (copy_watch(&copy_plan, &watch, &totals) != 0) failed = true;
+    } else {
+        // 执行复制操作
+        for (size_t i = 0; i < selected_count; i++) {
+            char rule_msg[50];
+            snprintf(rule_msg, sizeof(rule_msg), "执行规则 %d", selected[i]->id);
+            log_info(rule_msg);
+            
+            execute_copy_rule(selected[i], marker, date);
+        }
+        
+        dir_tree_cache_free(&source_cache);
+        
+        // 用线程池复制所有文件
+        log_info("复制 %zu 个文件 (%.1f MB)，使用 %d 个线程",
+                 copy_plan.job_count, copy_plan.total_bytes / 1048576.0, jobs);
+        manifest_load_expected(&copy_plan);
+        sync_prepare(&copy_plan, 0, date);
+        progress_tty = isatty(STDOUT_FILENO);
+        copy_plan.progress = update_progress;
+        copy_plan.progress_interval_ms = progress_tty ? PROGRESS_TTY_INTERVAL_MS : PROGRESS_LOG_INTERVAL_MS;
+        copy_plan_run(&copy_plan, jobs, &totals);
+    }
     
-    // 最终进度更新
-    update_progress(total_files, total_files, "复制完成");
+    int total_files = (int)(totals.files_copied + totals.files_failed);
+    int copied_files = (int)totals.files_copied;
+    if (totals.files_failed > 0 || copy_plan.errors > 0) failed = true;
+    if (delta_generate(&copy_plan, date, jobs) != 0) failed = true;
+    if (feed_generate(&copy_plan, date, jobs) != 0) failed = true;
+    catalog_resolve_commits(&copy_plan);
+    if (manifest_write(&copy_plan, marker) != 0) failed = true;
+    const char* catalog = catalog_path();
+    if (catalog != NULL && catalog_append(catalog, &copy_plan, date, marker) != 0) failed = true;
+    copy_plan_free(&copy_plan);
+    
+    double duration = (double)(copy_now_ns() - start_time) / 1e9;
+    double copy_seconds = (double)totals.elapsed_ns / 1e9;
+    double throughput = copy_seconds > 0 ? totals.bytes_copied / 1048576.0 / copy_seconds : 0;
     
     if (copied_files > 0) {
-        char success_msg[100];
-        snprintf(success_msg, sizeof(success_msg), 
-                "构建产物复制完成 (总计: %d/%d, 耗时: %d秒)", 
-                copied_files, total_files, duration);
-        log_info(success_msg);
+        log_info("构建产物复制完成 (总计: %d/%d 个文件, %.1f MB, 耗时: %.2f秒, 吞吐量: %.1f MB/s)",
+                 copied_files, total_files, totals.bytes_copied / 1048576.0, duration, throughput);
     } else {
-        char warning_msg[100];
-        snprintf(warning_msg, sizeof(warning_msg), 
-                "没有复制任何文件 (耗时: %d秒)", duration);
-        log_warning(warning_msg);
+        log_warning("没有复制任何文件 (耗时: %.2f秒)", duration);
+    }
+    if (totals.files_compressed > 0) {
+        double ratio = totals.compress_in > 0 ? (double)totals.compress_out / (double)totals.compress_in : 0;
+        double rate = copy_seconds > 0 ? totals.compress_in / 1048576.0 / copy_seconds : 0;
+        log_info("压缩: %zu 个文件, %.1f MB -> %.1f MB (压缩比 %.1f%%), 吞吐量: %.1f MB/s",
+                 totals.files_compressed, totals.compress_in / 1048576.0,
+                 totals.compress_out / 1048576.0, ratio * 100, rate);
+    }
+    if (totals.files_synced > 0) {
+        unsigned long long synced = totals.sync_written + totals.sync_reused;
+        log_info("增量同步: %zu 个文件, 共 %.1f MB, 实际写入 %.1f MB, 复用 %.1f MB (%.1f%%)",
+                 totals.files_synced, synced / 1048576.0, totals.sync_written / 1048576.0,
+                 totals.sync_reused / 1048576.0, synced > 0 ? 100.0 * totals.sync_reused / synced : 0);
+    }
+    if (totals.files_verified > 0) {
+        log_info("%zu 个文件与 sha256sums 核对一致", totals.files_verified);
+    }
+    
+    if (store != NULL && store[0] != '\0' && copied_files > 0) {
+        const StoreStats* stats = &totals.store;
+        double ratio = totals.bytes_copied > 0 ?
+            (double)stats->bytes_deduped / (double)totals.bytes_copied : 0;
+        log_info("去重: 逻辑 %.1f MB, 新写入 %.1f MB, 节省 %.1f MB, 去重率 %.1f%% "
+                 "(新对象 %zu, 复用 %zu; 硬链接 %zu, reflink %zu, 复制 %zu)",
+                 totals.bytes_copied / 1048576.0, stats->bytes_stored / 1048576.0,
+                 stats->bytes_deduped / 1048576.0, ratio * 100,
+                 stats->files_stored, stats->files_deduped,
+                 stats->files_hardlinked, stats->files_reflinked, stats->files_copied);
     }
     
-    return copied_files > 0 ? 0 : 1;
+    return copied_files > 0 && !failed ? 0 : 1;
+}
+
+// 按 copy.conf 中的保留策略清理旧的日期目录
+int gc_build_artifacts(const char* config_path, bool dry_run) {
+    if (!file_exists(config_path)) {
+        log_error("复制配置文件不存在");
+        return 1;
+    }
+    if (parse_config_file(config_path) != 0) {
+        log_error("解析配置文件失败");
+        return 1;
+    }
+    
+    GcPolicy policy = { .keep_dates = 0, .keep_marked = true, .max_size = 0 };
+    const char* value = varenv_get(variables, "KEEP_DATES");
+    if (value != NULL && value[0] != '\0') {
+        policy.keep_dates = atoi(value);
+        if (policy.keep_dates < 1) {
+            log_error("无效的 KEEP_DATES: %s", value);
+            return 1;
+        }
+    }
+    value = varenv_get(variables, "KEEP_MARKED");
+    if (value != NULL && (strcmp(value, "0") == 0 || strcasecmp(value, "no") == 0 ||
+                          strcasecmp(value, "false") == 0)) {
+        policy.keep_marked = false;
+    }
+    value = varenv_get(variables, "MAX_SIZE");
+    if (value != NULL && value[0] != '\0' && gc_parse_size(value, &policy.max_size) != 0) {
+        log_error("无效的 MAX_SIZE: %s", value);
+        return 1;
+    }
+    if (policy.keep_dates == 0 && policy.max_size == 0) {
+        log_warning("copy.conf 中没有配置 KEEP_DATES 或 MAX_SIZE，不清理任何目录");
+        return 0;
+    }
+    
+    const char* targets[MAX_RULES];
+    size_t target_count = collect_targets(targets);
+    
+    const char* store = varenv_get(variables, "STORE");
+    if (store != NULL && store[0] == '\0') store = NULL;
+    int jobs = copy_jobs > 0 ? copy_jobs : default_copy_jobs(targets, target_count);
+    int result = copy_gc(targets, target_count, store, &policy, jobs, dry_run);
+    
+    // 删除的日期不再出现在查询结果中
+    const char* catalog = catalog_path();
+    if (result == 0 && !dry_run && catalog != NULL &&
+        catalog_rebuild(catalog, targets, target_count) != 0) {
+        result = 1;
+    }
+    return result;
+}
+
+// 在产物索引中查找以前复制的产物，结果每行一个文件:
+// 日期 标记 规则 大小 SHA-256 提交 路径
+int query_build_artifacts(const char* config_path, const CatalogQuery* query) {
+    if (!file_exists(config_path)) {
+        log_error("复制配置文件不存在");
+        return 1;
+    }
+    quiet_config = true;
+    if (parse_config_file(config_path) != 0) {
+        log_error("解析配置文件失败");
+        return 1;
+    }
+    const char* catalog = catalog_path();
+    if (catalog == NULL) {
+        log_error("copy.conf 中没有配置 CATALOG");
+        return 1;
+    }
+    return catalog_query(catalog, query) == 0 ? 0 : 1;
+}
+
+// 从产物目录重新生成产物索引
+int rebuild_catalog(const char* config_path) {
+    if (!file_exists(config_path)) {
+        log_error("复制配置文件不存在");
+        return 1;
+    }
+    if (parse_config_file(config_path) != 0) {
+        log_error("解析配置文件失败");
+        return 1;
+    }
+    const char* catalog = catalog_path();
+    if (catalog == NULL) {
+        log_error("copy.conf 中没有配置 CATALOG");
+        return 1;
+    }
+    const char* targets[MAX_RULES];
+    size_t target_count = collect_targets(targets);
+    return catalog_rebuild(catalog, targets, target_count) == 0 ? 0 : 1;
 }
 
 // 打印帮助信息
@@ -541,6 +612,19 @@ void print_help(const char* program_name) {
     printf("  -r, --rules <规则ID>  指定要执行的规则ID（逗号分隔或范围，如1,3,5或1-3，或'all'执行所有规则）\n");
     printf("  -m, --marker <标识>   在目标路径中添加标识目录\n");
     printf("  -d, --date <日期>     在目标路径中添加日期目录（格式: YYYY-MM-DD）\n");
+    printf("  -j, --jobs <n>        复制线程数（默认根据目标存储类型自动决定）\n");
+    printf("  -g, --gc              按 KEEP_DATES / KEEP_MARKED / MAX_SIZE 清理旧的日期目录\n");
+    printf("  -n, --dry-run         与 --gc 一起使用，只列出将要删除的目录\n");
+    printf("  -w, --watch <标记文件> 边构建边复制：监视源目录，文件写完即复制，标记文件出现后补齐剩余文件并结束\n");
+    printf("  -q, --query [<文件>]  在产物索引（CATALOG）中查找以前复制的产物，可用通配符匹配文件名，\n");
+    printf("                        可与 -t、-m、-d、-r 一起使用；默认每个目标和标记只列出最新的日期\n");
+    printf("                        目标、摘要、日期、标记和文件名的固定前缀走索引，只有 -r 或 '*' 开头的模式时扫描全部记录\n");
+    printf("  -t, --target <目标>   查询指定目标目录（或其最后一段）的产物\n");
+    printf("  --hash <前缀>         按 SHA-256 前缀查询\n");
+    printf("  -a, --all             查询时列出所有日期\n");
+    printf("  --rebuild-catalog     从各目标目录的校验清单重新生成产物索引\n");
+    printf("  --apply-delta <差分> <旧文件> [<输出>]\n");
+    printf("                        用差分还原新文件并校验摘要，不指定输出时只校验\n");
     printf("  -h, --help           显示此帮助信息\n");
     printf("\n");
     printf("如果不指定 -r 选项，默认执行规则0\n");
@@ -548,7 +632,34 @@ void print_help(const char* program_name) {
     printf("\n");
     printf("配置文件格式:\n");
     printf("  变量定义: <变量名>=\"值\"\n");
-    printf("  复制规则: <序号>;<源路径>;<目标路径>\n");
+    printf("  复制规则: <序号>;<源路径>;<目标路径>[;<标志>]\n");
+    printf("\n");
+    printf("源路径模式（空白分隔，可写多个）:\n");
+    printf("  * ? [...]   与 shell 相同，匹配到的目录整体复制\n");
+    printf("  {a,b}       花括号展开，如 *.{img,bin}\n");
+    printf("  **          匹配任意层目录（只匹配文件），目标保留 ** 之前固定目录下的相对路径；\n");
+    printf("              根目录相同的规则共享一次并行目录遍历\n");
+    printf("  !<模式>     排除匹配的文件；含 / 时匹配完整路径，否则只匹配文件名\n");
+    printf("\n");
+    printf("规则标志:\n");
+    printf("  gz, zstd    复制时压缩，目标加 .gz/.zst 后缀；已是压缩格式的文件不再压缩，找不到 zstd 时改用 gz\n");
+    printf("  delta       与更早日期中最近的同名产物生成 bsdiff 差分 <文件>.delta，用 --apply-delta 还原\n");
+    printf("  sync        以已有目标或更早日期的同名产物为参照按块增量同步，只写入变化的块，\n");
+    printf("              适合网络挂载的目标；与 gz/zstd 或 STORE 同时使用时不生效\n");
+    printf("  feed        在每个含 .ipk 的目录生成 Packages/Packages.gz；控制信息按 SHA-256 缓存在\n");
+    printf("              <目标>/.feed-cache，源目录中的旧索引被替换，旧签名被删除\n");
+    printf("\n");
+    printf("可选变量:\n");
+    printf("  STORE       内容寻址存储目录；权限和时间戳相同时硬链接，否则 reflink，\n");
+    printf("              不支持 reflink 时时间戳不同仍硬链接，权限不同则单独复制；压缩结果同样存入\n");
+    printf("  KEEP_DATES  --gc 时每个目标保留的最近日期数；最新的日期总是保留\n");
+    printf("  MAX_SIZE    --gc 时的总占用上限，如 200G，超出时从最旧的日期删除；\n");
+    printf("              共享的内容按 SHA-256 只计一次\n");
+    printf("  KEEP_MARKED 是否始终保留 -m 标记的发布（默认 1）；标记目录按其中的 manifest.json 识别\n");
+    printf("  CATALOG     产物索引文件，每次复制追加记录并维护排序索引 <CATALOG>.idx\n");
+    printf("\n");
+    printf("监视模式（-w）用 inotify 监视规则的源目录，文件写完即复制；标记文件出现后完整匹配一次，\n");
+    printf("补齐遗漏的文件并删除中途出现但已不存在的文件，再核对 sha256sums 并生成校验清单\n");
     printf("\n");
     printf("示例:\n");
     printf("  %s -c copy.conf              # 执行规则0，使用当前日期\n", program_name);
@@ -558,6 +669,9 @@ void print_help(const char* program_name) {
     printf("  %s -c copy.conf -r all       # 执行所有规则，使用当前日期\n", program_name);
     printf("  %s -c copy.conf -r 1 -m release  # 执行规则1并添加release目录，使用当前日期\n", program_name);
     printf("  %s -c copy.conf -d 2025-09-07    # 执行规则0，使用指定日期\n", program_name);
+    printf("  %s -c copy.conf --gc -n      # 预览将要清理的日期目录\n", program_name);
+    printf("  %s -c copy.conf -r all -w srcs/x/.build-done  # 与编译同时运行，编译结束后创建标记文件\n", program_name);
+    printf("  %s -c copy.conf -q -t xiguapi '*sysupgrade*'  # 查询 xiguapi 最新的 sysupgrade 固件\n", program_name);
 }
 
 // 主函数
@@ -566,6 +680,13 @@ int main(int argc, char* argv[]) {
     const char* rule_str = NULL;
     const char* marker = NULL;
     const char* date = NULL;
+    bool gc = false;
+    bool dry_run = false;
+    const char* delta_path = NULL;
+    const char* watch_file = NULL;
+    bool query = false;
+    bool rebuild = false;
+    CatalogQuery catalog_filter = { .rule_id = -1 };
     
     // 定义长选项
     static struct option long_options[] = {
@@ -573,6 +694,16 @@ int main(int argc, char* argv[]) {
         {"rules", required_argument, 0, 'r'},
         {"marker", required_argument, 0, 'm'},
         {"date", required_argument, 0, 'd'},
+        {"jobs", required_argument, 0, 'j'},
+        {"gc", no_argument, 0, 'g'},
+        {"dry-run", no_argument, 0, 'n'},
+        {"apply-delta", required_argument, 0, 'A'},
+        {"watch", required_argument, 0, 'w'},
+        {"query", no_argument, 0, 'q'},
+        {"target", required_argument, 0, 't'},
+        {"hash", required_argument, 0, 'H'},
+        {"all", no_argument, 0, 'a'},
+        {"rebuild-catalog", no_argument, 0, 'R'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
@@ -581,7 +712,7 @@ int main(int argc, char* argv[]) {
     int opt;
     int option_index = 0;
     
-    while ((opt = getopt_long(argc, argv, "c:r:m:d:h", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "c:r:m:d:j:gnw:qt:ah", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'c':
                 config_path = optarg;
@@ -595,6 +726,40 @@ int main(int argc, char* argv[]) {
             case 'd':
                 date = optarg;
                 break;
+            case 'j':
+                copy_jobs = atoi(optarg);
+                if (copy_jobs < 1) {
+                    fprintf(stderr, "错误: 无效的线程数 %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'g':
+                gc = true;
+                break;
+            case 'n':
+                dry_run = true;
+                break;
+            case 'A':
+                delta_path = optarg;
+                break;
+            case 'w':
+                watch_file = optarg;
+                break;
+            case 'q':
+                query = true;
+                break;
+            case 't':
+                catalog_filter.target = optarg;
+                break;
+            case 'H':
+                catalog_filter.hash = optarg;
+                break;
+            case 'a':
+                catalog_filter.all = true;
+                break;
+            case 'R':
+                rebuild = true;
+                break;
             case 'h':
                 print_help(argv[0]);
                 return 0;
@@ -605,12 +770,42 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    // 还原差分不需要配置文件：copy --apply-delta <差分> <旧文件> [<输出>]
+    if (delta_path) {
+        if (optind >= argc || argc - optind > 2) {
+            fprintf(stderr, "错误: --apply-delta 需要旧文件路径和可选的输出路径\n");
+            return 1;
+        }
+        return delta_apply(delta_path, argv[optind], optind + 1 < argc ? argv[optind + 1] : NULL) == 0 ? 0 : 1;
+    }
+    
     if (!config_path) {
         fprintf(stderr, "错误: 必须指定配置文件 (-c)\n");
         print_help(argv[0]);
         return 1;
     }
     
+    if (gc) {
+        return gc_build_artifacts(config_path, dry_run);
+    }
+    
+    if (rebuild) {
+        return rebuild_catalog(config_path);
+    }
+    
+    // 查询时 -m、-d、-r 是过滤条件，可选的位置参数是文件名通配符
+    if (query) {
+        if (argc - optind > 1) {
+            fprintf(stderr, "错误: --query 最多接受一个文件名模式\n");
+            return 1;
+        }
+        catalog_filter.marker = marker;
+        catalog_filter.date = date;
+        catalog_filter.rule_id = rule_str != NULL ? atoi(rule_str) : -1;
+        catalog_filter.file = optind < argc ? argv[optind] : NULL;
+        return query_build_artifacts(config_path, &catalog_filter);
+    }
+    
     // 如果没有指定日期，使用当前日期
     if (!date) {
         time_t now = time(NULL);
@@ -620,5 +815,8 @@ int main(int argc, char* argv[]) {
         date = current_date;
     }
     
-    return copy_build_artifacts(config_path, rule_str, marker, date);
+    // zstd 压缩子进程异常退出时写管道返回 EPIPE 而不是终止进程；在线程池启动前设置一次
+    signal(SIGPIPE, SIG_IGN);
+    
+    return copy_build_artifacts(config_path, rule_str, marker, date, watch_file);
 }
\ No newline at end of file
@@ -0,0 +1,309 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "../utils/utils.h"
+#include "../utils/varenv.h"
+#include "../utils/sha256.h"
+#include "../utils/dirwalk.h"
+
+// 复制时的压缩方式
+typedef enum {
+    COMPRESS_NONE = 0,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD
+} CopyCompress;
+
+// 并行压缩的块大小；不超过一块的文件由复制线程直接压缩
+#define COMPRESS_BLOCK_SIZE (1024 * 1024)
+
+// 复制规则结构
+typedef struct {
+    int id;
+    char *source;
+    char *target;
+    CopyCompress compress;  // 规则第四列的 gz / zstd 标志
+    bool delta;             // 规则第四列的 delta 标志
+    bool sync;              // 规则第四列的 sync 标志
+    bool feed;              // 规则第四列的 feed 标志
+} CopyRule;
+
+// 一个待复制的普通文件
+typedef struct {
+    char *src;
+    char *dst;
+    struct stat st;         // 源文件元数据
+    int result;             // 0 成功，非 0 失败
+    int rule_id;            // 所属复制规则
+    int output;             // 所属输出目录在 CopyPlan.outputs 中的下标
+    CopyCompress compress;  // 非 NONE 时 dst 已带压缩后缀
+    bool delta;             // 复制后生成相对上一个日期同名产物的差分
+    char *delta_base;       // 差分文件对应的旧产物，普通文件为 NULL
+    bool sync;              // 按块比较已有目标，只写入变化的部分
+    char *sync_basis;       // 增量同步的参照文件（已有目标或上一个日期的同名产物）
+    bool feed;              // 复制后编入所在目录的软件源索引
+    bool superseded;        // watch 模式中源文件更新后被新任务取代，不再写入清单
+    char *commit;           // 源文件所在 git 仓库的提交，未知时为 NULL
+    unsigned long long size;         // 写入目标的字节数
+    char hash[SHA256_HEX_SIZE];      // 复制时计算的摘要
+    char expected[SHA256_HEX_SIZE];  // 源目录 sha256sums 中记录的摘要，空串表示没有
+} CopyJob;
+
+// 复制完成后需要恢复时间戳的目录
+typedef struct {
+    char *path;
+    struct stat st;
+} CopyDir;
+
+// 规则的输出目录（目标/日期[/标记]），每个目录生成一份校验清单
+typedef struct {
+    char *dir;
+    char *target;           // 所属规则的目标目录，用于查找更早的日期目录
+} CopyOutput;
+
+// 复制进度快照
+typedef struct {
+    size_t files_done;
+    size_t total_files;
+    unsigned long long bytes_done;
+    unsigned long long total_bytes;
+    uint64_t elapsed_ns;
+} CopyProgress;
+
+// 进度回调，由进度线程按固定间隔调用，结束时以 final 为 true 再调用一次
+typedef void (*CopyProgressFn)(const CopyProgress *progress, bool final);
+
+// 一次复制的全部任务：目录和符号链接在规划阶段直接创建，普通文件交给线程池
+typedef struct {
+    CopyJob *jobs;
+    size_t job_count;
+    size_t job_capacity;
+    CopyDir *dirs;
+    size_t dir_count;
+    size_t dir_capacity;
+    CopyOutput *outputs;
+    size_t output_count;
+    size_t output_capacity;
+    unsigned long long total_bytes;
+    int errors;             // 规划阶段的错误数
+    int rule_id;            // 正在规划的规则，记录到新加入的任务
+    int output;
+    CopyCompress compress;
+    bool delta;
+    bool sync;
+    bool feed;
+    char *const *excludes;  // 正在规划的规则的排除模式，展开目录时跳过匹配的条目
+    int exclude_count;
+    const char *store;      // 内容寻址存储目录，NULL 表示直接复制
+    CopyProgressFn progress;        // 为 NULL 时不报告进度
+    unsigned progress_interval_ms;
+} CopyPlan;
+
+// 内容寻址存储的统计
+typedef struct {
+    size_t files_stored;        // 新写入存储的对象
+    size_t files_deduped;       // 存储中已有相同内容
+    size_t files_hardlinked;
+    size_t files_reflinked;
+    size_t files_copied;        // 硬链接和 reflink 都不可用时退回复制
+    unsigned long long bytes_stored;
+    unsigned long long bytes_deduped;
+} StoreStats;
+
+// 线程池执行结果
+typedef struct {
+    size_t files_copied;
+    size_t files_failed;
+    size_t files_verified;  // 与源目录 sha256sums 核对一致的文件
+    size_t files_compressed;
+    unsigned long long bytes_copied;
+    unsigned long long compress_in;     // 压缩前后的字节数
+    unsigned long long compress_out;
+    size_t files_synced;
+    unsigned long long sync_written;    // 增量同步实际写入目标的字节数
+    unsigned long long sync_reused;     // 从参照文件复用的字节数
+    uint64_t elapsed_ns;
+    StoreStats store;
+} CopyTotals;
+
+// engine.c
+void copy_plan_init(CopyPlan *plan);
+void copy_plan_free(CopyPlan *plan);
+// 登记规则目标 target 下的输出目录，返回其下标（同一目录只登记一次），失败返回 -1
+int copy_plan_output(CopyPlan *plan, const char *dir, const char *target);
+// 把 src（文件或目录树）按 rule 的标志加入复制计划，目标为 dst；已存在的目标先删除，
+// sync 规则保留已有的同类型目标作为增量同步的参照，并删除已有目录中源已不存在的条目
+// compress 非 NONE 时，非压缩格式的文件在复制时压缩并加上对应后缀
+int copy_plan_add(CopyPlan *plan, const char *src, const char *dst, const CopyRule *rule, int output);
+// 与 copy_plan_add 相同，但 src 是符号链接时按链接本身复制（用于目录树中的条目）
+int copy_plan_add_entry(CopyPlan *plan, const char *src, const char *dst, const CopyRule *rule, int output);
+// 按源目录 src 的权限创建目标目录 dst，复制结束后恢复其时间戳
+int copy_plan_add_dir(CopyPlan *plan, const char *src, const char *dst);
+// 规则的输出目录 <目标>/<日期>[/<标记>]，不带结尾的 /
+char* copy_output_dir(const CopyRule *rule, const char *date, const char *marker);
+// 把复制阶段之外生成的文件（如差分）作为已完成的任务登记，用于生成校验清单
+int copy_plan_add_result(CopyPlan *plan, const char *src, const char *dst, int rule_id, int output,
+                         const char *delta_base);
+// 根据各目标所在存储的类型决定默认线程数（取最慢的设备）
+int default_copy_jobs(const char *const *paths, size_t count);
+// 用 jobs 个线程执行计划中的文件复制
+void copy_plan_run(CopyPlan *plan, int jobs, CopyTotals *totals);
+// 只执行下标从 first 开始的任务（watch 模式分批复制）
+void copy_plan_run_from(CopyPlan *plan, size_t first, int jobs, CopyTotals *totals);
+// 把一批的统计累加到 total
+void copy_totals_add(CopyTotals *total, const CopyTotals *batch);
+uint64_t copy_now_ns(void);
+
+// store.c
+int store_init(const char *store);
+// 把文件存入内容寻址存储（复制的同时计算摘要，源文件只读一次），
+// 并在 job->dst 创建指向存储对象、权限和时间戳与源文件一致的视图
+int store_copy_job(const char *store, CopyJob *job, StoreStats *stats, unsigned long long *progress);
+// 把已写到 job->dst 的文件（如压缩输出）按 job->hash 移入存储，原位置换成视图
+int store_adopt_job(const char *store, CopyJob *job, StoreStats *stats);
+
+// compress.c
+const char* compress_suffix(CopyCompress type);
+int compress_parse(const char *name, CopyCompress *type);
+// 已是压缩格式（.gz、.ipk、sysupgrade .bin 等）的文件不再压缩
+bool compress_skip(const char *path);
+bool compress_available(CopyCompress type);
+// 读取源文件一次，同时计算源摘要、压缩并写入 job->dst，threads 为并行压缩的线程数
+int compress_file(const CopyJob *job, int threads, char in_hex[SHA256_HEX_SIZE],
+                  char out_hex[SHA256_HEX_SIZE], unsigned long long *in_bytes,
+                  unsigned long long *out_bytes, unsigned long long *progress);
+
+// 日期目录的保留策略（copy.conf 中的 KEEP_DATES、KEEP_MARKED、MAX_SIZE）
+typedef struct {
+    int keep_dates;                 // 每个目标保留最近的日期数，0 表示不限
+    bool keep_marked;               // 保留带标记目录的日期
+    unsigned long long max_size;    // 总占用上限（字节），0 表示不限
+} GcPolicy;
+
+// gc.c
+// 解析 10G、500M 之类的大小
+int gc_parse_size(const char *text, unsigned long long *size);
+bool gc_is_date_name(const char *name);
+// 按策略删除过期的日期目录和内容存储中不再被引用的对象
+int copy_gc(const char **targets, size_t target_count, const char *store,
+            const GcPolicy *policy, int jobs, bool dry_run);
+
+// delta.c
+// 生成 old_path 到 new_path 的二进制差分（bsdiff 算法，threads 个线程并行比较），返回差分大小
+long long delta_create(const char *old_path, const char *new_path, const char *delta_path, int threads);
+// 用差分和旧文件还原新文件并核对摘要；out_path 为 NULL 时只校验
+int delta_apply(const char *delta_path, const char *old_path, const char *out_path);
+// 在早于 date 的日期目录中查找与 job 目标同名的最近产物，没有时返回 NULL
+char* previous_artifact(const CopyPlan *plan, const CopyJob *job, const char *date);
+// 为带 delta 标志的任务生成 <目标文件>.delta 并登记到计划中
+int delta_generate(CopyPlan *plan, const char *date, int threads);
+
+// sync.c
+typedef struct {
+    unsigned long long written;     // 写入目标的字节数（新内容，以及不支持服务端复制时的复用块）
+    unsigned long long reused;      // 从参照文件复用的字节数
+} SyncStats;
+
+// 为下标从 first 开始的 sync 任务确定参照文件：已有目标优先，否则使用上一个日期的同名产物
+void sync_prepare(CopyPlan *plan, size_t first, const char *date);
+// 按 rsync 算法把 job->src 同步到 job->dst：用滚动校验和在源文件中查找参照文件的块，
+// 相同的块用 copy_file_range 从参照文件复制，其余写入新数据，最后原子重命名
+int sync_file(CopyJob *job, SyncStats *stats, unsigned long long *progress);
+
+// feed.c
+// 为带 feed 标志的任务生成软件源索引：含 .ipk 的每个输出目录写入 Packages 和 Packages.gz，
+// threads 个线程并行解包读取控制信息；控制信息按 ipk 的 SHA-256 缓存在目标目录的
+// .feed-cache 中，已缓存的软件包不再解包
+int feed_generate(CopyPlan *plan, const char *date, int threads);
+
+// 源路径模式匹配到的一项
+typedef struct {
+    char *path;
+    char *name;             // 目标目录下的相对路径
+} SourceMatch;
+
+typedef struct {
+    SourceMatch *items;
+    size_t count;
+    size_t capacity;
+    char **excludes;        // 规则的排除模式，展开匹配到的目录时使用
+    int exclude_count;
+} SourceList;
+
+// match.c
+// 展开规则的源路径：空白分隔的多个模式，支持 ~、花括号和 ! 开头的排除模式；
+// 含 ** 的模式在 cache 中共享的目录树快照上匹配，结果按目标名排序
+int source_expand(const char *source, DirTreeCache *cache, int threads, SourceList *list);
+void source_list_free(SourceList *list);
+// path 或它在 root_len 之后的某一级上级目录被排除模式匹配时返回 true
+bool source_excluded(char *const *excludes, int exclude_count, const char *path, size_t root_len);
+
+// 规则源路径的逐个路径匹配器（watch 模式），匹配规则与 source_expand 相同
+typedef struct {
+    char **includes;
+    char **roots;           // 各模式第一个含通配符的路径段之前的固定目录
+    int include_count;
+    char **excludes;
+    int exclude_count;
+} SourceSpec;
+
+int source_spec_parse(const char *source, SourceSpec *spec);
+void source_spec_free(SourceSpec *spec);
+// path 属于规则时返回 true，*name 为目标目录下的相对路径（调用者释放）；
+// 位于匹配目录中的文件也属于规则，name 以该目录名开头
+bool source_spec_match(const SourceSpec *spec, const char *path, char **name);
+// 目录 dir 本身或其下的路径可能被规则匹配时返回 true
+bool source_spec_wants_dir(const SourceSpec *spec, const char *dir);
+
+// watch 模式的参数
+typedef struct {
+    const CopyRule **rules;     // 选中的规则
+    size_t rule_count;
+    const char *marker;
+    const char *date;
+    const char *done_file;      // 构建完成后出现的标记文件
+    int jobs;                   // 复制线程数
+    int walk_jobs;              // 遍历源目录的线程数
+} CopyWatch;
+
+// watch.c
+// 用 inotify 监视规则的源目录，文件写完关闭（或移入）后立即复制并计算摘要；
+// done_file 出现后再完整展开一次源路径，补齐遗漏或更新过的文件，删除构建中途消失的产物；
+// 被中断时删除本次复制的全部文件，所有任务标记为已取代，不生成清单和索引记录
+int copy_watch(CopyPlan *plan, const CopyWatch *watch, CopyTotals *totals);
+
+// manifest.c
+// 读取源文件所在目录中 OpenWrt 生成的 sha256sums，填入各任务的 expected
+void manifest_load_expected(CopyPlan *plan);
+// 在每个输出目录写入 sha256sums 和 manifest.json，保留之前的清单中仍然存在的文件
+int manifest_write(const CopyPlan *plan, const char *marker);
+// 输出目录中的 sha256sums、manifest.json 由 manifest_write 生成，不作为复制的产物记录
+bool manifest_own_file(const char *name);
+// 读取 manifest.json 中一个文件所在行的字符串字段和数值字段
+char* manifest_string(const char *line, const char *key);
+bool manifest_number(const char *line, const char *key, long long *value);
+
+// 产物索引的查询条件，NULL 或 -1 表示不限
+typedef struct {
+    const char *target;     // 目标目录，不含 / 时只比较最后一段（如 xiguapi）
+    const char *marker;
+    const char *date;
+    int rule_id;
+    const char *hash;       // SHA-256 前缀
+    const char *file;       // 文件的通配符，不含 / 时只匹配文件名
+    bool all;               // 列出所有日期，否则每个目标和标记只列出最新的日期
+} CatalogQuery;
+
+// catalog.c
+// 查询源文件所在 git 仓库的提交，填入各任务的 commit（每条规则查询一次）
+void catalog_resolve_commits(CopyPlan *plan);
+// 把本次复制的文件追加到产物索引 catalog，并把新记录归并进排序索引 <catalog>.idx
+int catalog_append(const char *catalog, const CopyPlan *plan, const char *date, const char *marker);
+// 在产物索引中二分查找，不访问产物目录；每个匹配的文件输出一行，没有匹配时返回 1
+int catalog_query(const char *catalog, const CatalogQuery *query);
+// 从目标目录中各日期的 manifest.json（或 sha256sums）重新生成这些目标的记录
+int catalog_rebuild(const char *catalog, const char **targets, size_t target_count);
+
+#endif // COPY_H
@@ -0,0 +1,783 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include "copy.h"
+#include "../utils/treecopy.h"
+
+// 差分文件格式（整数均为小端 64 位）:
+//   "OWDELTA1" 旧文件大小 新文件大小 旧文件 SHA-256 新文件 SHA-256
+//   控制流/差值流/新增流 压缩后长度 ×3，原始长度 ×3，随后是三段 zlib 数据
+// 控制流由 (x, y, z) 三元组组成：从旧文件当前位置取 x 字节加上差值流，
+// 再追加新增流的 y 字节，然后把旧文件位置移动 z（可为负）
+#define DELTA_MAGIC "OWDELTA1"
+#define DELTA_MAGIC_SIZE 8
+#define DELTA_HEADER_SIZE (DELTA_MAGIC_SIZE + 2 * 8 + 2 * SHA256_DIGEST_SIZE + 6 * 8)
+// 后缀数组每字节需要 8 字节内存，旧文件超过该大小时不生成差分
+#define DELTA_MAX_OLD_SIZE (256ULL * 1024 * 1024)
+// 还原时新文件和各数据流的长度上限，差分文件头中超出的长度视为损坏
+#define DELTA_MAX_NEW_SIZE (SIZE_MAX / 2)
+#define DELTA_CONTROL_SIZE 24
+// 新文件按块分给线程并行比较，块太小时边界处的匹配损失明显
+#define DELTA_MIN_CHUNK (1024 * 1024)
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+} MappedFile;
+
+static int map_file(const char *path, MappedFile *file) {
+    file->data = NULL;
+    file->size = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    file->size = (size_t)st.st_size;
+    if (file->size > 0) {
+        void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        file->data = data;
+    }
+    close(fd);
+    return 0;
+}
+
+static void unmap_file(MappedFile *file) {
+    if (file->data != NULL) munmap(file->data, file->size);
+    file->data = NULL;
+}
+
+// Larsson-Sadakane 前缀倍增构造后缀数组，与 bsdiff 相同
+static void suffix_split(int32_t *I, int32_t *V, int64_t start, int64_t len, int64_t h) {
+    int64_t i, j, k, jj, kk;
+    int32_t x, tmp;
+
+    if (len < 16) {
+        for (k = start; k < start + len; k += j) {
+            j = 1;
+            x = V[I[k] + h];
+            for (i = 1; k + i < start + len; i++) {
+                if (V[I[k + i] + h] < x) {
+                    x = V[I[k + i] + h];
+                    j = 0;
+                }
+                if (V[I[k + i] + h] == x) {
+                    tmp = I[k + j];
+                    I[k + j] = I[k + i];
+                    I[k + i] = tmp;
+                    j++;
+                }
+            }
+            for (i = 0; i < j; i++) V[I[k + i]] = (int32_t)(k + j - 1);
+            if (j == 1) I[k] = -1;
+        }
+        return;
+    }
+
+    x = V[I[start + len / 2] + h];
+    jj = 0;
+    kk = 0;
+    for (i = start; i < start + len; i++) {
+        if (V[I[i] + h] < x) jj++;
+        if (V[I[i] + h] == x) kk++;
+    }
+    jj += start;
+    kk += jj;
+
+    i = start;
+    j = 0;
+    k = 0;
+    while (i < jj) {
+        if (V[I[i] + h] < x) {
+            i++;
+        } else if (V[I[i] + h] == x) {
+            tmp = I[i];
+            I[i] = I[jj + j];
+            I[jj + j] = tmp;
+            j++;
+        } else {
+            tmp = I[i];
+            I[i] = I[kk + k];
+            I[kk + k] = tmp;
+            k++;
+        }
+    }
+    while (jj + j < kk) {
+        if (V[I[jj + j] + h] == x) {
+            j++;
+        } else {
+            tmp = I[jj + j];
+            I[jj + j] = I[kk + k];
+            I[kk + k] = tmp;
+            k++;
+        }
+    }
+
+    if (jj > start) suffix_split(I, V, start, jj - start, h);
+    for (i = 0; i < kk - jj; i++) V[I[jj + i]] = (int32_t)(kk - 1);
+    if (jj == kk - 1) I[jj] = -1;
+    if (start + len > kk) suffix_split(I, V, kk, start + len - kk, h);
+}
+
+static int32_t* suffix_sort(const unsigned char *old, int64_t size) {
+    int32_t *I = malloc((size_t)(size + 1) * sizeof(int32_t));
+    int32_t *V = malloc((size_t)(size + 1) * sizeof(int32_t));
+    if (I == NULL || V == NULL) {
+        free(I);
+        free(V);
+        return NULL;
+    }
+
+    int64_t buckets[256] = {0};
+    for (int64_t i = 0; i < size; i++) buckets[old[i]]++;
+    for (int i = 1; i < 256; i++) buckets[i] += buckets[i - 1];
+    for (int i = 255; i > 0; i--) buckets[i] = buckets[i - 1];
+    buckets[0] = 0;
+
+    for (int64_t i = 0; i < size; i++) I[++buckets[old[i]]] = (int32_t)i;
+    I[0] = (int32_t)size;
+    for (int64_t i = 0; i < size; i++) V[i] = (int32_t)buckets[old[i]];
+    V[size] = 0;
+    for (int i = 1; i < 256; i++) {
+        if (buckets[i] == buckets[i - 1] + 1) I[buckets[i]] = -1;
+    }
+    I[0] = -1;
+
+    for (int64_t h = 1; I[0] != -(size + 1); h += h) {
+        int64_t len = 0;
+        int64_t i = 0;
+        while (i < size + 1) {
+            if (I[i] < 0) {
+                len -= I[i];
+                i -= I[i];
+            } else {
+                if (len) I[i - len] = (int32_t)-len;
+                len = V[I[i]] + 1 - i;
+                suffix_split(I, V, i, len, h);
+                i += len;
+                len = 0;
+            }
+        }
+        if (len) I[i - len] = (int32_t)-len;
+    }
+
+    for (int64_t i = 0; i < size + 1; i++) I[V[i]] = (int32_t)i;
+    free(V);
+    return I;
+}
+
+static int64_t match_length(const unsigned char *a, int64_t a_size, const unsigned char *b, int64_t b_size) {
+    int64_t i = 0;
+    while (i < a_size && i < b_size && a[i] == b[i]) i++;
+    return i;
+}
+
+// 在后缀数组中二分查找与 target 最长的公共前缀
+static int64_t suffix_search(const int32_t *I, const unsigned char *old, int64_t old_size,
+                             const unsigned char *target, int64_t target_size,
+                             int64_t start, int64_t end, int64_t *pos) {
+    while (end - start >= 2) {
+        int64_t mid = start + (end - start) / 2;
+        int64_t n = old_size - I[mid] < target_size ? old_size - I[mid] : target_size;
+        if (memcmp(old + I[mid], target, (size_t)n) < 0) start = mid;
+        else end = mid;
+    }
+    int64_t x = match_length(old + I[start], old_size - I[start], target, target_size);
+    int64_t y = match_length(old + I[end], old_size - I[end], target, target_size);
+    *pos = x > y ? I[start] : I[end];
+    return x > y ? x : y;
+}
+
+typedef struct {
+    int64_t *items;
+    size_t count;
+    size_t capacity;
+} ControlList;
+
+static int control_add(ControlList *list, int64_t x, int64_t y, int64_t z) {
+    if (list->count + 3 > list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 768;
+        int64_t *items = realloc(list->items, capacity * sizeof(int64_t));
+        if (items == NULL) return -1;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = x;
+    list->items[list->count++] = y;
+    list->items[list->count++] = z;
+    return 0;
+}
+
+// 一个线程负责的新文件片段及其输出
+typedef struct {
+    const int32_t *I;
+    const unsigned char *old;
+    int64_t old_size;
+    const unsigned char *new_data;
+    int64_t new_size;
+    ControlList control;
+    unsigned char *diff;
+    int64_t diff_len;
+    unsigned char *extra;
+    int64_t extra_len;
+    int result;
+} DeltaChunk;
+
+// bsdiff 的匹配扫描；片段结束时把旧文件位置移回 0，便于各片段的控制流直接拼接
+static void* delta_chunk(void *arg) {
+    DeltaChunk *chunk = arg;
+    const unsigned char *old = chunk->old;
+    const unsigned char *new_data = chunk->new_data;
+    int64_t old_size = chunk->old_size;
+    int64_t new_size = chunk->new_size;
+
+    chunk->result = -1;
+    chunk->diff = malloc((size_t)new_size + 1);
+    chunk->extra = malloc((size_t)new_size + 1);
+    if (chunk->diff == NULL || chunk->extra == NULL) return NULL;
+
+    int64_t scan = 0, len = 0, pos = 0;
+    int64_t last_scan = 0, last_pos = 0, last_offset = 0;
+    while (scan < new_size) {
+        int64_t old_score = 0;
+        int64_t scsc;
+        for (scsc = scan += len; scan < new_size; scan++) {
+            len = suffix_search(chunk->I, old, old_size, new_data + scan, new_size - scan, 0, old_size, &pos);
+            for (; scsc < scan + len; scsc++) {
+                if (scsc + last_offset < old_size && old[scsc + last_offset] == new_data[scsc]) old_score++;
+            }
+            if ((len == old_score && len != 0) || len > old_score + 8) break;
+            if (scan + last_offset < old_size && old[scan + last_offset] == new_data[scan]) old_score--;
+        }
+        if (len == old_score && scan != new_size) continue;
+
+        // 向前、向后扩展近似匹配，并处理两段重叠
+        int64_t s = 0, best = 0, len_forward = 0;
+        for (int64_t i = 0; last_scan + i < scan && last_pos + i < old_size;) {
+            if (old[last_pos + i] == new_data[last_scan + i]) s++;
+            i++;
+            if (s * 2 - i > best * 2 - len_forward) {
+                best = s;
+                len_forward = i;
+            }
+        }
+
+        int64_t len_back = 0;
+        if (scan < new_size) {
+            s = 0;
+            best = 0;
+            for (int64_t i = 1; scan >= last_scan + i && pos >= i; i++) {
+                if (old[pos - i] == new_data[scan - i]) s++;
+                if (s * 2 - i > best * 2 - len_back) {
+                    best = s;
+                    len_back = i;
+                }
+            }
+        }
+
+        if (last_scan + len_forward > scan - len_back) {
+            int64_t overlap = (last_scan + len_forward) - (scan - len_back);
+            int64_t len_split = 0;
+            s = 0;
+            best = 0;
+            for (int64_t i = 0; i < overlap; i++) {
+                if (new_data[last_scan + len_forward - overlap + i] == old[last_pos + len_forward - overlap + i]) s++;
+                if (new_data[scan - len_back + i] == old[pos - len_back + i]) s--;
+                if (s > best) {
+                    best = s;
+                    len_split = i + 1;
+                }
+            }
+            len_forward += len_split - overlap;
+            len_back -= len_split;
+        }
+
+        for (int64_t i = 0; i < len_forward; i++) {
+            chunk->diff[chunk->diff_len + i] = new_data[last_scan + i] - old[last_pos + i];
+        }
+        int64_t extra = (scan - len_back) - (last_scan + len_forward);
+        memcpy(chunk->extra + chunk->extra_len, new_data + last_scan + len_forward, (size_t)extra);
+        chunk->diff_len += len_forward;
+        chunk->extra_len += extra;
+
+        int64_t seek = (pos - len_back) - (last_pos + len_forward);
+        if (scan == new_size) seek -= pos - len_back;
+        if (control_add(&chunk->control, len_forward, extra, seek) != 0) return NULL;
+
+        last_scan = scan - len_back;
+        last_pos = pos - len_back;
+        last_offset = pos - scan;
+    }
+
+    chunk->result = 0;
+    return NULL;
+}
+
+static void put_u64(unsigned char *p, uint64_t value) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static unsigned char* deflate_buffer(const unsigned char *data, size_t size, size_t *out_size) {
+    uLongf bound = compressBound((uLong)size);
+    unsigned char *out = malloc(bound);
+    if (out == NULL) return NULL;
+    if (compress2(out, &bound, data, (uLong)size, Z_BEST_COMPRESSION) != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    *out_size = bound;
+    return out;
+}
+
+static int write_all(int fd, const unsigned char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+// 写入差分文件，返回其大小；失败返回 -1
+static long long write_delta(const char *path, const MappedFile *old, const MappedFile *new_file,
+                             DeltaChunk *chunks, int chunk_count) {
+    size_t control_count = 0;
+    int64_t diff_len = 0, extra_len = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        control_count += chunks[i].control.count;
+        diff_len += chunks[i].diff_len;
+        extra_len += chunks[i].extra_len;
+    }
+
+    // 拼接各片段的输出
+    unsigned char *control = malloc(control_count * 8 + 1);
+    unsigned char *diff = malloc((size_t)diff_len + 1);
+    unsigned char *extra = malloc((size_t)extra_len + 1);
+    unsigned char *streams[3] = {NULL, NULL, NULL};
+    size_t stream_sizes[3] = {0, 0, 0};
+    long long result = -1;
+    if (control == NULL || diff == NULL || extra == NULL) goto out;
+
+    size_t control_pos = 0;
+    int64_t diff_pos = 0, extra_pos = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        for (size_t j = 0; j < chunks[i].control.count; j++) {
+            put_u64(control + control_pos, (uint64_t)chunks[i].control.items[j]);
+            control_pos += 8;
+        }
+        memcpy(diff + diff_pos, chunks[i].diff, (size_t)chunks[i].diff_len);
+        memcpy(extra + extra_pos, chunks[i].extra, (size_t)chunks[i].extra_len);
+        diff_pos += chunks[i].diff_len;
+        extra_pos += chunks[i].extra_len;
+    }
+
+    const unsigned char *raw[3] = {control, diff, extra};
+    size_t raw_sizes[3] = {control_count * 8, (size_t)diff_len, (size_t)extra_len};
+    for (int i = 0; i < 3; i++) {
+        streams[i] = deflate_buffer(raw[i], raw_sizes[i], &stream_sizes[i]);
+        if (streams[i] == NULL) goto out;
+    }
+
+    unsigned char header[DELTA_HEADER_SIZE];
+    unsigned char *p = header;
+    memcpy(p, DELTA_MAGIC, DELTA_MAGIC_SIZE);
+    p += DELTA_MAGIC_SIZE;
+    put_u64(p, old->size);
+    put_u64(p + 8, new_file->size);
+    p += 16;
+    Sha256Ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, old->data, old->size);
+    sha256_final(&ctx, p);
+    sha256_init(&ctx);
+    sha256_update(&ctx, new_file->data, new_file->size);
+    sha256_final(&ctx, p + SHA256_DIGEST_SIZE);
+    p += 2 * SHA256_DIGEST_SIZE;
+    for (int i = 0; i < 3; i++) put_u64(p + 8 * i, stream_sizes[i]);
+    for (int i = 0; i < 3; i++) put_u64(p + 24 + 8 * i, raw_sizes[i]);
+
+    char *tmp_path = NULL;
+    int fd = open_temp_file(path, &tmp_path);
+    if (fd < 0) goto out;
+    int status = fchmod(fd, 0644) == 0 ? write_all(fd, header, sizeof(header)) : -1;
+    for (int i = 0; status == 0 && i < 3; i++) status = write_all(fd, streams[i], stream_sizes[i]);
+    if (close(fd) != 0) status = -1;
+    if (status == 0 && rename(tmp_path, path) != 0) status = -1;
+    if (status != 0) {
+        unlink(tmp_path);
+    } else {
+        result = (long long)(sizeof(header) + stream_sizes[0] + stream_sizes[1] + stream_sizes[2]);
+    }
+    free(tmp_path);
+
+out:
+    for (int i = 0; i < 3; i++) free(streams[i]);
+    free(control);
+    free(diff);
+    free(extra);
+    return result;
+}
+
+long long delta_create(const char *old_path, const char *new_path, const char *delta_path, int threads) {
+    MappedFile old, new_file;
+    if (map_file(old_path, &old) != 0) return -1;
+    if (map_file(new_path, &new_file) != 0) {
+        unmap_file(&old);
+        return -1;
+    }
+
+    long long result = -1;
+    int32_t *I = NULL;
+    DeltaChunk *chunks = NULL;
+    int chunk_count = 0;
+    if (old.size == 0 || new_file.size == 0 || old.size > DELTA_MAX_OLD_SIZE) goto out;
+
+    I = suffix_sort(old.data, (int64_t)old.size);
+    if (I == NULL) goto out;
+
+    // 后缀数组只读，各线程并行比较新文件的不同片段
+    if (threads < 1) threads = 1;
+    chunk_count = (int)((new_file.size + DELTA_MIN_CHUNK - 1) / DELTA_MIN_CHUNK);
+    if (chunk_count > threads) chunk_count = threads;
+    if (chunk_count < 1) chunk_count = 1;
+    chunks = calloc((size_t)chunk_count, sizeof(DeltaChunk));
+    if (chunks == NULL) goto out;
+
+    size_t chunk_size = (new_file.size + chunk_count - 1) / chunk_count;
+    pthread_t *workers = malloc((size_t)chunk_count * sizeof(pthread_t));
+    bool *started = calloc((size_t)chunk_count, sizeof(bool));
+    for (int i = 0; i < chunk_count; i++) {
+        size_t offset = (size_t)i * chunk_size;
+        chunks[i].I = I;
+        chunks[i].old = old.data;
+        chunks[i].old_size = (int64_t)old.size;
+        chunks[i].new_data = new_file.data + offset;
+        chunks[i].new_size = (int64_t)(offset + chunk_size <= new_file.size ? chunk_size : new_file.size - offset);
+        chunks[i].result = -1;
+        if (i > 0 && workers != NULL && started != NULL &&
+            pthread_create(&workers[i], NULL, delta_chunk, &chunks[i]) == 0) {
+            started[i] = true;
+        }
+    }
+    // 第一个片段以及创建线程失败的片段在当前线程执行
+    for (int i = 0; i < chunk_count; i++) {
+        if (started == NULL || !started[i]) delta_chunk(&chunks[i]);
+    }
+    for (int i = 1; i < chunk_count; i++) {
+        if (started != NULL && started[i]) pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    free(started);
+
+    bool ok = true;
+    for (int i = 0; i < chunk_count; i++) {
+        if (chunks[i].result != 0) ok = false;
+    }
+    if (ok) result = write_delta(delta_path, &old, &new_file, chunks, chunk_count);
+
+out:
+    for (int i = 0; chunks != NULL && i < chunk_count; i++) {
+        free(chunks[i].control.items);
+        free(chunks[i].diff);
+        free(chunks[i].extra);
+    }
+    free(chunks);
+    free(I);
+    unmap_file(&old);
+    unmap_file(&new_file);
+    return result;
+}
+
+static unsigned char* inflate_buffer(const unsigned char *data, size_t size, size_t raw_size) {
+    unsigned char *out = malloc(raw_size + 1);
+    if (out == NULL) return NULL;
+    uLongf out_size = (uLongf)raw_size;
+    if (uncompress(out, &out_size, data, (uLong)size) != Z_OK || out_size != raw_size) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+int delta_apply(const char *delta_path, const char *old_path, const char *out_path) {
+    MappedFile delta, old;
+    if (map_file(delta_path, &delta) != 0) {
+        log_error("无法读取差分文件: %s", delta_path);
+        return -1;
+    }
+    if (delta.size < DELTA_HEADER_SIZE || memcmp(delta.data, DELTA_MAGIC, DELTA_MAGIC_SIZE) != 0) {
+        log_error("不是有效的差分文件: %s", delta_path);
+        unmap_file(&delta);
+        return -1;
+    }
+    if (map_file(old_path, &old) != 0) {
+        log_error("无法读取旧文件: %s", old_path);
+        unmap_file(&delta);
+        return -1;
+    }
+
+    const unsigned char *p = delta.data + DELTA_MAGIC_SIZE;
+    uint64_t old_size = get_u64(p);
+    uint64_t new_size = get_u64(p + 8);
+    const unsigned char *old_digest = p + 16;
+    const unsigned char *new_digest = p + 16 + SHA256_DIGEST_SIZE;
+    p += 16 + 2 * SHA256_DIGEST_SIZE;
+    uint64_t stream_sizes[3], raw_sizes[3];
+    for (int i = 0; i < 3; i++) {
+        stream_sizes[i] = get_u64(p + 8 * i);
+        raw_sizes[i] = get_u64(p + 24 + 8 * i);
+    }
+
+    int result = -1;
+    unsigned char *streams[3] = {NULL, NULL, NULL};
+    unsigned char *new_data = NULL;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    Sha256Ctx ctx;
+
+    // 先确认旧文件正是生成差分时使用的那个
+    sha256_init(&ctx);
+    sha256_update(&ctx, old.data, old.size);
+    sha256_final(&ctx, digest);
+    if (old.size != old_size || memcmp(digest, old_digest, SHA256_DIGEST_SIZE) != 0) {
+        log_error("旧文件与差分记录的摘要不一致: %s", old_path);
+        goto out;
+    }
+
+    // 文件头中的长度不可信，分配内存前先检查：差值流和新增流不会比新文件长，
+    // 所有长度都要能放进 size_t 和 zlib 的 uLong
+    if (new_size > DELTA_MAX_NEW_SIZE || new_size > (uint64_t)(uLong)-1) goto corrupt;
+    if (raw_sizes[1] > new_size || raw_sizes[2] > new_size) goto corrupt;
+    if (raw_sizes[0] % DELTA_CONTROL_SIZE != 0) goto corrupt;
+    for (int i = 0; i < 3; i++) {
+        if (raw_sizes[i] > DELTA_MAX_NEW_SIZE || raw_sizes[i] > (uint64_t)(uLong)-1 ||
+            stream_sizes[i] > (uint64_t)(uLong)-1) {
+            goto corrupt;
+        }
+    }
+
+    uint64_t offset = DELTA_HEADER_SIZE;
+    for (int i = 0; i < 3; i++) {
+        if (stream_sizes[i] > delta.size - offset) goto corrupt;
+        streams[i] = inflate_buffer(delta.data + offset, stream_sizes[i], raw_sizes[i]);
+        if (streams[i] == NULL) goto corrupt;
+        offset += stream_sizes[i];
+    }
+
+    new_data = malloc(new_size + 1);
+    if (new_data == NULL) goto out;
+
+    uint64_t new_pos = 0, diff_pos = 0, extra_pos = 0;
+    int64_t old_pos = 0;
+    for (uint64_t c = 0; c + DELTA_CONTROL_SIZE <= raw_sizes[0]; c += DELTA_CONTROL_SIZE) {
+        int64_t x = (int64_t)get_u64(streams[0] + c);
+        int64_t y = (int64_t)get_u64(streams[0] + c + 8);
+        int64_t z = (int64_t)get_u64(streams[0] + c + 16);
+        if (x < 0 || y < 0 || (uint64_t)x > new_size - new_pos || (uint64_t)x > raw_sizes[1] - diff_pos) {
+            goto corrupt;
+        }
+        for (int64_t i = 0; i < x; i++) {
+            unsigned char base = old_pos + i >= 0 && (uint64_t)(old_pos + i) < old_size ? old.data[old_pos + i] : 0;
+            new_data[new_pos + i] = streams[1][diff_pos + i] + base;
+        }
+        new_pos += x;
+        diff_pos += x;
+        old_pos += x;
+        if ((uint64_t)y > new_size - new_pos || (uint64_t)y > raw_sizes[2] - extra_pos) goto corrupt;
+        memcpy(new_data + new_pos, streams[2] + extra_pos, (size_t)y);
+        new_pos += y;
+        extra_pos += y;
+        old_pos += z;
+    }
+    if (new_pos != new_size) goto corrupt;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, new_data, new_size);
+    sha256_final(&ctx, digest);
+    if (memcmp(digest, new_digest, SHA256_DIGEST_SIZE) != 0) {
+        log_error("还原结果的摘要与差分记录不一致");
+        goto out;
+    }
+
+    char hex[SHA256_HEX_SIZE];
+    sha256_to_hex(digest, hex);
+    if (out_path == NULL) {
+        log_success("差分校验通过: %s (sha256 %s)", delta_path, hex);
+        result = 0;
+        goto out;
+    }
+
+    char *tmp_path = NULL;
+    int fd = open_temp_file(out_path, &tmp_path);
+    int status = fd >= 0 && fchmod(fd, 0644) == 0 ? write_all(fd, new_data, new_size) : -1;
+    if (fd >= 0 && close(fd) != 0) status = -1;
+    if (status == 0 && rename(tmp_path, out_path) != 0) status = -1;
+    if (status != 0) {
+        if (tmp_path != NULL) unlink(tmp_path);
+        log_error("无法写入: %s", out_path);
+    } else {
+        log_success("已还原: %s (sha256 %s)", out_path, hex);
+        result = 0;
+    }
+    free(tmp_path);
+    goto out;
+
+corrupt:
+    log_error("差分文件已损坏: %s", delta_path);
+out:
+    for (int i = 0; i < 3; i++) free(streams[i]);
+    free(new_data);
+    unmap_file(&old);
+    unmap_file(&delta);
+    return result;
+}
+
+static int compare_names_desc(const void *a, const void *b) {
+    return strcmp(*(char* const*)b, *(char* const*)a);
+}
+
+// 在早于 date 的日期目录中找最近的同名产物，先找不带标记的位置，再找各标记目录
+static char* find_previous(const char *target, const char *date, const char *rel) {
+    DIR *dir = opendir(target);
+    if (dir == NULL) return NULL;
+    char **dates = NULL;
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!gc_is_date_name(entry->d_name) || strcmp(entry->d_name, date) >= 0) continue;
+        char **grown = realloc(dates, (count + 1) * sizeof(char*));
+        if (grown == NULL) break;
+        dates = grown;
+        dates[count] = strdup(entry->d_name);
+        if (dates[count] != NULL) count++;
+    }
+    closedir(dir);
+    if (count > 1) qsort(dates, count, sizeof(char*), compare_names_desc);
+
+    char *found = NULL;
+    struct stat st;
+    for (size_t i = 0; found == NULL && i < count; i++) {
+        char *path = NULL;
+        if (asprintf(&path, "%s/%s/%s", target, dates[i], rel) >= 0 && stat(path, &st) == 0 &&
+            S_ISREG(st.st_mode)) {
+            found = path;
+            break;
+        }
+        free(path);
+
+        char *date_dir = NULL;
+        if (asprintf(&date_dir, "%s/%s", target, dates[i]) < 0) continue;
+        DIR *markers = opendir(date_dir);
+        while (markers != NULL && found == NULL && (entry = readdir(markers)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            path = NULL;
+            if (asprintf(&path, "%s/%s/%s", date_dir, entry->d_name, rel) >= 0 && stat(path, &st) == 0 &&
+                S_ISREG(st.st_mode)) {
+                found = path;
+            } else {
+                free(path);
+            }
+        }
+        if (markers != NULL) closedir(markers);
+        free(date_dir);
+    }
+
+    for (size_t i = 0; i < count; i++) free(dates[i]);
+    free(dates);
+    return found;
+}
+
+char* previous_artifact(const CopyPlan *plan, const CopyJob *job, const char *date) {
+    const CopyOutput *output = &plan->outputs[job->output];
+    return find_previous(output->target, date, job->dst + strlen(output->dir) + 1);
+}
+
+int delta_generate(CopyPlan *plan, const char *date, int threads) {
+    size_t job_count = plan->job_count;
+    int failures = 0;
+
+    // 生成的差分文件作为已完成的任务追加到计划中，plan->jobs 可能因此重新分配
+    for (size_t i = 0; i < job_count; i++) {
+        if (!plan->jobs[i].delta || plan->jobs[i].result != 0 || plan->jobs[i].superseded) continue;
+        if (plan->jobs[i].compress != COMPRESS_NONE) {
+            log_warning("已压缩的文件不生成差分: %s", plan->jobs[i].dst);
+            continue;
+        }
+
+        const char *output_dir = plan->outputs[plan->jobs[i].output].dir;
+        const char *rel = plan->jobs[i].dst + strlen(output_dir) + 1;
+        char *previous = previous_artifact(plan, &plan->jobs[i], date);
+        if (previous == NULL) {
+            log_info("没有更早的同名产物，跳过差分: %s", rel);
+            continue;
+        }
+
+        // 空文件和超过后缀数组内存上限的旧产物不生成差分，不算失败
+        struct stat old_st;
+        if (stat(previous, &old_st) == 0 &&
+            (old_st.st_size == 0 || plan->jobs[i].size == 0 ||
+             (unsigned long long)old_st.st_size > DELTA_MAX_OLD_SIZE)) {
+            if (old_st.st_size > 0 && plan->jobs[i].size > 0) {
+                log_info("旧产物超过 %llu MB，跳过差分: %s", DELTA_MAX_OLD_SIZE / 1048576, rel);
+            } else {
+                log_info("空文件不生成差分: %s", rel);
+            }
+            free(previous);
+            continue;
+        }
+
+        char *delta_path = NULL;
+        if (asprintf(&delta_path, "%s.delta", plan->jobs[i].dst) < 0) {
+            free(previous);
+            failures++;
+            continue;
+        }
+
+        uint64_t start = copy_now_ns();
+        long long size = delta_create(previous, plan->jobs[i].dst, delta_path, threads);
+        double seconds = (double)(copy_now_ns() - start) / 1e9;
+        unsigned long long new_size = plan->jobs[i].size;
+        if (size < 0) {
+            log_error("生成差分失败: %s -> %s", previous, plan->jobs[i].dst);
+            failures++;
+        } else if ((unsigned long long)size >= new_size) {
+            log_info("差分不小于完整文件，已删除: %s", delta_path);
+            unlink(delta_path);
+        } else {
+            CopyJob *job = &plan->jobs[i];
+            log_info("差分: %s (%.1f MB -> %.1f KB, %.1f%%, 基于 %s, 耗时 %.1f 秒)", rel,
+                     new_size / 1048576.0, size / 1024.0, new_size > 0 ? 100.0 * size / new_size : 0,
+                     previous, seconds);
+            if (copy_plan_add_result(plan, job->dst, delta_path, job->rule_id, job->output, previous) != 0) {
+                failures++;
+            }
+        }
+        free(delta_path);
+        free(previous);
+    }
+    return failures > 0 ? -1 : 0;
+}
@@ -0,0 +1,668 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "copy.h"
+#include "../utils/treecopy.h"
+
+// 机械硬盘上并发过多会导致磁头来回寻道，只用少量线程
+#define ROTATIONAL_COPY_JOBS 2
+#define MAX_COPY_JOBS 16
+
+uint64_t copy_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void copy_plan_init(CopyPlan *plan) {
+    memset(plan, 0, sizeof(*plan));
+}
+
+void copy_plan_free(CopyPlan *plan) {
+    for (size_t i = 0; i < plan->job_count; i++) {
+        free(plan->jobs[i].src);
+        free(plan->jobs[i].dst);
+        free(plan->jobs[i].delta_base);
+        free(plan->jobs[i].sync_basis);
+        free(plan->jobs[i].commit);
+    }
+    for (size_t i = 0; i < plan->dir_count; i++) {
+        free(plan->dirs[i].path);
+    }
+    for (size_t i = 0; i < plan->output_count; i++) {
+        free(plan->outputs[i].dir);
+        free(plan->outputs[i].target);
+    }
+    free(plan->jobs);
+    free(plan->dirs);
+    free(plan->outputs);
+    memset(plan, 0, sizeof(*plan));
+}
+
+int copy_plan_output(CopyPlan *plan, const char *dir, const char *target) {
+    for (size_t i = 0; i < plan->output_count; i++) {
+        if (strcmp(plan->outputs[i].dir, dir) == 0) return (int)i;
+    }
+    if (plan->output_count >= plan->output_capacity) {
+        size_t new_capacity = plan->output_capacity ? plan->output_capacity * 2 : 8;
+        CopyOutput *outputs = realloc(plan->outputs, new_capacity * sizeof(CopyOutput));
+        if (outputs == NULL) return -1;
+        plan->outputs = outputs;
+        plan->output_capacity = new_capacity;
+    }
+    CopyOutput *output = &plan->outputs[plan->output_count];
+    output->dir = strdup(dir);
+    output->target = strdup(target);
+    if (output->dir == NULL || output->target == NULL) {
+        free(output->dir);
+        free(output->target);
+        return -1;
+    }
+    return (int)plan->output_count++;
+}
+
+static int plan_add_job(CopyPlan *plan, const char *src, const char *dst, const struct stat *st) {
+    CopyCompress compress = plan->compress;
+    if (compress != COMPRESS_NONE && compress_skip(src)) compress = COMPRESS_NONE;
+
+    if (plan->job_count >= plan->job_capacity) {
+        size_t new_capacity = plan->job_capacity ? plan->job_capacity * 2 : 64;
+        CopyJob *jobs = realloc(plan->jobs, new_capacity * sizeof(CopyJob));
+        if (jobs == NULL) return -1;
+        plan->jobs = jobs;
+        plan->job_capacity = new_capacity;
+    }
+    CopyJob *job = &plan->jobs[plan->job_count];
+    job->src = strdup(src);
+    job->dst = NULL;
+    if (asprintf(&job->dst, "%s%s", dst, compress_suffix(compress)) < 0) job->dst = NULL;
+    job->st = *st;
+    job->result = -1;
+    job->rule_id = plan->rule_id;
+    job->output = plan->output;
+    job->compress = compress;
+    job->delta = plan->delta;
+    job->delta_base = NULL;
+    job->sync = plan->sync;
+    job->sync_basis = NULL;
+    job->feed = plan->feed;
+    job->superseded = false;
+    job->commit = NULL;
+    job->size = 0;
+    job->hash[0] = '\0';
+    job->expected[0] = '\0';
+    if (job->src == NULL || job->dst == NULL) {
+        free(job->src);
+        free(job->dst);
+        return -1;
+    }
+    plan->job_count++;
+    plan->total_bytes += (unsigned long long)st->st_size;
+    return 0;
+}
+
+static int plan_add_dir(CopyPlan *plan, const char *dst, const struct stat *st) {
+    if (plan->dir_count >= plan->dir_capacity) {
+        size_t new_capacity = plan->dir_capacity ? plan->dir_capacity * 2 : 16;
+        CopyDir *dirs = realloc(plan->dirs, new_capacity * sizeof(CopyDir));
+        if (dirs == NULL) return -1;
+        plan->dirs = dirs;
+        plan->dir_capacity = new_capacity;
+    }
+    CopyDir *dir = &plan->dirs[plan->dir_count];
+    dir->path = strdup(dst);
+    dir->st = *st;
+    if (dir->path == NULL) return -1;
+    plan->dir_count++;
+    return 0;
+}
+
+static char* join_path(const char *dir, const char *name) {
+    char *path = NULL;
+    if (asprintf(&path, "%s/%s", dir, name) < 0) return NULL;
+    return path;
+}
+
+static void plan_entry(CopyPlan *plan, const char *src, const char *dst, const struct stat *st);
+
+static bool strip_suffix(char *name, const char *suffix) {
+    size_t len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    if (suffix_len == 0 || len <= suffix_len || strcmp(name + len - suffix_len, suffix) != 0) return false;
+    name[len - suffix_len] = '\0';
+    return true;
+}
+
+// 目标目录中的条目是否对应源目录中仍然存在的条目：压缩后的文件带有后缀，
+// 差分文件和软件源索引是复制后生成的，按对应的源文件或目录判断
+static bool entry_in_source(const CopyPlan *plan, const char *src, const char *name) {
+    if (plan->feed && (strcmp(name, "Packages") == 0 || strcmp(name, "Packages.gz") == 0)) return true;
+
+    char *base = strdup(name);
+    if (base == NULL) return true;
+    if (plan->delta) strip_suffix(base, ".delta");
+    char *child_src = join_path(src, base);
+    struct stat st;
+    bool exists = child_src == NULL || lstat(child_src, &st) == 0;
+    free(child_src);
+    if (!exists && plan->compress != COMPRESS_NONE && strip_suffix(base, compress_suffix(plan->compress))) {
+        child_src = join_path(src, base);
+        exists = child_src == NULL || lstat(child_src, &st) == 0;
+        free(child_src);
+    }
+    free(base);
+    return exists;
+}
+
+// 增量同步保留了已有的目标目录，删除其中源目录已不存在的条目（与 treecopy 的镜像模式一致），
+// 否则删除或改名的文件会一直留在目标中，且不在校验清单里
+static void prune_directory(CopyPlan *plan, const char *src, const char *dst) {
+    DIR *dir = opendir(dst);
+    if (dir == NULL) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (entry_in_source(plan, src, entry->d_name)) continue;
+
+        char *child_dst = join_path(dst, entry->d_name);
+        if (child_dst == NULL) {
+            plan->errors++;
+            continue;
+        }
+        log_warning("源文件已不存在，删除: %s", child_dst);
+        if (remove_tree(child_dst) != 0) {
+            log_error("删除失败: %s", child_dst);
+            plan->errors++;
+        }
+        free(child_dst);
+    }
+    closedir(dir);
+}
+
+// 创建目标目录并展开源目录中的条目
+static void plan_directory(CopyPlan *plan, const char *src, const char *dst, const struct stat *st) {
+    struct stat dst_st;
+    bool existed = plan->sync && lstat(dst, &dst_st) == 0 && S_ISDIR(dst_st.st_mode);
+    if (mkdir(dst, (st->st_mode & 07777) | S_IRWXU) != 0 && errno != EEXIST) {
+        log_error("创建目录失败: %s", dst);
+        plan->errors++;
+        return;
+    }
+    if (plan_add_dir(plan, dst, st) != 0) {
+        plan->errors++;
+        return;
+    }
+
+    DIR *dir = opendir(src);
+    if (dir == NULL) {
+        log_error("无法读取目录: %s", src);
+        plan->errors++;
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char *child_src = join_path(src, entry->d_name);
+        char *child_dst = join_path(dst, entry->d_name);
+        struct stat child_st;
+        if (child_src == NULL || child_dst == NULL) {
+            plan->errors++;
+        } else if (source_excluded(plan->excludes, plan->exclude_count, child_src, strlen(src))) {
+            // 被排除的条目不复制，被排除的子目录整个跳过
+        } else if (lstat(child_src, &child_st) != 0) {
+            log_error("无法访问: %s", child_src);
+            plan->errors++;
+        } else {
+            plan_entry(plan, child_src, child_dst, &child_st);
+        }
+        free(child_src);
+        free(child_dst);
+    }
+    closedir(dir);
+
+    if (existed) prune_directory(plan, src, dst);
+}
+
+static void plan_entry(CopyPlan *plan, const char *src, const char *dst, const struct stat *st) {
+    if (S_ISDIR(st->st_mode)) {
+        plan_directory(plan, src, dst, st);
+    } else if (S_ISREG(st->st_mode)) {
+        if (plan_add_job(plan, src, dst, st) != 0) plan->errors++;
+    } else if (S_ISLNK(st->st_mode)) {
+        // 目录中的符号链接按链接本身复制，与 cp -r 一致
+        char target[PATH_MAX];
+        if (plan->sync) unlink(dst);
+        ssize_t len = readlink(src, target, sizeof(target) - 1);
+        if (len < 0 || (target[len] = '\0', symlink(target, dst) != 0)) {
+            log_error("创建符号链接失败: %s", dst);
+            plan->errors++;
+        }
+    } else {
+        log_warning("跳过特殊文件: %s", src);
+    }
+}
+
+static int plan_add(CopyPlan *plan, const char *src, const char *dst, const CopyRule *rule, int output,
+                    bool follow) {
+    int errors = plan->errors;
+    plan->rule_id = rule->id;
+    plan->output = output;
+    plan->compress = rule->compress;
+    plan->delta = rule->delta;
+    plan->sync = rule->sync;
+    plan->feed = rule->feed;
+
+    // 顶层源路径跟随符号链接，与 cp 一致；目录树中的条目不跟随
+    struct stat st;
+    if ((follow ? stat(src, &st) : lstat(src, &st)) != 0) {
+        log_error("无法访问: %s", src);
+        plan->errors++;
+        return -1;
+    }
+
+    // 目标已存在（文件或目录）时先删除，保证结果与源一致；
+    // 增量同步时同类型的目标保留下来，其中的文件作为参照；
+    // 使用内容存储时目标是指向存储对象的链接，不做增量同步，已有目标同样先删除
+    struct stat dst_st;
+    bool keep = plan->sync && plan->store == NULL && lstat(dst, &dst_st) == 0 &&
+                ((S_ISREG(st.st_mode) && S_ISREG(dst_st.st_mode)) ||
+                 (S_ISDIR(st.st_mode) && S_ISDIR(dst_st.st_mode)));
+    if (!keep && lstat(dst, &dst_st) == 0) {
+        log_warning("目标已存在，正在删除: %s", dst);
+        if (remove_tree(dst) != 0) {
+            log_error("删除已存在目标失败: %s", dst);
+            plan->errors++;
+            return -1;
+        }
+    }
+
+    // 确保目标的父目录存在
+    char *parent = strdup(dst);
+    char *slash = parent ? strrchr(parent, '/') : NULL;
+    if (slash != NULL && slash != parent) {
+        *slash = '\0';
+        if (make_dirs(parent, 0755) != 0) {
+            log_error("创建目标目录失败: %s", parent);
+            plan->errors++;
+        }
+    }
+    free(parent);
+
+    if (plan->errors == errors) {
+        plan_entry(plan, src, dst, &st);
+    }
+    return plan->errors == errors ? 0 : -1;
+}
+
+int copy_plan_add(CopyPlan *plan, const char *src, const char *dst, const CopyRule *rule, int output) {
+    return plan_add(plan, src, dst, rule, output, true);
+}
+
+int copy_plan_add_entry(CopyPlan *plan, const char *src, const char *dst, const CopyRule *rule, int output) {
+    return plan_add(plan, src, dst, rule, output, false);
+}
+
+int copy_plan_add_dir(CopyPlan *plan, const char *src, const char *dst) {
+    struct stat st;
+    if (stat(src, &st) != 0) {
+        log_error("无法访问: %s", src);
+        plan->errors++;
+        return -1;
+    }
+    if (make_dirs(dst, 0755) != 0 || chmod(dst, (st.st_mode & 07777) | S_IRWXU) != 0) {
+        log_error("创建目录失败: %s", dst);
+        plan->errors++;
+        return -1;
+    }
+    if (plan_add_dir(plan, dst, &st) != 0) {
+        plan->errors++;
+        return -1;
+    }
+    return 0;
+}
+
+char* copy_output_dir(const CopyRule *rule, const char *date, const char *marker) {
+    char *dir = NULL;
+    if (asprintf(&dir, "%s/%s%s%s", rule->target, date, marker && marker[0] != '\0' ? "/" : "",
+                 marker ? marker : "") < 0) {
+        return NULL;
+    }
+    size_t len = strlen(dir);
+    while (len > 1 && dir[len - 1] == '/') dir[--len] = '\0';
+    return dir;
+}
+
+int copy_plan_add_result(CopyPlan *plan, const char *src, const char *dst, int rule_id, int output,
+                         const char *delta_base) {
+    struct stat st;
+    char hash[SHA256_HEX_SIZE];
+    if (stat(dst, &st) != 0 || sha256_file_hex(dst, hash) != 0) {
+        log_error("无法读取: %s", dst);
+        return -1;
+    }
+
+    plan->rule_id = rule_id;
+    plan->output = output;
+    plan->compress = COMPRESS_NONE;
+    plan->delta = false;
+    plan->sync = false;
+    plan->feed = false;
+    if (plan_add_job(plan, src, dst, &st) != 0) return -1;
+    plan->total_bytes -= (unsigned long long)st.st_size;
+
+    CopyJob *job = &plan->jobs[plan->job_count - 1];
+    job->result = 0;
+    job->size = (unsigned long long)st.st_size;
+    memcpy(job->hash, hash, SHA256_HEX_SIZE);
+    job->delta_base = delta_base != NULL ? strdup(delta_base) : NULL;
+    return 0;
+}
+
+// 读取块设备的 rotational 属性；分区需要查看所属磁盘的队列属性
+static int device_rotational(dev_t dev) {
+    char path[PATH_MAX];
+    const char *formats[] = {
+        "/sys/dev/block/%u:%u/queue/rotational",
+        "/sys/dev/block/%u:%u/../queue/rotational"
+    };
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        snprintf(path, sizeof(path), formats[i], major(dev), minor(dev));
+        FILE *file = fopen(path, "r");
+        if (file == NULL) continue;
+        int value = -1;
+        if (fscanf(file, "%d", &value) != 1) value = -1;
+        fclose(file);
+        return value;
+    }
+    return -1;
+}
+
+static int path_copy_jobs(const char *path, long cpus) {
+    // 目标可能尚未创建，向上查找已存在的目录
+    char *probe = strdup(path);
+    struct stat st;
+    int rotational = -1;
+    while (probe != NULL) {
+        if (stat(probe, &st) == 0) {
+            rotational = device_rotational(st.st_dev);
+            break;
+        }
+        char *slash = strrchr(probe, '/');
+        if (slash == NULL) {
+            if (stat(".", &st) == 0) rotational = device_rotational(st.st_dev);
+            break;
+        }
+        if (slash == probe) {
+            probe[1] = '\0';
+        } else {
+            *slash = '\0';
+        }
+    }
+    free(probe);
+
+    if (rotational == 1) return ROTATIONAL_COPY_JOBS;
+
+    // 固态硬盘、内存文件系统等：I/O 队列较深，线程数可以多于 CPU 数
+    long jobs = cpus * 2;
+    if (jobs < 2) jobs = 2;
+    if (jobs > MAX_COPY_JOBS) jobs = MAX_COPY_JOBS;
+    return (int)jobs;
+}
+
+int default_copy_jobs(const char *const *paths, size_t count) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    if (count == 0) return path_copy_jobs(".", cpus);
+
+    // 按最慢的目标设备决定，机械硬盘上的目标不会因其他规则的目标是固态硬盘而线程过多
+    int jobs = MAX_COPY_JOBS;
+    for (size_t i = 0; i < count; i++) {
+        int path_jobs = path_copy_jobs(paths[i], cpus);
+        if (path_jobs < jobs) jobs = path_jobs;
+    }
+    return jobs;
+}
+
+// 线程池共享状态
+typedef struct {
+    CopyPlan *plan;
+    size_t next;
+    int threads;            // 线程池的线程数，也是大文件并行压缩的线程数
+    CopyTotals *totals;
+    pthread_mutex_t lock;
+    // 进度：字节数在复制过程中原子累加，文件数在任务完成时累加
+    unsigned long long bytes_done;
+    size_t files_done;
+    bool finished;
+    pthread_cond_t finished_cond;
+} CopyQueue;
+
+// 大文件的压缩在线程池结束后逐个进行，每个文件使用全部线程按块并行压缩
+static bool deferred_job(const CopyQueue *queue, const CopyJob *job) {
+    return job->compress != COMPRESS_NONE && queue->threads > 1 &&
+           job->st.st_size > COMPRESS_BLOCK_SIZE;
+}
+
+static void run_job(CopyQueue *queue, CopyJob *job, int threads) {
+    unsigned long long bytes = 0;
+    unsigned long long compressed = 0;
+    StoreStats store = {0};
+    SyncStats sync = {0};
+    bool synced = false;
+    char source_hash[SHA256_HEX_SIZE] = "";
+
+    if (job->compress != COMPRESS_NONE) {
+        job->result = compress_file(job, threads, source_hash, job->hash, &bytes, &compressed,
+                                    &queue->bytes_done);
+        job->size = compressed;
+        // 压缩后的文件同样存入内容存储，各日期目录共享同一对象
+        if (job->result == 0 && queue->plan->store != NULL) {
+            job->result = store_adopt_job(queue->plan->store, job, &store);
+        }
+    } else {
+        if (job->sync_basis != NULL && queue->plan->store == NULL) {
+            job->result = sync_file(job, &sync, &queue->bytes_done);
+            bytes = (unsigned long long)job->st.st_size;
+            synced = true;
+        } else if (queue->plan->store != NULL) {
+            job->result = store_copy_job(queue->plan->store, job, &store, &queue->bytes_done);
+            bytes = job->size;
+        } else {
+            job->result = copy_file_data_hash(job->src, job->dst, &job->st, &bytes, job->hash,
+                                              &queue->bytes_done);
+        }
+        memcpy(source_hash, job->hash, SHA256_HEX_SIZE);
+        job->size = bytes;
+    }
+
+    // 在后续调用改写 errno 之前取得失败原因
+    int error = job->result != 0 ? errno : 0;
+    bool verified = false;
+    if (job->result != 0) {
+        log_error("复制失败: %s -> %s (%s)", job->src, job->dst, strerror(error));
+    } else if (job->expected[0] != '\0') {
+        verified = strcmp(source_hash, job->expected) == 0;
+        if (!verified) {
+            log_error("校验失败: %s (sha256sums: %s, 实际: %s)", job->src, job->expected, source_hash);
+            // 内容与 sha256sums 不符的文件不留在输出目录中
+            unlink(job->dst);
+            job->result = -1;
+        }
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    queue->files_done++;
+    if (job->result == 0) {
+        StoreStats *total = &queue->totals->store;
+        queue->totals->files_copied++;
+        queue->totals->bytes_copied += bytes;
+        if (verified) queue->totals->files_verified++;
+        if (synced) {
+            queue->totals->files_synced++;
+            queue->totals->sync_written += sync.written;
+            queue->totals->sync_reused += sync.reused;
+        }
+        if (job->compress != COMPRESS_NONE) {
+            queue->totals->files_compressed++;
+            queue->totals->compress_in += bytes;
+            queue->totals->compress_out += compressed;
+        }
+        total->files_stored += store.files_stored;
+        total->files_deduped += store.files_deduped;
+        total->files_hardlinked += store.files_hardlinked;
+        total->files_reflinked += store.files_reflinked;
+        total->files_copied += store.files_copied;
+        total->bytes_stored += store.bytes_stored;
+        total->bytes_deduped += store.bytes_deduped;
+    } else {
+        queue->totals->files_failed++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static CopyProgress progress_snapshot(CopyQueue *queue, uint64_t start) {
+    CopyProgress progress;
+    progress.total_files = queue->plan->job_count;
+    progress.total_bytes = queue->plan->total_bytes;
+    progress.bytes_done = __atomic_load_n(&queue->bytes_done, __ATOMIC_RELAXED);
+    progress.files_done = queue->files_done;
+    progress.elapsed_ns = copy_now_ns() - start;
+    return progress;
+}
+
+// 进度线程：按固定间隔取快照调用回调，刷新频率与文件数量无关
+static void* progress_reporter(void *arg) {
+    CopyQueue *queue = arg;
+    uint64_t start = copy_now_ns();
+    unsigned interval = queue->plan->progress_interval_ms ? queue->plan->progress_interval_ms : 200;
+
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->finished) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += interval / 1000;
+        deadline.tv_nsec += (long)(interval % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&queue->finished_cond, &queue->lock, &deadline);
+        if (queue->finished) break;
+
+        CopyProgress progress = progress_snapshot(queue, start);
+        pthread_mutex_unlock(&queue->lock);
+        queue->plan->progress(&progress, false);
+        pthread_mutex_lock(&queue->lock);
+    }
+    CopyProgress progress = progress_snapshot(queue, start);
+    pthread_mutex_unlock(&queue->lock);
+    queue->plan->progress(&progress, true);
+    return NULL;
+}
+
+static void* copy_worker(void *arg) {
+    CopyQueue *queue = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        size_t index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (index >= queue->plan->job_count) break;
+
+        CopyJob *job = &queue->plan->jobs[index];
+        if (!deferred_job(queue, job)) run_job(queue, job, 1);
+    }
+    return NULL;
+}
+
+void copy_plan_run(CopyPlan *plan, int jobs, CopyTotals *totals) {
+    copy_plan_run_from(plan, 0, jobs, totals);
+}
+
+void copy_plan_run_from(CopyPlan *plan, size_t first, int jobs, CopyTotals *totals) {
+    uint64_t start = copy_now_ns();
+    memset(totals, 0, sizeof(*totals));
+
+    if (jobs < 1) jobs = 1;
+    CopyQueue queue = { .plan = plan, .next = first, .threads = jobs, .totals = totals };
+    size_t pending = plan->job_count > first ? plan->job_count - first : 0;
+    if ((size_t)jobs > pending) jobs = pending > 0 ? (int)pending : 1;
+
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.finished_cond, NULL);
+    pthread_t reporter;
+    bool reporting = plan->progress != NULL &&
+                     pthread_create(&reporter, NULL, progress_reporter, &queue) == 0;
+
+    pthread_t *threads = jobs > 1 ? malloc(jobs * sizeof(pthread_t)) : NULL;
+    int started = 0;
+    for (int i = 0; threads != NULL && i < jobs; i++) {
+        if (pthread_create(&threads[i], NULL, copy_worker, &queue) != 0) break;
+        started++;
+    }
+    // 单线程或线程创建失败时由当前线程完成剩余任务
+    if (started == 0) copy_worker(&queue);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    for (size_t i = first; i < plan->job_count; i++) {
+        if (deferred_job(&queue, &plan->jobs[i])) run_job(&queue, &plan->jobs[i], queue.threads);
+    }
+
+    if (reporting) {
+        pthread_mutex_lock(&queue.lock);
+        queue.finished = true;
+        pthread_cond_signal(&queue.finished_cond);
+        pthread_mutex_unlock(&queue.lock);
+        pthread_join(reporter, NULL);
+    }
+    pthread_cond_destroy(&queue.finished_cond);
+    pthread_mutex_destroy(&queue.lock);
+
+    // 目录中的文件写完后再恢复目录的权限和时间戳（子目录先于父目录）
+    for (size_t i = plan->dir_count; i > 0; i--) {
+        const CopyDir *dir = &plan->dirs[i - 1];
+        struct timespec times[2] = { dir->st.st_atim, dir->st.st_mtim };
+        chmod(dir->path, dir->st.st_mode & 07777);
+        utimensat(AT_FDCWD, dir->path, times, 0);
+    }
+
+    totals->elapsed_ns = copy_now_ns() - start;
+}
+
+void copy_totals_add(CopyTotals *total, const CopyTotals *batch) {
+    total->files_copied += batch->files_copied;
+    total->files_failed += batch->files_failed;
+    total->files_verified += batch->files_verified;
+    total->files_compressed += batch->files_compressed;
+    total->bytes_copied += batch->bytes_copied;
+    total->compress_in += batch->compress_in;
+    total->compress_out += batch->compress_out;
+    total->files_synced += batch->files_synced;
+    total->sync_written += batch->sync_written;
+    total->sync_reused += batch->sync_reused;
+    total->elapsed_ns += batch->elapsed_ns;
+    total->store.files_stored += batch->store.files_stored;
+    total->store.files_deduped += batch->store.files_deduped;
+    total->store.files_hardlinked += batch->store.files_hardlinked;
+    total->store.files_reflinked += batch->store.files_reflinked;
+    total->store.files_copied += batch->store.files_copied;
+    total->store.bytes_stored += batch->store.bytes_stored;
+    total->store.bytes_deduped += batch->store.bytes_deduped;
+}
@@ -0,0 +1,653 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "copy.h"
+
+#define FEED_INDEX "Packages"
+#define FEED_CACHE_FILE ".feed-cache"
+#define FEED_CACHE_HEADER "# copy feed cache v1\n"
+#define TAR_BLOCK 512
+// 控制信息只有几 KB，超过上限的视为损坏的软件包
+#define CONTROL_ARCHIVE_MAX (1024 * 1024)
+#define CONTROL_TAR_MAX (4 * 1024 * 1024)
+
+// 一个软件包的控制信息，按 ipk 的摘要缓存
+typedef struct {
+    char hash[SHA256_HEX_SIZE];
+    char date[11];          // 最后一次使用的日期
+    char *control;
+} FeedCacheEntry;
+
+// 目标目录下的控制信息缓存
+typedef struct {
+    char *target;
+    FeedCacheEntry *entries;
+    size_t count;
+    size_t capacity;
+    size_t sorted;          // 前 sorted 个条目按摘要排序，可以二分查找
+} FeedCache;
+
+typedef struct {
+    size_t job;             // 在 plan->jobs 中的下标（计划会追加任务，不保存指针）
+    size_t cache;           // 所属缓存的下标
+    const char *control;
+    char *parsed;           // 本次解包读取的控制信息
+} FeedItem;
+
+typedef struct {
+    const CopyPlan *plan;
+    FeedItem **pending;
+    size_t count;
+    size_t next;
+} ParseQueue;
+
+// 依次读取 tar 流的回调：buf 为 NULL 时跳过 len 字节，读满返回 0
+typedef struct {
+    int (*read)(void *ctx, void *buf, size_t len);
+    void *ctx;
+} TarReader;
+
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+} MemReader;
+
+static int mem_read(void *ctx, void *buf, size_t len) {
+    MemReader *reader = ctx;
+    if (reader->size - reader->pos < len) return -1;
+    if (buf != NULL) memcpy(buf, reader->data + reader->pos, len);
+    reader->pos += len;
+    return 0;
+}
+
+// gzread 可以读取不压缩的文件，普通 tar 格式的外层也能处理
+static int gz_read(void *ctx, void *buf, size_t len) {
+    gzFile gz = ctx;
+    unsigned char scratch[64 * 1024];
+    while (len > 0) {
+        unsigned chunk = len > sizeof(scratch) ? sizeof(scratch) : (unsigned)len;
+        int n = gzread(gz, buf != NULL ? buf : scratch, chunk);
+        if (n <= 0) return -1;
+        if (buf != NULL) buf = (unsigned char *)buf + n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static unsigned long long tar_number(const unsigned char *field, size_t len) {
+    // GNU 扩展：最高位置 1 时为 base-256 编码
+    unsigned long long value = 0;
+    if (field[0] & 0x80) {
+        for (size_t i = 1; i < len; i++) value = (value << 8) | field[i];
+        return value;
+    }
+    for (size_t i = 0; i < len && field[i] != '\0' && field[i] != ' '; i++) {
+        if (field[i] < '0' || field[i] > '7') break;
+        value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+// 条目名忽略开头的 ./
+static bool tar_name_is(const char *entry, const char *name) {
+    while (entry[0] == '.' && entry[1] == '/') entry += 2;
+    return strcmp(entry, name) == 0;
+}
+
+// 在 tar 流中查找普通文件 name，读出其内容（以 \0 结尾）
+static int tar_extract(const TarReader *reader, const char *name, size_t max_size,
+                       unsigned char **data, size_t *size) {
+    unsigned char block[TAR_BLOCK];
+    char long_name[PATH_MAX] = "";
+
+    while (reader->read(reader->ctx, block, TAR_BLOCK) == 0) {
+        bool empty = true;
+        for (size_t i = 0; i < TAR_BLOCK && empty; i++) empty = block[i] == 0;
+        if (empty) break;
+
+        char entry[PATH_MAX];
+        if (long_name[0] != '\0') {
+            snprintf(entry, sizeof(entry), "%s", long_name);
+            long_name[0] = '\0';
+        } else if (memcmp(block + 257, "ustar", 5) == 0 && block[345] != '\0') {
+            snprintf(entry, sizeof(entry), "%.155s/%.100s", (const char *)block + 345, (const char *)block);
+        } else {
+            snprintf(entry, sizeof(entry), "%.100s", (const char *)block);
+        }
+        unsigned long long length = tar_number(block + 124, 12);
+        unsigned long long padded = (length + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+        char type = (char)block[156];
+
+        if (type == 'L' && length < sizeof(long_name)) {
+            if (reader->read(reader->ctx, long_name, padded) != 0) return -1;
+            long_name[length] = '\0';
+            continue;
+        }
+        if ((type == '0' || type == '\0') && tar_name_is(entry, name)) {
+            if (length > max_size) return -1;
+            *data = malloc(length + 1);
+            if (*data == NULL) return -1;
+            if (reader->read(reader->ctx, *data, length) != 0) {
+                free(*data);
+                *data = NULL;
+                return -1;
+            }
+            (*data)[length] = '\0';
+            *size = length;
+            return 0;
+        }
+        if (reader->read(reader->ctx, NULL, padded) != 0) return -1;
+    }
+    return -1;
+}
+
+// 旧格式的 ipk 是 ar 归档
+static int ar_extract(FILE *fp, const char *name, size_t max_size, unsigned char **data, size_t *size) {
+    char header[60];
+    while (fread(header, 1, sizeof(header), fp) == sizeof(header)) {
+        char entry[17];
+        memcpy(entry, header, 16);
+        entry[16] = '\0';
+        for (int i = 15; i >= 0 && (entry[i] == ' ' || entry[i] == '/'); i--) entry[i] = '\0';
+        char size_field[11];
+        memcpy(size_field, header + 48, 10);
+        size_field[10] = '\0';
+        unsigned long long length = strtoull(size_field, NULL, 10);
+
+        if (tar_name_is(entry, name)) {
+            if (length > max_size) return -1;
+            *data = malloc(length + 1);
+            if (*data == NULL) return -1;
+            if (fread(*data, 1, length, fp) != length) {
+                free(*data);
+                *data = NULL;
+                return -1;
+            }
+            (*data)[length] = '\0';
+            *size = length;
+            return 0;
+        }
+        if (fseeko(fp, (off_t)(length + (length & 1)), SEEK_CUR) != 0) return -1;
+    }
+    return -1;
+}
+
+static int gunzip_buffer(const unsigned char *in, size_t in_size, size_t max_size,
+                         unsigned char **out, size_t *out_size) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) return -1;
+
+    size_t capacity = in_size * 4 + 4096;
+    unsigned char *buffer = NULL;
+    size_t used = 0;
+    int status = Z_OK;
+    stream.next_in = (unsigned char *)in;
+    stream.avail_in = (uInt)in_size;
+    while (status == Z_OK) {
+        if (buffer == NULL || used == capacity) {
+            if (buffer != NULL) capacity *= 2;
+            if (capacity > max_size) capacity = max_size;
+            if (buffer != NULL && used == capacity) break;
+            unsigned char *grown = realloc(buffer, capacity);
+            if (grown == NULL) break;
+            buffer = grown;
+        }
+        stream.next_out = buffer + used;
+        stream.avail_out = (uInt)(capacity - used);
+        status = inflate(&stream, Z_NO_FLUSH);
+        used = capacity - stream.avail_out;
+    }
+    inflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        free(buffer);
+        return -1;
+    }
+    *out = buffer;
+    *out_size = used;
+    return 0;
+}
+
+// ipk 的外层是 tar.gz（旧格式为 ar），其中 control.tar.gz 里的 ./control 是控制信息
+static char* ipk_read_control(const char *path) {
+    unsigned char *archive = NULL;
+    size_t archive_size = 0;
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) return NULL;
+    char magic[8];
+    bool ar = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, "!<arch>\n", 8) == 0;
+    int result;
+    if (ar) {
+        result = ar_extract(fp, "control.tar.gz", CONTROL_ARCHIVE_MAX, &archive, &archive_size);
+        fclose(fp);
+    } else {
+        fclose(fp);
+        gzFile gz = gzopen(path, "rb");
+        if (gz == NULL) return NULL;
+        gzbuffer(gz, 128 * 1024);
+        TarReader reader = { gz_read, gz };
+        result = tar_extract(&reader, "control.tar.gz", CONTROL_ARCHIVE_MAX, &archive, &archive_size);
+        gzclose(gz);
+    }
+    if (result != 0) return NULL;
+
+    unsigned char *tar = NULL;
+    size_t tar_size = 0;
+    result = gunzip_buffer(archive, archive_size, CONTROL_TAR_MAX, &tar, &tar_size);
+    free(archive);
+    if (result != 0) return NULL;
+
+    MemReader mem = { tar, tar_size, 0 };
+    TarReader reader = { mem_read, &mem };
+    unsigned char *control = NULL;
+    size_t control_size = 0;
+    result = tar_extract(&reader, "control", CONTROL_TAR_MAX, &control, &control_size);
+    free(tar);
+    return result == 0 ? (char *)control : NULL;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const FeedCacheEntry *entry_a = a;
+    const FeedCacheEntry *entry_b = b;
+    return strcmp(entry_a->hash, entry_b->hash);
+}
+
+static FeedCacheEntry* cache_find(FeedCache *cache, const char *hash) {
+    FeedCacheEntry key;
+    memcpy(key.hash, hash, SHA256_HEX_SIZE);
+    return cache->sorted > 0 ? bsearch(&key, cache->entries, cache->sorted, sizeof(FeedCacheEntry),
+                                       compare_entries) : NULL;
+}
+
+static FeedCacheEntry* cache_add(FeedCache *cache, const char *hash, const char *date, char *control) {
+    if (cache->count >= cache->capacity) {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 256;
+        FeedCacheEntry *entries = realloc(cache->entries, capacity * sizeof(FeedCacheEntry));
+        if (entries == NULL) return NULL;
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+    FeedCacheEntry *entry = &cache->entries[cache->count++];
+    memcpy(entry->hash, hash, SHA256_HEX_SIZE);
+    snprintf(entry->date, sizeof(entry->date), "%s", date);
+    entry->control = control;
+    return entry;
+}
+
+static char* cache_path(const FeedCache *cache) {
+    char *path = NULL;
+    if (asprintf(&path, "%s/%s", cache->target, FEED_CACHE_FILE) < 0) return NULL;
+    return path;
+}
+
+// 缓存格式：每条为 "<摘要> <日期> <长度>\n" 加控制信息和一个换行；损坏的缓存从头重建
+static void cache_load(FeedCache *cache) {
+    char *path = cache_path(cache);
+    FILE *fp = path != NULL ? fopen(path, "r") : NULL;
+    free(path);
+    if (fp == NULL) return;
+
+    char line[256];
+    bool valid = fgets(line, sizeof(line), fp) != NULL && strcmp(line, FEED_CACHE_HEADER) == 0;
+    while (valid && fgets(line, sizeof(line), fp) != NULL) {
+        char hash[SHA256_HEX_SIZE];
+        char date[11];
+        size_t length;
+        if (sscanf(line, "%64s %10s %zu", hash, date, &length) != 3 || strlen(hash) != SHA256_HEX_SIZE - 1 ||
+            length > CONTROL_TAR_MAX) {
+            valid = false;
+            break;
+        }
+        char *control = malloc(length + 1);
+        if (control == NULL || fread(control, 1, length, fp) != length || fgetc(fp) != '\n') {
+            free(control);
+            valid = false;
+            break;
+        }
+        control[length] = '\0';
+        if (cache_add(cache, hash, date, control) == NULL) {
+            free(control);
+            break;
+        }
+    }
+    fclose(fp);
+
+    if (!valid) {
+        log_warning("软件源缓存已损坏，重新读取所有软件包: %s/%s", cache->target, FEED_CACHE_FILE);
+        for (size_t i = 0; i < cache->count; i++) free(cache->entries[i].control);
+        cache->count = 0;
+    }
+    if (cache->count > 1) qsort(cache->entries, cache->count, sizeof(FeedCacheEntry), compare_entries);
+    cache->sorted = cache->count;
+}
+
+// 最早的日期目录之前就不再使用的条目对应的产物已被清理，写回时丢弃
+static void cache_save(FeedCache *cache) {
+    char oldest[11] = "";
+    DIR *dir = opendir(cache->target);
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (gc_is_date_name(entry->d_name) && (oldest[0] == '\0' || strcmp(entry->d_name, oldest) < 0)) {
+                // gc_is_date_name 保证名字正好是 10 个字符
+                memcpy(oldest, entry->d_name, sizeof(oldest));
+            }
+        }
+        closedir(dir);
+    }
+    if (cache->count > 1) qsort(cache->entries, cache->count, sizeof(FeedCacheEntry), compare_entries);
+
+    char *path = cache_path(cache);
+    char *tmp = NULL;
+    if (path == NULL || asprintf(&tmp, "%s.tmp", path) < 0) {
+        free(path);
+        return;
+    }
+    FILE *fp = fopen(tmp, "w");
+    bool ok = fp != NULL && fputs(FEED_CACHE_HEADER, fp) >= 0;
+    for (size_t i = 0; ok && i < cache->count; i++) {
+        const FeedCacheEntry *entry = &cache->entries[i];
+        if (i > 0 && strcmp(entry->hash, cache->entries[i - 1].hash) == 0) continue;
+        if (oldest[0] != '\0' && strcmp(entry->date, oldest) < 0) continue;
+        size_t length = strlen(entry->control);
+        ok = fprintf(fp, "%s %s %zu\n", entry->hash, entry->date, length) > 0 &&
+             fwrite(entry->control, 1, length, fp) == length && fputc('\n', fp) != EOF;
+    }
+    if (fp != NULL && fclose(fp) != 0) ok = false;
+    if (!ok || rename(tmp, path) != 0) {
+        log_warning("写入软件源缓存失败: %s", path);
+        unlink(tmp);
+    }
+    free(tmp);
+    free(path);
+}
+
+static void* parse_worker(void *arg) {
+    ParseQueue *queue = arg;
+    for (;;) {
+        size_t index = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (index >= queue->count) break;
+        FeedItem *item = queue->pending[index];
+        item->parsed = ipk_read_control(queue->plan->jobs[item->job].dst);
+    }
+    return NULL;
+}
+
+static void parse_pending(ParseQueue *queue, int threads) {
+    if ((size_t)threads > queue->count) threads = (int)queue->count;
+    pthread_t *workers = threads > 1 ? malloc(threads * sizeof(pthread_t)) : NULL;
+    int started = 0;
+    for (int i = 0; workers != NULL && i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, parse_worker, queue) != 0) break;
+        started++;
+    }
+    if (started == 0) parse_worker(queue);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+}
+
+static const char* base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static const CopyPlan *sort_plan;
+
+// 按所在目录分组，目录内按文件名排序
+static int compare_items(const void *a, const void *b) {
+    const char *path_a = sort_plan->jobs[((const FeedItem *)a)->job].dst;
+    const char *path_b = sort_plan->jobs[((const FeedItem *)b)->job].dst;
+    size_t dir_a = base_name(path_a) - path_a;
+    size_t dir_b = base_name(path_b) - path_b;
+    int result = strncmp(path_a, path_b, dir_a < dir_b ? dir_a : dir_b);
+    if (result != 0) return result;
+    if (dir_a != dir_b) return dir_a < dir_b ? -1 : 1;
+    return strcmp(path_a + dir_a, path_b + dir_b);
+}
+
+// 与 OpenWrt 的 ipkg-make-index.sh 相同：Filename、Size、SHA256sum 插在 Description 之前
+static void write_entry(FILE *fp, const char *control, const CopyJob *job) {
+    size_t length = strlen(control);
+    while (length > 0 && (control[length - 1] == '\n' || control[length - 1] == '\r' ||
+                          control[length - 1] == ' ')) {
+        length--;
+    }
+    const char *description = strncmp(control, "Description:", 12) == 0 ? control : NULL;
+    if (description == NULL) {
+        description = strstr(control, "\nDescription:");
+        if (description != NULL) description++;
+    }
+    if (description == NULL || description >= control + length) description = control + length;
+
+    fwrite(control, 1, description - control, fp);
+    if (description == control + length && length > 0) fputc('\n', fp);
+    fprintf(fp, "Filename: %s\nSize: %llu\nSHA256sum: %s\n", base_name(job->dst), job->size, job->hash);
+    if (description < control + length) {
+        fwrite(description, 1, control + length - description, fp);
+        fputc('\n', fp);
+    }
+    fputc('\n', fp);
+}
+
+static int write_file(const char *path, const char *data, size_t size, bool compress) {
+    char *tmp = NULL;
+    if (asprintf(&tmp, "%s.tmp", path) < 0) return -1;
+    bool ok;
+    if (compress) {
+        gzFile gz = gzopen(tmp, "wb9");
+        ok = gz != NULL && (size == 0 || gzwrite(gz, data, (unsigned)size) == (int)size);
+        if (gz != NULL && gzclose(gz) != Z_OK) ok = false;
+    } else {
+        FILE *fp = fopen(tmp, "w");
+        ok = fp != NULL && fwrite(data, 1, size, fp) == size;
+        if (fp != NULL && fclose(fp) != 0) ok = false;
+    }
+    // 设备可能正在下载索引，写完后原子替换
+    if (!ok || rename(tmp, path) != 0) {
+        log_error("写入失败: %s", path);
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+    return 0;
+}
+
+// 源目录中复制过来的旧索引和签名与新的软件包列表不一致，由新生成的索引取代
+static void supersede_index(CopyPlan *plan, const char *dir, size_t dir_len) {
+    for (size_t i = 0; i < plan->job_count; i++) {
+        CopyJob *job = &plan->jobs[i];
+        if (!job->feed || job->superseded || strncmp(job->dst, dir, dir_len) != 0 ||
+            strchr(job->dst + dir_len, '/') != NULL) {
+            continue;
+        }
+        const char *name = job->dst + dir_len;
+        if (strcmp(name, FEED_INDEX) == 0 || strcmp(name, FEED_INDEX ".gz") == 0) {
+            job->superseded = true;
+        } else if (strcmp(name, FEED_INDEX ".sig") == 0) {
+            log_warning("签名与新生成的索引不符，已删除: %s", job->dst);
+            job->superseded = true;
+            unlink(job->dst);
+        }
+    }
+}
+
+// 为同一目录中的软件包写入 Packages 和 Packages.gz，并登记到计划中
+static int write_index(CopyPlan *plan, const FeedItem *items, size_t count) {
+    const CopyJob *first = &plan->jobs[items[0].job];
+    size_t dir_len = base_name(first->dst) - first->dst;
+    char *dir = strndup(first->dst, dir_len);
+    int rule_id = first->rule_id;
+    int output = first->output;
+    char *buffer = NULL;
+    size_t size = 0;
+    FILE *fp = dir != NULL ? open_memstream(&buffer, &size) : NULL;
+    if (fp == NULL) {
+        free(dir);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        write_entry(fp, items[i].control, &plan->jobs[items[i].job]);
+    }
+    fclose(fp);
+
+    supersede_index(plan, dir, dir_len);
+    char *index = NULL;
+    char *index_gz = NULL;
+    int result = -1;
+    if (asprintf(&index, "%s%s", dir, FEED_INDEX) >= 0 && asprintf(&index_gz, "%s%s.gz", dir, FEED_INDEX) >= 0 &&
+        write_file(index, buffer, size, false) == 0 && write_file(index_gz, buffer, size, true) == 0 &&
+        copy_plan_add_result(plan, index, index, rule_id, output, NULL) == 0 &&
+        copy_plan_add_result(plan, index_gz, index_gz, rule_id, output, NULL) == 0) {
+        result = 0;
+    }
+    free(index);
+    free(index_gz);
+    free(buffer);
+    free(dir);
+    return result;
+}
+
+// 与 ipkg-make-index.sh 相同，kernel 和 libc 不编入索引
+static bool feed_package(const CopyJob *job) {
+    const char *name = base_name(job->dst);
+    size_t len = strlen(name);
+    if (len < 4 || strcmp(name + len - 4, ".ipk") != 0) return false;
+    return strncmp(name, "kernel_", 7) != 0 && strncmp(name, "libc_", 5) != 0;
+}
+
+int feed_generate(CopyPlan *plan, const char *date, int threads) {
+    size_t count = 0;
+    for (size_t i = 0; i < plan->job_count; i++) {
+        const CopyJob *job = &plan->jobs[i];
+        if (job->feed && job->result == 0 && !job->superseded && feed_package(job)) count++;
+    }
+    if (count == 0) return 0;
+
+    uint64_t start = copy_now_ns();
+    FeedItem *items = calloc(count, sizeof(FeedItem));
+    FeedItem **pending = calloc(count, sizeof(FeedItem*));
+    FeedCache *caches = NULL;
+    size_t cache_count = 0;
+    int failures = 0;
+    if (items == NULL || pending == NULL) {
+        free(items);
+        free(pending);
+        return -1;
+    }
+
+    // 每个目标目录一份缓存；已缓存的软件包直接使用缓存的控制信息
+    size_t item_count = 0;
+    size_t pending_count = 0;
+    for (size_t i = 0; i < plan->job_count; i++) {
+        const CopyJob *job = &plan->jobs[i];
+        if (!job->feed || job->result != 0 || job->superseded || !feed_package(job)) continue;
+
+        const char *target = plan->outputs[job->output].target;
+        FeedCache *cache = NULL;
+        size_t cache_index = 0;
+        for (size_t j = 0; j < cache_count && cache == NULL; j++) {
+            if (strcmp(caches[j].target, target) == 0) {
+                cache = &caches[j];
+                cache_index = j;
+            }
+        }
+        if (cache == NULL) {
+            FeedCache *grown = realloc(caches, (cache_count + 1) * sizeof(FeedCache));
+            char *owned = grown != NULL ? strdup(target) : NULL;
+            if (grown != NULL) caches = grown;
+            if (owned == NULL) {
+                failures++;
+                continue;
+            }
+            cache_index = cache_count++;
+            cache = &caches[cache_index];
+            memset(cache, 0, sizeof(*cache));
+            cache->target = owned;
+            cache_load(cache);
+        }
+
+        FeedItem *item = &items[item_count++];
+        item->job = i;
+        item->cache = cache_index;
+        FeedCacheEntry *entry = cache_find(cache, job->hash);
+        if (entry != NULL) {
+            item->control = entry->control;
+            snprintf(entry->date, sizeof(entry->date), "%s", date);
+        } else {
+            pending[pending_count++] = item;
+        }
+    }
+
+    // 只有缓存中没有的软件包需要解包，多个线程并行读取
+    ParseQueue queue = { plan, pending, pending_count, 0 };
+    if (pending_count > 0) parse_pending(&queue, threads);
+    size_t parsed = 0;
+    for (size_t i = 0; i < pending_count; i++) {
+        FeedItem *item = pending[i];
+        const CopyJob *job = &plan->jobs[item->job];
+        if (item->parsed == NULL) {
+            log_error("读取软件包控制信息失败: %s", job->src);
+            failures++;
+            continue;
+        }
+        FeedCacheEntry *entry = cache_add(&caches[item->cache], job->hash, date, item->parsed);
+        if (entry == NULL) {
+            free(item->parsed);
+            item->parsed = NULL;
+            failures++;
+            continue;
+        }
+        item->control = entry->control;
+        parsed++;
+    }
+
+    // 去掉读取失败的软件包后按目录分组写索引
+    size_t kept = 0;
+    for (size_t i = 0; i < item_count; i++) {
+        if (items[i].control != NULL) items[kept++] = items[i];
+    }
+    sort_plan = plan;
+    if (kept > 1) qsort(items, kept, sizeof(FeedItem), compare_items);
+    size_t indexes = 0;
+    for (size_t i = 0; i < kept;) {
+        const char *dst = plan->jobs[items[i].job].dst;
+        size_t dir_len = base_name(dst) - dst;
+        size_t end = i + 1;
+        while (end < kept) {
+            const char *other = plan->jobs[items[end].job].dst;
+            if ((size_t)(base_name(other) - other) != dir_len || strncmp(dst, other, dir_len) != 0) break;
+            end++;
+        }
+        if (write_index(plan, items + i, end - i) != 0) {
+            failures++;
+        } else {
+            log_info("软件源索引: %.*s%s (%zu 个软件包)", (int)dir_len, plan->jobs[items[i].job].dst,
+                     FEED_INDEX, end - i);
+            indexes++;
+        }
+        i = end;
+    }
+
+    for (size_t i = 0; i < cache_count; i++) {
+        cache_save(&caches[i]);
+        for (size_t j = 0; j < caches[i].count; j++) free(caches[i].entries[j].control);
+        free(caches[i].entries);
+        free(caches[i].target);
+    }
+    free(caches);
+    free(items);
+    free(pending);
+
+    log_info("软件源: %zu 个索引, %zu 个软件包, 新读取 %zu 个, 缓存命中 %zu 个, 耗时 %.2f 秒",
+             indexes, kept, parsed, kept - parsed, (double)(copy_now_ns() - start) / 1e9);
+    return failures > 0 ? -1 : 0;
+}
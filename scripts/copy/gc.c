@@ -0,0 +1,748 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "copy.h"
+#include "../utils/treecopy.h"
+
+// 一个 inode 的引用情况：同一内容可能以硬链接出现在多个日期目录和内容存储中，
+// 只有全部链接都被删除时才真正释放空间
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    nlink_t nlink;
+    unsigned long long size;    // 实际占用的磁盘空间
+    unsigned store_links;       // 内容存储中的链接数
+    unsigned evicted_links;     // 待删除目录中的链接数
+    size_t object;              // 清单记录的内容对应的存储对象下标 + 1，0 表示没有
+    size_t store_object;        // 以该 inode 为存储文件的对象下标 + 1，0 表示没有
+} GcInode;
+
+// 内容存储中的对象（或清单中记录的摘要），按摘要索引
+typedef struct {
+    char hash[SHA256_HEX_SIZE];
+    bool in_store;
+    size_t inode;               // 对象文件的 inode 下标
+    size_t live_dates;          // 清单中记录该摘要、且不删除的日期目录数
+    size_t last_date;           // 最近一个记录该摘要的日期目录下标 + 1，用于去重
+} GcObject;
+
+// 开放寻址的索引，槽位保存 items 下标 + 1；items 扩容时下标不变
+typedef struct {
+    size_t *slots;
+    size_t capacity;
+} SlotIndex;
+
+typedef struct {
+    GcInode *items;
+    size_t count;
+    size_t capacity;
+    SlotIndex index;
+} InodeTable;
+
+typedef struct {
+    GcObject *items;
+    size_t count;
+    size_t capacity;
+    SlotIndex index;
+} ObjectTable;
+
+// 一个日期目录
+typedef struct {
+    char *path;
+    const char *date;           // 指向 path 中的日期部分
+    bool keep;                  // 保留最近的日期或带标记的发布
+    bool marked;
+    bool evict;
+    size_t *inodes;             // 目录中文件对应的 inode 下标（每个链接一项）
+    size_t inode_count;
+    size_t inode_capacity;
+    size_t *objects;            // 目录中清单记录的摘要对应的对象下标（每个摘要一项）
+    size_t object_count;
+    size_t object_capacity;
+} GcDate;
+
+typedef struct {
+    GcDate *dates;
+    size_t count;
+    size_t capacity;
+    InodeTable inodes;
+    ObjectTable objects;
+    bool use_store;             // 有内容存储时才需要读取日期目录中的清单
+} GcScan;
+
+static int index_append(size_t **items, size_t *count, size_t *capacity, size_t value) {
+    if (*count >= *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        size_t *new_items = realloc(*items, new_capacity * sizeof(size_t));
+        if (new_items == NULL) return -1;
+        *items = new_items;
+        *capacity = new_capacity;
+    }
+    (*items)[(*count)++] = value;
+    return 0;
+}
+
+// ---- inode 表与对象表 ----
+
+static size_t inode_hash(dev_t dev, ino_t ino) {
+    unsigned long long key = (unsigned long long)ino * 0x9E3779B97F4A7C15ULL ^ (unsigned long long)dev;
+    return (size_t)(key ^ (key >> 29));
+}
+
+// 摘要本身已均匀分布，取前 16 位十六进制即可
+static size_t object_hash(const char *hash) {
+    unsigned long long key = 0;
+    for (int i = 0; i < 16 && isxdigit((unsigned char)hash[i]); i++) {
+        key = key << 4 | (unsigned long long)(isdigit((unsigned char)hash[i]) ? hash[i] - '0'
+                                                                               : tolower((unsigned char)hash[i]) - 'a' + 10);
+    }
+    return (size_t)(key ^ (key >> 29));
+}
+
+// 容量翻倍并按 hash_of 重新放置所有下标
+static int slot_grow(SlotIndex *index, size_t count, size_t (*hash_of)(const void*, size_t),
+                     const void *items) {
+    size_t capacity = index->capacity ? index->capacity * 2 : 1024;
+    size_t *slots = calloc(capacity, sizeof(size_t));
+    if (slots == NULL) return -1;
+    for (size_t i = 0; i < count; i++) {
+        size_t j = hash_of(items, i) & (capacity - 1);
+        while (slots[j] != 0) j = (j + 1) & (capacity - 1);
+        slots[j] = i + 1;
+    }
+    free(index->slots);
+    index->slots = slots;
+    index->capacity = capacity;
+    return 0;
+}
+
+static size_t inode_item_hash(const void *items, size_t i) {
+    const GcInode *inode = &((const GcInode*)items)[i];
+    return inode_hash(inode->dev, inode->ino);
+}
+
+static size_t object_item_hash(const void *items, size_t i) {
+    return object_hash(((const GcObject*)items)[i].hash);
+}
+
+// 返回 inode 的下标，不存在时插入
+static long inode_lookup(InodeTable *table, const struct stat *st) {
+    if ((table->count + 1) * 2 > table->index.capacity &&
+        slot_grow(&table->index, table->count, inode_item_hash, table->items) != 0) {
+        return -1;
+    }
+
+    size_t mask = table->index.capacity - 1;
+    size_t i = inode_hash(st->st_dev, st->st_ino) & mask;
+    for (; table->index.slots[i] != 0; i = (i + 1) & mask) {
+        GcInode *inode = &table->items[table->index.slots[i] - 1];
+        if (inode->dev == st->st_dev && inode->ino == st->st_ino) return (long)(table->index.slots[i] - 1);
+    }
+
+    if (table->count >= table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 1024;
+        GcInode *items = realloc(table->items, capacity * sizeof(GcInode));
+        if (items == NULL) return -1;
+        table->items = items;
+        table->capacity = capacity;
+    }
+    GcInode *inode = &table->items[table->count];
+    memset(inode, 0, sizeof(*inode));
+    inode->dev = st->st_dev;
+    inode->ino = st->st_ino;
+    inode->nlink = st->st_nlink;
+    inode->size = (unsigned long long)st->st_blocks * 512;
+    table->index.slots[i] = ++table->count;
+    return (long)(table->count - 1);
+}
+
+// 返回摘要对应对象的下标；insert 为 false 时不存在返回 -1
+static long object_lookup(ObjectTable *table, const char *hash, bool insert) {
+    if (insert && (table->count + 1) * 2 > table->index.capacity &&
+        slot_grow(&table->index, table->count, object_item_hash, table->items) != 0) {
+        return -1;
+    }
+    if (table->index.capacity == 0) return -1;
+
+    size_t mask = table->index.capacity - 1;
+    size_t i = object_hash(hash) & mask;
+    for (; table->index.slots[i] != 0; i = (i + 1) & mask) {
+        if (strcmp(table->items[table->index.slots[i] - 1].hash, hash) == 0) {
+            return (long)(table->index.slots[i] - 1);
+        }
+    }
+    if (!insert) return -1;
+
+    if (table->count >= table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 1024;
+        GcObject *items = realloc(table->items, capacity * sizeof(GcObject));
+        if (items == NULL) return -1;
+        table->items = items;
+        table->capacity = capacity;
+    }
+    GcObject *object = &table->items[table->count];
+    memset(object, 0, sizeof(*object));
+    snprintf(object->hash, sizeof(object->hash), "%s", hash);
+    table->index.slots[i] = ++table->count;
+    return (long)(table->count - 1);
+}
+
+static bool is_hash_name(const char *name) {
+    if (strlen(name) != SHA256_HEX_SIZE - 1) return false;
+    for (const char *p = name; *p; p++) {
+        if (!isxdigit((unsigned char)*p) || isupper((unsigned char)*p)) return false;
+    }
+    return true;
+}
+
+// 除内容存储和待删除目录外仍有链接，空间不会被释放
+static bool inode_alive(const GcInode *inode) {
+    return inode->nlink > inode->store_links + inode->evicted_links;
+}
+
+// 存储对象仍被使用：保留的日期目录清单中记录了它的摘要，或仍有其他硬链接
+static bool object_alive(const GcScan *scan, const GcObject *object) {
+    return object->live_dates > 0 || inode_alive(&scan->inodes.items[object->inode]);
+}
+
+// ---- 扫描 ----
+
+typedef int (*ScanVisit)(const char *path, const struct stat *st, void *ctx);
+
+// 递归遍历目录中的普通文件，不跟随符号链接
+static int scan_tree(const char *path, ScanVisit visit, void *ctx) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) return -1;
+
+    int result = 0;
+    struct dirent *entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        char *child = NULL;
+        if (asprintf(&child, "%s/%s", path, entry->d_name) < 0) {
+            result = -1;
+            break;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            result = scan_tree(child, visit, ctx);
+        } else if (S_ISREG(st.st_mode)) {
+            result = visit(child, &st, ctx);
+        }
+        free(child);
+    }
+    closedir(dir);
+    return result;
+}
+
+// 记录日期目录清单中的一项：摘要计入该目录，对应文件的 inode 关联到摘要，
+// 这样 reflink 视图（不增加链接数）也能按内容找到存储对象
+static int record_listed_file(GcScan *scan, const char *dir, const char *name, const char *hash) {
+    size_t date_index = scan->count - 1;
+    GcDate *date = &scan->dates[date_index];
+    if (!is_hash_name(hash) || strstr(name, "..") != NULL) return 0;
+
+    long object = object_lookup(&scan->objects, hash, true);
+    if (object < 0) return -1;
+    GcObject *item = &scan->objects.items[object];
+    if (item->last_date != date_index + 1) {
+        item->last_date = date_index + 1;
+        item->live_dates++;
+        if (index_append(&date->objects, &date->object_count, &date->object_capacity, (size_t)object) != 0) {
+            return -1;
+        }
+    }
+
+    char *path = NULL;
+    struct stat st;
+    if (asprintf(&path, "%s/%s", dir, name) < 0) return -1;
+    if (lstat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+        long inode = inode_lookup(&scan->inodes, &st);
+        if (inode < 0) {
+            free(path);
+            return -1;
+        }
+        scan->inodes.items[inode].object = (size_t)object + 1;
+    }
+    free(path);
+    return 0;
+}
+
+// 读取日期目录中的 manifest.json 或 sha256sums，路径相对清单所在目录
+static int load_listing(GcScan *scan, const char *path, bool is_manifest) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return 0;
+
+    char *dir = strdup(path);
+    if (dir == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    *strrchr(dir, '/') = '\0';
+
+    int result = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (result == 0 && getline(&line, &line_cap, fp) != -1) {
+        if (is_manifest) {
+            char *name = manifest_string(line, "path");
+            char *hash = name != NULL ? manifest_string(line, "sha256") : NULL;
+            if (hash != NULL) result = record_listed_file(scan, dir, name, hash);
+            free(name);
+            free(hash);
+        } else {
+            line[strcspn(line, "\r\n")] = '\0';
+            char *name = strchr(line, ' ');
+            if (name == NULL) continue;
+            *name++ = '\0';
+            if (*name == '*' || *name == ' ') name++;
+            result = record_listed_file(scan, dir, name, line);
+        }
+    }
+    free(line);
+    free(dir);
+    fclose(fp);
+    return result;
+}
+
+static int visit_date_file(const char *path, const struct stat *st, void *ctx) {
+    GcScan *scan = ctx;
+    GcDate *date = &scan->dates[scan->count - 1];
+    long index = inode_lookup(&scan->inodes, st);
+    if (index < 0) return -1;
+    if (index_append(&date->inodes, &date->inode_count, &date->inode_capacity, (size_t)index) != 0) {
+        return -1;
+    }
+
+    const char *name = strrchr(path, '/') + 1;
+    if (scan->use_store && manifest_own_file(name)) {
+        return load_listing(scan, path, strcmp(name, "manifest.json") == 0);
+    }
+    return 0;
+}
+
+static int visit_store_object(const char *path, const struct stat *st, void *ctx) {
+    GcScan *scan = ctx;
+    long index = inode_lookup(&scan->inodes, st);
+    if (index < 0) return -1;
+    scan->inodes.items[index].store_links++;
+
+    const char *name = strrchr(path, '/') + 1;
+    if (!is_hash_name(name)) return 0;
+    long object = object_lookup(&scan->objects, name, true);
+    if (object < 0) return -1;
+    scan->objects.items[object].in_store = true;
+    scan->objects.items[object].inode = (size_t)index;
+    scan->inodes.items[index].store_object = (size_t)object + 1;
+    return 0;
+}
+
+bool gc_is_date_name(const char *name) {
+    // YYYY-MM-DD
+    if (strlen(name) != 10 || name[4] != '-' || name[7] != '-') return false;
+    for (int i = 0; i < 10; i++) {
+        if (i == 4 || i == 7) continue;
+        if (!isdigit((unsigned char)name[i])) return false;
+    }
+    return true;
+}
+
+// 日期目录自身的清单（不带标记的复制）中有 name/ 下的文件时，name 是复制来的子目录
+static bool listed_in_date(const char *path, const char *name) {
+    const char *lists[] = { "manifest.json", "sha256sums" };
+    size_t len = strlen(name);
+    bool found = false;
+    char *line = NULL;
+    size_t line_cap = 0;
+
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]) && !found; i++) {
+        char *list = NULL;
+        if (asprintf(&list, "%s/%s", path, lists[i]) < 0) break;
+        FILE *fp = fopen(list, "r");
+        free(list);
+        if (fp == NULL) continue;
+        while (!found && getline(&line, &line_cap, fp) != -1) {
+            if (i == 0) {
+                char *file = manifest_string(line, "path");
+                found = file != NULL && strncmp(file, name, len) == 0 && file[len] == '/';
+                free(file);
+            } else {
+                const char *file = strchr(line, ' ');
+                if (file == NULL) continue;
+                file++;
+                if (*file == '*' || *file == ' ') file++;
+                found = strncmp(file, name, len) == 0 && file[len] == '/';
+            }
+        }
+        fclose(fp);
+    }
+    free(line);
+    return found;
+}
+
+// 日期目录下有带 manifest.json 的子目录，说明是用 -m 标记复制的发布。
+// 较早复制的标记目录没有 manifest.json：不在日期目录自身清单中的子目录无法确认，
+// 同样按标记的发布保留，避免误删
+static bool date_marked(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) return false;
+
+    bool marked = false;
+    struct dirent *entry;
+    while (!marked && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        char *manifest = NULL;
+        if (asprintf(&manifest, "%s/%s/manifest.json", path, entry->d_name) < 0) break;
+        marked = access(manifest, F_OK) == 0;
+        free(manifest);
+        if (!marked && !listed_in_date(path, entry->d_name)) {
+            log_info("无法确认 %s/%s 是否为标记目录（没有 manifest.json），按标记的发布处理",
+                     path, entry->d_name);
+            marked = true;
+        }
+    }
+    closedir(dir);
+    return marked;
+}
+
+static int compare_date_desc(const void *a, const void *b) {
+    return strcmp(((const GcDate*)b)->date, ((const GcDate*)a)->date);
+}
+
+// 列出目标目录下的日期目录，按日期从新到旧标记保留项
+static int scan_target(GcScan *scan, const char *target, const GcPolicy *policy) {
+    DIR *dir = opendir(target);
+    if (dir == NULL) return 0;
+
+    size_t first = scan->count;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!gc_is_date_name(entry->d_name)) continue;
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        if (scan->count >= scan->capacity) {
+            size_t capacity = scan->capacity ? scan->capacity * 2 : 32;
+            GcDate *dates = realloc(scan->dates, capacity * sizeof(GcDate));
+            if (dates == NULL) break;
+            scan->dates = dates;
+            scan->capacity = capacity;
+        }
+        GcDate *date = &scan->dates[scan->count];
+        memset(date, 0, sizeof(*date));
+        if (asprintf(&date->path, "%s/%s", target, entry->d_name) < 0) break;
+        date->date = date->path + strlen(date->path) - 10;
+        scan->count++;
+        if (scan_tree(date->path, visit_date_file, scan) != 0) {
+            log_warning("扫描目录不完整: %s", date->path);
+        }
+    }
+    closedir(dir);
+
+    GcDate *dates = &scan->dates[first];
+    size_t count = scan->count - first;
+    qsort(dates, count, sizeof(GcDate), compare_date_desc);
+    for (size_t i = 0; i < count; i++) {
+        dates[i].marked = date_marked(dates[i].path);
+        // 最新的日期总是保留，即使只配置了 MAX_SIZE
+        dates[i].keep = i == 0 || (policy->keep_dates > 0 && i < (size_t)policy->keep_dates) ||
+                        (policy->keep_marked && dates[i].marked);
+    }
+    return 0;
+}
+
+// 存储对象按摘要只计一次，其硬链接和 reflink 视图不再重复计入
+static unsigned long long object_usage(const GcScan *scan, const GcObject *object) {
+    if (!object->in_store || !object_alive(scan, object)) return 0;
+    return scan->inodes.items[object->inode].size;
+}
+
+// 存储之外的文件按 inode 计算；属于存储对象的 inode 已由 object_usage 计入
+static unsigned long long inode_usage(const GcScan *scan, const GcInode *inode) {
+    if (inode->store_links > 0) return 0;
+    if (inode->object != 0 && scan->objects.items[inode->object - 1].in_store) return 0;
+    return inode_alive(inode) ? inode->size : 0;
+}
+
+// 当前保留内容占用的空间
+static unsigned long long live_usage(const GcScan *scan) {
+    unsigned long long usage = 0;
+    for (size_t i = 0; i < scan->objects.count; i++) {
+        usage += object_usage(scan, &scan->objects.items[i]);
+    }
+    for (size_t i = 0; i < scan->inodes.count; i++) {
+        usage += inode_usage(scan, &scan->inodes.items[i]);
+    }
+    return usage;
+}
+
+// inode 及以它为存储文件的对象当前计入的空间
+static unsigned long long inode_total_usage(const GcScan *scan, const GcInode *inode) {
+    unsigned long long usage = inode_usage(scan, inode);
+    if (inode->store_object != 0) usage += object_usage(scan, &scan->objects.items[inode->store_object - 1]);
+    return usage;
+}
+
+// 把日期目录加入待删除集合，返回因此释放的空间：
+// 只有 inode 或存储对象的最后一个保留引用消失时才扣除其大小
+static unsigned long long evict_date(GcScan *scan, GcDate *date) {
+    unsigned long long freed = 0;
+    date->evict = true;
+    for (size_t i = 0; i < date->inode_count; i++) {
+        GcInode *inode = &scan->inodes.items[date->inodes[i]];
+        unsigned long long before = inode_total_usage(scan, inode);
+        inode->evicted_links++;
+        freed += before - inode_total_usage(scan, inode);
+    }
+    for (size_t i = 0; i < date->object_count; i++) {
+        GcObject *object = &scan->objects.items[date->objects[i]];
+        unsigned long long before = object_usage(scan, object);
+        object->live_dates--;
+        freed += before - object_usage(scan, object);
+    }
+    return freed;
+}
+
+// ---- 并行删除 ----
+
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t capacity;
+} PathList;
+
+static int path_list_add(PathList *list, const char *path) {
+    if (list->count >= list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        char **paths = realloc(list->paths, capacity * sizeof(char*));
+        if (paths == NULL) return -1;
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    list->paths[list->count] = strdup(path);
+    if (list->paths[list->count] == NULL) return -1;
+    list->count++;
+    return 0;
+}
+
+static void path_list_free(PathList *list) {
+    for (size_t i = 0; i < list->count; i++) free(list->paths[i]);
+    free(list->paths);
+}
+
+static int visit_collect(const char *path, const struct stat *st, void *ctx) {
+    (void)st;
+    return path_list_add(ctx, path);
+}
+
+typedef struct {
+    GcScan *scan;
+    PathList *orphans;
+} OrphanScan;
+
+// 保留的日期目录清单中没有记录其摘要、且只剩自身一个链接的对象已没有日期目录引用。
+// reflink 视图不增加链接数，只靠链接数判断会删掉仍被使用的内容
+static int visit_orphan_object(const char *path, const struct stat *st, void *ctx) {
+    OrphanScan *orphan = ctx;
+    if (st->st_nlink > 1) return 0;
+
+    const char *name = strrchr(path, '/') + 1;
+    long object = object_lookup(&orphan->scan->objects, name, false);
+    if (object >= 0 && orphan->scan->objects.items[object].live_dates > 0) return 0;
+    return path_list_add(orphan->orphans, path);
+}
+
+typedef struct {
+    const PathList *list;
+    size_t next;
+    size_t failed;
+    pthread_mutex_t lock;
+} UnlinkQueue;
+
+static void* unlink_worker(void *arg) {
+    UnlinkQueue *queue = arg;
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        size_t index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (index >= queue->list->count) break;
+
+        if (unlink(queue->list->paths[index]) != 0 && errno != ENOENT) {
+            pthread_mutex_lock(&queue->lock);
+            queue->failed++;
+            pthread_mutex_unlock(&queue->lock);
+        }
+    }
+    return NULL;
+}
+
+// 多个线程同时 unlink，目录项和 inode 的释放可以在文件系统中并发进行
+static size_t unlink_parallel(const PathList *list, int jobs) {
+    UnlinkQueue queue = { .list = list, .next = 0, .failed = 0 };
+    pthread_mutex_init(&queue.lock, NULL);
+
+    if (jobs < 1) jobs = 1;
+    if ((size_t)jobs > list->count) jobs = list->count > 0 ? (int)list->count : 1;
+    pthread_t *threads = jobs > 1 ? malloc((size_t)jobs * sizeof(pthread_t)) : NULL;
+    int started = 0;
+    for (int i = 0; threads != NULL && i < jobs; i++) {
+        if (pthread_create(&threads[i], NULL, unlink_worker, &queue) != 0) break;
+        started++;
+    }
+    if (started == 0) unlink_worker(&queue);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    free(threads);
+
+    pthread_mutex_destroy(&queue.lock);
+    return queue.failed;
+}
+
+// ---- 入口 ----
+
+int gc_parse_size(const char *text, unsigned long long *size) {
+    char *end = NULL;
+    errno = 0;
+    double value = strtod(text, &end);
+    if (errno != 0 || end == text || value < 0) return -1;
+
+    unsigned long long unit = 1;
+    switch (toupper((unsigned char)*end)) {
+        case 'T': unit <<= 10; /* fall through */
+        case 'G': unit <<= 10; /* fall through */
+        case 'M': unit <<= 10; /* fall through */
+        case 'K': unit <<= 10; end++; break;
+        case '\0': break;
+        default: return -1;
+    }
+    // 允许 10G、10GB、10GiB 等写法
+    if (*end == 'i' || *end == 'I') end++;
+    if (*end == 'b' || *end == 'B') end++;
+    if (*end != '\0') return -1;
+
+    *size = (unsigned long long)(value * (double)unit);
+    return 0;
+}
+
+static void scan_free(GcScan *scan) {
+    for (size_t i = 0; i < scan->count; i++) {
+        free(scan->dates[i].path);
+        free(scan->dates[i].inodes);
+        free(scan->dates[i].objects);
+    }
+    free(scan->dates);
+    free(scan->inodes.items);
+    free(scan->inodes.index.slots);
+    free(scan->objects.items);
+    free(scan->objects.index.slots);
+}
+
+static int compare_date_asc(const void *a, const void *b) {
+    const GcDate *date_a = *(const GcDate* const*)a;
+    const GcDate *date_b = *(const GcDate* const*)b;
+    int result = strcmp(date_a->date, date_b->date);
+    return result != 0 ? result : strcmp(date_a->path, date_b->path);
+}
+
+int copy_gc(const char **targets, size_t target_count, const char *store,
+            const GcPolicy *policy, int jobs, bool dry_run) {
+    GcScan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.use_store = store != NULL;
+
+    for (size_t i = 0; i < target_count; i++) {
+        scan_target(&scan, targets[i], policy);
+    }
+    if (store != NULL) {
+        char *objects = NULL;
+        if (asprintf(&objects, "%s/objects", store) >= 0) {
+            scan_tree(objects, visit_store_object, &scan);
+            free(objects);
+        }
+    }
+
+    unsigned long long before = live_usage(&scan);
+    log_info("扫描到 %zu 个日期目录，占用 %.1f MB", scan.count, before / 1048576.0);
+
+    // 按日期从旧到新考虑删除
+    GcDate **order = malloc((scan.count + 1) * sizeof(GcDate*));
+    if (order == NULL) {
+        scan_free(&scan);
+        return 1;
+    }
+    for (size_t i = 0; i < scan.count; i++) order[i] = &scan.dates[i];
+    qsort(order, scan.count, sizeof(GcDate*), compare_date_asc);
+
+    unsigned long long usage = before;
+    size_t evicted = 0;
+    for (size_t i = 0; i < scan.count; i++) {
+        GcDate *date = order[i];
+        bool expired = !date->keep && policy->keep_dates > 0;
+        bool oversize = !date->keep && policy->max_size > 0 && usage > policy->max_size;
+        if (!expired && !oversize) continue;
+
+        unsigned long long freed = evict_date(&scan, date);
+        usage -= freed;
+        evicted++;
+        log_info("%s: %s (释放 %.1f MB)", dry_run ? "将删除" : "删除", date->path, freed / 1048576.0);
+    }
+    if (policy->max_size > 0 && usage > policy->max_size) {
+        log_warning("保留的目录仍占用 %.1f MB，超过 MAX_SIZE", usage / 1048576.0);
+    }
+
+    int result = 0;
+    if (!dry_run && evicted > 0) {
+        uint64_t start = copy_now_ns();
+        PathList files = {0};
+        for (size_t i = 0; i < scan.count; i++) {
+            if (scan.dates[i].evict) scan_tree(scan.dates[i].path, visit_collect, &files);
+        }
+        size_t failed = unlink_parallel(&files, jobs);
+
+        // 文件删除后目录树中只剩目录和符号链接
+        for (size_t i = 0; i < scan.count; i++) {
+            if (scan.dates[i].evict && remove_tree(scan.dates[i].path) != 0) failed++;
+        }
+
+        PathList orphans = {0};
+        if (store != NULL) {
+            char *objects = NULL;
+            if (asprintf(&objects, "%s/objects", store) >= 0) {
+                OrphanScan orphan = { .scan = &scan, .orphans = &orphans };
+                scan_tree(objects, visit_orphan_object, &orphan);
+                free(objects);
+            }
+            failed += unlink_parallel(&orphans, jobs);
+        }
+
+        log_info("删除 %zu 个文件、%zu 个存储对象，耗时 %.2f秒", files.count, orphans.count,
+                 (double)(copy_now_ns() - start) / 1e9);
+        if (failed > 0) {
+            log_error("%zu 个条目删除失败", failed);
+            result = 1;
+        }
+        path_list_free(&files);
+        path_list_free(&orphans);
+    }
+
+    log_success("清理%s: 删除 %zu 个日期目录，%.1f MB -> %.1f MB",
+                dry_run ? "预览" : "完成", evicted, before / 1048576.0, usage / 1048576.0);
+
+    free(order);
+    scan_free(&scan);
+    return result;
+}
@@ -0,0 +1,498 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "copy.h"
+
+#define SUMS_FILE "sha256sums"
+#define MANIFEST_FILE "manifest.json"
+// 向上查找 sha256sums 的层数：OpenWrt 在 bin/targets/<target>/<subtarget> 生成，
+// 其中也记录了 packages/ 等子目录中的文件
+#define SUMS_SEARCH_DEPTH 3
+
+typedef struct {
+    char *name;
+    char hash[SHA256_HEX_SIZE];
+} SumsEntry;
+
+// 一个目录中的 sha256sums（不存在时 entries 为空）
+typedef struct {
+    char *dir;
+    SumsEntry *entries;
+    size_t count;
+} SumsFile;
+
+typedef struct {
+    SumsFile *files;
+    size_t count;
+} SumsCache;
+
+// 解析 sha256sum 格式的一行："<摘要> *<文件名>" 或 "<摘要>  <文件名>"
+static int parse_sums_line(char *line, SumsEntry *entry) {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+    if (len < SHA256_HEX_SIZE + 1) return -1;
+
+    for (int i = 0; i < SHA256_HEX_SIZE - 1; i++) {
+        if (!isxdigit((unsigned char)line[i])) return -1;
+    }
+    if (line[SHA256_HEX_SIZE - 1] != ' ') return -1;
+    const char *name = line + SHA256_HEX_SIZE;
+    if (*name == '*' || *name == ' ') name++;
+    if (*name == '\0') return -1;
+
+    for (int i = 0; i < SHA256_HEX_SIZE - 1; i++) {
+        entry->hash[i] = (char)tolower((unsigned char)line[i]);
+    }
+    entry->hash[SHA256_HEX_SIZE - 1] = '\0';
+    entry->name = strdup(name);
+    return entry->name != NULL ? 0 : -1;
+}
+
+static SumsFile* sums_load(SumsCache *cache, const char *dir) {
+    for (size_t i = 0; i < cache->count; i++) {
+        if (strcmp(cache->files[i].dir, dir) == 0) return &cache->files[i];
+    }
+
+    SumsFile *files = realloc(cache->files, (cache->count + 1) * sizeof(SumsFile));
+    if (files == NULL) return NULL;
+    cache->files = files;
+    SumsFile *sums = &cache->files[cache->count];
+    sums->dir = strdup(dir);
+    sums->entries = NULL;
+    sums->count = 0;
+    if (sums->dir == NULL) return NULL;
+    cache->count++;
+
+    char *path = NULL;
+    if (asprintf(&path, "%s/" SUMS_FILE, dir) < 0) return sums;
+    FILE *fp = fopen(path, "r");
+    free(path);
+    if (fp == NULL) return sums;
+
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t capacity = 0;
+    while (getline(&line, &line_size, fp) != -1) {
+        SumsEntry entry;
+        if (parse_sums_line(line, &entry) != 0) continue;
+        if (sums->count >= capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            SumsEntry *entries = realloc(sums->entries, capacity * sizeof(SumsEntry));
+            if (entries == NULL) {
+                free(entry.name);
+                break;
+            }
+            sums->entries = entries;
+        }
+        sums->entries[sums->count++] = entry;
+    }
+    free(line);
+    fclose(fp);
+    return sums;
+}
+
+static const char* sums_find(const SumsFile *sums, const char *name) {
+    for (size_t i = 0; i < sums->count; i++) {
+        if (strcmp(sums->entries[i].name, name) == 0) return sums->entries[i].hash;
+    }
+    return NULL;
+}
+
+static void sums_free(SumsCache *cache) {
+    for (size_t i = 0; i < cache->count; i++) {
+        for (size_t j = 0; j < cache->files[i].count; j++) {
+            free(cache->files[i].entries[j].name);
+        }
+        free(cache->files[i].entries);
+        free(cache->files[i].dir);
+    }
+    free(cache->files);
+}
+
+void manifest_load_expected(CopyPlan *plan) {
+    SumsCache cache = {0};
+    size_t found = 0;
+
+    for (size_t i = 0; i < plan->job_count; i++) {
+        CopyJob *job = &plan->jobs[i];
+        if (job->superseded) continue;
+        char *dir = strdup(job->src);
+        if (dir == NULL) continue;
+
+        // 从文件所在目录向上查找，文件名相对于 sha256sums 所在目录
+        for (int depth = 0; depth < SUMS_SEARCH_DEPTH; depth++) {
+            char *slash = strrchr(dir, '/');
+            if (slash == NULL || slash == dir) break;
+            *slash = '\0';
+
+            SumsFile *sums = sums_load(&cache, dir);
+            if (sums == NULL || sums->count == 0) continue;
+            const char *hash = sums_find(sums, job->src + (slash - dir) + 1);
+            if (hash != NULL) {
+                memcpy(job->expected, hash, SHA256_HEX_SIZE);
+                found++;
+                break;
+            }
+        }
+        free(dir);
+    }
+
+    sums_free(&cache);
+    if (found > 0) {
+        log_info("%zu 个文件将与源目录中的 %s 核对", found, SUMS_FILE);
+    }
+}
+
+// manifest.json 每个文件一行，读取该行中 key 对应的字符串
+char* manifest_string(const char *line, const char *key) {
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), "\"%s\": \"", key);
+    const char *p = strstr(line, pattern);
+    if (p == NULL) return NULL;
+    p += strlen(pattern);
+
+    char *buffer = NULL;
+    size_t size = 0;
+    FILE *fp = open_memstream(&buffer, &size);
+    if (fp == NULL) return NULL;
+    bool ok = false;
+    while (*p != '\0') {
+        if (*p == '"') {
+            ok = true;
+            break;
+        }
+        if (*p != '\\') {
+            fputc(*p++, fp);
+            continue;
+        }
+        p++;
+        switch (*p) {
+            case 'n': fputc('\n', fp); break;
+            case 'r': fputc('\r', fp); break;
+            case 't': fputc('\t', fp); break;
+            case 'b': fputc('\b', fp); break;
+            case 'f': fputc('\f', fp); break;
+            case 'u': {
+                char hex[5] = {0};
+                for (int i = 0; i < 4 && p[i + 1] != '\0'; i++) hex[i] = p[i + 1];
+                if (strlen(hex) != 4) break;
+                unsigned code = (unsigned)strtoul(hex, NULL, 16);
+                if (code < 0x80) {
+                    fputc((int)code, fp);
+                } else if (code < 0x800) {
+                    fputc(0xc0 | (code >> 6), fp);
+                    fputc(0x80 | (code & 0x3f), fp);
+                } else {
+                    fputc(0xe0 | (code >> 12), fp);
+                    fputc(0x80 | ((code >> 6) & 0x3f), fp);
+                    fputc(0x80 | (code & 0x3f), fp);
+                }
+                p += 4;
+                break;
+            }
+            case '\0': p--; break;
+            default: fputc(*p, fp);
+        }
+        p++;
+    }
+    if (fclose(fp) != 0) ok = false;
+    if (!ok) {
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+bool manifest_number(const char *line, const char *key, long long *value) {
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    const char *p = strstr(line, pattern);
+    if (p == NULL) return false;
+    char *end;
+    errno = 0;
+    *value = strtoll(p + strlen(pattern), &end, 10);
+    return errno == 0 && end != p + strlen(pattern);
+}
+
+bool manifest_own_file(const char *name) {
+    return strcmp(name, SUMS_FILE) == 0 || strcmp(name, MANIFEST_FILE) == 0;
+}
+
+// 清单中的一个文件：本次复制的任务，或上次清单中仍然存在的文件
+typedef struct {
+    char *path;                 // 相对输出目录的路径
+    char hash[SHA256_HEX_SIZE];
+    char *entry;                // manifest.json 中的一项，不含缩进和分隔的逗号
+} ManifestEntry;
+
+typedef struct {
+    ManifestEntry *items;
+    size_t count;
+    size_t capacity;
+} ManifestList;
+
+// 取得 path 和 entry 的所有权
+static int entry_add(ManifestList *list, char *path, const char *hash, char *entry) {
+    if (path == NULL || entry == NULL) {
+        free(path);
+        free(entry);
+        return -1;
+    }
+    if (list->count >= list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        ManifestEntry *items = realloc(list->items, capacity * sizeof(ManifestEntry));
+        if (items == NULL) {
+            free(path);
+            free(entry);
+            return -1;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    ManifestEntry *item = &list->items[list->count++];
+    item->path = path;
+    memcpy(item->hash, hash, SHA256_HEX_SIZE);
+    item->hash[SHA256_HEX_SIZE - 1] = '\0';
+    item->entry = entry;
+    return 0;
+}
+
+static void entry_list_free(ManifestList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->items[i].path);
+        free(list->items[i].entry);
+    }
+    free(list->items);
+    list->items = NULL;
+    list->count = list->capacity = 0;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const ManifestEntry*)a)->path, ((const ManifestEntry*)b)->path);
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// 本次运行中某个任务的目标（无论复制成功与否），names 已排序
+static bool name_listed(char **names, size_t count, const char *name) {
+    return bsearch(&name, names, count, sizeof(char*), compare_names) != NULL;
+}
+
+static char* job_entry(const CopyJob *job, size_t prefix, const char *marker) {
+    char *buffer = NULL;
+    size_t size = 0;
+    FILE *fp = open_memstream(&buffer, &size);
+    if (fp == NULL) return NULL;
+
+    fputs("{\"path\": ", fp);
+    json_write_string(fp, job->dst + prefix);
+    fprintf(fp, ", \"size\": %llu, \"sha256\": \"%s\", \"source\": ", job->size, job->hash);
+    json_write_string(fp, job->src);
+    if (job->commit != NULL) {
+        fprintf(fp, ", \"commit\": \"%s\"", job->commit);
+    }
+    if (job->compress != COMPRESS_NONE) {
+        fprintf(fp, ", \"compression\": \"%s\", \"source_size\": %lld",
+                compress_suffix(job->compress) + 1, (long long)job->st.st_size);
+    }
+    if (job->delta_base != NULL) {
+        fprintf(fp, ", \"delta_base\": ");
+        json_write_string(fp, job->delta_base);
+    }
+    fprintf(fp, ", \"rule\": %d, \"marker\": ", job->rule_id);
+    if (marker != NULL && marker[0] != '\0') {
+        json_write_string(fp, marker);
+    } else {
+        fputs("null", fp);
+    }
+    fprintf(fp, ", \"verified\": %s}", job->expected[0] != '\0' ? "true" : "false");
+
+    if (fclose(fp) != 0) {
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+// 上次清单中的文件不是本次任何任务的目标、且仍是普通文件时保留；
+// 本次复制或校验失败的文件不沿用上次的摘要，否则清单与磁盘上的内容可能不符
+static bool keep_previous(const char *dir, char **jobs, size_t job_count, const char *name,
+                          struct stat *st) {
+    if (manifest_own_file(name) || name_listed(jobs, job_count, name)) return false;
+    char *path = NULL;
+    if (asprintf(&path, "%s/%s", dir, name) < 0) return false;
+    bool keep = lstat(path, st) == 0 && S_ISREG(st->st_mode);
+    free(path);
+    return keep;
+}
+
+// 同一输出目录可能由多次复制（不同规则或 watch）写入，合并上次清单中仍然存在的文件；
+// 旧的目录只有 sha256sums。返回是否存在上次的清单
+static bool load_previous(const char *dir, ManifestList *list, char **jobs, size_t job_count) {
+    char *line = NULL;
+    size_t line_cap = 0;
+    struct stat st;
+
+    char *path = NULL;
+    FILE *fp = asprintf(&path, "%s/" MANIFEST_FILE, dir) >= 0 ? fopen(path, "r") : NULL;
+    free(path);
+    if (fp != NULL) {
+        while (getline(&line, &line_cap, fp) != -1) {
+            char *entry = line + strspn(line, " ");
+            size_t len = strcspn(entry, "\r\n");
+            while (len > 0 && entry[len - 1] == ',') len--;
+            if (entry[0] != '{' || len == 0 || entry[len - 1] != '}') continue;
+
+            char *name = manifest_string(entry, "path");
+            char *hash = name != NULL ? manifest_string(entry, "sha256") : NULL;
+            if (hash != NULL && strlen(hash) == SHA256_HEX_SIZE - 1 &&
+                keep_previous(dir, jobs, job_count, name, &st)) {
+                entry_add(list, name, hash, strndup(entry, len));
+                name = NULL;
+            }
+            free(name);
+            free(hash);
+        }
+        fclose(fp);
+        free(line);
+        return true;
+    }
+
+    path = NULL;
+    fp = asprintf(&path, "%s/" SUMS_FILE, dir) >= 0 ? fopen(path, "r") : NULL;
+    free(path);
+    if (fp == NULL) return false;
+    while (getline(&line, &line_cap, fp) != -1) {
+        SumsEntry sums;
+        if (parse_sums_line(line, &sums) != 0) continue;
+        char *entry = NULL;
+        if (keep_previous(dir, jobs, job_count, sums.name, &st)) {
+            char *buffer = NULL;
+            size_t size = 0;
+            FILE *mem = open_memstream(&buffer, &size);
+            if (mem != NULL) {
+                fputs("{\"path\": ", mem);
+                json_write_string(mem, sums.name);
+                fprintf(mem, ", \"size\": %lld, \"sha256\": \"%s\"}", (long long)st.st_size, sums.hash);
+                if (fclose(mem) == 0) entry = buffer;
+                else free(buffer);
+            }
+        }
+        if (entry != NULL) {
+            entry_add(list, sums.name, sums.hash, entry);
+        } else {
+            free(sums.name);
+        }
+    }
+    fclose(fp);
+    free(line);
+    return true;
+}
+
+// 先写临时文件再重命名，读取方不会看到写了一半的清单
+static FILE* open_output(const char *dir, const char *name, char **tmp_path, char **path) {
+    *tmp_path = NULL;
+    *path = NULL;
+    if (asprintf(path, "%s/%s", dir, name) < 0) return NULL;
+    if (asprintf(tmp_path, "%s.tmp", *path) < 0) return NULL;
+    return fopen(*tmp_path, "w");
+}
+
+static int close_output(FILE *fp, char *tmp_path, char *path) {
+    int result = 0;
+    if (fp == NULL || ferror(fp)) result = -1;
+    if (fp != NULL && fclose(fp) != 0) result = -1;
+    if (result == 0 && rename(tmp_path, path) != 0) result = -1;
+    if (result != 0 && tmp_path != NULL) {
+        unlink(tmp_path);
+        log_error("无法写入: %s", path ? path : "");
+    }
+    free(tmp_path);
+    free(path);
+    return result;
+}
+
+static int write_output(const char *dir, const ManifestList *list) {
+    char *tmp_path, *path;
+    int result = 0;
+
+    // OpenWrt 兼容格式，可直接用 sha256sum -c 校验
+    FILE *fp = open_output(dir, SUMS_FILE, &tmp_path, &path);
+    for (size_t i = 0; fp != NULL && i < list->count; i++) {
+        fprintf(fp, "%s *%s\n", list->items[i].hash, list->items[i].path);
+    }
+    if (close_output(fp, tmp_path, path) != 0) result = -1;
+
+    fp = open_output(dir, MANIFEST_FILE, &tmp_path, &path);
+    if (fp != NULL) {
+        fprintf(fp, "{\n  \"directory\": ");
+        json_write_string(fp, dir);
+        fprintf(fp, ",\n  \"files\": [");
+        for (size_t i = 0; i < list->count; i++) {
+            fprintf(fp, "%s\n    %s", i > 0 ? "," : "", list->items[i].entry);
+        }
+        fprintf(fp, "%s]\n}\n", list->count > 0 ? "\n  " : "");
+    }
+    if (close_output(fp, tmp_path, path) != 0) result = -1;
+
+    return result;
+}
+
+int manifest_write(const CopyPlan *plan, const char *marker) {
+    int result = 0;
+    for (size_t output = 0; output < plan->output_count; output++) {
+        const char *dir = plan->outputs[output].dir;
+        size_t prefix = strlen(dir) + 1;
+        ManifestList list = {0};
+        char **jobs = NULL;
+        size_t job_count = 0;
+
+        // 复制来的 sha256sums、manifest.json（如 OpenWrt 自带的）会被本次生成的清单覆盖，不列入清单
+        for (size_t i = 0; i < plan->job_count; i++) {
+            const CopyJob *job = &plan->jobs[i];
+            if (job->output != (int)output) continue;
+            if (jobs == NULL) jobs = malloc(plan->job_count * sizeof(char*));
+            if (jobs == NULL) {
+                result = -1;
+                break;
+            }
+            jobs[job_count++] = job->dst + prefix;
+            if (job->result != 0 || job->superseded || manifest_own_file(job->dst + prefix)) continue;
+            if (entry_add(&list, strdup(job->dst + prefix), job->hash, job_entry(job, prefix, marker)) != 0) {
+                result = -1;
+            }
+        }
+        if (job_count == 0) {
+            free(jobs);
+            entry_list_free(&list);
+            continue;
+        }
+
+        // 全部任务都失败时，上次的清单中仍可能记录着这些文件，同样需要重写
+        size_t count = list.count;
+        qsort(jobs, job_count, sizeof(char*), compare_names);
+        bool previous = load_previous(dir, &list, jobs, job_count);
+        free(jobs);
+        if (list.count == 0 && !previous) continue;
+        qsort(list.items, list.count, sizeof(ManifestEntry), compare_entries);
+
+        if (write_output(dir, &list) != 0) {
+            result = -1;
+        } else if (list.count > count) {
+            log_info("已生成校验清单: %s/%s (%zu 个文件，其中 %zu 个来自之前的复制)",
+                     dir, SUMS_FILE, list.count, list.count - count);
+        } else {
+            log_info("已生成校验清单: %s/%s (%zu 个文件)", dir, SUMS_FILE, list.count);
+        }
+        entry_list_free(&list);
+    }
+    return result;
+}
@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <glob.h>
+#include <fnmatch.h>
+#include <dirent.h>
+
+#include "copy.h"
+#include "../utils/pathglob.h"
+
+typedef struct {
+    char **items;
+    int count;
+    int capacity;
+} PatternList;
+
+static int source_list_add(SourceList *list, const char *path, const char *name) {
+    if (list->count >= list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        SourceMatch *items = realloc(list->items, capacity * sizeof(SourceMatch));
+        if (items == NULL) return -1;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    SourceMatch *match = &list->items[list->count];
+    match->path = strdup(path);
+    match->name = strdup(name);
+    if (match->path == NULL || match->name == NULL) {
+        free(match->path);
+        free(match->name);
+        return -1;
+    }
+    list->count++;
+    return 0;
+}
+
+void source_list_free(SourceList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->items[i].path);
+        free(list->items[i].name);
+    }
+    free(list->items);
+    path_glob_free(list->excludes, list->exclude_count);
+    memset(list, 0, sizeof(*list));
+}
+
+// 展开开头的 ~ 为 HOME，与原来 glob 的 GLOB_TILDE 一致
+static char* expand_tilde(const char *pattern) {
+    const char *home = getenv("HOME");
+    char *path = NULL;
+    if (pattern[0] == '~' && (pattern[1] == '/' || pattern[1] == '\0') && home != NULL) {
+        if (asprintf(&path, "%s%s", home, pattern + 1) < 0) return NULL;
+        return path;
+    }
+    return strdup(pattern);
+}
+
+static bool has_recursive(const char *pattern) {
+    for (const char *p = strstr(pattern, "**"); p != NULL; p = strstr(p + 1, "**")) {
+        if ((p == pattern || p[-1] == '/') && (p[2] == '/' || p[2] == '\0')) return true;
+    }
+    return false;
+}
+
+// 不含 ** 的模式仍用 glob，目录也会匹配并整体复制；目标名为文件名
+static int expand_glob(const char *pattern, SourceList *list) {
+    glob_t result;
+    if (glob(pattern, 0, NULL, &result) != 0) return 0;
+    int status = 0;
+    for (size_t i = 0; status == 0 && i < result.gl_pathc; i++) {
+        const char *path = result.gl_pathv[i];
+        const char *name = strrchr(path, '/');
+        status = source_list_add(list, path, name ? name + 1 : path);
+    }
+    globfree(&result);
+    return status;
+}
+
+// 第一个含通配符的路径段之前是固定前缀，返回其长度，*rest 指向其后的部分
+static size_t literal_prefix(const char *pattern, const char **rest) {
+    *rest = pattern;
+    size_t root_len = 0;
+    for (const char *p = pattern; *p;) {
+        const char *end = strchrnul(p, '/');
+        char comp[NAME_MAX + 1];
+        size_t len = end - p;
+        if (len > NAME_MAX) len = NAME_MAX;
+        memcpy(comp, p, len);
+        comp[len] = '\0';
+        if (path_has_glob(comp)) break;
+        root_len = end - pattern;
+        p = *end ? end + 1 : end;
+        *rest = p;
+    }
+    return root_len;
+}
+
+// 固定前缀目录，没有时为 / 或 .
+static char* pattern_root(const char *pattern, const char **rest) {
+    char *root = strdup(pattern);
+    if (root == NULL) return NULL;
+    size_t root_len = literal_prefix(pattern, rest);
+    root[root_len] = '\0';
+    if (root_len == 0) strcpy(root, pattern[0] == '/' ? "/" : ".");
+    return root;
+}
+
+// 含 ** 的模式：在缓存的目录树中匹配，只匹配文件和符号链接，
+// 目标名保留相对于模式中固定前缀目录的路径
+static int expand_recursive(const char *pattern, DirTreeCache *cache, int threads, SourceList *list) {
+    // 从固定前缀目录开始遍历
+    const char *rest;
+    char *root = pattern_root(pattern, &rest);
+    if (root == NULL) return -1;
+
+    const DirTree *tree = dir_tree_cache_get(cache, root, threads);
+    if (tree == NULL) {
+        free(root);
+        return 0;
+    }
+
+    // 树根可能是 root 的上级目录，只看 root 之下的条目；条目已排序，二分查找起点
+    const char *prefix = root + strlen(tree->root);
+    while (*prefix == '/') prefix++;
+    if (strcmp(root, ".") == 0) prefix = "";
+    size_t prefix_len = strlen(prefix);
+    size_t lo = 0;
+    size_t hi = tree->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(tree->entries[mid].path, prefix) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    int status = 0;
+    for (size_t i = lo; status == 0 && i < tree->count; i++) {
+        const DirEntry *entry = &tree->entries[i];
+        const char *rel = entry->path;
+        if (prefix_len > 0) {
+            if (strncmp(rel, prefix, prefix_len) != 0) break;
+            if (rel[prefix_len] != '/') continue;
+            rel += prefix_len + 1;
+        }
+        if (entry->type == DT_DIR || !path_match(rest, rel)) continue;
+
+        char *path = NULL;
+        if (strcmp(tree->root, ".") == 0) {
+            path = strdup(entry->path);
+        } else if (asprintf(&path, "%s%s%s", tree->root,
+                            tree->root[strlen(tree->root) - 1] == '/' ? "" : "/", entry->path) < 0) {
+            path = NULL;
+        }
+        status = path != NULL ? source_list_add(list, path, rel) : -1;
+        free(path);
+    }
+
+    free(root);
+    return status;
+}
+
+// 排除模式含 / 时匹配完整路径，否则只匹配文件名
+static bool excluded(char *const *excludes, int exclude_count, const char *path) {
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    for (int i = 0; i < exclude_count; i++) {
+        const char *pattern = excludes[i];
+        if (strchr(pattern, '/') != NULL) {
+            if (path_match(pattern, path)) return true;
+        } else if (fnmatch(pattern, name, FNM_PERIOD) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool source_excluded(char *const *excludes, int exclude_count, const char *path, size_t root_len) {
+    if (exclude_count == 0) return false;
+    char *dir = strdup(path);
+    if (dir == NULL) return false;
+    bool result = false;
+    for (;;) {
+        if (excluded(excludes, exclude_count, dir)) {
+            result = true;
+            break;
+        }
+        char *slash = strrchr(dir, '/');
+        if (slash == NULL || (size_t)(slash - dir) <= root_len) break;
+        *slash = '\0';
+    }
+    free(dir);
+    return result;
+}
+
+static int compare_names(const void *a, const void *b) {
+    const SourceMatch *match_a = a;
+    const SourceMatch *match_b = b;
+    int result = strcmp(match_a->name, match_b->name);
+    return result != 0 ? result : strcmp(match_a->path, match_b->path);
+}
+
+// 按空白拆分后展开 ~ 和花括号，! 开头的加入排除列表
+static int split_patterns(const char *source, PatternList *includes, PatternList *excludes) {
+    char *copy = strdup(source);
+    if (copy == NULL) return -1;
+    int status = 0;
+    char *saveptr;
+    for (char *tok = strtok_r(copy, " \t", &saveptr); status == 0 && tok;
+         tok = strtok_r(NULL, " \t", &saveptr)) {
+        bool exclude = tok[0] == '!';
+        char *pattern = expand_tilde(exclude ? tok + 1 : tok);
+        char **expanded = NULL;
+        int count = 0;
+        if (pattern == NULL || pattern[0] == '\0' || path_brace_expand(pattern, &expanded, &count) != 0) {
+            status = pattern == NULL ? -1 : status;
+            free(pattern);
+            continue;
+        }
+        PatternList *target = exclude ? excludes : includes;
+        for (int i = 0; i < count; i++) {
+            if (target->count >= target->capacity) {
+                int capacity = target->capacity ? target->capacity * 2 : 8;
+                char **items = realloc(target->items, capacity * sizeof(char*));
+                if (items == NULL) {
+                    status = -1;
+                    break;
+                }
+                target->items = items;
+                target->capacity = capacity;
+            }
+            target->items[target->count++] = expanded[i];
+            expanded[i] = NULL;
+        }
+        path_glob_free(expanded, count);
+        free(pattern);
+    }
+    free(copy);
+    return status;
+}
+
+int source_expand(const char *source, DirTreeCache *cache, int threads, SourceList *list) {
+    PatternList includes = {0};
+    PatternList excludes = {0};
+    int status = split_patterns(source, &includes, &excludes);
+
+    SourceList found = {0};
+    for (int i = 0; status == 0 && i < includes.count; i++) {
+        if (has_recursive(includes.items[i])) {
+            status = expand_recursive(includes.items[i], cache, threads, &found);
+        } else {
+            status = expand_glob(includes.items[i], &found);
+        }
+    }
+
+    // 多个模式可能匹配到同一文件，或不同文件落到同一目标，只保留一个
+    if (status == 0 && found.count > 1) {
+        qsort(found.items, found.count, sizeof(SourceMatch), compare_names);
+    }
+    for (size_t i = 0; status == 0 && i < found.count; i++) {
+        const SourceMatch *match = &found.items[i];
+        if (excluded(excludes.items, excludes.count, match->path)) continue;
+        if (list->count > 0 && strcmp(list->items[list->count - 1].name, match->name) == 0) {
+            if (strcmp(list->items[list->count - 1].path, match->path) != 0) {
+                log_warning("多个源文件对应同一目标 %s，忽略: %s", match->name, match->path);
+            }
+            continue;
+        }
+        status = source_list_add(list, match->path, match->name);
+    }
+
+    // 排除模式留给调用者，展开匹配到的目录时同样跳过被排除的条目
+    list->excludes = excludes.items;
+    list->exclude_count = excludes.count;
+    source_list_free(&found);
+    path_glob_free(includes.items, includes.count);
+    return status;
+}
+
+int source_spec_parse(const char *source, SourceSpec *spec) {
+    PatternList includes = {0};
+    PatternList excludes = {0};
+    memset(spec, 0, sizeof(*spec));
+    if (split_patterns(source, &includes, &excludes) != 0) {
+        path_glob_free(includes.items, includes.count);
+        path_glob_free(excludes.items, excludes.count);
+        return -1;
+    }
+    spec->includes = includes.items;
+    spec->include_count = includes.count;
+    spec->excludes = excludes.items;
+    spec->exclude_count = excludes.count;
+    spec->roots = calloc(includes.count > 0 ? includes.count : 1, sizeof(char*));
+    if (spec->roots == NULL) {
+        source_spec_free(spec);
+        return -1;
+    }
+    for (int i = 0; i < spec->include_count; i++) {
+        const char *rest;
+        spec->roots[i] = pattern_root(spec->includes[i], &rest);
+        if (spec->roots[i] == NULL) {
+            source_spec_free(spec);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void source_spec_free(SourceSpec *spec) {
+    path_glob_free(spec->roots, spec->roots != NULL ? spec->include_count : 0);
+    path_glob_free(spec->includes, spec->include_count);
+    path_glob_free(spec->excludes, spec->exclude_count);
+    memset(spec, 0, sizeof(*spec));
+}
+
+// 取下一个路径段，跳过空段和 .；没有更多路径段时返回 false
+static bool next_component(const char **p, char comp[NAME_MAX + 1]) {
+    for (;;) {
+        while (**p == '/') (*p)++;
+        if (**p == '\0') return false;
+        const char *end = strchrnul(*p, '/');
+        size_t len = end - *p;
+        if (len > NAME_MAX) len = NAME_MAX;
+        memcpy(comp, *p, len);
+        comp[len] = '\0';
+        *p = end;
+        if (strcmp(comp, ".") != 0) return true;
+    }
+}
+
+// 逐段比较：dir 是模式某个前缀可能匹配的目录、模式匹配的目录本身，
+// 或（不含 ** 时）位于模式匹配的目录之中
+static bool pattern_wants_dir(const char *pattern, const char *dir) {
+    if ((pattern[0] == '/') != (dir[0] == '/')) return false;
+    char pattern_comp[NAME_MAX + 1];
+    char dir_comp[NAME_MAX + 1];
+    const char *p = pattern;
+    const char *d = dir;
+    for (;;) {
+        bool more_pattern = next_component(&p, pattern_comp);
+        if (!next_component(&d, dir_comp)) return true;
+        if (!more_pattern) return !has_recursive(pattern);
+        if (strcmp(pattern_comp, "**") == 0) {
+            // ** 不进入隐藏目录
+            do {
+                if (dir_comp[0] == '.') return false;
+            } while (next_component(&d, dir_comp));
+            return true;
+        }
+        if (fnmatch(pattern_comp, dir_comp, FNM_PERIOD) != 0) return false;
+    }
+}
+
+bool source_spec_wants_dir(const SourceSpec *spec, const char *dir) {
+    for (int i = 0; i < spec->include_count; i++) {
+        if (pattern_wants_dir(spec->includes[i], dir)) return true;
+    }
+    return false;
+}
+
+bool source_spec_match(const SourceSpec *spec, const char *path, char **name) {
+    *name = NULL;
+    for (int i = 0; i < spec->include_count; i++) {
+        const char *pattern = spec->includes[i];
+        const char *root = spec->roots[i];
+        if (has_recursive(pattern)) {
+            // 与 expand_recursive 相同：相对于固定前缀目录匹配，目标名为相对路径
+            const char *rest;
+            literal_prefix(pattern, &rest);
+            const char *rel = path;
+            if (strcmp(root, ".") != 0) {
+                size_t root_len = strlen(root);
+                if (strncmp(path, root, root_len) != 0) continue;
+                rel = path + root_len;
+                if (root_len > 1 || root[0] != '/') {
+                    if (*rel != '/') continue;
+                    rel++;
+                }
+            }
+            if (!path_match(rest, rel) || excluded(spec->excludes, spec->exclude_count, path)) continue;
+            *name = strdup(rel);
+            return *name != NULL;
+        }
+
+        // 与 glob 相同：模式可能匹配文件本身，也可能匹配其所在的某一级目录（整体复制）
+        char *candidate = strdup(path);
+        if (candidate == NULL) return false;
+        size_t root_len = strlen(root);
+        for (;;) {
+            if (fnmatch(pattern, candidate, FNM_PATHNAME | FNM_PERIOD) == 0) {
+                // 匹配的是上级目录时，目录中被排除的条目（或其所在的子目录）同样不复制
+                if (!excluded(spec->excludes, spec->exclude_count, candidate) &&
+                    !source_excluded(spec->excludes, spec->exclude_count, path, strlen(candidate))) {
+                    const char *base = strrchr(candidate, '/');
+                    base = base ? base + 1 : candidate;
+                    *name = malloc(strlen(base) + strlen(path + strlen(candidate)) + 1);
+                    if (*name != NULL) {
+                        strcpy(*name, base);
+                        strcat(*name, path + strlen(candidate));
+                    }
+                }
+                break;
+            }
+            char *slash = strrchr(candidate, '/');
+            if (slash == NULL || (size_t)(slash - candidate) < root_len) break;
+            *slash = '\0';
+        }
+        free(candidate);
+        if (*name != NULL) return true;
+    }
+    return false;
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "copy.h"
+#include "../utils/sha256.h"
+#include "../utils/treecopy.h"
+
+// 内容寻址存储布局:
+//   <存储目录>/objects/<摘要前两位>/<完整摘要>  按内容保存的文件（只写一次）
+//   <存储目录>/tmp/                          写入中的临时文件
+// 日期目录和标记目录中的文件都是指向这些对象的硬链接或 reflink
+
+int store_init(const char *store) {
+    char *objects = NULL;
+    char *tmp = NULL;
+    int result = -1;
+
+    if (asprintf(&objects, "%s/objects", store) >= 0 && asprintf(&tmp, "%s/tmp", store) >= 0 &&
+        make_dirs(objects, 0755) == 0 && make_dirs(tmp, 0755) == 0) {
+        result = 0;
+    } else {
+        log_error("无法初始化内容存储: %s", store);
+    }
+
+    free(objects);
+    free(tmp);
+    return result;
+}
+
+static char* object_path(const char *store, const char *hash) {
+    char *path = NULL;
+    if (asprintf(&path, "%s/objects/%.2s/%s", store, hash, hash) < 0) return NULL;
+    return path;
+}
+
+// 把已写好的临时文件存为对象；对象已存在时保留临时文件，由调用者决定如何处理
+static int store_put(const char *tmp, const char *object, bool *exists) {
+    struct stat st;
+    *exists = stat(object, &st) == 0;
+    if (*exists) return 0;
+
+    // 对象所在的子目录
+    char *dir = strdup(object);
+    if (dir == NULL) return -1;
+    *strrchr(dir, '/') = '\0';
+    int result = make_dirs(dir, 0755);
+    free(dir);
+    if (result != 0) return -1;
+
+    // 多个线程可能同时写入相同内容，重命名是原子的，后写入的对象内容相同
+    return rename(tmp, object);
+}
+
+static bool same_mode(const struct stat *a, const struct stat *b) {
+    return (a->st_mode & 07777) == (b->st_mode & 07777);
+}
+
+static bool same_mtime(const struct stat *a, const struct stat *b) {
+    return a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+// 用 reflink 共享对象的数据块，权限和时间戳取自源文件
+static int store_reflink(const char *object, const char *dst, const struct stat *src_st) {
+    int in = open(object, O_RDONLY);
+    if (in < 0) return -1;
+    int out = open(dst, O_WRONLY | O_CREAT | O_EXCL, src_st->st_mode & 07777);
+    int result = -1;
+    if (out >= 0 && ioctl(out, FICLONE, in) == 0) {
+        struct timespec times[2] = { src_st->st_atim, src_st->st_mtim };
+        if (fchmod(out, src_st->st_mode & 07777) == 0 && futimens(out, times) == 0) result = 0;
+    }
+    if (out >= 0) {
+        close(out);
+        if (result != 0) unlink(dst);
+    }
+    close(in);
+    return result;
+}
+
+// 在目标位置创建指向对象的视图，视图的权限和时间戳取自源文件：
+// 对象的权限和时间戳都相同时硬链接；否则优先 reflink，各视图有自己的元数据；
+// 不支持 reflink 时，只有时间戳不同仍硬链接（共用对象的时间戳，保留去重），
+// 权限不同则使用刚写入的临时文件（不去重）
+static int store_link(const char *object, const char *tmp, const char *dst,
+                      const struct stat *src_st, StoreStats *stats) {
+    struct stat st;
+    if (stat(object, &st) != 0) return -1;
+    bool exact = same_mode(&st, src_st) && same_mtime(&st, src_st);
+    if (!exact && store_reflink(object, dst, src_st) == 0) {
+        stats->files_reflinked++;
+        return 0;
+    }
+    if (same_mode(&st, src_st)) {
+        if (link(object, dst) == 0) {
+            stats->files_hardlinked++;
+            return 0;
+        }
+        if (errno != EXDEV && errno != EMLINK && errno != EPERM) return -1;
+        if (exact && store_reflink(object, dst, src_st) == 0) {
+            stats->files_reflinked++;
+            return 0;
+        }
+    }
+
+    // 临时文件不存在说明它已成为对象，从对象复制一份
+    int result = tmp != NULL && access(tmp, F_OK) == 0 ? rename(tmp, dst) : -1;
+    if (result != 0) {
+        const char *from = tmp != NULL && access(tmp, F_OK) == 0 ? tmp : object;
+        result = copy_file_data(from, dst, src_st, NULL);
+    }
+    if (result != 0) return -1;
+    stats->files_copied++;
+    return 0;
+}
+
+// 把已写好的临时文件存为对象并在目标位置创建视图，更新去重统计
+static int store_commit(const char *store, const char *tmp, CopyJob *job,
+                        const struct stat *view_st, unsigned long long bytes, StoreStats *stats) {
+    char *object = object_path(store, job->hash);
+    bool exists = false;
+    int result = object != NULL ? store_put(tmp, object, &exists) : -1;
+    if (result == 0) {
+        size_t copied = stats->files_copied;
+        result = store_link(object, tmp, job->dst, view_st, stats);
+        // 视图退回复制时没有共享对象的数据，不计入去重
+        if (result == 0 && !exists) {
+            stats->files_stored++;
+            stats->bytes_stored += bytes;
+        } else if (result == 0 && stats->files_copied == copied) {
+            stats->files_deduped++;
+            stats->bytes_deduped += bytes;
+        }
+    }
+    free(object);
+    return result;
+}
+
+static char* store_temp_path(const char *store) {
+    char *tmp = NULL;
+    static unsigned long counter = 0;
+    unsigned long id = __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+    if (asprintf(&tmp, "%s/tmp/%d.%lu", store, (int)getpid(), id) < 0) return NULL;
+    return tmp;
+}
+
+int store_copy_job(const char *store, CopyJob *job, StoreStats *stats, unsigned long long *progress) {
+    // 写入临时文件的同时计算摘要，源文件只读一次；写完后才知道对象名
+    char *tmp = store_temp_path(store);
+    if (tmp == NULL) return -1;
+
+    unsigned long long bytes = 0;
+    int result = copy_file_data_hash(job->src, tmp, &job->st, &bytes, job->hash, progress);
+    if (result == 0) {
+        job->size = bytes;
+        result = store_commit(store, tmp, job, &job->st, bytes, stats);
+    }
+    int error = errno;
+    unlink(tmp);
+    free(tmp);
+    errno = error;
+    return result;
+}
+
+int store_adopt_job(const char *store, CopyJob *job, StoreStats *stats) {
+    // 压缩输出已写到目标位置，job->hash 是压缩后内容的摘要；移入存储后再在原位置创建视图
+    struct stat st;
+    if (stat(job->dst, &st) != 0) return -1;
+    char *tmp = store_temp_path(store);
+    if (tmp == NULL) return -1;
+
+    int result = rename(job->dst, tmp);
+    if (result != 0 && errno == EXDEV) {
+        result = copy_file_data(job->dst, tmp, &st, NULL);
+        if (result == 0) unlink(job->dst);
+    }
+    if (result == 0) result = store_commit(store, tmp, job, &st, (unsigned long long)st.st_size, stats);
+    int error = errno;
+    unlink(tmp);
+    free(tmp);
+    errno = error;
+    return result;
+}
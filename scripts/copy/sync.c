@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "copy.h"
+#include "../utils/treecopy.h"
+
+// 块大小取参照文件大小的平方根附近的 2 的幂，与 rsync 的取法相近
+#define SYNC_MIN_BLOCK 2048
+#define SYNC_MAX_BLOCK (128 * 1024)
+// 强校验取 SHA-256 的前 16 字节
+#define SYNC_STRONG_SIZE 16
+
+typedef struct {
+    uint32_t weak;
+    uint8_t strong[SYNC_STRONG_SIZE];
+} BlockSum;
+
+// 参照文件的块签名，按弱校验和组织成哈希表
+typedef struct {
+    size_t block;
+    size_t count;
+    BlockSum *sums;
+    uint32_t *heads;        // 下标 + 1，0 表示空
+    uint32_t *next;
+    size_t mask;
+} Signature;
+
+// 待写出的操作：连续的复用块合并为一次复制
+typedef struct {
+    int basis_fd;
+    int out_fd;
+    off_t copy_from;
+    size_t copy_len;
+    bool copy_range;        // copy_file_range 可用（同一文件系统或支持服务端复制）
+    SyncStats *stats;
+    unsigned long long *progress;
+} SyncWriter;
+
+static uint32_t weak_sum(const unsigned char *data, size_t len, uint32_t *a_out, uint32_t *b_out) {
+    uint32_t a = 0, b = 0;
+    for (size_t i = 0; i < len; i++) {
+        a += data[i];
+        b += (uint32_t)(len - i) * data[i];
+    }
+    *a_out = a & 0xffff;
+    *b_out = b & 0xffff;
+    return *a_out | (*b_out << 16);
+}
+
+static void strong_sum(const unsigned char *data, size_t len, uint8_t out[SYNC_STRONG_SIZE]) {
+    Sha256Ctx ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+    memcpy(out, digest, SYNC_STRONG_SIZE);
+}
+
+static size_t block_size(size_t size) {
+    size_t block = SYNC_MIN_BLOCK;
+    while (block < SYNC_MAX_BLOCK && block * block < size) block *= 2;
+    return block;
+}
+
+static void signature_free(Signature *sig) {
+    free(sig->sums);
+    free(sig->heads);
+    free(sig->next);
+}
+
+// 计算参照文件所有完整块的签名，末尾不足一块的部分不参与匹配
+static int signature_build(const unsigned char *data, size_t size, Signature *sig) {
+    memset(sig, 0, sizeof(*sig));
+    sig->block = block_size(size);
+    sig->count = size / sig->block;
+    size_t table = 1;
+    while (table < sig->count * 2) table *= 2;
+    sig->mask = table - 1;
+
+    sig->sums = malloc((sig->count + 1) * sizeof(BlockSum));
+    sig->heads = calloc(table, sizeof(uint32_t));
+    sig->next = malloc((sig->count + 1) * sizeof(uint32_t));
+    if (sig->sums == NULL || sig->heads == NULL || sig->next == NULL || sig->count >= UINT32_MAX) {
+        signature_free(sig);
+        return -1;
+    }
+
+    for (size_t i = 0; i < sig->count; i++) {
+        const unsigned char *block = data + i * sig->block;
+        uint32_t a, b;
+        sig->sums[i].weak = weak_sum(block, sig->block, &a, &b);
+        strong_sum(block, sig->block, sig->sums[i].strong);
+    }
+    // 倒序插入，链表中块按位置升序，优先匹配靠前的块
+    for (size_t i = sig->count; i-- > 0;) {
+        size_t slot = (sig->sums[i].weak * 2654435761u) & sig->mask;
+        sig->next[i] = sig->heads[slot];
+        sig->heads[slot] = (uint32_t)(i + 1);
+    }
+    return 0;
+}
+
+static int write_all(int fd, const unsigned char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// 复用参照文件的一段：优先 copy_file_range，数据不经过本机；不支持时读出再写入
+static int flush_copy(SyncWriter *writer) {
+    if (writer->copy_len == 0) return 0;
+    off_t from = writer->copy_from;
+    size_t remaining = writer->copy_len;
+    writer->copy_len = 0;
+
+    while (remaining > 0 && writer->copy_range) {
+        ssize_t n = copy_file_range(writer->basis_fd, &from, writer->out_fd, NULL, remaining, 0);
+        if (n < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+            writer->copy_range = false;
+            break;
+        }
+        if (n <= 0) return -1;
+        remaining -= (size_t)n;
+        writer->stats->reused += (unsigned long long)n;
+    }
+
+    unsigned char buffer[64 * 1024];
+    while (remaining > 0) {
+        size_t chunk = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+        ssize_t n = pread(writer->basis_fd, buffer, chunk, from);
+        if (n <= 0 || write_all(writer->out_fd, buffer, (size_t)n) != 0) return -1;
+        from += n;
+        remaining -= (size_t)n;
+        writer->stats->reused += (unsigned long long)n;
+        writer->stats->written += (unsigned long long)n;
+    }
+    return 0;
+}
+
+static int emit_copy(SyncWriter *writer, off_t from, size_t len) {
+    if (writer->copy_len > 0 && writer->copy_from + (off_t)writer->copy_len == from) {
+        writer->copy_len += len;
+    } else {
+        if (flush_copy(writer) != 0) return -1;
+        writer->copy_from = from;
+        writer->copy_len = len;
+    }
+    if (writer->progress != NULL) __atomic_add_fetch(writer->progress, len, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static int emit_literal(SyncWriter *writer, const unsigned char *data, size_t len) {
+    if (len == 0) return 0;
+    if (flush_copy(writer) != 0 || write_all(writer->out_fd, data, len) != 0) return -1;
+    writer->stats->written += len;
+    if (writer->progress != NULL) __atomic_add_fetch(writer->progress, len, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// 在源文件中滚动查找与参照块相同的窗口
+static int sync_scan(const unsigned char *src, size_t size, const Signature *sig, SyncWriter *writer) {
+    size_t block = sig->block;
+    size_t pos = 0;
+    size_t literal = 0;
+    uint32_t a = 0, b = 0;
+    bool window = false;
+
+    while (sig->count > 0 && pos + block <= size) {
+        if (!window) {
+            weak_sum(src + pos, block, &a, &b);
+            window = true;
+        }
+        uint32_t weak = a | (b << 16);
+
+        bool strong_ready = false;
+        uint8_t strong[SYNC_STRONG_SIZE];
+        long matched = -1;
+        for (uint32_t i = sig->heads[(weak * 2654435761u) & sig->mask]; i != 0; i = sig->next[i - 1]) {
+            const BlockSum *sum = &sig->sums[i - 1];
+            if (sum->weak != weak) continue;
+            if (!strong_ready) {
+                strong_sum(src + pos, block, strong);
+                strong_ready = true;
+            }
+            if (memcmp(sum->strong, strong, SYNC_STRONG_SIZE) == 0) {
+                matched = (long)(i - 1);
+                // 紧接上一段复用的块可以合并成一次复制，优先选它
+                if (writer->copy_len > 0 &&
+                    (off_t)(matched * block) == writer->copy_from + (off_t)writer->copy_len) {
+                    break;
+                }
+            }
+        }
+
+        if (matched >= 0) {
+            if (emit_literal(writer, src + literal, pos - literal) != 0) return -1;
+            if (emit_copy(writer, (off_t)matched * (off_t)block, block) != 0) return -1;
+            pos += block;
+            literal = pos;
+            window = false;
+            continue;
+        }
+
+        // 窗口右移一个字节
+        if (pos + block < size) {
+            a = (a - src[pos] + src[pos + block]) & 0xffff;
+            b = (b - (uint32_t)block * src[pos] + a) & 0xffff;
+        }
+        pos++;
+    }
+
+    if (emit_literal(writer, src + literal, size - literal) != 0) return -1;
+    return flush_copy(writer);
+}
+
+static int map_readonly(int fd, size_t size, const unsigned char **data) {
+    *data = NULL;
+    if (size == 0) return 0;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return -1;
+    *data = map;
+    return 0;
+}
+
+int sync_file(CopyJob *job, SyncStats *stats, unsigned long long *progress) {
+    int src_fd = open(job->src, O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) return -1;
+    int basis_fd = open(job->sync_basis, O_RDONLY | O_CLOEXEC);
+    struct stat basis_st;
+    if (basis_fd < 0 || fstat(basis_fd, &basis_st) != 0) {
+        // 参照文件不可用时退回完整复制
+        if (basis_fd >= 0) close(basis_fd);
+        close(src_fd);
+        unsigned long long bytes = 0;
+        int result = copy_file_data_hash(job->src, job->dst, &job->st, &bytes, job->hash, progress);
+        stats->written += bytes;
+        return result;
+    }
+
+    size_t size = (size_t)job->st.st_size;
+    const unsigned char *src = NULL;
+    const unsigned char *basis = NULL;
+    Signature sig;
+    bool have_sig = false;
+    char *tmp_path = NULL;
+    int out_fd = -1;
+    int result = -1;
+
+    if (map_readonly(src_fd, size, &src) != 0) goto out;
+    sha256_hex(src, size, job->hash);
+
+    // 目标本身就是参照且大小、修改时间一致时无需写入，只同步权限（chmod 不改变修改时间）
+    if (strcmp(job->sync_basis, job->dst) == 0 && basis_st.st_size == job->st.st_size &&
+        basis_st.st_mtim.tv_sec == job->st.st_mtim.tv_sec &&
+        basis_st.st_mtim.tv_nsec == job->st.st_mtim.tv_nsec) {
+        stats->reused += size;
+        if (progress != NULL) __atomic_add_fetch(progress, size, __ATOMIC_RELAXED);
+        result = 0;
+        if ((basis_st.st_mode & 07777) != (job->st.st_mode & 07777) &&
+            fchmod(basis_fd, job->st.st_mode & 07777) != 0) {
+            result = -1;
+        }
+        goto out;
+    }
+
+    if (map_readonly(basis_fd, (size_t)basis_st.st_size, &basis) != 0) goto out;
+    if (signature_build(basis, (size_t)basis_st.st_size, &sig) != 0) goto out;
+    have_sig = true;
+
+    out_fd = open_temp_file(job->dst, &tmp_path);
+    if (out_fd < 0) goto out;
+
+    SyncWriter writer = {
+        .basis_fd = basis_fd,
+        .out_fd = out_fd,
+        .copy_range = true,
+        .stats = stats,
+        .progress = progress,
+    };
+    result = sync_scan(src, size, &sig, &writer);
+
+    if (result == 0) {
+        struct timespec times[2] = { job->st.st_atim, job->st.st_mtim };
+        if (fchmod(out_fd, job->st.st_mode & 07777) != 0 || futimens(out_fd, times) != 0) result = -1;
+    }
+    if (close(out_fd) != 0) result = -1;
+    out_fd = -1;
+    if (result == 0 && rename(tmp_path, job->dst) != 0) result = -1;
+
+out:;
+    // 清理会改写 errno，保留失败时的值供调用者报告
+    int error = errno;
+    if (result != 0 && out_fd < 0 && tmp_path != NULL) unlink(tmp_path);
+    if (out_fd >= 0) {
+        close(out_fd);
+        unlink(tmp_path);
+    }
+    if (have_sig) signature_free(&sig);
+    if (src != NULL) munmap((void*)src, size);
+    if (basis != NULL) munmap((void*)basis, (size_t)basis_st.st_size);
+    free(tmp_path);
+    close(basis_fd);
+    close(src_fd);
+    errno = error;
+    return result;
+}
+
+void sync_prepare(CopyPlan *plan, size_t first, const char *date) {
+    size_t found = 0;
+    for (size_t i = first; i < plan->job_count; i++) {
+        CopyJob *job = &plan->jobs[i];
+        if (!job->sync) continue;
+        // 压缩输出和内容存储不按块同步
+        if (job->compress != COMPRESS_NONE || plan->store != NULL) continue;
+
+        struct stat st;
+        if (lstat(job->dst, &st) == 0 && S_ISREG(st.st_mode)) {
+            job->sync_basis = strdup(job->dst);
+        } else {
+            job->sync_basis = previous_artifact(plan, job, date);
+        }
+        if (job->sync_basis != NULL) found++;
+    }
+    if (found > 0) {
+        log_info("%zu 个文件将按块增量同步", found);
+    }
+}
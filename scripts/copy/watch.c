@@ -0,0 +1,486 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "copy.h"
+#include "../utils/treecopy.h"
+
+// 文件写完关闭或移入目录时复制；新建的目录加入监视
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR)
+// 没有事件时检查完成标记的间隔
+#define WATCH_POLL_MS 500
+#define WATCH_BUFFER_SIZE (64 * 1024)
+
+// 目标路径到任务的索引，用于跳过未变化的文件和取代过期的任务
+typedef struct {
+    char *dst;
+    size_t job;
+    bool seen;              // 结束时的完整展开中仍然存在
+} LedgerEntry;
+
+typedef struct {
+    CopyPlan *plan;
+    const CopyWatch *watch;
+    CopyTotals *totals;
+    SourceSpec *specs;      // 与 watch->rules 一一对应
+    char **outputs;
+    int *output_ids;
+    int fd;
+    char **dirs;            // 按监视描述符索引的目录路径
+    int dir_capacity;
+    size_t dir_count;
+    bool watch_full;        // 已达到 max_user_watches
+    LedgerEntry *ledger;
+    size_t ledger_count;
+    size_t ledger_capacity;
+    size_t batch_first;     // 尚未执行的第一个任务
+    bool final;
+} WatchState;
+
+static volatile sig_atomic_t watch_stop = 0;
+
+static void watch_signal(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+static char* child_path(const char *dir, const char *name) {
+    char *path = NULL;
+    if (strcmp(dir, ".") == 0) return strdup(name);
+    if (asprintf(&path, "%s%s%s", dir, dir[strlen(dir) - 1] == '/' ? "" : "/", name) < 0) return NULL;
+    return path;
+}
+
+static size_t ledger_hash(const char *key) {
+    size_t hash = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// 返回 dst 所在的槽位，不存在时返回应插入的空槽位；调用前保证有空余
+static LedgerEntry* ledger_slot(WatchState *state, const char *dst) {
+    size_t mask = state->ledger_capacity - 1;
+    for (size_t i = ledger_hash(dst) & mask;; i = (i + 1) & mask) {
+        LedgerEntry *entry = &state->ledger[i];
+        if (entry->dst == NULL || strcmp(entry->dst, dst) == 0) return entry;
+    }
+}
+
+static int ledger_reserve(WatchState *state) {
+    if ((state->ledger_count + 1) * 2 <= state->ledger_capacity) return 0;
+    size_t capacity = state->ledger_capacity ? state->ledger_capacity * 2 : 1024;
+    LedgerEntry *old = state->ledger;
+    size_t old_capacity = state->ledger_capacity;
+    state->ledger = calloc(capacity, sizeof(LedgerEntry));
+    if (state->ledger == NULL) {
+        state->ledger = old;
+        return -1;
+    }
+    state->ledger_capacity = capacity;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].dst != NULL) *ledger_slot(state, old[i].dst) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+static bool same_file(const struct stat *a, const struct stat *b) {
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+// 把规则 index 匹配到的 src 加入计划；同一目标已有任务时，源文件未变化则跳过，
+// 任务尚未执行则更新其元数据，已执行过则由新任务取代
+static int plan_file(WatchState *state, size_t index, const char *src, const char *name,
+                     const struct stat *st, bool entry) {
+    CopyPlan *plan = state->plan;
+    const CopyRule *rule = state->watch->rules[index];
+    char *dst = child_path(state->outputs[index], name);
+    if (dst == NULL || ledger_reserve(state) != 0) {
+        free(dst);
+        plan->errors++;
+        return -1;
+    }
+
+    LedgerEntry *slot = ledger_slot(state, dst);
+    if (slot->dst != NULL) {
+        CopyJob *job = &plan->jobs[slot->job];
+        slot->seen = state->final;
+        if (!job->superseded && same_file(&job->st, st)) {
+            free(dst);
+            return 0;
+        }
+        if (slot->job >= state->batch_first) {
+            plan->total_bytes += (unsigned long long)st->st_size - (unsigned long long)job->st.st_size;
+            job->st = *st;
+            free(dst);
+            return 0;
+        }
+        job->superseded = true;
+        log_info("源文件已更新，重新复制: %s", src);
+    }
+
+    size_t planned = plan->job_count;
+    int result = entry ? copy_plan_add_entry(plan, src, dst, rule, state->output_ids[index]) :
+                         copy_plan_add(plan, src, dst, rule, state->output_ids[index]);
+    if (result != 0) {
+        log_error("复制失败: %s -> %s", src, dst);
+    } else if (plan->job_count > planned) {
+        if (!state->final) log_info("复制: %s -> %s", src, dst);
+        if (slot->dst == NULL) {
+            slot->dst = dst;
+            state->ledger_count++;
+            dst = NULL;
+        }
+        slot->job = planned;
+        slot->seen = state->final;
+    }
+    free(dst);
+    return result;
+}
+
+// 构建过程中出现的文件：交给匹配它的每条规则
+static void handle_file(WatchState *state, const char *path) {
+    struct stat st;
+    if (lstat(path, &st) != 0 || !S_ISREG(st.st_mode)) return;
+    for (size_t i = 0; i < state->watch->rule_count; i++) {
+        char *name = NULL;
+        if (source_spec_match(&state->specs[i], path, &name)) {
+            plan_file(state, i, path, name, &st, false);
+        }
+        free(name);
+    }
+}
+
+static bool wanted_dir(const WatchState *state, const char *path) {
+    for (size_t i = 0; i < state->watch->rule_count; i++) {
+        if (source_spec_wants_dir(&state->specs[i], path)) return true;
+    }
+    return false;
+}
+
+// 监视目录并扫描已有的内容：先加监视再扫描，扫描期间写完的文件不会遗漏
+static void add_dir(WatchState *state, const char *path) {
+    if (!wanted_dir(state, path)) return;
+
+    int wd = inotify_add_watch(state->fd, path, WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC && !state->watch_full) {
+            log_warning("inotify 监视数达到上限 (fs.inotify.max_user_watches)，"
+                        "其余目录中的文件在构建结束后复制");
+            state->watch_full = true;
+        }
+        return;
+    }
+    if (wd >= state->dir_capacity) {
+        int capacity = state->dir_capacity ? state->dir_capacity : 64;
+        while (capacity <= wd) capacity *= 2;
+        char **dirs = realloc(state->dirs, capacity * sizeof(char*));
+        if (dirs == NULL) return;
+        memset(dirs + state->dir_capacity, 0, (capacity - state->dir_capacity) * sizeof(char*));
+        state->dirs = dirs;
+        state->dir_capacity = capacity;
+    }
+    // 同一目录（如通过不同的路径）只监视一次
+    if (state->dirs[wd] != NULL) return;
+    state->dirs[wd] = strdup(path);
+    if (state->dirs[wd] == NULL) return;
+    state->dir_count++;
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char *child = child_path(path, entry->d_name);
+        if (child == NULL) continue;
+        unsigned char type = entry->d_type;
+        struct stat st;
+        if (type == DT_UNKNOWN && lstat(child, &st) == 0) {
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_DIR) {
+            add_dir(state, child);
+        } else if (type == DT_REG) {
+            handle_file(state, child);
+        }
+        free(child);
+    }
+    closedir(dir);
+}
+
+// 源目录可能在构建中途才创建，从最近的已存在的上级目录开始监视
+static void add_root(WatchState *state, const char *root) {
+    char *dir = strdup(root);
+    if (dir == NULL) return;
+    struct stat st;
+    while (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        char *slash = strrchr(dir, '/');
+        if (slash == NULL) {
+            strcpy(dir, ".");
+        } else if (slash == dir) {
+            dir[1] = '\0';
+        } else {
+            *slash = '\0';
+            continue;
+        }
+        break;
+    }
+    add_dir(state, dir);
+    free(dir);
+}
+
+// 执行新加入的任务；源目录中的 sha256sums 可能还是上一次构建的，留到最后核对
+static void run_batch(WatchState *state) {
+    CopyPlan *plan = state->plan;
+    if (plan->job_count == state->batch_first) return;
+    sync_prepare(plan, state->batch_first, state->watch->date);
+    CopyTotals batch;
+    copy_plan_run_from(plan, state->batch_first, state->watch->jobs, &batch);
+    copy_totals_add(state->totals, &batch);
+    state->batch_first = plan->job_count;
+}
+
+static void read_events(WatchState *state) {
+    char buffer[WATCH_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t len = read(state->fd, buffer, sizeof(buffer));
+        if (len <= 0) break;
+        for (char *p = buffer; p < buffer + len;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // 丢失的事件由结束时的完整展开补齐
+                log_warning("inotify 事件队列溢出，部分文件将在构建结束后复制");
+                continue;
+            }
+            if (event->wd < 0 || event->wd >= state->dir_capacity || state->dirs[event->wd] == NULL) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                free(state->dirs[event->wd]);
+                state->dirs[event->wd] = NULL;
+                state->dir_count--;
+                continue;
+            }
+            if (event->len == 0) continue;
+
+            char *path = child_path(state->dirs[event->wd], event->name);
+            if (path == NULL) continue;
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) add_dir(state, path);
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                handle_file(state, path);
+            }
+            free(path);
+        }
+    }
+}
+
+// 构建结束后按规则完整展开一次：补齐监视遗漏或之后又修改过的文件，
+// 匹配到的目录逐个条目处理，已复制且未变化的文件不再复制
+static void final_pass(WatchState *state) {
+    CopyPlan *plan = state->plan;
+    DirTreeCache cache = {0};
+    state->final = true;
+
+    for (size_t i = 0; i < state->watch->rule_count; i++) {
+        SourceList sources = {0};
+        if (source_expand(state->watch->rules[i]->source, &cache, state->watch->walk_jobs, &sources) != 0) {
+            log_error("展开源路径失败: %s", state->watch->rules[i]->source);
+            plan->errors++;
+        }
+        for (size_t j = 0; j < sources.count; j++) {
+            const SourceMatch *match = &sources.items[j];
+            struct stat st;
+            if (stat(match->path, &st) != 0) {
+                log_error("无法访问: %s", match->path);
+                plan->errors++;
+                continue;
+            }
+            if (!S_ISDIR(st.st_mode)) {
+                plan_file(state, i, match->path, match->name, &st, false);
+                continue;
+            }
+
+            char *dst = child_path(state->outputs[i], match->name);
+            if (dst == NULL || copy_plan_add_dir(plan, match->path, dst) != 0) {
+                free(dst);
+                continue;
+            }
+            DirTree *tree = dir_tree_walk(match->path, state->watch->walk_jobs);
+            const SourceSpec *spec = &state->specs[i];
+            for (size_t k = 0; tree != NULL && k < tree->count; k++) {
+                const DirEntry *entry = &tree->entries[k];
+                char *src = child_path(match->path, entry->path);
+                char *name = child_path(match->name, entry->path);
+                char *sub = child_path(dst, entry->path);
+                if (src == NULL || name == NULL || sub == NULL) {
+                    plan->errors++;
+                } else if (source_excluded(spec->excludes, spec->exclude_count, src, strlen(match->path))) {
+                    // 与 source_expand 相同，匹配目录中被排除的条目不复制
+                } else if (entry->type == DT_DIR) {
+                    copy_plan_add_dir(plan, src, sub);
+                } else if (lstat(src, &st) == 0) {
+                    plan_file(state, i, src, name, &st, !S_ISREG(st.st_mode));
+                }
+                free(src);
+                free(name);
+                free(sub);
+            }
+            if (tree == NULL) {
+                log_error("无法读取目录: %s", match->path);
+                plan->errors++;
+            }
+            dir_tree_free(tree);
+            free(dst);
+        }
+        source_list_free(&sources);
+    }
+    dir_tree_cache_free(&cache);
+
+    // 构建中途出现、最后已不存在的文件（临时文件等）不属于产物
+    for (size_t i = 0; i < state->ledger_capacity; i++) {
+        LedgerEntry *entry = &state->ledger[i];
+        if (entry->dst == NULL || entry->seen) continue;
+        CopyJob *job = &plan->jobs[entry->job];
+        if (job->superseded) continue;
+        log_warning("源文件已不存在，删除: %s", job->dst);
+        job->superseded = true;
+        unlink(job->dst);
+    }
+}
+
+int copy_watch(CopyPlan *plan, const CopyWatch *watch, CopyTotals *totals) {
+    WatchState state = { .plan = plan, .watch = watch, .totals = totals, .fd = -1 };
+    memset(totals, 0, sizeof(*totals));
+    int result = 0;
+
+    size_t count = watch->rule_count > 0 ? watch->rule_count : 1;
+    state.specs = calloc(count, sizeof(SourceSpec));
+    state.outputs = calloc(count, sizeof(char*));
+    state.output_ids = calloc(count, sizeof(int));
+    if (state.specs == NULL || state.outputs == NULL || state.output_ids == NULL) {
+        result = -1;
+        goto out;
+    }
+    for (size_t i = 0; i < watch->rule_count; i++) {
+        state.outputs[i] = copy_output_dir(watch->rules[i], watch->date, watch->marker);
+        if (state.outputs[i] == NULL || source_spec_parse(watch->rules[i]->source, &state.specs[i]) != 0) {
+            log_error("解析源路径失败: %s", watch->rules[i]->source);
+            result = -1;
+            goto out;
+        }
+        state.output_ids[i] = copy_plan_output(plan, state.outputs[i], watch->rules[i]->target);
+    }
+
+    state.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (state.fd < 0) {
+        log_error("inotify 初始化失败: %s", strerror(errno));
+        result = -1;
+        goto out;
+    }
+
+    // 中断（或编译失败后被 make build-copy 终止）时停止监视，并删除本次复制的文件
+    struct sigaction action = { .sa_handler = watch_signal };
+    struct sigaction old_int, old_term;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+    watch_stop = 0;
+
+    for (size_t i = 0; i < watch->rule_count; i++) {
+        for (int j = 0; j < state.specs[i].include_count; j++) {
+            add_root(&state, state.specs[i].roots[j]);
+        }
+    }
+    log_info("监视 %zu 个源目录，等待构建完成标记: %s", state.dir_count, watch->done_file);
+    run_batch(&state);
+
+    while (!watch_stop) {
+        struct pollfd pfd = { .fd = state.fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, WATCH_POLL_MS);
+        if (ready < 0 && errno != EINTR) {
+            log_error("等待 inotify 事件失败: %s", strerror(errno));
+            result = -1;
+            break;
+        }
+        if (ready > 0) read_events(&state);
+        run_batch(&state);
+        if (access(watch->done_file, F_OK) == 0) break;
+    }
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+
+    if (watch_stop) {
+        // 构建没有完成，已复制的只是部分产物：删除这些文件并标记为已取代，
+        // 不写入校验清单和产物索引，避免被当作最新的产物查询到
+        size_t removed = 0;
+        for (size_t i = 0; i < plan->job_count; i++) {
+            CopyJob *job = &plan->jobs[i];
+            if (job->superseded) continue;
+            job->superseded = true;
+            if (job->result == 0 && unlink(job->dst) == 0) removed++;
+        }
+        log_warning("监视被中断，不再补齐剩余文件，已删除本次复制的 %zu 个文件", removed);
+        result = -1;
+    } else if (result == 0) {
+        log_info("构建已完成，构建期间已复制 %zu 个文件，检查剩余文件", totals->files_copied);
+        size_t first = state.batch_first;
+        final_pass(&state);
+
+        // 构建结束后 sha256sums 已更新，之前复制的文件用复制时计算的摘要核对
+        manifest_load_expected(plan);
+        for (size_t i = 0; i < first; i++) {
+            CopyJob *job = &plan->jobs[i];
+            if (job->superseded || job->result != 0 || job->expected[0] == '\0' ||
+                job->compress != COMPRESS_NONE) {
+                continue;
+            }
+            if (strcmp(job->hash, job->expected) == 0) {
+                totals->files_verified++;
+            } else {
+                log_error("校验失败: %s (sha256sums: %s, 实际: %s)", job->src, job->expected, job->hash);
+                // 与 run_job 相同：不符的文件不留在输出目录中，失败的任务也不写入校验清单和产物索引
+                unlink(job->dst);
+                job->result = -1;
+            }
+        }
+        run_batch(&state);
+    }
+
+    // 被取代的任务不计入结果
+    totals->files_copied = 0;
+    totals->files_failed = 0;
+    for (size_t i = 0; i < plan->job_count; i++) {
+        if (plan->jobs[i].superseded) continue;
+        if (plan->jobs[i].result == 0) totals->files_copied++;
+        else totals->files_failed++;
+    }
+
+out:
+    if (state.fd >= 0) close(state.fd);
+    for (int i = 0; i < state.dir_capacity; i++) free(state.dirs[i]);
+    free(state.dirs);
+    for (size_t i = 0; i < state.ledger_capacity; i++) free(state.ledger[i].dst);
+    free(state.ledger);
+    for (size_t i = 0; state.specs != NULL && i < watch->rule_count; i++) {
+        source_spec_free(&state.specs[i]);
+        if (state.outputs != NULL) free(state.outputs[i]);
+    }
+    free(state.specs);
+    free(state.outputs);
+    free(state.output_ids);
+    return result;
+}
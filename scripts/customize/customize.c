@@ -18,6 +18,19 @@ void print_usage(const char *program_name) {
     printf("  -s, --src-dir <dir>  指定源码目录 (默认: 项目根目录/srcs)\n");
     printf("  -r, --res-dir <dir>  指定资源目录 (默认: 配置文件所在目录/res)\n");
     printf("  -a, --author <name>  指定作者名称 (默认从配置文件读取)\n");
+    printf("  -f, --force          忽略规则日志，重新检查所有规则\n");
+    printf("  -j, --jobs <n>       并行处理目标文件的线程数 (默认: CPU 核心数)\n");
+    printf("      --no-journal     不读取也不写入规则日志 (源码目录/%s)\n", CUSTOMIZE_STATE_DIR);
+    printf("      --build-time-file <file>  构建时间只写入该文件，__BUILD_TIME__ 替换为对它的引用\n");
+    printf("      --profile        输出每条规则和每个文件的耗时、读写字节数、扫描行数和匹配数\n");
+    printf("      --profile-json <file>  把性能统计以 JSON 格式写入文件\n");
+    printf("\n构建时间文件 (--build-time-file 或配置 BUILD_TIME_FILE):\n");
+    printf("  构建时间只写入该文件，规则中的 __BUILD_TIME__ 替换为 $(cat <文件在目标系统中的路径>)，\n");
+    printf("  其他文件内容保持不变，避免每次编译都重新打包 default-settings。\n");
+    printf("  目标系统中的路径取 files/ 之后的部分，也可用配置 BUILD_TIME_REF 直接指定引用文本。\n");
+    printf("  仅在 build 阶段生效，init 阶段 __BUILD_TIME__ 仍替换为当前时间。\n");
+    printf("  $(cat ...) 只在目标系统中由 shell 求值时展开 (双引号或不加引号的赋值)，\n");
+    printf("  单引号内、UCI 配置或普通文本文件中会原样保留，这类位置不要使用 __BUILD_TIME__。\n");
 }
 
 // 获取项目根目录
@@ -134,6 +147,12 @@ int main(int argc, char *argv[]) {
     char *res_dir = NULL;
     char *author = NULL;
     char *project_root = NULL;
+    char *build_time_file = NULL;
+    char *profile_json = NULL;
+    bool profile = false;
+    bool force = false;
+    bool use_journal = true;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
     
     // 标记哪些指针是动态分配的
     bool src_dir_allocated = false;
@@ -147,11 +166,17 @@ int main(int argc, char *argv[]) {
         {"src-dir", required_argument, 0, 's'},
         {"res-dir", required_argument, 0, 'r'},
         {"author", required_argument, 0, 'a'},
+        {"force", no_argument, 0, 'f'},
+        {"jobs", required_argument, 0, 'j'},
+        {"no-journal", no_argument, 0, 'J'},
+        {"build-time-file", required_argument, 0, 'T'},
+        {"profile", no_argument, 0, 'P'},
+        {"profile-json", required_argument, 0, 'R'},
         {0, 0, 0, 0}
     };
     
     int opt;
-    while ((opt = getopt_long(argc, argv, "hc:s:r:a:", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hc:s:r:a:fj:", long_options, NULL)) != -1) {
         switch (opt) {
             case 'h':
                 print_usage(argv[0]);
@@ -180,6 +205,34 @@ int main(int argc, char *argv[]) {
                 author_allocated = false;
                 break;
                 
+            case 'f':
+                force = true;
+                break;
+                
+            case 'J':
+                use_journal = false;
+                break;
+                
+            case 'T':
+                build_time_file = optarg;
+                break;
+                
+            case 'P':
+                profile = true;
+                break;
+                
+            case 'R':
+                profile_json = optarg;
+                break;
+                
+            case 'j':
+                jobs = atol(optarg);
+                if (jobs < 1) {
+                    log_error("错误: 无效的线程数 %s", optarg);
+                    return 1;
+                }
+                break;
+                
             default:
                 print_usage(argv[0]);
                 return 1;
@@ -231,12 +284,12 @@ int main(int argc, char *argv[]) {
     
     // 解析配置文件和变量
     Rule *rules = NULL;
-    char **variables = NULL;
     int rule_count = 0;
-    int var_count = 0;
+    VarEnv *env = varenv_new();
     
-    if (parse_customize_config(config_file, &rules, &rule_count, &variables, &var_count) != 0) {
+    if (env == NULL || parse_customize_config(config_file, &rules, &rule_count, env) != 0) {
         log_error("错误: 解析配置文件失败");
+        varenv_free(env);
         free(project_root);
         if (src_dir_allocated) free(src_dir);
         if (res_dir_allocated) free(res_dir);
@@ -246,7 +299,8 @@ int main(int argc, char *argv[]) {
     
     if (rule_count == 0) {
         log_info("没有找到任何规则");
-        free_rules_and_vars(rules, rule_count, variables, var_count);
+        free_rules(rules, rule_count);
+        varenv_free(env);
         free(project_root);
         if (src_dir_allocated) free(src_dir);
         if (res_dir_allocated) free(res_dir);
@@ -254,11 +308,32 @@ int main(int argc, char *argv[]) {
         return 0;
     }
     
+    // 内置变量优先于配置文件中的同名定义
+    varenv_set_literal(env, "SRC_DIR", src_dir);
+    varenv_set_literal(env, "RES_DIR", res_dir);
+    varenv_set_literal(env, "AUTHOR", author);
+    if (build_time_file != NULL) {
+        varenv_set_literal(env, "BUILD_TIME_FILE", build_time_file);
+    }
+    
+    // 规则日志保存在源码目录下
+    char state_dir[PATH_MAX];
+    snprintf(state_dir, sizeof(state_dir), "%s/%s", src_dir, CUSTOMIZE_STATE_DIR);
+    
+    ExecOptions options = {
+        .state_dir = use_journal ? state_dir : NULL,
+        .force = force,
+        .jobs = jobs > 0 ? (int)jobs : 1,
+        .profile = profile,
+        .profile_json = profile_json
+    };
+    
     // 执行规则
-    int result = execute_rules(rules, rule_count, context, src_dir, res_dir, author, variables, var_count);
+    int result = execute_rules(rules, rule_count, context, env, &options);
     
     // 释放内存
-    free_rules_and_vars(rules, rule_count, variables, var_count);
+    free_rules(rules, rule_count);
+    varenv_free(env);
     free(project_root);
     if (src_dir_allocated) free(src_dir);
     if (res_dir_allocated) free(res_dir);
@@ -2,8 +2,15 @@
 #define CUSTOMIZE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <regex.h>
+#include <sys/stat.h>
 #include "../utils/utils.h" 
+#include "../utils/varenv.h"
+#include "../utils/sha256.h"
+
+// 规则日志目录（位于源码目录下）
+#define CUSTOMIZE_STATE_DIR ".customize-state"
 
 // 操作类型枚举
 typedef enum {
@@ -14,6 +21,8 @@ typedef enum {
     OP_DELETE,
     OP_EXEC,
     OP_COPY,
+    OP_KCONFIG_SET,
+    OP_KCONFIG_UNSET,
     OP_UNKNOWN
 } OperationType;
 
@@ -34,22 +43,196 @@ typedef struct {
     char *param2;
 } Rule;
 
+// 匹配方式：不含正则元字符的模式直接按字面量匹配
+typedef enum {
+    MATCH_LITERAL,          // 任意位置的字面量
+    MATCH_PREFIX,           // ^literal
+    MATCH_SUFFIX,           // literal$
+    MATCH_EXACT,            // ^literal$
+    MATCH_REGEX             // 其他情况使用 POSIX 扩展正则
+} MatchKind;
+
+// 预编译的匹配模式
+typedef struct {
+    MatchKind kind;
+    char *literal;          // 字面量；正则模式下为每个匹配都必须包含的片段
+    size_t literal_len;
+    regex_t regex;
+    bool regex_ready;
+} Matcher;
+
+typedef struct AcAutomaton AcAutomaton;
+typedef struct KconfigIndex KconfigIndex;
+
+// 单条规则实例的性能计数（--profile）
+typedef struct {
+    uint64_t wall_ns;       // 规则执行耗时
+    uint64_t compile_ns;    // 编译匹配模式的耗时
+    uint64_t subprocess_ns; // exec/copy 子进程耗时
+    size_t bytes_read;      // 扫描的字节数
+    size_t bytes_written;   // 生成的字节数（替换结果、插入内容）
+    size_t lines_scanned;
+    int matches;
+} RuleProfile;
+
+// 变量替换后的规则实例
+typedef struct {
+    const Rule *rule;
+    int index;              // 规则序号（配置文件中的第几条规则，从 1 开始）
+    char *target_file;
+    char *param1;
+    char *param2;
+    Matcher matcher;        // 预编译的匹配模式
+    bool matcher_ready;
+    bool absent;            // 预筛选确认模式不在文件中，无需逐行扫描
+    char signature[SHA256_HEX_SIZE];  // 规则签名，用于规则日志
+    bool journaled;         // 规则日志表明已经应用，无需再次检查
+    int result;             // 0 成功，非 0 失败
+    RuleProfile profile;
+} RuleTask;
+
+// 规则执行选项
+typedef struct {
+    const char *state_dir;  // 规则日志目录，NULL 表示不使用规则日志
+    bool force;             // 忽略已有的规则日志
+    int jobs;               // 并行处理目标文件的线程数
+    bool profile;           // 输出每条规则和每个文件的性能统计
+    const char *profile_json;  // 性能统计的 JSON 输出文件，NULL 表示不输出
+} ExecOptions;
+
+// 单个目标文件的性能计数
+typedef struct {
+    char *path;
+    uint64_t wall_ns;       // 读取、执行规则、写回的总耗时
+    uint64_t load_ns;
+    uint64_t save_ns;
+    size_t bytes_read;
+    size_t bytes_written;
+    int rule_count;
+} FileProfile;
+
+// 同一目标文件上的一组文本编辑规则
+typedef struct {
+    char *path;
+    char *key;              // 规范化后的路径，用于合并指向同一文件的规则
+    RuleTask **tasks;
+    int task_count;
+    int task_capacity;
+    // 统计信息
+    int replace_count;
+    int insert_count;
+    int append_count;
+    int delete_count;
+    int kconfig_count;      // 实际改变的 Kconfig 符号数
+    int skip_count;
+    int journal_skip_count; // 根据规则日志直接跳过的规则数
+    int fail_count;
+    bool written;
+    bool loaded;
+    FileProfile profile;    // path 不单独分配
+} FileGroup;
+
+// 单个目标文件的规则日志
+typedef struct {
+    bool valid;
+    unsigned long long ino;
+    long long size;
+    long long mtime_ns;
+    char hash[SHA256_HEX_SIZE];  // 应用规则后的文件内容摘要
+    char **rules;                // 已应用规则的记录: <签名> <操作类型>
+    int rule_count;
+} Journal;
+
+// 一行内容的切片（不含换行符）
+// 未修改的行直接指向文件映射区，修改过或新插入的行才持有自己的内存
+typedef struct {
+    const char *data;
+    size_t len;
+    char *owned;
+} LineSlice;
+
+// 同一文件上多个字面量模式共享一次 Aho-Corasick 扫描，
+// 找出根本不在文件中的模式；之后新写入的内容会重新检查
+typedef struct {
+    AcAutomaton *ac;
+    bool **absent;          // 各模式对应规则的 absent 标记
+    bool *found;            // 扫描时使用的临时标记
+    int count;
+} Prefilter;
+
+// 内存中的文件内容
+typedef struct {
+    LineSlice *lines;
+    size_t count;
+    size_t capacity;
+    char *map;              // 普通文件的只读内存映射
+    size_t map_size;
+    char *data;             // 非普通文件（管道等）流式读取到的内容
+    size_t data_size;
+    size_t saved_size;      // 最近一次写回的字节数
+    Prefilter *prefilter;   // 修改内容时需要更新的预筛选结果
+    KconfigIndex *kconfig;  // .config 符号索引，首次执行 kconfig 规则时建立
+    unsigned long generation;  // 每次修改内容时递增，用于判断索引是否失效
+    bool final_newline;     // 最后一行是否以换行符结尾
+    bool missing;           // 文件原本不存在
+    bool modified;
+} FileBuffer;
+
 #ifndef PATH_MAX
 #define PATH_MAX 1024
 #endif
 
 // 函数声明
-int parse_customize_config(const char *filename, Rule **rules, int *rule_count, 
-                          char ***variables, int *var_count);
-void free_rules_and_vars(Rule *rules, int rule_count, char **variables, int var_count);
-int execute_rules(Rule *rules, int rule_count, ContextType current_context, 
-                  const char *src_dir, const char *res_dir, const char *author,
-                  char **variables, int var_count);
+int parse_customize_config(const char *filename, Rule **rules, int *rule_count, VarEnv *env);
+void free_rules(Rule *rules, int rule_count);
+int execute_rules(Rule *rules, int rule_count, ContextType current_context, VarEnv *env,
+                  const ExecOptions *options);
 ContextType parse_context(const char *context_str);
 OperationType parse_operation(const char *operation_str);
-char* replace_variables(const char *str, const char *src_dir, const char *res_dir, 
-                       const char *author, const char *build_time,
-                       char **variables, int var_count);
+const char* operation_to_string(OperationType operation);
+char* replace_variables(const VarEnv *env, const char *str);
 char* get_current_time_str(void);
+char* clean_string(const char *str);
+
+// filebuf.c
+bool is_text_edit_operation(OperationType operation);
+int filebuf_load(FileBuffer *buf, const char *path);
+int filebuf_save(FileBuffer *buf, const char *path);
+void filebuf_free(FileBuffer *buf);
+int filebuf_set_line(FileBuffer *buf, size_t pos, const char *text, size_t len);
+int filebuf_insert_line(FileBuffer *buf, size_t pos, const char *text);
+void filebuf_hash(const FileBuffer *buf, char hex[SHA256_HEX_SIZE]);
+int apply_file_group(FileGroup *group, const ExecOptions *options);
+
+// matcher.c
+int matcher_compile(Matcher *matcher, const char *pattern);
+void matcher_free(Matcher *matcher);
+bool matcher_has_literal(const Matcher *matcher);
+bool matcher_find(const Matcher *matcher, const char *data, size_t len, size_t start,
+                  bool notbol, size_t *so, size_t *eo);
+AcAutomaton* ac_build(const char **patterns, const size_t *lengths, int count);
+void ac_free(AcAutomaton *ac);
+void ac_scan(const AcAutomaton *ac, const char *data, size_t len, bool *found);
+
+// kconfig.c
+int kconfig_apply(FileBuffer *buf, const RuleTask *task);
+void kconfig_index_free(KconfigIndex *index);
+
+// profile.c
+uint64_t profile_now_ns(void);
+void profile_report(RuleTask **tasks, int task_count, const FileProfile *files, int file_count,
+                    uint64_t total_ns);
+int profile_write_json(const char *path, RuleTask **tasks, int task_count,
+                       const FileProfile *files, int file_count, uint64_t total_ns);
+
+// journal.c
+void rule_signature(const RuleTask *task, char sig[SHA256_HEX_SIZE]);
+int journal_load(const char *state_dir, const char *target, Journal *journal);
+bool journal_has_rule(const Journal *journal, const char *sig);
+bool journal_stat_matches(const Journal *journal, const struct stat *st);
+int journal_save(const char *state_dir, const char *target, const char *hash,
+                 RuleTask **tasks, int task_count);
+void journal_remove(const char *state_dir, const char *target);
+void journal_free(Journal *journal);
 
 #endif // CUSTOMIZE_H
\ No newline at end of file
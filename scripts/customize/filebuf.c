@@ -0,0 +1,817 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+
+#include "customize.h"
+
+// 写回文件时输出缓冲区达到该大小就落盘，内存占用与文件大小无关
+#define WRITE_CHUNK_SIZE (1024 * 1024)
+
+// 可增长的输出缓冲区
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} OutBuffer;
+
+static int outbuf_reserve(OutBuffer *out, size_t extra) {
+    if (out->len + extra <= out->cap) return 0;
+    size_t new_cap = out->cap ? out->cap * 2 : 256;
+    while (new_cap < out->len + extra) new_cap *= 2;
+    char *data = realloc(out->data, new_cap);
+    if (data == NULL) return -1;
+    out->data = data;
+    out->cap = new_cap;
+    return 0;
+}
+
+static int outbuf_append(OutBuffer *out, const char *data, size_t len) {
+    if (len == 0) return 0;
+    if (outbuf_reserve(out, len) != 0) return -1;
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    return 0;
+}
+
+// 将缓冲区内容全部写入文件描述符
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// 判断操作是否为可在内存中合并执行的文本编辑操作
+bool is_text_edit_operation(OperationType operation) {
+    return operation == OP_REPLACE || operation == OP_INSERT_AFTER ||
+           operation == OP_INSERT_BEFORE || operation == OP_APPEND ||
+           operation == OP_DELETE || operation == OP_KCONFIG_SET ||
+           operation == OP_KCONFIG_UNSET;
+}
+
+static int filebuf_reserve(FileBuffer *buf, size_t count) {
+    if (count <= buf->capacity) return 0;
+    size_t new_capacity = buf->capacity ? buf->capacity * 2 : 256;
+    while (new_capacity < count) new_capacity *= 2;
+    LineSlice *lines = realloc(buf->lines, new_capacity * sizeof(LineSlice));
+    if (lines == NULL) return -1;
+    buf->lines = lines;
+    buf->capacity = new_capacity;
+    return 0;
+}
+
+// 新写入的内容中出现了某个模式时，取消该模式的 absent 标记
+static void prefilter_note(Prefilter *prefilter, const char *text, size_t len) {
+    if (prefilter == NULL) return;
+    memset(prefilter->found, 0, prefilter->count * sizeof(bool));
+    ac_scan(prefilter->ac, text, len, prefilter->found);
+    for (int i = 0; i < prefilter->count; i++) {
+        if (prefilter->found[i]) *prefilter->absent[i] = false;
+    }
+}
+
+// 用新内容替换一行，新内容由该行持有
+static int line_set(LineSlice *line, const char *text, size_t len) {
+    char *owned = malloc(len + 1);
+    if (owned == NULL) return -1;
+    memcpy(owned, text, len);
+    owned[len] = '\0';
+    free(line->owned);
+    line->owned = owned;
+    line->data = owned;
+    line->len = len;
+    return 0;
+}
+
+// 在指定位置插入一行（text 不含换行符）
+static int filebuf_insert(FileBuffer *buf, size_t pos, const char *text) {
+    if (filebuf_reserve(buf, buf->count + 1) != 0) return -1;
+
+    LineSlice line = {0};
+    if (line_set(&line, text, strlen(text)) != 0) return -1;
+    prefilter_note(buf->prefilter, line.data, line.len);
+
+    memmove(&buf->lines[pos + 1], &buf->lines[pos], (buf->count - pos) * sizeof(LineSlice));
+    buf->lines[pos] = line;
+    buf->count++;
+    // 在末尾插入时，原来的最后一行需要补上换行符
+    if (pos + 1 == buf->count) buf->final_newline = true;
+    buf->modified = true;
+    buf->generation++;
+    return 0;
+}
+
+int filebuf_insert_line(FileBuffer *buf, size_t pos, const char *text) {
+    return filebuf_insert(buf, pos, text);
+}
+
+// 替换指定行的内容
+int filebuf_set_line(FileBuffer *buf, size_t pos, const char *text, size_t len) {
+    const LineSlice *line = &buf->lines[pos];
+    if (line->len == len && memcmp(line->data, text, len) == 0) return 0;
+    if (line_set(&buf->lines[pos], text, len) != 0) return -1;
+    prefilter_note(buf->prefilter, text, len);
+    buf->modified = true;
+    buf->generation++;
+    return 0;
+}
+
+// 把内容切分成行，切片直接指向原始数据
+static int filebuf_split(FileBuffer *buf, const char *data, size_t size) {
+    const char *pos = data;
+    const char *end = data + size;
+
+    while (pos < end) {
+        const char *newline = memchr(pos, '\n', (size_t)(end - pos));
+        size_t len = newline ? (size_t)(newline - pos) : (size_t)(end - pos);
+
+        if (filebuf_reserve(buf, buf->count + 1) != 0) return -1;
+        LineSlice *line = &buf->lines[buf->count++];
+        line->data = pos;
+        line->len = len;
+        line->owned = NULL;
+
+        pos += len + (newline ? 1 : 0);
+    }
+
+    buf->final_newline = size == 0 || data[size - 1] == '\n';
+    return 0;
+}
+
+// 非普通文件或无法映射时，流式读取全部内容
+static int filebuf_read_stream(FileBuffer *buf, int fd) {
+    OutBuffer in = {0};
+    for (;;) {
+        if (outbuf_reserve(&in, 65536) != 0) {
+            free(in.data);
+            return -1;
+        }
+        ssize_t n = read(fd, in.data + in.len, in.cap - in.len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(in.data);
+            return -1;
+        }
+        if (n == 0) break;
+        in.len += (size_t)n;
+    }
+
+    buf->data = in.data;
+    buf->data_size = in.len;
+    return filebuf_split(buf, in.data ? in.data : "", in.len);
+}
+
+// 读取文件：普通文件使用只读内存映射，其他文件流式读取
+// 文件不存在时返回空缓冲区并标记 missing
+int filebuf_load(FileBuffer *buf, const char *path) {
+    memset(buf, 0, sizeof(*buf));
+    buf->final_newline = true;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            buf->missing = true;
+            return 0;
+        }
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    int result;
+    if (S_ISREG(st.st_mode) && st.st_size == 0) {
+        result = 0;
+    } else if (S_ISREG(st.st_mode)) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+            buf->map = map;
+            buf->map_size = (size_t)st.st_size;
+            result = filebuf_split(buf, buf->map, buf->map_size);
+        } else {
+            result = filebuf_read_stream(buf, fd);
+        }
+    } else {
+        result = filebuf_read_stream(buf, fd);
+    }
+
+    close(fd);
+    if (result != 0) filebuf_free(buf);
+    return result;
+}
+
+// 写回文件：先写临时文件再重命名，保留原文件权限
+// 原文件的映射在重命名后依然有效，因此可以边读映射边写新文件
+int filebuf_save(FileBuffer *buf, const char *path) {
+    size_t tmp_len = strlen(path) + 5;
+    char *tmp_path = malloc(tmp_len);
+    if (tmp_path == NULL) return -1;
+    snprintf(tmp_path, tmp_len, "%s.tmp", path);
+
+    struct stat st;
+    mode_t mode = 0644;
+    if (!buf->missing && stat(path, &st) == 0) {
+        mode = st.st_mode & 07777;
+    }
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        log_error("错误: 无法创建临时文件 %s", tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    OutBuffer out = {0};
+    size_t saved_size = 0;
+    int result = 0;
+    for (size_t i = 0; i < buf->count && result == 0; i++) {
+        const LineSlice *line = &buf->lines[i];
+        bool newline = i + 1 < buf->count || buf->final_newline;
+        saved_size += line->len + (newline ? 1 : 0);
+
+        // 超长行直接写出，避免复制到输出缓冲区
+        if (line->len >= WRITE_CHUNK_SIZE) {
+            if (write_all(fd, out.data, out.len) != 0 ||
+                write_all(fd, line->data, line->len) != 0) {
+                result = -1;
+            }
+            out.len = 0;
+        } else if (outbuf_append(&out, line->data, line->len) != 0) {
+            result = -1;
+        }
+
+        if (result == 0 && newline && outbuf_append(&out, "\n", 1) != 0) {
+            result = -1;
+        }
+        if (result == 0 && out.len >= WRITE_CHUNK_SIZE) {
+            if (write_all(fd, out.data, out.len) != 0) result = -1;
+            out.len = 0;
+        }
+    }
+    if (result == 0 && write_all(fd, out.data, out.len) != 0) {
+        result = -1;
+    }
+    free(out.data);
+
+    if (result == 0) {
+        fchmod(fd, mode);
+        buf->saved_size = saved_size;
+    }
+    if (close(fd) != 0) result = -1;
+
+    if (result != 0) {
+        log_error("错误: 写入临时文件失败 %s", tmp_path);
+        remove(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    if (rename(tmp_path, path) != 0) {
+        log_error("错误: 无法替换原文件 %s", path);
+        remove(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    free(tmp_path);
+    buf->modified = false;
+    return 0;
+}
+
+// 生成的内容与读取时的原文件逐字节相同时无需写回
+// 避免无意义的重写改变文件的修改时间，触发 OpenWrt 重新打包
+static bool filebuf_unchanged(const FileBuffer *buf) {
+    if (buf->missing) return false;
+
+    const char *origin = buf->map ? (const char*)buf->map : buf->data;
+    size_t size = buf->map ? buf->map_size : buf->data_size;
+    size_t offset = 0;
+
+    for (size_t i = 0; i < buf->count; i++) {
+        const LineSlice *line = &buf->lines[i];
+        if (size - offset < line->len ||
+            (line->len > 0 && memcmp(origin + offset, line->data, line->len) != 0)) {
+            return false;
+        }
+        offset += line->len;
+
+        if (i + 1 < buf->count || buf->final_newline) {
+            if (offset >= size || origin[offset] != '\n') return false;
+            offset++;
+        }
+    }
+    return offset == size;
+}
+
+void filebuf_free(FileBuffer *buf) {
+    for (size_t i = 0; i < buf->count; i++) {
+        free(buf->lines[i].owned);
+    }
+    free(buf->lines);
+    if (buf->map) munmap(buf->map, buf->map_size);
+    kconfig_index_free(buf->kconfig);
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+// 检查文件中是否已经包含指定内容（按去除首尾空白后的行比较）
+static bool filebuf_contains(const FileBuffer *buf, const char *content, RuleProfile *profile) {
+    size_t content_len = strlen(content);
+    for (size_t i = 0; i < buf->count; i++) {
+        profile->lines_scanned++;
+        profile->bytes_read += buf->lines[i].len;
+        const char *start = buf->lines[i].data;
+        const char *end = start + buf->lines[i].len;
+        while (start < end && (*start == ' ' || *start == '\t' || *start == '\r')) start++;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+        if (memmem(start, (size_t)(end - start), content, content_len) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 替换操作（支持正则表达式），返回替换次数
+static int buffer_replace(FileBuffer *buf, RuleTask *task, const char *replace) {
+    int changes = 0;
+    size_t replace_len = strlen(replace);
+    OutBuffer result = {0};
+    // 预筛选确认模式不存在时无需逐行扫描
+    size_t line_count = task->absent ? 0 : buf->count;
+
+    for (size_t i = 0; i < line_count; i++) {
+        LineSlice *line = &buf->lines[i];
+        size_t pos = 0;
+        size_t so, eo;
+        bool notbol = false;
+        int line_changes = 0;
+        result.len = 0;
+        task->profile.lines_scanned++;
+        task->profile.bytes_read += line->len;
+
+        // 查找所有匹配
+        while (pos < line->len &&
+               matcher_find(&task->matcher, line->data, line->len, pos, notbol, &so, &eo)) {
+            // 复制匹配之前的部分和替换字符串
+            outbuf_append(&result, line->data + pos, so - pos);
+            outbuf_append(&result, replace, replace_len);
+
+            // 空匹配时前进一个字符，避免死循环
+            if (eo == so) {
+                if (eo >= line->len) {
+                    pos = line->len;
+                    line_changes++;
+                    break;
+                }
+                outbuf_append(&result, line->data + eo, 1);
+                pos = eo + 1;
+            } else {
+                pos = eo;
+            }
+            notbol = true;
+            line_changes++;
+        }
+
+        if (line_changes == 0) continue;
+
+        // 复制剩余部分
+        outbuf_append(&result, line->data + pos, line->len - pos);
+        if (filebuf_set_line(buf, i, result.data, result.len) != 0) break;
+        task->profile.bytes_written += result.len;
+        changes += line_changes;
+    }
+
+    free(result.data);
+    return changes;
+}
+
+// 插入操作（支持正则表达式），返回插入次数
+static int buffer_insert(FileBuffer *buf, RuleTask *task, const char *content, bool after) {
+    size_t content_len = strlen(content);
+    int changes = 0;
+    bool found_pattern = false;
+    size_t so, eo;
+
+    for (size_t i = 0; !task->absent && i < buf->count; i++) {
+        const LineSlice *line = &buf->lines[i];
+        task->profile.lines_scanned++;
+        task->profile.bytes_read += line->len;
+        if (!matcher_find(&task->matcher, line->data, line->len, 0, false, &so, &eo)) continue;
+
+        found_pattern = true;
+        if (after) {
+            // 在匹配行后插入
+            filebuf_insert(buf, i + 1, content);
+        } else {
+            // 在匹配行前插入
+            filebuf_insert(buf, i, content);
+        }
+        i++;
+        changes++;
+        task->profile.bytes_written += content_len;
+    }
+
+    // 如果模式未找到但需要插入，则在文件末尾插入
+    if (!found_pattern && after) {
+        filebuf_insert(buf, buf->count, content);
+        changes++;
+        task->profile.bytes_written += content_len;
+        log_warning("模式未找到，在文件末尾插入内容");
+    }
+
+    return changes;
+}
+
+// 删除操作（支持正则表达式），返回删除的行数
+static int buffer_delete(FileBuffer *buf, RuleTask *task) {
+    size_t kept = 0;
+    int changes = 0;
+    size_t so, eo;
+
+    if (task->absent) return 0;
+
+    for (size_t i = 0; i < buf->count; i++) {
+        const LineSlice *line = &buf->lines[i];
+        task->profile.lines_scanned++;
+        task->profile.bytes_read += line->len;
+        if (matcher_find(&task->matcher, line->data, line->len, 0, false, &so, &eo)) {
+            // 匹配，跳过这行（删除）
+            free(buf->lines[i].owned);
+            changes++;
+            // 删除最后一行后，新的最后一行保留原有的换行符
+            if (i + 1 == buf->count) buf->final_newline = true;
+        } else {
+            buf->lines[kept++] = buf->lines[i];
+        }
+    }
+
+    buf->count = kept;
+    if (changes > 0) {
+        buf->modified = true;
+        buf->generation++;
+    }
+    return changes;
+}
+
+// 在内存中应用单条规则
+static int apply_task(FileBuffer *buf, FileGroup *group, RuleTask *task) {
+    OperationType operation = task->rule->operation;
+    const char *path = group->path;
+
+    bool kconfig = operation == OP_KCONFIG_SET || operation == OP_KCONFIG_UNSET;
+
+    // 检查参数
+    if (operation == OP_APPEND || operation == OP_DELETE || kconfig) {
+        if (!task->param1) {
+            log_error("错误: %s操作需要一个参数",
+                      operation == OP_APPEND ? "追加" : operation == OP_DELETE ? "删除" : "Kconfig");
+            return -1;
+        }
+    } else if (!task->param1 || !task->param2) {
+        log_error("错误: %s操作需要两个参数", operation == OP_REPLACE ? "替换" : "插入");
+        return -1;
+    }
+
+    if (buf->missing && operation != OP_APPEND) {
+        if (operation == OP_DELETE) {
+            // 如果文件不存在，认为删除已经应用
+            log_info("规则已经应用，跳过执行");
+            group->skip_count++;
+            return 0;
+        }
+        log_error("错误: 无法打开源文件 %s", path);
+        return -1;
+    }
+
+    if (operation != OP_APPEND && !kconfig && !task->matcher_ready) {
+        log_error("错误: 无效的正则表达式 '%s'", task->param1);
+        return -1;
+    }
+
+    int changes;
+    switch (operation) {
+        case OP_REPLACE:
+            changes = buffer_replace(buf, task, task->param2);
+            task->profile.matches = changes;
+            if (changes > 0) {
+                log_info("在文件 %s 中进行了 %d 处替换", path, changes);
+                group->replace_count += changes;
+            } else {
+                log_error("在文件 %s 中没有找到匹配的文本", path);
+            }
+            return 0;
+
+        case OP_INSERT_AFTER:
+        case OP_INSERT_BEFORE:
+            // 首先检查内容是否已经存在
+            if (filebuf_contains(buf, task->param2, &task->profile)) {
+                log_info("跳过重复插入: 目标文件中已存在相同内容");
+                group->skip_count++;
+                return 0;
+            }
+            changes = buffer_insert(buf, task, task->param2, operation == OP_INSERT_AFTER);
+            task->profile.matches = changes;
+            if (changes > 0) {
+                log_info("在文件 %s 中进行了 %d 处插入", path, changes);
+                group->insert_count += changes;
+            } else {
+                log_info("在文件 %s 中没有找到匹配的文本", path);
+            }
+            return 0;
+
+        case OP_APPEND: {
+            if (filebuf_contains(buf, task->param1, &task->profile)) {
+                log_info("跳过重复追加: 目标文件中已存在相同内容");
+                group->skip_count++;
+                return 0;
+            }
+            char *clean_content = clean_string(task->param1);
+            if (clean_content == NULL) {
+                log_error("错误: 无法清理内容字符串");
+                return -1;
+            }
+            filebuf_insert(buf, buf->count, clean_content);
+            task->profile.bytes_written += strlen(clean_content);
+            free(clean_content);
+            group->append_count++;
+            return 0;
+        }
+
+        case OP_KCONFIG_SET:
+        case OP_KCONFIG_UNSET:
+            changes = kconfig_apply(buf, task);
+            if (changes < 0) return -1;
+            task->profile.matches = changes;
+            if (changes > 0) {
+                log_info("在文件 %s 中修改了 %d 个 Kconfig 符号", path, changes);
+                group->kconfig_count += changes;
+            } else {
+                log_info("Kconfig 符号已经是目标值，无需修改");
+            }
+            return 0;
+
+        case OP_DELETE:
+            changes = buffer_delete(buf, task);
+            task->profile.matches = changes;
+            if (changes > 0) {
+                log_info("在文件 %s 中删除了 %d 行", path, changes);
+                group->delete_count += changes;
+            } else {
+                log_warning("在文件 %s 中没有找到匹配的文本", path);
+            }
+            return 0;
+
+        default:
+            log_error("错误: 未知的操作类型");
+            return -1;
+    }
+}
+
+// 计算缓冲区内容（即写回后的文件内容）的摘要
+void filebuf_hash(const FileBuffer *buf, char hex[SHA256_HEX_SIZE]) {
+    Sha256Ctx ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    sha256_init(&ctx);
+    for (size_t i = 0; i < buf->count; i++) {
+        sha256_update(&ctx, buf->lines[i].data, buf->lines[i].len);
+        if (i + 1 < buf->count || buf->final_newline) {
+            sha256_update(&ctx, "\n", 1);
+        }
+    }
+    sha256_final(&ctx, digest);
+    sha256_to_hex(digest, hex);
+}
+
+// 根据规则日志标记已经应用过的规则，返回仍需执行的规则数
+// 文件元数据与日志一致时不读取文件；不一致时比较内容摘要
+// 只跳过开头连续已记录的规则：一旦有规则需要执行，其后的规则必须在它的结果上重新执行，
+// 否则修改会打乱配置中的顺序
+static int mark_journaled_tasks(FileGroup *group, Journal *journal, bool *stat_fresh) {
+    struct stat st;
+    bool content_known = false;
+
+    if (stat(group->path, &st) == 0 && journal->valid) {
+        if (journal_stat_matches(journal, &st)) {
+            content_known = true;
+            *stat_fresh = true;
+        } else {
+            char hex[SHA256_HEX_SIZE];
+            content_known = sha256_file_hex(group->path, hex) == 0 &&
+                            strcmp(hex, journal->hash) == 0;
+        }
+    }
+
+    int pending = 0;
+    for (int i = 0; i < group->task_count; i++) {
+        RuleTask *task = group->tasks[i];
+        if (content_known && journal_has_rule(journal, task->signature)) {
+            task->journaled = true;
+            task->result = 0;
+            group->journal_skip_count++;
+        } else {
+            content_known = false;
+            pending++;
+        }
+    }
+    return pending;
+}
+
+// 编译本组规则的匹配模式，并用一次 Aho-Corasick 扫描
+// 找出文件中根本不存在的字面量（包括正则中必须出现的片段）
+static void prepare_matchers(FileGroup *group, FileBuffer *buf, Prefilter *prefilter) {
+    const char **patterns = malloc(group->task_count * sizeof(char*));
+    size_t *lengths = malloc(group->task_count * sizeof(size_t));
+    bool **absent = malloc(group->task_count * sizeof(bool*));
+    int count = 0;
+
+    memset(prefilter, 0, sizeof(*prefilter));
+
+    for (int i = 0; i < group->task_count; i++) {
+        RuleTask *task = group->tasks[i];
+        OperationType operation = task->rule->operation;
+        if (task->journaled || task->param1 == NULL || operation == OP_APPEND ||
+            operation == OP_KCONFIG_SET || operation == OP_KCONFIG_UNSET) {
+            continue;
+        }
+        if (!task->matcher_ready) {
+            uint64_t start = profile_now_ns();
+            task->matcher_ready = matcher_compile(&task->matcher, task->param1) == 0;
+            uint64_t elapsed = profile_now_ns() - start;
+            task->profile.compile_ns += elapsed;
+            task->profile.wall_ns += elapsed;
+        }
+        if (task->matcher_ready && matcher_has_literal(&task->matcher) && patterns && lengths && absent) {
+            patterns[count] = task->matcher.literal;
+            lengths[count] = task->matcher.literal_len;
+            absent[count] = &task->absent;
+            count++;
+        }
+    }
+
+    // 只有一个字面量模式时直接用 memmem 逐行查找即可
+    if (count >= 2) {
+        prefilter->ac = ac_build(patterns, lengths, count);
+        prefilter->found = calloc(count, sizeof(bool));
+    }
+
+    if (prefilter->ac != NULL && prefilter->found != NULL) {
+        prefilter->absent = absent;
+        prefilter->count = count;
+        for (size_t i = 0; i < buf->count; i++) {
+            ac_scan(prefilter->ac, buf->lines[i].data, buf->lines[i].len, prefilter->found);
+        }
+        for (int i = 0; i < count; i++) {
+            *absent[i] = !prefilter->found[i];
+        }
+        buf->prefilter = prefilter;
+        absent = NULL;
+    } else {
+        ac_free(prefilter->ac);
+        free(prefilter->found);
+        memset(prefilter, 0, sizeof(*prefilter));
+    }
+
+    free(patterns);
+    free(lengths);
+    free(absent);
+}
+
+static void free_prefilter(Prefilter *prefilter) {
+    ac_free(prefilter->ac);
+    free(prefilter->absent);
+    free(prefilter->found);
+    memset(prefilter, 0, sizeof(*prefilter));
+}
+
+// 对同一个文件依次应用一组规则：只读取一次、只写回一次
+// 配置了规则日志目录时使用规则日志跳过已经应用过的规则
+// 不同文件的分组可能在多个线程中同时执行，这里只访问本分组的数据
+int apply_file_group(FileGroup *group, const ExecOptions *options) {
+    const char *state_dir = options->state_dir;
+    FileBuffer buf;
+    Journal journal = {0};
+    bool stat_fresh = false;
+    int fail_count = 0;
+    uint64_t group_start = profile_now_ns();
+
+    group->profile.path = group->path;
+    group->profile.rule_count = group->task_count;
+
+    for (int i = 0; i < group->task_count; i++) {
+        rule_signature(group->tasks[i], group->tasks[i]->signature);
+    }
+
+    if (state_dir != NULL && !options->force) {
+        journal_load(state_dir, group->path, &journal);
+    }
+
+    int pending = mark_journaled_tasks(group, &journal, &stat_fresh);
+    if (pending == 0) {
+        log_info("文件 %s: %d 条规则已记录在规则日志中，跳过执行", group->path, group->task_count);
+        // 内容未变但元数据变化（例如被 touch），更新日志以便下次直接命中
+        if (!stat_fresh && state_dir != NULL) {
+            journal_save(state_dir, group->path, journal.hash, group->tasks, group->task_count);
+        }
+        journal_free(&journal);
+        group->profile.wall_ns = profile_now_ns() - group_start;
+        return 0;
+    }
+    journal_free(&journal);
+
+    uint64_t load_start = profile_now_ns();
+    int load_result = filebuf_load(&buf, group->path);
+    group->profile.load_ns = profile_now_ns() - load_start;
+    if (load_result != 0) {
+        log_error("错误: 无法打开源文件 %s", group->path);
+        for (int i = 0; i < group->task_count; i++) {
+            group->tasks[i]->result = -1;
+        }
+        return group->task_count;
+    }
+    group->loaded = true;
+    group->profile.bytes_read = buf.map ? buf.map_size : buf.data_size;
+
+    Prefilter prefilter;
+    prepare_matchers(group, &buf, &prefilter);
+
+    for (int i = 0; i < group->task_count; i++) {
+        RuleTask *task = group->tasks[i];
+        if (task->journaled) {
+            log_info("跳过规则 #%d: 已记录在规则日志中", task->index);
+            continue;
+        }
+        log_info("执行规则 #%d: %s;%s;%s;%s",
+                 task->index, operation_to_string(task->rule->operation), group->path,
+                 task->param1 ? task->param1 : "", task->param2 ? task->param2 : "");
+        uint64_t task_start = profile_now_ns();
+        task->result = apply_task(&buf, group, task);
+        task->profile.wall_ns += profile_now_ns() - task_start;
+        if (task->result == 0) {
+            log_info("规则 #%d 执行成功: %s", task->index, group->path);
+        } else {
+            log_error("规则 #%d 执行失败: %s", task->index, group->path);
+            fail_count++;
+        }
+    }
+
+    if (buf.modified && filebuf_unchanged(&buf)) {
+        log_info("文件 %s 内容没有变化，跳过写入", group->path);
+        buf.modified = false;
+    }
+
+    if (buf.modified) {
+        uint64_t save_start = profile_now_ns();
+        int save_result = filebuf_save(&buf, group->path);
+        group->profile.save_ns = profile_now_ns() - save_start;
+        if (save_result == 0) {
+            group->written = true;
+            group->profile.bytes_written = buf.saved_size;
+        } else {
+            log_error("写回文件失败，本文件的规则均视为失败: %s", group->path);
+            for (int i = 0; i < group->task_count; i++) {
+                if (group->tasks[i]->result == 0) {
+                    group->tasks[i]->result = -1;
+                    fail_count++;
+                }
+            }
+        }
+    }
+
+    // 记录本次应用后的文件状态，文件仍不存在时不保留日志
+    if (state_dir != NULL) {
+        if (buf.missing && !group->written) {
+            journal_remove(state_dir, group->path);
+        } else {
+            char hex[SHA256_HEX_SIZE];
+            filebuf_hash(&buf, hex);
+            journal_save(state_dir, group->path, hex, group->tasks, group->task_count);
+        }
+    }
+
+    log_info("文件 %s: 替换 %d 处, 插入 %d 处, 追加 %d 处, 删除 %d 行, Kconfig %d 项, 跳过 %d 条, 日志跳过 %d 条 (读取 %d 次, 写入 %d 次)",
+             group->path, group->replace_count, group->insert_count, group->append_count,
+             group->delete_count, group->kconfig_count, group->skip_count, group->journal_skip_count,
+             group->loaded ? 1 : 0, group->written ? 1 : 0);
+
+    filebuf_free(&buf);
+    free_prefilter(&prefilter);
+    group->profile.wall_ns = profile_now_ns() - group_start;
+    return fail_count;
+}
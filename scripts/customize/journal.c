@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include "customize.h"
+
+#define JOURNAL_HEADER "# customize journal v1"
+
+// 日志文件路径: <状态目录>/<目标路径摘要前 16 位>.journal
+static void journal_path(const char *state_dir, const char *target, char *path, size_t size) {
+    char hex[SHA256_HEX_SIZE];
+    sha256_hex(target, strlen(target), hex);
+    hex[16] = '\0';
+    snprintf(path, size, "%s/%s.journal", state_dir, hex);
+}
+
+static long long stat_mtime_ns(const struct stat *st) {
+    return (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+// 规则签名: 操作类型与变量替换后的参数的摘要
+void rule_signature(const RuleTask *task, char sig[SHA256_HEX_SIZE]) {
+    Sha256Ctx ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    const char *fields[] = {
+        operation_to_string(task->rule->operation),
+        task->target_file,
+        task->param1 ? task->param1 : "",
+        task->param2 ? task->param2 : ""
+    };
+
+    sha256_init(&ctx);
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        // 包含结尾的 '\0'，避免字段拼接产生歧义
+        sha256_update(&ctx, fields[i], strlen(fields[i]) + 1);
+    }
+    // Kconfig 片段文件的内容变化时规则需要重新执行
+    OperationType operation = task->rule->operation;
+    if ((operation == OP_KCONFIG_SET || operation == OP_KCONFIG_UNSET) &&
+        task->param1 && task->param1[0] == '@') {
+        char fragment_hash[SHA256_HEX_SIZE];
+        if (sha256_file_hex(task->param1 + 1, fragment_hash) == 0) {
+            sha256_update(&ctx, fragment_hash, strlen(fragment_hash) + 1);
+        }
+    }
+
+    sha256_final(&ctx, digest);
+    sha256_to_hex(digest, sig);
+}
+
+int journal_load(const char *state_dir, const char *target, Journal *journal) {
+    memset(journal, 0, sizeof(*journal));
+
+    char path[PATH_MAX];
+    journal_path(state_dir, target, path, sizeof(path));
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return -1;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    bool header_ok = false;
+    bool target_ok = false;
+
+    while (getline(&line, &line_cap, file) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+
+        if (!header_ok) {
+            header_ok = strcmp(line, JOURNAL_HEADER) == 0;
+            if (!header_ok) break;
+        } else if (strncmp(line, "path ", 5) == 0) {
+            target_ok = strcmp(line + 5, target) == 0;
+        } else if (strncmp(line, "stat ", 5) == 0) {
+            unsigned long long ino;
+            long long size, mtime_ns;
+            if (sscanf(line + 5, "%llu %lld %lld", &ino, &size, &mtime_ns) == 3) {
+                journal->ino = ino;
+                journal->size = size;
+                journal->mtime_ns = mtime_ns;
+            }
+        } else if (strncmp(line, "hash ", 5) == 0) {
+            snprintf(journal->hash, sizeof(journal->hash), "%s", line + 5);
+        } else if (strncmp(line, "rule ", 5) == 0 && strlen(line + 5) >= SHA256_HEX_SIZE - 1) {
+            char **rules = realloc(journal->rules, (journal->rule_count + 1) * sizeof(char*));
+            if (rules == NULL) break;
+            journal->rules = rules;
+            // 行格式: rule <签名> <操作类型>，保存签名之后的整行以便原样写回
+            journal->rules[journal->rule_count++] = strdup(line + 5);
+        }
+    }
+
+    free(line);
+    fclose(file);
+
+    journal->valid = header_ok && target_ok && journal->hash[0] != '\0';
+    if (!journal->valid) {
+        journal_free(journal);
+        return -1;
+    }
+    return 0;
+}
+
+static bool rule_matches(const char *record, const char *sig) {
+    return record != NULL && strncmp(record, sig, SHA256_HEX_SIZE - 1) == 0 &&
+           (record[SHA256_HEX_SIZE - 1] == '\0' || record[SHA256_HEX_SIZE - 1] == ' ');
+}
+
+bool journal_has_rule(const Journal *journal, const char *sig) {
+    for (int i = 0; i < journal->rule_count; i++) {
+        if (rule_matches(journal->rules[i], sig)) return true;
+    }
+    return false;
+}
+
+// 文件元数据与日志一致时认为内容未变，无需读取文件
+bool journal_stat_matches(const Journal *journal, const struct stat *st) {
+    return journal->valid &&
+           journal->ino == (unsigned long long)st->st_ino &&
+           journal->size == (long long)st->st_size &&
+           journal->mtime_ns == stat_mtime_ns(st);
+}
+
+// 写入日志：记录文件当前的元数据、内容摘要以及已应用的规则。
+// 同一文件可能同时有 init 和 build 规则，每次只执行其中一组；
+// 上次日志的内容摘要与本次一致时，其中其他规则的记录仍然成立，合并保留
+int journal_save(const char *state_dir, const char *target, const char *hash,
+                 RuleTask **tasks, int task_count) {
+    struct stat st;
+    if (stat(target, &st) != 0) return -1;
+
+    Journal previous;
+    if (journal_load(state_dir, target, &previous) == 0 && strcmp(previous.hash, hash) != 0) {
+        journal_free(&previous);
+    }
+
+    if (mkdir(state_dir, 0755) != 0 && errno != EEXIST) {
+        log_warning("无法创建状态目录: %s", state_dir);
+        journal_free(&previous);
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX + 8];
+    journal_path(state_dir, target, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        log_warning("无法写入规则日志: %s", tmp_path);
+        journal_free(&previous);
+        return -1;
+    }
+
+    fprintf(file, "%s\n", JOURNAL_HEADER);
+    fprintf(file, "path %s\n", target);
+    fprintf(file, "stat %llu %lld %lld\n", (unsigned long long)st.st_ino,
+            (long long)st.st_size, stat_mtime_ns(&st));
+    fprintf(file, "hash %s\n", hash);
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i]->result != 0) continue;
+        fprintf(file, "rule %s %s\n", tasks[i]->signature,
+                operation_to_string(tasks[i]->rule->operation));
+    }
+    for (int i = 0; i < previous.rule_count; i++) {
+        bool current = false;
+        for (int j = 0; j < task_count && !current; j++) {
+            current = rule_matches(previous.rules[i], tasks[j]->signature);
+        }
+        if (!current) fprintf(file, "rule %s\n", previous.rules[i]);
+    }
+    journal_free(&previous);
+
+    if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// 目标文件不存在时删除对应的日志
+void journal_remove(const char *state_dir, const char *target) {
+    char path[PATH_MAX];
+    journal_path(state_dir, target, path, sizeof(path));
+    unlink(path);
+}
+
+void journal_free(Journal *journal) {
+    for (int i = 0; i < journal->rule_count; i++) {
+        free(journal->rules[i]);
+    }
+    free(journal->rules);
+    journal->rules = NULL;
+    journal->rule_count = 0;
+    journal->valid = false;
+}
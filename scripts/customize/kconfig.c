@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "customize.h"
+
+#define KCONFIG_PREFIX "CONFIG_"
+#define KCONFIG_UNSET_PREFIX "# CONFIG_"
+#define KCONFIG_UNSET_SUFFIX " is not set"
+
+// .config 中的一个符号及其所在行
+typedef struct {
+    const char *name;       // 指向行内容中的符号名（不以 '\0' 结尾）
+    size_t len;
+    size_t line;
+} KconfigEntry;
+
+// 符号名到行号的索引（开放寻址哈希表）
+struct KconfigIndex {
+    KconfigEntry *entries;
+    size_t capacity;
+    size_t count;
+    unsigned long generation;   // 建立索引时缓冲区的修改代数
+};
+
+// 解析一行中的符号名: CONFIG_X=... 或 # CONFIG_X is not set
+static bool parse_symbol_line(const char *data, size_t len, const char **name, size_t *name_len) {
+    size_t prefix_len = strlen(KCONFIG_PREFIX);
+    size_t unset_len = strlen(KCONFIG_UNSET_PREFIX);
+    size_t suffix_len = strlen(KCONFIG_UNSET_SUFFIX);
+
+    if (len > prefix_len && memcmp(data, KCONFIG_PREFIX, prefix_len) == 0) {
+        const char *equals = memchr(data, '=', len);
+        if (equals == NULL) return false;
+        *name = data;
+        *name_len = (size_t)(equals - data);
+        return true;
+    }
+
+    if (len > unset_len + suffix_len && memcmp(data, KCONFIG_UNSET_PREFIX, unset_len) == 0 &&
+        memcmp(data + len - suffix_len, KCONFIG_UNSET_SUFFIX, suffix_len) == 0) {
+        *name = data + 2;
+        *name_len = len - 2 - suffix_len;
+        return true;
+    }
+
+    return false;
+}
+
+static size_t hash_symbol(const char *name, size_t len) {
+    size_t hash = 5381;
+    for (size_t i = 0; i < len; i++) hash = hash * 33 + (unsigned char)name[i];
+    return hash;
+}
+
+static KconfigEntry* find_entry(KconfigIndex *index, const char *name, size_t len) {
+    size_t mask = index->capacity - 1;
+    size_t slot = hash_symbol(name, len) & mask;
+    while (index->entries[slot].name != NULL) {
+        KconfigEntry *entry = &index->entries[slot];
+        if (entry->len == len && memcmp(entry->name, name, len) == 0) break;
+        slot = (slot + 1) & mask;
+    }
+    return &index->entries[slot];
+}
+
+static int index_grow(KconfigIndex *index) {
+    KconfigEntry *old_entries = index->entries;
+    size_t old_capacity = index->capacity;
+
+    index->capacity = old_capacity ? old_capacity * 2 : 1024;
+    index->entries = calloc(index->capacity, sizeof(KconfigEntry));
+    if (index->entries == NULL) {
+        index->entries = old_entries;
+        index->capacity = old_capacity;
+        return -1;
+    }
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_entries[i].name != NULL) {
+            *find_entry(index, old_entries[i].name, old_entries[i].len) = old_entries[i];
+        }
+    }
+    free(old_entries);
+    return 0;
+}
+
+static int index_put(KconfigIndex *index, const char *name, size_t len, size_t line) {
+    if ((index->count + 1) * 2 > index->capacity && index_grow(index) != 0) return -1;
+    KconfigEntry *entry = find_entry(index, name, len);
+    if (entry->name == NULL) index->count++;
+    entry->name = name;
+    entry->len = len;
+    entry->line = line;
+    return 0;
+}
+
+void kconfig_index_free(KconfigIndex *index) {
+    if (index == NULL) return;
+    free(index->entries);
+    free(index);
+}
+
+// 一次遍历 .config 建立符号索引；其他规则修改过缓冲区后重新建立
+static KconfigIndex* kconfig_index(FileBuffer *buf) {
+    KconfigIndex *index = buf->kconfig;
+    if (index != NULL && index->generation == buf->generation) return index;
+
+    if (index == NULL) {
+        index = calloc(1, sizeof(KconfigIndex));
+        if (index == NULL) return NULL;
+        buf->kconfig = index;
+    } else {
+        memset(index->entries, 0, index->capacity * sizeof(KconfigEntry));
+        index->count = 0;
+    }
+
+    for (size_t i = 0; i < buf->count; i++) {
+        const char *name;
+        size_t len;
+        if (parse_symbol_line(buf->lines[i].data, buf->lines[i].len, &name, &len)) {
+            if (index_put(index, name, len, i) != 0) return NULL;
+        }
+    }
+    index->generation = buf->generation;
+    return index;
+}
+
+// 设置一个符号，line 为目标行内容（CONFIG_X=v 或 # CONFIG_X is not set）
+// 返回 1 表示有修改，0 表示已经是目标值，-1 表示失败
+static int kconfig_put_line(FileBuffer *buf, KconfigIndex *index, const char *line) {
+    const char *name;
+    size_t name_len;
+    size_t len = strlen(line);
+    if (!parse_symbol_line(line, len, &name, &name_len)) return -1;
+
+    KconfigEntry *entry = find_entry(index, name, name_len);
+    if (entry->name != NULL) {
+        const LineSlice *current = &buf->lines[entry->line];
+        if (current->len == len && memcmp(current->data, line, len) == 0) return 0;
+
+        size_t line_no = entry->line;
+        if (filebuf_set_line(buf, line_no, line, len) != 0) return -1;
+        // 行内容已被替换，索引中的符号名需要指向新内容
+        parse_symbol_line(buf->lines[line_no].data, buf->lines[line_no].len, &name, &name_len);
+        entry->name = name;
+    } else {
+        size_t line_no = buf->count;
+        if (filebuf_insert_line(buf, line_no, line) != 0) return -1;
+        parse_symbol_line(buf->lines[line_no].data, buf->lines[line_no].len, &name, &name_len);
+        if (index_put(index, name, name_len, line_no) != 0) return -1;
+    }
+
+    index->generation = buf->generation;
+    return 1;
+}
+
+// 规范化符号名，自动补全 CONFIG_ 前缀
+static char* normalize_symbol(const char *symbol) {
+    while (*symbol == ' ' || *symbol == '\t') symbol++;
+    size_t len = strcspn(symbol, " \t=");
+    bool has_prefix = strncmp(symbol, KCONFIG_PREFIX, strlen(KCONFIG_PREFIX)) == 0;
+    size_t total = len + (has_prefix ? 0 : strlen(KCONFIG_PREFIX));
+
+    char *result = malloc(total + 1);
+    if (result == NULL) return NULL;
+    snprintf(result, total + 1, "%s%.*s", has_prefix ? "" : KCONFIG_PREFIX, (int)len, symbol);
+    return result;
+}
+
+static char* make_set_line(const char *symbol, const char *value) {
+    char *name = normalize_symbol(symbol);
+    if (name == NULL) return NULL;
+
+    char *line;
+    // 值为 n 等价于取消设置
+    if (value == NULL || strcmp(value, "n") == 0) {
+        if (asprintf(&line, "# %s%s", name, KCONFIG_UNSET_SUFFIX) < 0) line = NULL;
+    } else {
+        if (asprintf(&line, "%s=%s", name, value) < 0) line = NULL;
+    }
+    free(name);
+    return line;
+}
+
+// 应用一个符号设置，累计修改数
+static int kconfig_apply_one(FileBuffer *buf, KconfigIndex *index, const char *symbol,
+                             const char *value, int *changed) {
+    char *line = make_set_line(symbol, value);
+    if (line == NULL) return -1;
+
+    int result = kconfig_put_line(buf, index, line);
+    if (result > 0) {
+        log_info("Kconfig: %s", line);
+        (*changed)++;
+    }
+    free(line);
+    return result < 0 ? -1 : 0;
+}
+
+// 批量形式: 逐行读取片段文件
+// kconfig-set 的片段使用 .config 格式；kconfig-unset 的片段每行一个符号
+static int kconfig_apply_fragment(FileBuffer *buf, KconfigIndex *index, const char *fragment,
+                                  bool unset, int *changed) {
+    FILE *file = fopen(fragment, "r");
+    if (file == NULL) {
+        log_error("错误: 无法打开 Kconfig 片段文件 %s", fragment);
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t n;
+    int result = 0;
+
+    while (result == 0 && (n = getline(&line, &line_cap, file)) != -1) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+
+        const char *name;
+        size_t name_len;
+        bool is_symbol_line = parse_symbol_line(line, (size_t)n, &name, &name_len);
+
+        if (unset) {
+            const char *symbol = is_symbol_line ? name : line;
+            while (*symbol == ' ' || *symbol == '\t') symbol++;
+            if (*symbol == '\0' || *symbol == '#') continue;
+            result = kconfig_apply_one(buf, index, symbol, NULL, changed);
+        } else if (is_symbol_line) {
+            if (line[0] == '#') {
+                result = kconfig_apply_one(buf, index, name, NULL, changed);
+            } else {
+                result = kconfig_apply_one(buf, index, line, line + name_len + 1, changed);
+            }
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return result;
+}
+
+// kconfig-set;<.config>;<符号>;<值，默认 y>  或  kconfig-set;<.config>;@<片段文件>
+// kconfig-unset;<.config>;<符号>            或  kconfig-unset;<.config>;@<片段文件>
+// 返回修改的符号数，失败返回 -1
+int kconfig_apply(FileBuffer *buf, const RuleTask *task) {
+    KconfigIndex *index = kconfig_index(buf);
+    if (index == NULL) {
+        log_error("错误: 内存不足");
+        return -1;
+    }
+
+    bool unset = task->rule->operation == OP_KCONFIG_UNSET;
+    int changed = 0;
+    int result;
+
+    if (task->param1[0] == '@') {
+        result = kconfig_apply_fragment(buf, index, task->param1 + 1, unset, &changed);
+    } else if (unset) {
+        result = kconfig_apply_one(buf, index, task->param1, NULL, &changed);
+    } else {
+        const char *value = task->param2 ? task->param2 : "y";
+        result = kconfig_apply_one(buf, index, task->param1, value, &changed);
+    }
+
+    return result < 0 ? -1 : changed;
+}
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "customize.h"
+
+// 扩展正则表达式中的元字符
+#define REGEX_META_CHARS ".[]()*+?{}|^$\\"
+
+// 把不含正则元字符的模式还原成字面量（允许用反斜杠转义元字符，如 23\.05）
+// 返回 NULL 表示模式是真正的正则表达式
+static char* pattern_to_literal(const char *pattern, size_t len) {
+    char *literal = malloc(len + 1);
+    if (literal == NULL) return NULL;
+
+    size_t out = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = pattern[i];
+        if (c == '\\') {
+            if (i + 1 < len && strchr(REGEX_META_CHARS, pattern[i + 1]) != NULL) {
+                literal[out++] = pattern[++i];
+                continue;
+            }
+            free(literal);
+            return NULL;
+        }
+        if (strchr(REGEX_META_CHARS, c) != NULL) {
+            free(literal);
+            return NULL;
+        }
+        literal[out++] = c;
+    }
+    literal[out] = '\0';
+    return literal;
+}
+
+// 提取正则表达式中每个匹配都必须包含的最长字面量片段，用于快速排除
+// 含分组或分支的模式不做分析
+static char* required_literal(const char *pattern) {
+    if (strpbrk(pattern, "(|") != NULL) return NULL;
+
+    size_t len = strlen(pattern);
+    char *run = malloc(len + 1);
+    char *best = NULL;
+    size_t best_len = 0;
+    size_t run_len = 0;
+    if (run == NULL) return NULL;
+
+    for (size_t i = 0; i <= len; i++) {
+        char c = pattern[i];
+        bool literal_char = false;
+        char value = c;
+
+        if (c == '\\' && i + 1 < len && strchr(REGEX_META_CHARS, pattern[i + 1]) != NULL) {
+            value = pattern[++i];
+            literal_char = true;
+        } else if (c != '\0' && strchr(REGEX_META_CHARS, c) == NULL) {
+            literal_char = true;
+        }
+
+        // 后面跟着 * ? { 的字符可以不出现
+        char follow = i + 1 < len ? pattern[i + 1] : '\0';
+        bool optional = follow == '*' || follow == '?' || follow == '{';
+
+        if (literal_char && !optional) {
+            run[run_len++] = value;
+            continue;
+        }
+
+        if (run_len > best_len) {
+            free(best);
+            best = strndup(run, run_len);
+            best_len = run_len;
+        }
+        run_len = 0;
+
+        // 跳过其他转义序列（如 \w）和重复次数 {n,m}
+        if (c == '\\') {
+            i++;
+        } else if (c == '{') {
+            while (i < len && pattern[i] != '}') i++;
+        } else if (c == '[') {
+            // 跳过方括号表达式
+            size_t j = i + 1;
+            if (j < len && pattern[j] == '^') j++;
+            if (j < len && pattern[j] == ']') j++;
+            while (j < len && pattern[j] != ']') j++;
+            i = j;
+        }
+    }
+
+    free(run);
+    return best;
+}
+
+int matcher_compile(Matcher *matcher, const char *pattern) {
+    memset(matcher, 0, sizeof(*matcher));
+
+    size_t len = strlen(pattern);
+    size_t start = 0;
+    bool anchor_start = false;
+    bool anchor_end = false;
+
+    // ^literal、literal$、^literal$ 同样走字面量路径
+    if (len > 0 && pattern[0] == '^') {
+        anchor_start = true;
+        start = 1;
+    }
+    if (len > start && pattern[len - 1] == '$' && (len < 2 || pattern[len - 2] != '\\')) {
+        anchor_end = true;
+        len--;
+    }
+
+    char *literal = len > start ? pattern_to_literal(pattern + start, len - start) : NULL;
+    if (literal != NULL) {
+        matcher->literal = literal;
+        matcher->literal_len = strlen(literal);
+        if (anchor_start && anchor_end) {
+            matcher->kind = MATCH_EXACT;
+        } else if (anchor_start) {
+            matcher->kind = MATCH_PREFIX;
+        } else if (anchor_end) {
+            matcher->kind = MATCH_SUFFIX;
+        } else {
+            matcher->kind = MATCH_LITERAL;
+        }
+        return 0;
+    }
+
+    matcher->kind = MATCH_REGEX;
+    if (regcomp(&matcher->regex, pattern, REG_EXTENDED) != 0) {
+        return -1;
+    }
+    matcher->regex_ready = true;
+    matcher->literal = required_literal(pattern);
+    matcher->literal_len = matcher->literal ? strlen(matcher->literal) : 0;
+    return 0;
+}
+
+void matcher_free(Matcher *matcher) {
+    free(matcher->literal);
+    if (matcher->regex_ready) {
+        regfree(&matcher->regex);
+    }
+    memset(matcher, 0, sizeof(*matcher));
+}
+
+// 匹配器是否带有必须出现的字面量（可用于预筛选）
+bool matcher_has_literal(const Matcher *matcher) {
+    return matcher->literal != NULL && matcher->literal_len > 0;
+}
+
+// 在 data[start, len) 中查找第一个匹配，*so/*eo 为相对 data 的偏移
+// notbol 表示 start 之前还有内容（同一行中的后续匹配），此时 ^ 不能匹配
+bool matcher_find(const Matcher *matcher, const char *data, size_t len, size_t start,
+                  bool notbol, size_t *so, size_t *eo) {
+    size_t lit_len = matcher->literal_len;
+
+    switch (matcher->kind) {
+        case MATCH_LITERAL: {
+            if (len - start < lit_len) return false;
+            const char *found = memmem(data + start, len - start, matcher->literal, lit_len);
+            if (found == NULL) return false;
+            *so = (size_t)(found - data);
+            *eo = *so + lit_len;
+            return true;
+        }
+
+        case MATCH_PREFIX:
+            if (notbol || start > 0 || len < lit_len || memcmp(data, matcher->literal, lit_len) != 0) {
+                return false;
+            }
+            *so = 0;
+            *eo = lit_len;
+            return true;
+
+        case MATCH_SUFFIX:
+            if (len < lit_len || len - lit_len < start ||
+                memcmp(data + len - lit_len, matcher->literal, lit_len) != 0) {
+                return false;
+            }
+            *so = len - lit_len;
+            *eo = len;
+            return true;
+
+        case MATCH_EXACT:
+            if (notbol || start > 0 || len != lit_len || memcmp(data, matcher->literal, lit_len) != 0) {
+                return false;
+            }
+            *so = 0;
+            *eo = len;
+            return true;
+
+        case MATCH_REGEX: {
+            // 必需的字面量不在剩余内容中时，正则不可能匹配
+            if (lit_len > 0 && (len - start < lit_len ||
+                memmem(data + start, len - start, matcher->literal, lit_len) == NULL)) {
+                return false;
+            }
+
+            // REG_STARTEND: 行内容无需以 '\0' 结尾
+            regmatch_t match;
+            match.rm_so = (regoff_t)start;
+            match.rm_eo = (regoff_t)len;
+            int eflags = REG_STARTEND | (notbol ? REG_NOTBOL : 0);
+            if (regexec(&matcher->regex, len ? data : "", 1, &match, eflags) != 0) {
+                return false;
+            }
+            *so = (size_t)match.rm_so;
+            *eo = (size_t)match.rm_eo;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Aho-Corasick 自动机，转移表补全为 DFA，扫描时每个字节只查一次表
+struct AcAutomaton {
+    int (*next)[256];
+    int *fail;
+    int *first_pattern;     // 在该状态结束的第一个模式，-1 表示没有
+    int *dict_link;         // 沿失败链最近的、有模式结束的状态，0 表示没有
+    int *pattern_next;      // 在同一状态结束的下一个模式
+    int state_count;
+    int pattern_count;
+};
+
+AcAutomaton* ac_build(const char **patterns, const size_t *lengths, int count) {
+    size_t total = 1;
+    for (int i = 0; i < count; i++) total += lengths[i];
+
+    AcAutomaton *ac = calloc(1, sizeof(AcAutomaton));
+    if (ac == NULL) return NULL;
+    ac->next = calloc(total, sizeof(*ac->next));
+    ac->fail = calloc(total, sizeof(int));
+    ac->first_pattern = malloc(total * sizeof(int));
+    ac->dict_link = calloc(total, sizeof(int));
+    ac->pattern_next = malloc((count > 0 ? count : 1) * sizeof(int));
+    int *queue = malloc(total * sizeof(int));
+    if (!ac->next || !ac->fail || !ac->first_pattern || !ac->dict_link || !ac->pattern_next || !queue) {
+        free(queue);
+        ac_free(ac);
+        return NULL;
+    }
+
+    // 状态 0 为根；转移为 0 的非根转移在构建 trie 阶段表示“不存在”
+    for (size_t i = 0; i < total; i++) ac->first_pattern[i] = -1;
+    ac->state_count = 1;
+    ac->pattern_count = count;
+
+    for (int p = 0; p < count; p++) {
+        int state = 0;
+        for (size_t i = 0; i < lengths[p]; i++) {
+            unsigned char c = (unsigned char)patterns[p][i];
+            if (ac->next[state][c] == 0) {
+                ac->next[state][c] = ac->state_count++;
+            }
+            state = ac->next[state][c];
+        }
+        ac->pattern_next[p] = ac->first_pattern[state];
+        ac->first_pattern[state] = p;
+    }
+
+    // 广度优先计算失败链接，并补全转移表
+    int head = 0, tail = 0;
+    for (int c = 0; c < 256; c++) {
+        int child = ac->next[0][c];
+        if (child != 0) {
+            ac->fail[child] = 0;
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail) {
+        int state = queue[head++];
+        int fail = ac->fail[state];
+        ac->dict_link[state] = ac->first_pattern[fail] >= 0 ? fail : ac->dict_link[fail];
+
+        for (int c = 0; c < 256; c++) {
+            int child = ac->next[state][c];
+            if (child != 0) {
+                ac->fail[child] = ac->next[fail][c];
+                queue[tail++] = child;
+            } else {
+                ac->next[state][c] = ac->next[fail][c];
+            }
+        }
+    }
+
+    free(queue);
+    return ac;
+}
+
+void ac_free(AcAutomaton *ac) {
+    if (ac == NULL) return;
+    free(ac->next);
+    free(ac->fail);
+    free(ac->first_pattern);
+    free(ac->dict_link);
+    free(ac->pattern_next);
+    free(ac);
+}
+
+// 扫描数据，把出现过的模式标记到 found 中
+void ac_scan(const AcAutomaton *ac, const char *data, size_t len, bool *found) {
+    int state = 0;
+    for (size_t i = 0; i < len; i++) {
+        state = ac->next[state][(unsigned char)data[i]];
+        for (int s = state; s != 0; s = ac->dict_link[s]) {
+            for (int p = ac->first_pattern[s]; p >= 0; p = ac->pattern_next[p]) {
+                found[p] = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "customize.h"
+
+// 汇总中列出的最慢规则和文件数量
+#define PROFILE_TOP_COUNT 10
+
+// 同一条配置规则（通配符可能展开为多个实例）的汇总
+typedef struct {
+    int index;
+    OperationType operation;
+    const char *target;     // 配置文件中的原始目标
+    int instances;
+    int journaled;
+    RuleProfile total;
+} RuleStat;
+
+uint64_t profile_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static double ns_to_ms(uint64_t ns) {
+    return (double)ns / 1e6;
+}
+
+// 按规则序号合并实例；同一规则的实例在任务列表中是连续的
+static RuleStat* collect_rule_stats(RuleTask **tasks, int task_count, int *stat_count) {
+    RuleStat *stats = calloc(task_count > 0 ? task_count : 1, sizeof(RuleStat));
+    int count = 0;
+    if (stats == NULL) {
+        *stat_count = 0;
+        return NULL;
+    }
+
+    for (int i = 0; i < task_count; i++) {
+        const RuleTask *task = tasks[i];
+        RuleStat *stat = count > 0 && stats[count - 1].index == task->index ? &stats[count - 1] : NULL;
+        if (stat == NULL) {
+            stat = &stats[count++];
+            stat->index = task->index;
+            stat->operation = task->rule->operation;
+            stat->target = task->rule->target_file ? task->rule->target_file : "";
+        }
+
+        const RuleProfile *p = &task->profile;
+        stat->instances++;
+        if (task->journaled) stat->journaled++;
+        stat->total.wall_ns += p->wall_ns;
+        stat->total.compile_ns += p->compile_ns;
+        stat->total.subprocess_ns += p->subprocess_ns;
+        stat->total.bytes_read += p->bytes_read;
+        stat->total.bytes_written += p->bytes_written;
+        stat->total.lines_scanned += p->lines_scanned;
+        stat->total.matches += p->matches;
+    }
+
+    *stat_count = count;
+    return stats;
+}
+
+static int compare_rule_wall(const void *a, const void *b) {
+    const RuleStat *x = *(const RuleStat* const*)a;
+    const RuleStat *y = *(const RuleStat* const*)b;
+    if (x->total.wall_ns != y->total.wall_ns) return x->total.wall_ns < y->total.wall_ns ? 1 : -1;
+    return x->index - y->index;
+}
+
+static int compare_file_wall(const void *a, const void *b) {
+    const FileProfile *x = *(const FileProfile* const*)a;
+    const FileProfile *y = *(const FileProfile* const*)b;
+    if (x->wall_ns != y->wall_ns) return x->wall_ns < y->wall_ns ? 1 : -1;
+    return strcmp(x->path, y->path);
+}
+
+static void log_rule_stat(const RuleStat *stat) {
+    const RuleProfile *p = &stat->total;
+    log_info("  规则 #%-3d %-14s %9.2f ms (编译 %.2f ms, 子进程 %.2f ms) 实例 %d, 日志跳过 %d, "
+             "扫描 %zu 行/%zu 字节, 匹配 %d 处, 生成 %zu 字节",
+             stat->index, operation_to_string(stat->operation), ns_to_ms(p->wall_ns),
+             ns_to_ms(p->compile_ns), ns_to_ms(p->subprocess_ns), stat->instances, stat->journaled,
+             p->lines_scanned, p->bytes_read, p->matches, p->bytes_written);
+}
+
+void profile_report(RuleTask **tasks, int task_count, const FileProfile *files, int file_count,
+                    uint64_t total_ns) {
+    int stat_count;
+    RuleStat *stats = collect_rule_stats(tasks, task_count, &stat_count);
+    if (stats == NULL) return;
+
+    log_info("性能统计: 总耗时 %.2f ms, 规则 %d 条, 目标文件 %d 个",
+             ns_to_ms(total_ns), stat_count, file_count);
+    for (int i = 0; i < stat_count; i++) {
+        log_rule_stat(&stats[i]);
+    }
+
+    // 最慢的规则
+    RuleStat **sorted = malloc((stat_count > 0 ? stat_count : 1) * sizeof(RuleStat*));
+    if (sorted != NULL && stat_count > 0) {
+        for (int i = 0; i < stat_count; i++) sorted[i] = &stats[i];
+        qsort(sorted, stat_count, sizeof(RuleStat*), compare_rule_wall);
+        log_info("最慢的规则:");
+        for (int i = 0; i < stat_count && i < PROFILE_TOP_COUNT; i++) {
+            log_rule_stat(sorted[i]);
+        }
+    }
+    free(sorted);
+
+    // 最慢的文件
+    const FileProfile **sorted_files = malloc((file_count > 0 ? file_count : 1) * sizeof(FileProfile*));
+    if (sorted_files != NULL && file_count > 0) {
+        for (int i = 0; i < file_count; i++) sorted_files[i] = &files[i];
+        qsort(sorted_files, file_count, sizeof(FileProfile*), compare_file_wall);
+        log_info("最慢的文件:");
+        for (int i = 0; i < file_count && i < PROFILE_TOP_COUNT; i++) {
+            const FileProfile *f = sorted_files[i];
+            log_info("  %9.2f ms  %s (规则 %d 条, 读取 %zu 字节 %.2f ms, 写入 %zu 字节 %.2f ms)",
+                     ns_to_ms(f->wall_ns), f->path, f->rule_count, f->bytes_read,
+                     ns_to_ms(f->load_ns), f->bytes_written, ns_to_ms(f->save_ns));
+        }
+    }
+    free(sorted_files);
+    free(stats);
+}
+
+// 输出 JSON 格式的统计，便于跨构建跟踪
+int profile_write_json(const char *path, RuleTask **tasks, int task_count,
+                       const FileProfile *files, int file_count, uint64_t total_ns) {
+    int stat_count;
+    RuleStat *stats = collect_rule_stats(tasks, task_count, &stat_count);
+    if (stats == NULL) return -1;
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        log_error("错误: 无法写入性能统计文件 %s", path);
+        free(stats);
+        return -1;
+    }
+
+    fprintf(file, "{\n  \"total_ms\": %.3f,\n  \"rules\": [", ns_to_ms(total_ns));
+    for (int i = 0; i < stat_count; i++) {
+        const RuleStat *stat = &stats[i];
+        const RuleProfile *p = &stat->total;
+        fprintf(file, "%s\n    {\"index\": %d, \"operation\": \"%s\", \"target\": ",
+                i ? "," : "", stat->index, operation_to_string(stat->operation));
+        json_write_string(file, stat->target);
+        fprintf(file, ", \"instances\": %d, \"journaled\": %d, \"wall_ms\": %.3f, "
+                "\"compile_ms\": %.3f, \"subprocess_ms\": %.3f, \"lines_scanned\": %zu, "
+                "\"bytes_read\": %zu, \"bytes_written\": %zu, \"matches\": %d}",
+                stat->instances, stat->journaled, ns_to_ms(p->wall_ns), ns_to_ms(p->compile_ns),
+                ns_to_ms(p->subprocess_ns), p->lines_scanned, p->bytes_read, p->bytes_written,
+                p->matches);
+    }
+    fprintf(file, "%s],\n  \"files\": [", stat_count ? "\n  " : "");
+    for (int i = 0; i < file_count; i++) {
+        const FileProfile *f = &files[i];
+        fprintf(file, "%s\n    {\"path\": ", i ? "," : "");
+        json_write_string(file, f->path);
+        fprintf(file, ", \"rules\": %d, \"wall_ms\": %.3f, \"load_ms\": %.3f, \"save_ms\": %.3f, "
+                "\"bytes_read\": %zu, \"bytes_written\": %zu}",
+                f->rule_count, ns_to_ms(f->wall_ns), ns_to_ms(f->load_ns), ns_to_ms(f->save_ns),
+                f->bytes_read, f->bytes_written);
+    }
+    fprintf(file, "%s]\n}\n", file_count ? "\n  " : "");
+
+    free(stats);
+    if (fclose(file) != 0) {
+        log_error("错误: 写入性能统计文件失败 %s", path);
+        return -1;
+    }
+    return 0;
+}
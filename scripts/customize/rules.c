@@ -7,31 +7,32 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "customize.h"
+#include "../utils/pathglob.h"
+#include "../utils/treecopy.h"
 
-int parse_customize_config(const char *filename, Rule **rules, int *rule_count, 
-                          char ***variables, int *var_count) {
+int parse_customize_config(const char *filename, Rule **rules, int *rule_count, VarEnv *env) {
     FILE *file = fopen(filename, "r");
     if (file == NULL) {
         log_error("错误: 无法打开文件 %s", filename);
         return -1;
     }
     
-    char line[1024];
+    char *line = NULL;
+    size_t line_cap = 0;
     *rule_count = 0;
-    *var_count = 0;
     int max_rules = 100;
-    int max_vars = 20;
     *rules = malloc(max_rules * sizeof(Rule));
-    *variables = malloc(max_vars * sizeof(char*));
     
-    if (*rules == NULL || *variables == NULL) {
+    if (*rules == NULL) {
         fclose(file);
         return -1;
     }
     
-    while (fgets(line, sizeof(line), file) != NULL) {
+    // 使用 getline 读取，规则行长度不受限制
+    while (getline(&line, &line_cap, file) != -1) {
         // 跳过注释行和空行
         if (line[0] == '#' || line[0] == '\n') {
             continue;
@@ -58,29 +59,25 @@ int parse_customize_config(const char *filename, Rule **rules, int *rule_count,
             
             if (is_valid_var && !has_semicolon) {
                 // 这是一个变量定义
-                if (*var_count >= max_vars) {
-                    max_vars *= 2;
-                    *variables = realloc(*variables, max_vars * sizeof(char*));
-                    if (*variables == NULL) {
-                        fclose(file);
-                        return -1;
-                    }
-                }
-                
                 *equals = '\0';
                 char *name = line;
                 char *value = equals + 1;
                 
                 // 去除值中的引号
-                if (value[0] == '"' && value[strlen(value)-1] == '"') {
+                if (strlen(value) >= 2 && value[0] == '"' && value[strlen(value)-1] == '"') {
                     value[strlen(value)-1] = '\0';
                     value++;
                 }
                 
-                // 保存变量
-                char *var_def = malloc(strlen(name) + strlen(value) + 2);
-                sprintf(var_def, "%s=%s", name, value);
-                (*variables)[(*var_count)++] = var_def;
+                // 保存变量（去除值的首尾空白）
+                char *clean_value = clean_string(value);
+                if (clean_value == NULL || varenv_set(env, name, clean_value) != 0) {
+                    free(clean_value);
+                    free(line);
+                    fclose(file);
+                    return -1;
+                }
+                free(clean_value);
                 log_info("解析到变量: %s=%s", name, value);
                 continue;
             }
@@ -116,6 +113,7 @@ int parse_customize_config(const char *filename, Rule **rules, int *rule_count,
             max_rules *= 2;
             *rules = realloc(*rules, max_rules * sizeof(Rule));
             if (*rules == NULL) {
+                free(line);
                 fclose(file);
                 return -1;
             }
@@ -132,52 +130,25 @@ int parse_customize_config(const char *filename, Rule **rules, int *rule_count,
         log_info("解析到规则: %s;%s;%s;%s;%s",
            context == CTX_INIT ? "init" : 
            context == CTX_BUILD ? "build" : "all",
-           operation == OP_REPLACE ? "replace" :
-           operation == OP_INSERT_AFTER ? "insert-after" :
-           operation == OP_INSERT_BEFORE ? "insert-before" :
-           operation == OP_APPEND ? "append" :
-           operation == OP_DELETE ? "delete" :
-           operation == OP_EXEC ? "exec" :
-           operation == OP_COPY ? "copy" : "unknown",
+           operation_to_string(operation),
            target_file,
            param1 ? param1 : "",
            param2 ? param2 : "");
     }
     
+    free(line);
     fclose(file);
     return 0;
 }
 
-// 释放规则和变量内存
-void free_rules_and_vars(Rule *rules, int rule_count, char **variables, int var_count) {
+// 释放规则内存
+void free_rules(Rule *rules, int rule_count) {
     for (int i = 0; i < rule_count; i++) {
         free(rules[i].target_file);
         free(rules[i].param1);
         free(rules[i].param2);
     }
     free(rules);
-    
-    for (int i = 0; i < var_count; i++) {
-        free(variables[i]);
-    }
-    free(variables);
-}
-
-// 从变量列表中获取变量值
-char* get_variable_value(char **variables, int var_count, const char *var_name) {
-    for (int i = 0; i < var_count; i++) {
-        char *var_def = variables[i];
-        char *equals = strchr(var_def, '=');
-        if (equals != NULL) {
-            *equals = '\0';
-            if (strcmp(var_def, var_name) == 0) {
-                *equals = '=';
-                return equals + 1;
-            }
-            *equals = '=';
-        }
-    }
-    return NULL;
 }
 
 // 解析上下文字符串
@@ -197,6 +168,8 @@ OperationType parse_operation(const char *operation_str) {
     if (strcmp(operation_str, "delete") == 0) return OP_DELETE;
     if (strcmp(operation_str, "exec") == 0) return OP_EXEC;
     if (strcmp(operation_str, "copy") == 0) return OP_COPY;
+    if (strcmp(operation_str, "kconfig-set") == 0) return OP_KCONFIG_SET;
+    if (strcmp(operation_str, "kconfig-unset") == 0) return OP_KCONFIG_UNSET;
     return OP_UNKNOWN;
 }
 
@@ -249,729 +222,468 @@ char* clean_string(const char *str) {
 }
 
 // 替换变量（确保不包含不必要的换行符）
-char* replace_variables(const char *str, const char *src_dir, const char *res_dir, 
-                       const char *author, const char *build_time, 
-                       char **variables, int var_count) {
+char* replace_variables(const VarEnv *env, const char *str) {
     if (str == NULL) return NULL;
     
     // 清理输入字符串
     char *clean_str = clean_string(str);
     if (clean_str == NULL) return NULL;
     
-    // 第一次扫描：计算需要的缓冲区大小
-    size_t len = strlen(clean_str);
-    size_t new_len = len;
-    const char *s = clean_str;
-    
-    while (*s) {
-        if (strncmp(s, "${SRC_DIR}", 10) == 0 && src_dir) {
-            new_len += strlen(src_dir) - 10;
-            s += 10;
-        } else if (strncmp(s, "${RES_DIR}", 10) == 0 && res_dir) {
-            new_len += strlen(res_dir) - 10;
-            s += 10;
-        } else if (strncmp(s, "${AUTHOR}", 9) == 0 && author) {
-            new_len += strlen(author) - 9;
-            s += 9;
-        } else if (strncmp(s, "__BUILD_TIME__", 14) == 0 && build_time) {
-            new_len += strlen(build_time) - 14;
-            s += 14;
-        } else if (s[0] == '$' && s[1] == '{') {
-            // 查找自定义变量
-            const char *end = strchr(s + 2, '}');
-            if (end != NULL) {
-                int var_len = end - s + 1;
-                char *var_name = malloc(var_len - 2);
-                strncpy(var_name, s + 2, var_len - 3);
-                var_name[var_len - 3] = '\0';
-                
-                char *var_value = get_variable_value(variables, var_count, var_name);
-                if (var_value != NULL) {
-                    // 清理变量值
-                    char *clean_value = clean_string(var_value);
-                    if (clean_value != NULL) {
-                        // 递归替换变量值中的变量
-                        char *expanded_value = replace_variables(clean_value, src_dir, res_dir, 
-                                                               author, build_time, 
-                                                               variables, var_count);
-                        if (expanded_value != NULL) {
-                            new_len += strlen(expanded_value) - var_len;
-                            free(expanded_value);
-                        } else {
-                            new_len += strlen(clean_value) - var_len;
-                        }
-                        
-                        free(clean_value);
-                    }
-                }
-                
-                free(var_name);
-                s += var_len;
-            } else {
-                s++;
-            }
-        } else {
-            s++;
-        }
-    }
-    
-    // 分配缓冲区
-    char *result = malloc(new_len + 1);
-    if (result == NULL) {
-        free(clean_str);
-        return NULL;
-    }
-    
-    // 第二次扫描：实际替换变量
-    char *p_result = result;
-    s = clean_str;
-    
-    while (*s) {
-        if (strncmp(s, "${SRC_DIR}", 10) == 0 && src_dir) {
-            strcpy(p_result, src_dir);
-            p_result += strlen(src_dir);
-            s += 10;
-        } else if (strncmp(s, "${RES_DIR}", 10) == 0 && res_dir) {
-            strcpy(p_result, res_dir);
-            p_result += strlen(res_dir);
-            s += 10;
-        } else if (strncmp(s, "${AUTHOR}", 9) == 0 && author) {
-            strcpy(p_result, author);
-            p_result += strlen(author);
-            s += 9;
-        } else if (strncmp(s, "__BUILD_TIME__", 14) == 0 && build_time) {
-            strcpy(p_result, build_time);
-            p_result += strlen(build_time);
-            s += 14;
-        } else if (s[0] == '$' && s[1] == '{') {
-            // 处理自定义变量
-            const char *end = strchr(s + 2, '}');
-            if (end != NULL) {
-                int var_len = end - s + 1;
-                char *var_name = malloc(var_len - 2);
-                strncpy(var_name, s + 2, var_len - 3);
-                var_name[var_len - 3] = '\0';
-                
-                char *var_value = get_variable_value(variables, var_count, var_name);
-                if (var_value != NULL) {
-                    // 清理变量值
-                    char *clean_value = clean_string(var_value);
-                    if (clean_value != NULL) {
-                        // 递归替换变量值中的变量
-                        char *expanded_value = replace_variables(clean_value, src_dir, res_dir, 
-                                                               author, build_time, 
-                                                               variables, var_count);
-                        if (expanded_value != NULL) {
-                            strcpy(p_result, expanded_value);
-                            p_result += strlen(expanded_value);
-                            free(expanded_value);
-                        } else {
-                            strcpy(p_result, clean_value);
-                            p_result += strlen(clean_value);
-                        }
-                        
-                        free(clean_value);
-                    }
-                } else {
-                    // 变量未定义，保留原样
-                    strncpy(p_result, s, var_len);
-                    p_result += var_len;
-                }
-                
-                free(var_name);
-                s += var_len;
-            } else {
-                *p_result++ = *s++;
-            }
-        } else {
-            *p_result++ = *s++;
-        }
-    }
-    
-    *p_result = '\0';
+    char *result = varenv_expand(env, clean_str);
     free(clean_str);
-    
     return result;
 }
 
-// 执行替换操作（支持正则表达式）
-int execute_replace(const char *file_path, const char *search_pattern, const char *replace) {
-    // 构建临时文件路径
-    char tmp_path[PATH_MAX];
-    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", file_path);
-    
-    FILE *src_file = fopen(file_path, "r");
-    if (src_file == NULL) {
-        log_error("错误: 无法打开源文件 %s", file_path);
-        return -1;
-    }
-    
-    FILE *dst_file = fopen(tmp_path, "w");
-    if (dst_file == NULL) {
-        fclose(src_file);
-        log_error("错误: 无法创建临时文件 %s", tmp_path);
-        return -1;
+// 执行命令操作
+int execute_exec(const char *command) {
+    return system(command);
+}
+
+// 执行复制操作：原生增量复制，只复制内容有变化的文件
+// mirror 为真时删除目标中源已不存在的文件
+int execute_copy(const char *src, const char *dest, bool mirror, RuleProfile *profile) {
+    TreeCopyOptions copy_options = { .mirror = mirror };
+    TreeCopyStats stats;
+    int result = tree_copy(src, dest, &copy_options, &stats);
+
+    log_info("复制 %lu 个文件 (%llu 字节), 未变化 %lu 个, 新建目录 %lu 个",
+             stats.files_copied, stats.bytes_copied, stats.files_unchanged, stats.dirs_created);
+    if (mirror) {
+        log_info("镜像模式: 删除了 %lu 个源中已不存在的条目", stats.files_deleted);
     }
-    
-    char line[4096];
-    int changes = 0;
-    
-    // 编译正则表达式
-    regex_t regex;
-    int regex_result = regcomp(&regex, search_pattern, REG_EXTENDED);
-    if (regex_result != 0) {
-        fclose(src_file);
-        fclose(dst_file);
-        log_error("错误: 无效的正则表达式 '%s'", search_pattern);
-        return -1;
+    profile->bytes_written += stats.bytes_copied;
+    return result;
+}
+
+// 操作类型名称
+const char* operation_to_string(OperationType operation) {
+    switch (operation) {
+        case OP_REPLACE: return "replace";
+        case OP_INSERT_AFTER: return "insert-after";
+        case OP_INSERT_BEFORE: return "insert-before";
+        case OP_APPEND: return "append";
+        case OP_DELETE: return "delete";
+        case OP_EXEC: return "exec";
+        case OP_COPY: return "copy";
+        case OP_KCONFIG_SET: return "kconfig-set";
+        case OP_KCONFIG_UNSET: return "kconfig-unset";
+        default: return "unknown";
     }
+}
 
-    
-    while (fgets(line, sizeof(line), src_file) != NULL) {
-        char *pos = line;
-        regmatch_t matches[1];
-        char result[8192] = {0};
-        char *r = result;
-        
-        // 使用正则表达式查找所有匹配
-        while (regexec(&regex, pos, 1, matches, 0) == 0) {
-            // 复制匹配之前的部分
-            size_t len = matches[0].rm_so;
-            strncpy(r, pos, len);
-            r += len;
-            
-            // 复制替换字符串
-            strcpy(r, replace);
+// 创建规则实例，参数均复制一份
+static RuleTask* new_rule_task(const Rule *rule, int index, const char *target_file,
+                               const char *param1, const char *param2) {
+    RuleTask *task = calloc(1, sizeof(RuleTask));
+    if (task == NULL) return NULL;
+    task->rule = rule;
+    task->index = index;
+    task->target_file = strdup(target_file);
+    task->param1 = param1 ? strdup(param1) : NULL;
+    task->param2 = param2 ? strdup(param2) : NULL;
+    return task;
+}
 
-            r += strlen(replace);
-            
-            // 移动位置指针到匹配结束之后
-            pos += matches[0].rm_eo;
-            changes++;
+static void free_rule_task(RuleTask *task) {
+    free(task->target_file);
+    free(task->param1);
+    free(task->param2);
+    if (task->matcher_ready) {
+        matcher_free(&task->matcher);
+    }
+    free(task);
+}
+
+// 执行 exec / copy 规则
+static int execute_command_task(RuleTask *task) {
+    const char *target_file = task->target_file;
+    const char *param1 = task->param1;
+
+    switch (task->rule->operation) {
+        case OP_EXEC: {
+            // 执行操作总是执行，不检查是否已经应用
+            if (!param1) {
+                log_error("错误: 执行操作需要一个参数");
+                return -1;
+            }
+            uint64_t start = profile_now_ns();
+            int result = execute_exec(param1);
+            task->profile.subprocess_ns += profile_now_ns() - start;
+            return result;
         }
-        
-        // 复制剩余部分
-        strcpy(r, pos);
-        
-        fputs(result, dst_file);
-    }
-    
-    // 释放正则表达式
-    regfree(&regex);
-    
-    fclose(src_file);
-    fclose(dst_file);
-    
-    if (changes > 0) {
-        // 替换原文件
-        if (rename(tmp_path, file_path) != 0) {
-            log_error("错误: 无法替换原文件 %s", file_path);
-            remove(tmp_path);
+
+        case OP_COPY:
+            if (!param1) {
+                log_error("错误: 复制操作需要目标路径参数");
+                return -1;
+            }
+            // 逐个文件比较，未变化的文件不会重新复制；参数 2 为 mirror 时启用镜像模式
+            return execute_copy(target_file, param1,
+                                task->param2 != NULL && strcmp(task->param2, "mirror") == 0,
+                                &task->profile);
+
+        default:
+            log_error("错误: 未知的操作类型");
             return -1;
-        }
-        log_info("在文件 %s 中进行了 %d 处替换", file_path, changes);
-        return 0;
-    } else {
-        // 没有进行任何替换，删除临时文件
-        remove(tmp_path);
-        log_error("在文件 %s 中没有找到匹配的文本", file_path);
-        return 0;
     }
 }
 
+// 一次 execute_rules 调用的执行状态
+typedef struct {
+    const ExecOptions *options;
+    RuleTask **tasks;       // 所有规则实例，结束时统一释放
+    int task_count;
+    int task_capacity;
+    FileGroup *groups;      // 等待执行的文件分组
+    int group_count;
+    int group_capacity;
+    int *group_index;       // 按规范化路径索引分组的开放寻址哈希表，存放下标 + 1
+    size_t index_capacity;
+    int success_count;
+    int fail_count;
+    FileProfile *files;     // 已处理文件的性能统计（--profile）
+    int file_count;
+    int file_capacity;
+} RuleRun;
 
-// 检查替换操作是否已经应用
-bool check_replace_applied(const char *file_path, const char *search, const char *replace) {
-    FILE *file = fopen(file_path, "r");
-    if (file == NULL) return false;
-    
-    char line[4096];
-    bool found = false;
-    
-    // 编译正则表达式
-    regex_t regex;
-    if (regcomp(&regex, search, REG_EXTENDED) != 0) {
-        fclose(file);
-        return false;
-    }
-    
-    while (fgets(line, sizeof(line), file) != NULL) {
-        // 检查是否已经包含替换后的内容
-        if (strstr(line, replace) != NULL) {
-            found = true;
-            break;
-        }
-        
-        // 检查是否还需要替换
-        regmatch_t matches[1];
-        if (regexec(&regex, line, 1, matches, 0) == 0) {
-            // 找到了需要替换的内容，说明替换尚未完成
-            found = false;
-            break;
-        }
-    }
-    
-    regfree(&regex);
-    fclose(file);
-    return found;
+// 保存分组的性能统计，分组本身在落盘后即被释放
+static void record_file_profile(RuleRun *run, const FileGroup *group) {
+    if (run->file_count >= run->file_capacity) {
+        int new_capacity = run->file_capacity ? run->file_capacity * 2 : 64;
+        FileProfile *files = realloc(run->files, new_capacity * sizeof(FileProfile));
+        if (files == NULL) return;
+        run->files = files;
+        run->file_capacity = new_capacity;
+    }
+    FileProfile *profile = &run->files[run->file_count];
+    *profile = group->profile;
+    profile->path = strdup(group->path);
+    if (profile->path != NULL) run->file_count++;
 }
 
-// 检查插入操作是否已经应用 - 使用简单的字符串匹配
-bool check_insert_applied(const char *file_path, const char *pattern, const char *content, bool after) {
-    FILE *file = fopen(file_path, "r");
-    if (file == NULL) return false;
-    
-    char line[4096];
-    bool content_found = false;
-    
-    // 简单的字符串匹配：检查整个文件中是否已经包含要插入的内容
-    while (fgets(line, sizeof(line), file) != NULL) {
-        // 清理行内容进行比较
-        char *clean_line = clean_string(line);
-        if (clean_line && strstr(clean_line, content) != NULL) {
-            content_found = true;
-            free(clean_line);
-            break;
-        }
-        if (clean_line) free(clean_line);
-    }
-    
-    fclose(file);
-    
-    // 如果内容已经存在，就跳过插入
-    return content_found;
+static int track_task(RuleRun *run, RuleTask *task) {
+    if (run->task_count >= run->task_capacity) {
+        int new_capacity = run->task_capacity ? run->task_capacity * 2 : 64;
+        RuleTask **tasks = realloc(run->tasks, new_capacity * sizeof(RuleTask*));
+        if (tasks == NULL) return -1;
+        run->tasks = tasks;
+        run->task_capacity = new_capacity;
+    }
+    run->tasks[run->task_count++] = task;
+    return 0;
 }
 
-// 检查追加操作是否已经应用 - 使用简单的字符串匹配
-bool check_append_applied(const char *file_path, const char *content) {
-    FILE *file = fopen(file_path, "r");
-    if (file == NULL) return false;
-    
-    char line[4096];
-    bool found = false;
-    
-    // 检查整个文件中是否已经包含要追加的内容
-    while (fgets(line, sizeof(line), file) != NULL) {
-        char *clean_line = clean_string(line);
-        if (clean_line && strstr(clean_line, content) != NULL) {
-            found = true;
-            free(clean_line);
-            break;
-        }
-        if (clean_line) free(clean_line);
+static size_t hash_path(const char *path) {
+    size_t hash = 5381;
+    while (*path) hash = hash * 33 + (unsigned char)*path++;
+    return hash;
+}
+
+// 查找分组在哈希表中的槽位
+static size_t find_group_slot(const RuleRun *run, const char *key) {
+    size_t mask = run->index_capacity - 1;
+    size_t slot = hash_path(key) & mask;
+    while (run->group_index[slot] != 0 &&
+           strcmp(run->groups[run->group_index[slot] - 1].key, key) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int grow_group_index(RuleRun *run) {
+    size_t new_capacity = run->index_capacity ? run->index_capacity * 2 : 64;
+    int *index = calloc(new_capacity, sizeof(int));
+    if (index == NULL) return -1;
+    free(run->group_index);
+    run->group_index = index;
+    run->index_capacity = new_capacity;
+    for (int i = 0; i < run->group_count; i++) {
+        run->group_index[find_group_slot(run, run->groups[i].key)] = i + 1;
     }
-    
-    fclose(file);
-    return found;
+    return 0;
 }
 
-// 检查删除操作是否已经应用
-bool check_delete_applied(const char *file_path, const char *pattern) {
-    FILE *file = fopen(file_path, "r");
-    if (file == NULL) return true; // 如果文件不存在，认为删除已经应用
-    
-    char line[4096];
-    bool found = false;
-    
-    // 编译正则表达式
-    regex_t regex;
-    if (regcomp(&regex, pattern, REG_EXTENDED) != 0) {
-        fclose(file);
-        return false;
+// 把文本编辑规则加入对应目标文件的分组
+// 用规范化路径作为键，保证不同写法指向同一文件的规则不会被并行处理
+static FileGroup* add_to_file_group(RuleRun *run, RuleTask *task) {
+    char *key = realpath(task->target_file, NULL);
+    if (key == NULL) key = strdup(task->target_file);
+    if (key == NULL) return NULL;
+
+    if ((size_t)(run->group_count + 1) * 2 > run->index_capacity && grow_group_index(run) != 0) {
+        free(key);
+        return NULL;
     }
-    
-    while (fgets(line, sizeof(line), file) != NULL) {
-        // 检查模式是否还存在
-        regmatch_t matches[1];
-        if (regexec(&regex, line, 1, matches, 0) == 0) {
-            found = true;
-            break;
+
+    FileGroup *group;
+    size_t slot = find_group_slot(run, key);
+    if (run->group_index[slot] != 0) {
+        group = &run->groups[run->group_index[slot] - 1];
+        free(key);
+    } else {
+        if (run->group_count >= run->group_capacity) {
+            int new_capacity = run->group_capacity ? run->group_capacity * 2 : 16;
+            FileGroup *new_groups = realloc(run->groups, new_capacity * sizeof(FileGroup));
+            if (new_groups == NULL) {
+                free(key);
+                return NULL;
+            }
+            run->groups = new_groups;
+            run->group_capacity = new_capacity;
         }
+        group = &run->groups[run->group_count];
+        memset(group, 0, sizeof(*group));
+        group->path = strdup(task->target_file);
+        group->key = key;
+        run->group_index[slot] = ++run->group_count;
     }
-    
-    regfree(&regex);
-    fclose(file);
-    
-    // 如果找不到模式，说明删除已经应用
-    return !found;
+
+    if (group->task_count >= group->task_capacity) {
+        int new_capacity = group->task_capacity ? group->task_capacity * 2 : 8;
+        RuleTask **tasks = realloc(group->tasks, new_capacity * sizeof(RuleTask*));
+        if (tasks == NULL) return NULL;
+        group->tasks = tasks;
+        group->task_capacity = new_capacity;
+    }
+    group->tasks[group->task_count++] = task;
+    return group;
 }
 
-// 检查复制操作是否已经应用
-bool check_copy_applied(const char *src, const char *dest) {
-    struct stat src_stat, dest_stat;
-    
-    // 检查源文件和目标文件是否存在
-    if (stat(src, &src_stat) != 0 || stat(dest, &dest_stat) != 0) {
-        return false;
+// 工作线程共享的分组队列
+typedef struct {
+    FileGroup *groups;
+    int group_count;
+    int next;
+    pthread_mutex_t lock;
+    const ExecOptions *options;
+} GroupQueue;
+
+static void* group_worker(void *arg) {
+    GroupQueue *queue = arg;
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        int i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (i >= queue->group_count) break;
+
+        queue->groups[i].fail_count = apply_file_group(&queue->groups[i], queue->options);
     }
-    
-    // 检查修改时间，如果目标文件比源文件新，认为已经应用
-    return dest_stat.st_mtime >= src_stat.st_mtime;
+    return NULL;
 }
 
-// 执行插入操作（支持正则表达式）- 包含重复检查
-int execute_insert(const char *file_path, const char *pattern, const char *content, bool after) {
-    // 首先检查内容是否已经存在
-    if (check_insert_applied(file_path, pattern, content, after)) {
-        log_info("跳过重复插入: 目标文件中已存在相同内容");
-        return 0;
-    }
-    
-    // 构建临时文件路径
-    char tmp_path[PATH_MAX];
-    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", file_path);
-    
-    FILE *src_file = fopen(file_path, "r");
-    if (src_file == NULL) {
-        log_error("错误: 无法打开源文件 %s", file_path);
-        return -1;
-    }
-    
-    FILE *dst_file = fopen(tmp_path, "w");
-    if (dst_file == NULL) {
-        fclose(src_file);
-        log_error("错误: 无法创建临时文件 %s", tmp_path);
-        return -1;
-    }
-    
-    char line[4096];
-    int changes = 0;
-    bool found_pattern = false;
-    
-    // 编译正则表达式
-    regex_t regex;
-    int regex_result = regcomp(&regex, pattern, REG_EXTENDED);
-    if (regex_result != 0) {
-        fclose(src_file);
-        fclose(dst_file);
-        log_error("错误: 无效的正则表达式 '%s'", pattern);
-        return -1;
+// 执行所有已分组的文本编辑规则，每个文件只读写一次
+// 分组之间目标文件互不相同，可以在线程池中并行执行
+// .config 的符号有变化时执行一次 make defconfig 补全依赖，未变化时不执行
+static void run_defconfig(FileGroup *group, const ExecOptions *options) {
+    if (group->kconfig_count == 0 || group->fail_count > 0) return;
+
+    const char *base = strrchr(group->path, '/');
+    if (strcmp(base ? base + 1 : group->path, ".config") != 0) return;
+
+    char *dir = base ? strndup(group->path, base - group->path) : strdup(".");
+    char *makefile = NULL;
+    if (dir == NULL || asprintf(&makefile, "%s/Makefile", dir[0] ? dir : "/") < 0) {
+        free(dir);
+        return;
     }
-    
-    while (fgets(line, sizeof(line), src_file) != NULL) {
-        // 检查是否匹配模式
-        regmatch_t matches[1];
-        if (regexec(&regex, line, 1, matches, 0) == 0) {
-            found_pattern = true;
-            
-            if (!after) {
-                // 在匹配行前插入
-                fputs(content, dst_file);
-                fputs("\n", dst_file);
-                changes++;
-            }
-            
-            // 写入原行
-            fputs(line, dst_file);
-            
-            if (after) {
-                // 在匹配行后插入
-                fputs(content, dst_file);
-                fputs("\n", dst_file);
-                changes++;
+
+    if (file_exists(makefile)) {
+        char *cmd = NULL;
+        if (asprintf(&cmd, "make -C \"%s\" defconfig >/dev/null", dir[0] ? dir : "/") >= 0) {
+            log_info("%d 个 Kconfig 符号有变化，执行 make defconfig: %s", group->kconfig_count, dir);
+            fflush(stdout);
+            if (system(cmd) != 0) {
+                log_error("make defconfig 执行失败: %s", dir);
+                group->fail_count++;
+            } else if (options->state_dir) {
+                // defconfig 会改写 .config，重新记录内容摘要
+                char hex[SHA256_HEX_SIZE];
+                if (sha256_file_hex(group->path, hex) == 0) {
+                    journal_save(options->state_dir, group->path, hex, group->tasks, group->task_count);
+                }
             }
-        } else {
-            // 不匹配，直接写入
-            fputs(line, dst_file);
+            free(cmd);
         }
     }
-    
-    // 如果模式未找到但需要插入，则在文件末尾插入
-    if (!found_pattern && after) {
-        fputs(content, dst_file);
-        fputs("\n", dst_file);
-        changes++;
-        log_warning("模式未找到，在文件末尾插入内容");
-    }
-    
-    // 释放正则表达式
-    regfree(&regex);
-    
-    fclose(src_file);
-    fclose(dst_file);
-    
-    if (changes > 0) {
-        // 替换原文件
-        if (rename(tmp_path, file_path) != 0) {
-            log_error("错误: 无法替换原文件 %s", file_path);
-            remove(tmp_path);
-            return -1;
+
+    free(makefile);
+    free(dir);
+}
+
+static void flush_file_groups(RuleRun *run) {
+    int group_count = run->group_count;
+    if (group_count == 0) return;
+
+    int jobs = run->options->jobs;
+    if (jobs > group_count) jobs = group_count;
+
+    if (jobs <= 1) {
+        for (int i = 0; i < group_count; i++) {
+            run->groups[i].fail_count = apply_file_group(&run->groups[i], run->options);
         }
-        log_info("在文件 %s 中进行了 %d 处插入", file_path, changes);
-        return 0;
     } else {
-        // 没有进行任何插入，删除临时文件
-        remove(tmp_path);
-        log_info("在文件 %s 中没有找到匹配的文本", file_path);
-        return 0;
-    }
-}
+        GroupQueue queue = {
+            .groups = run->groups,
+            .group_count = group_count,
+            .next = 0,
+            .options = run->options
+        };
+        pthread_mutex_init(&queue.lock, NULL);
 
-// 执行追加操作 - 包含重复检查
-int execute_append(const char *file_path, const char *content) {
-    // 首先检查内容是否已经存在
-    if (check_append_applied(file_path, content)) {
-        log_info("跳过重复追加: 目标文件中已存在相同内容");
-        return 0;
-    }
-    
-    // 清理内容字符串
-    char *clean_content = clean_string(content);
-    if (clean_content == NULL) {
-        log_error("错误: 无法清理内容字符串");
-        return -1;
+        pthread_t *threads = malloc(jobs * sizeof(pthread_t));
+        int started = 0;
+        for (int i = 0; threads != NULL && i < jobs; i++) {
+            if (pthread_create(&threads[i], NULL, group_worker, &queue) != 0) break;
+            started++;
+        }
+        // 线程创建失败时由当前线程处理剩余分组
+        if (started == 0) group_worker(&queue);
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+        pthread_mutex_destroy(&queue.lock);
     }
-    
-    FILE *file = fopen(file_path, "a");
-    if (file == NULL) {
-        log_error("错误: 无法打开文件 %s", file_path);
-        free(clean_content);
-        return -1;
+
+    for (int i = 0; i < group_count; i++) {
+        FileGroup *group = &run->groups[i];
+        run_defconfig(group, run->options);
+        if (run->options->profile || run->options->profile_json) {
+            record_file_profile(run, group);
+        }
+        run->fail_count += group->fail_count;
+        run->success_count += group->task_count - group->fail_count;
+
+        free(group->path);
+        free(group->key);
+        free(group->tasks);
     }
-    
-    // 直接写入清理后的内容
-    fprintf(file, "%s\n", clean_content);
-    fclose(file);
-    
-    free(clean_content);
-    return 0;
+    run->group_count = 0;
+    memset(run->group_index, 0, run->index_capacity * sizeof(int));
 }
 
-// 执行删除操作（支持正则表达式）
-int execute_delete(const char *file_path, const char *pattern) {
-    // 构建临时文件路径
-    char tmp_path[PATH_MAX];
-    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", file_path);
-    
-    FILE *src_file = fopen(file_path, "r");
-    if (src_file == NULL) {
-        log_error("错误: 无法打开源文件 %s", file_path);
-        return -1;
-    }
-    
-    FILE *dst_file = fopen(tmp_path, "w");
-    if (dst_file == NULL) {
-        fclose(src_file);
-        log_error("错误: 无法创建临时文件 %s", tmp_path);
-        return -1;
+// 展开目标路径中的通配符，为每个匹配的文件生成一个规则实例
+static void add_glob_tasks(RuleRun *run, const RuleTask *template_task) {
+    char **matches = NULL;
+    int match_count = 0;
+
+    if (path_glob(template_task->target_file, &matches, &match_count) != 0) {
+        log_error("规则 #%d: 展开目标路径失败: %s", template_task->index, template_task->target_file);
+        run->fail_count++;
+        return;
     }
-    
-    char line[4096];
-    int changes = 0;
-    
-    // 编译正则表达式
-    regex_t regex;
-    int regex_result = regcomp(&regex, pattern, REG_EXTENDED);
-    if (regex_result != 0) {
-        fclose(src_file);
-        fclose(dst_file);
-        log_error("错误: 无效的正则表达式 '%s'", pattern);
-        return -1;
+
+    if (match_count == 0) {
+        log_warning("规则 #%d: 没有匹配的文件: %s", template_task->index, template_task->target_file);
+        run->success_count++;
+        return;
     }
-    
-    while (fgets(line, sizeof(line), src_file) != NULL) {
-        // 检查是否匹配模式
-        regmatch_t matches[1];
-        if (regexec(&regex, line, 1, matches, 0) == 0) {
-            // 匹配，跳过这行（删除）
-            changes++;
-        } else {
-            // 不匹配，保留这行
-            fputs(line, dst_file);
+
+    log_info("规则 #%d: %s 匹配到 %d 个文件", template_task->index,
+             template_task->target_file, match_count);
+
+    for (int i = 0; i < match_count; i++) {
+        RuleTask *task = new_rule_task(template_task->rule, template_task->index, matches[i],
+                                       template_task->param1, template_task->param2);
+        // 未能加入任务列表的实例不会在结束时释放
+        if (task != NULL && track_task(run, task) != 0) {
+            free_rule_task(task);
+            task = NULL;
         }
-    }
-    
-    // 释放正则表达式
-    regfree(&regex);
-    
-    fclose(src_file);
-    fclose(dst_file);
-    
-    if (changes > 0) {
-        // 替换原文件
-        if (rename(tmp_path, file_path) != 0) {
-            log_error("错误: 无法替换原文件 %s", file_path);
-            remove(tmp_path);
-            return -1;
+        if (task == NULL || add_to_file_group(run, task) == NULL) {
+            log_error("错误: 内存不足");
+            run->fail_count++;
         }
-        log_info("在文件 %s 中删除了 %d 行", file_path, changes);
-        return 0;
-    } else {
-        // 没有进行任何删除，删除临时文件
-        remove(tmp_path);
-        log_warning("在文件 %s 中没有找到匹配的文本", file_path);
-        return 0;
     }
+    path_glob_free(matches, match_count);
 }
 
-// 执行命令操作
-int execute_exec(const char *command) {
-    return system(command);
+// 构建时间在目标系统中的引用方式: 优先使用 BUILD_TIME_REF，
+// 否则把 OpenWrt 软件包 files/ 目录下的路径换算为安装后的路径
+static char* build_time_reference(const VarEnv *env, const char *time_file) {
+    const char *ref = varenv_get(env, "BUILD_TIME_REF");
+    if (ref != NULL && ref[0] != '\0') return strdup(ref);
+
+    const char *installed = strstr(time_file, "/files/");
+    if (installed != NULL) {
+        const char *next;
+        while ((next = strstr(installed + 1, "/files/")) != NULL) installed = next;
+        installed += strlen("/files");
+    } else {
+        installed = time_file;
+    }
+
+    char *result = NULL;
+    if (asprintf(&result, "$(cat %s)", installed) < 0) return NULL;
+    return result;
 }
 
-// 执行复制操作
-int execute_copy(const char *src, const char *dest) {
-    char cmd[4096];
-    snprintf(cmd, sizeof(cmd), "cp -r \"%s\" \"%s\"", src, dest);
-    return system(cmd);
+// 把构建时间写入单独的文件（先写临时文件再重命名）
+static int write_build_time_file(const char *time_file, const char *build_time) {
+    char *tmp_path = NULL;
+    if (asprintf(&tmp_path, "%s.tmp", time_file) < 0) return -1;
+
+    FILE *file = fopen(tmp_path, "w");
+    int result = file ? 0 : -1;
+    if (file != NULL) {
+        if (fprintf(file, "%s\n", build_time) < 0) result = -1;
+        if (fclose(file) != 0) result = -1;
+    }
+    if (result == 0 && rename(tmp_path, time_file) != 0) result = -1;
+    if (result != 0) remove(tmp_path);
+
+    free(tmp_path);
+    return result;
 }
 
-// 执行规则
-int execute_rule(const Rule *rule, const char *src_dir, const char *res_dir, 
-                const char *author, const char *build_time, 
-                char **variables, int var_count) {
-    // 替换变量
-    char *target_file = replace_variables(rule->target_file, src_dir, res_dir, 
-                                        author, build_time, variables, var_count);
-    char *param1 = replace_variables(rule->param1, src_dir, res_dir, 
-                                   author, build_time, variables, var_count);
-    char *param2 = replace_variables(rule->param2, src_dir, res_dir, 
-                                   author, build_time, variables, var_count);
-    
-    if (!target_file) {
-        log_error("错误: 无法替换目标文件变量");
-        return -1;
-    }
-    
-    int result = 0;
-    bool already_applied = false;
-    
-    // 检查规则是否已经应用
-    switch (rule->operation) {
-        case OP_REPLACE:
-            // 替换操作总是执行，不检查是否已经应用
-            already_applied = false;
-            break;
-            
-        case OP_INSERT_AFTER:
-            if (param1 && param2) {
-                already_applied = check_insert_applied(target_file, param1, param2, true);
-            }
-            break;
-            
-        case OP_INSERT_BEFORE:
-            if (param1 && param2) {
-                already_applied = check_insert_applied(target_file, param1, param2, false);
-            }
-            break;
-            
-        case OP_APPEND:
-            if (param1) {
-                already_applied = check_append_applied(target_file, param1);
-            }
-            break;
-            
-        case OP_DELETE:
-            if (param1) {
-                already_applied = check_delete_applied(target_file, param1);
-            }
-            break;
-            
-        case OP_COPY:
-            if (param1) {
-                already_applied = check_copy_applied(target_file, param1);
-            }
-            break;
-            
-        case OP_EXEC:
-            // 执行操作总是执行，不检查是否已经应用
-            already_applied = false;
-            break;
-            
-        default:
-            break;
+// 设置了 BUILD_TIME_FILE 时，每次变化的构建时间只写入这一个文件，
+// 规则中的 __BUILD_TIME__ 替换为对该文件的固定引用，其余文件内容保持稳定，
+// 不会因为时间变化而被重写并触发重新打包。
+// 只有编译阶段才真正产生新的构建时间，init 等阶段不改写该文件，
+// __BUILD_TIME__ 保持为当前时间文本
+static void route_build_time(VarEnv *env, const char *build_time, ContextType context) {
+    if (context != CTX_BUILD) return;
+
+    const char *value = varenv_get(env, "BUILD_TIME_FILE");
+    if (value == NULL || value[0] == '\0') return;
+
+    char *time_file = strdup(value);
+    char *ref = time_file ? build_time_reference(env, time_file) : NULL;
+    if (ref == NULL) {
+        free(time_file);
+        return;
     }
-    
-    if (already_applied) {
-        log_info("规则已经应用，跳过执行");
-        result = 0; // 跳过执行，返回成功
+
+    if (write_build_time_file(time_file, build_time) == 0) {
+        log_info("构建时间已写入 %s，规则中的 __BUILD_TIME__ 替换为 %s", time_file, ref);
+        varenv_set_token(env, "__BUILD_TIME__", ref);
+        varenv_resolve(env);
     } else {
-        // 执行规则
-        switch (rule->operation) {
-            case OP_REPLACE:
-                if (!param1 || !param2) {
-                    log_error("错误: 替换操作需要两个参数");
-                    result = -1;
-                } else {
-                    result = execute_replace(target_file, param1, param2);
-                }
-                break;
-                
-            case OP_INSERT_AFTER:
-                if (!param1 || !param2) {
-                    log_error("错误: 插入操作需要两个参数");
-                    result = -1;
-                } else {
-                    result = execute_insert(target_file, param1, param2, true);
-                }
-                break;
-                
-            case OP_INSERT_BEFORE:
-                if (!param1 || !param2) {
-                    log_error("错误: 插入操作需要两个参数");
-                    result = -1;
-                } else {
-                    result = execute_insert(target_file, param1, param2, false);
-                }
-                break;
-                
-            case OP_APPEND:
-                if (!param1) {
-                    log_error("错误: 追加操作需要一个参数");
-                    result = -1;
-                } else {
-                    result = execute_append(target_file, param1);
-                }
-                break;
-                
-            case OP_DELETE:
-                if (!param1) {
-                    log_error("错误: 删除操作需要一个参数");
-                    result = -1;
-                } else {
-                    result = execute_delete(target_file, param1);
-                }
-                break;
-                
-            case OP_EXEC:
-                if (!param1) {
-                    log_error("错误: 执行操作需要一个参数");
-                    result = -1;
-                } else {
-                    result = execute_exec(param1);
-                }
-                break;
-                
-            case OP_COPY:
-                if (!param1) {
-                    log_error("错误: 复制操作需要目标路径参数");
-                    result = -1;
-                } else {
-                    result = execute_copy(target_file, param1);
-                }
-                break;
-                
-            default:
-                log_error("错误: 未知的操作类型");
-                result = -1;
-                break;
-        }
+        log_warning("无法写入构建时间文件 %s，__BUILD_TIME__ 仍使用当前时间", time_file);
     }
-    
-    free(target_file);
-    free(param1);
-    free(param2);
-    
-    return result;
+
+    free(ref);
+    free(time_file);
 }
 
 // 执行所有规则
-int execute_rules(Rule *rules, int rule_count, ContextType current_context, 
-                  const char *src_dir, const char *res_dir, const char *author,
-                  char **variables, int var_count) {
+// 文本编辑规则按目标文件分组合并执行，不同文件的分组并行处理；
+// exec/copy 规则可能读写任意文件，执行前先把之前的分组全部落盘，
+// 保证与配置文件中的顺序语义一致
+int execute_rules(Rule *rules, int rule_count, ContextType current_context, VarEnv *env,
+                  const ExecOptions *options) {
+    uint64_t run_start = profile_now_ns();
     char *build_time = get_current_time_str();
-    int success_count = 0;
-    int fail_count = 0;
+    
+    // 所有变量定义只展开一次，之后每条规则单遍替换
+    varenv_set_token(env, "__BUILD_TIME__", build_time);
+    if (varenv_resolve(env) > 0) {
+        log_warning("配置文件中存在循环引用的变量，相关引用将保留原样");
+    }
+    route_build_time(env, build_time, current_context);
+    
+    RuleRun run = {0};
+    run.options = options;
     
     for (int i = 0; i < rule_count; i++) {
         Rule *rule = &rules[i];
@@ -981,36 +693,90 @@ int execute_rules(Rule *rules, int rule_count, ContextType current_context,
             continue;
         }
         
-        log_info("执行规则: %s;%s;%s;%s;%s",
-               rule->context == CTX_INIT ? "init" : 
-               rule->context == CTX_BUILD ? "build" : "all",
-               rule->operation == OP_REPLACE ? "replace" :
-               rule->operation == OP_INSERT_AFTER ? "insert-after" :
-               rule->operation == OP_INSERT_BEFORE ? "insert-before" :
-               rule->operation == OP_APPEND ? "append" :
-               rule->operation == OP_DELETE ? "delete" :
-               rule->operation == OP_EXEC ? "exec" :
-               rule->operation == OP_COPY ? "copy" : "unknown",
-               rule->target_file,
-               rule->param1 ? rule->param1 : "",
-               rule->param2 ? rule->param2 : "");
+        char *target_file = replace_variables(env, rule->target_file);
+        char *param1 = replace_variables(env, rule->param1);
+        char *param2 = replace_variables(env, rule->param2);
+        RuleTask *task = target_file ? new_rule_task(rule, i + 1, target_file, param1, param2) : NULL;
+        free(target_file);
+        free(param1);
+        free(param2);
+        
+        if (task == NULL) {
+            log_error("错误: 无法替换目标文件变量");
+            log_error("规则执行失败");
+            run.fail_count++;
+            continue;
+        }
+        
+        if (is_text_edit_operation(rule->operation)) {
+            if (path_has_glob(task->target_file)) {
+                add_glob_tasks(&run, task);
+                free_rule_task(task);
+            } else if (track_task(&run, task) != 0) {
+                log_error("错误: 内存不足");
+                free_rule_task(task);
+                run.fail_count++;
+            } else if (add_to_file_group(&run, task) == NULL) {
+                log_error("错误: 内存不足");
+                run.fail_count++;
+            }
+            continue;
+        }
+        
+        flush_file_groups(&run);
+        if (track_task(&run, task) != 0) {
+            log_error("错误: 内存不足");
+            free_rule_task(task);
+            run.fail_count++;
+            continue;
+        }
         
-        if (execute_rule(rule, src_dir, res_dir, author, build_time, variables, var_count) == 0) {
+        log_info("执行规则 #%d: %s;%s;%s;%s", task->index,
+               operation_to_string(rule->operation),
+               task->target_file,
+               task->param1 ? task->param1 : "",
+               task->param2 ? task->param2 : "");
+        
+        uint64_t task_start = profile_now_ns();
+        int task_result = execute_command_task(task);
+        task->profile.wall_ns += profile_now_ns() - task_start;
+        if (task_result == 0) {
             log_info("规则执行成功");
-            success_count++;
+            run.success_count++;
         } else {
             log_error("规则执行失败");
-            fail_count++;
+            run.fail_count++;
         }
     }
     
+    flush_file_groups(&run);
+    
+    uint64_t total_ns = profile_now_ns() - run_start;
+    if (options->profile) {
+        profile_report(run.tasks, run.task_count, run.files, run.file_count, total_ns);
+    }
+    if (options->profile_json) {
+        profile_write_json(options->profile_json, run.tasks, run.task_count,
+                           run.files, run.file_count, total_ns);
+    }
+    
+    for (int i = 0; i < run.task_count; i++) {
+        free_rule_task(run.tasks[i]);
+    }
+    for (int i = 0; i < run.file_count; i++) {
+        free(run.files[i].path);
+    }
+    free(run.files);
+    free(run.tasks);
+    free(run.groups);
+    free(run.group_index);
     free(build_time);
     
-    if (fail_count == 0) {
-        log_info("所有规则执行成功 (%d 个)", success_count);
+    if (run.fail_count == 0) {
+        log_info("所有规则执行成功 (%d 个)", run.success_count);
         return 0;
     } else {
-        log_error("规则执行完成，成功 %d 个，失败 %d 个", success_count, fail_count);
+        log_error("规则执行完成，成功 %d 个，失败 %d 个", run.success_count, run.fail_count);
         return 1;
     }
-}
\ No newline at end of file
+}
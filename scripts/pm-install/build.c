@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <limits.h>
+
+#include "pm-install.h"
+#include "../utils/utils.h"
+#include "../utils/sha256.h"
+
+// 查找编译产物时使用的上下文（nftw 回调无法传参）
+static struct {
+    const PackageMeta **metas;
+    int meta_count;
+    time_t since;
+    int found;
+    long long total_size;
+} artifact_scan;
+
+// 判断文件名是否属于本次编译的软件包: <包名>_<版本>_<架构>.ipk
+static bool artifact_belongs(const char *filename) {
+    for (int i = 0; i < artifact_scan.meta_count; i++) {
+        const PackageMeta *meta = artifact_scan.metas[i];
+        for (int j = 0; j < meta->provide_count; j++) {
+            size_t len = strlen(meta->provides[j]);
+            if (strncmp(filename, meta->provides[j], len) == 0 &&
+                (filename[len] == '_' || filename[len] == '-')) {
+                // 连字符只在紧跟版本号时接受（apk 格式: name-1.0-r1.apk）
+                if (filename[len] == '-' && !(filename[len + 1] >= '0' && filename[len + 1] <= '9')) {
+                    continue;
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void log_artifact(const char *path, const struct stat *st) {
+    log_success("编译产物: %s (%.1f KB)", path, st->st_size / 1024.0);
+    artifact_scan.found++;
+    artifact_scan.total_size += st->st_size;
+}
+
+static int report_artifact(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)ftw;
+    if (type != FTW_F || st->st_mtime < artifact_scan.since) return 0;
+
+    const char *filename = strrchr(path, '/');
+    filename = filename ? filename + 1 : path;
+
+    size_t len = strlen(filename);
+    bool is_package = (len > 4 && strcmp(filename + len - 4, ".ipk") == 0) ||
+                      (len > 4 && strcmp(filename + len - 4, ".apk") == 0);
+    if (!is_package || !artifact_belongs(filename)) return 0;
+
+    log_artifact(path, st);
+    return 0;
+}
+
+// 命中缓存的软件包保留缓存时的修改时间，按缓存条目中记录的安装包报告
+static void report_cached_artifacts(const char *src_dir, const PackageMeta *meta, const char *key) {
+    char **packages = NULL;
+    int count = 0;
+    if (package_cache_packages(meta, key, &packages, &count) != 0) return;
+
+    for (int i = 0; i < count; i++) {
+        char *path = NULL;
+        struct stat st;
+        if (asprintf(&path, "%s/%s", src_dir, packages[i]) >= 0 && stat(path, &st) == 0) {
+            log_artifact(path, &st);
+        }
+        free(path);
+    }
+    free_string_list(packages, count);
+}
+
+// 在 packages.list 解析出的目录中查找包含指定软件包的安装单元
+static char* find_install_unit(char *const *units, int unit_count, const char *dir) {
+    for (int i = 0; i < unit_count; i++) {
+        size_t len = strlen(units[i]);
+        if (strncmp(dir, units[i], len) == 0 && (dir[len] == '\0' || dir[len] == '/')) {
+            return units[i];
+        }
+    }
+    return NULL;
+}
+
+static int run_package_target(const char *model, const char *package, const char *action, int jobs,
+                              bool verbose) {
+    char cmd[PATH_MAX * 2];
+    snprintf(cmd, sizeof(cmd), "make -C \"srcs/%s\" package/%s/%s -j%d%s",
+             model, package, action, jobs, verbose ? " V=s" : "");
+    log_info("执行命令: %s", cmd);
+    fflush(stdout);
+    return system(cmd);
+}
+
+// 同步单个软件包到源码目录并只编译该软件包
+int build_single_package(const char *model, const char *author, const char *name,
+                         int jobs, bool use_cache, bool verbose) {
+    time_t start_time = time(NULL);
+
+    char src_dir[PATH_MAX];
+    snprintf(src_dir, sizeof(src_dir), "srcs/%s", model);
+    if (!dir_exists(src_dir)) {
+        log_error("源码目录不存在: %s", src_dir);
+        return 1;
+    }
+
+    char **units = NULL;
+    int unit_count = 0;
+    PackageIndex index;
+    if (load_install_list(model, author, true, &index, &units, &unit_count) != 0) {
+        return 1;
+    }
+
+    // 参数既可以是 packages.list 中的条目，也可以是软件包名称
+    char *unit = NULL;
+    const PackageMeta **targets = malloc((index.count + 1) * sizeof(PackageMeta*));
+    int target_count = 0;
+    int result = 0;
+    if (targets == NULL) {
+        log_error("内存不足");
+        result = 1;
+    }
+
+    for (int i = 0; i < unit_count && unit == NULL && result == 0; i++) {
+        char unit_copy[PATH_MAX];
+        snprintf(unit_copy, sizeof(unit_copy), "%s", units[i]);
+        if (strcmp(units[i], name) == 0 || strcmp(basename(unit_copy), name) == 0) {
+            unit = units[i];
+        }
+    }
+
+    if (result == 0 && unit != NULL) {
+        for (int i = 0; i < index.count; i++) {
+            char *unit_list[1] = { unit };
+            if (find_install_unit(unit_list, 1, index.items[i].dir) != NULL) {
+                targets[target_count++] = &index.items[i];
+            }
+        }
+    } else if (result == 0) {
+        const PackageMeta *meta = find_package_by_name(&index, name);
+        if (meta != NULL) {
+            unit = find_install_unit(units, unit_count, meta->dir);
+            if (unit == NULL) unit = meta->dir;
+            targets[target_count++] = meta;
+        }
+    }
+
+    CacheKeyContext keys;
+    if (use_cache && cache_key_context_init(&keys, model, &index) != 0) {
+        use_cache = false;
+    }
+
+    if (result == 0 && unit == NULL) {
+        log_error("未找到软件包: %s (既不在 packages.list 中，也不在 packages/ 中)", name);
+        result = 1;
+    } else if (result == 0 && target_count == 0) {
+        log_error("目录 packages/%s 中没有可编译的软件包 Makefile", unit);
+        result = 1;
+    }
+
+    if (result == 0) {
+        char unit_src[PATH_MAX];
+        char unit_dst[PATH_MAX];
+        char unit_copy[PATH_MAX];
+        snprintf(unit_copy, sizeof(unit_copy), "%s", unit);
+        if (snprintf(unit_src, sizeof(unit_src), "%s/%s", PACKAGES_DIR, unit) >= (int)sizeof(unit_src) ||
+            snprintf(unit_dst, sizeof(unit_dst), "%s/package/%s/%s",
+                     src_dir, author, basename(unit_copy)) >= (int)sizeof(unit_dst)) {
+            log_error("软件包路径过长: %s", unit);
+            result = 1;
+        } else {
+            log_info("同步软件包: %s -> %s", unit_src, unit_dst);
+            if (copy_with_cp(unit_src, unit_dst) != 0) {
+                result = 1;
+            }
+        }
+    }
+
+    // 命中缓存的软件包及其缓存键，其余为本次编译的软件包
+    const PackageMeta **compiled = malloc((target_count + 1) * sizeof(PackageMeta*));
+    char (*hit_keys)[SHA256_HEX_SIZE] = malloc((target_count + 1) * sizeof(*hit_keys));
+    const PackageMeta **hits = malloc((target_count + 1) * sizeof(PackageMeta*));
+    int compiled_count = 0;
+    int hit_count = 0;
+    if (compiled == NULL || hit_keys == NULL || hits == NULL) {
+        log_error("内存不足");
+        result = 1;
+    }
+
+    for (int i = 0; i < target_count && result == 0; i++) {
+        char dir_copy[PATH_MAX];
+        snprintf(dir_copy, sizeof(dir_copy), "%s", targets[i]->dir);
+        const char *package = basename(dir_copy);
+
+        // 源码、配置与工具链都未变化时直接使用缓存的编译输出
+        char key[SHA256_HEX_SIZE];
+        bool have_key = use_cache && package_cache_key(&keys, targets[i], key) == 0;
+        if (have_key && package_cache_restore(model, targets[i], key)) {
+            log_info("跳过编译: %s (%d/%d)", package, i + 1, target_count);
+            memcpy(hit_keys[hit_count], key, SHA256_HEX_SIZE);
+            hits[hit_count++] = targets[i];
+            continue;
+        }
+        compiled[compiled_count++] = targets[i];
+
+        log_info("编译软件包: %s (%d/%d)", package, i + 1, target_count);
+        if (run_package_target(model, package, "clean", jobs, verbose) != 0 ||
+            run_package_target(model, package, "compile", jobs, verbose) != 0) {
+            log_error("编译失败: %s", package);
+            result = 1;
+        } else if (have_key) {
+            package_cache_store(model, targets[i], key);
+        }
+    }
+
+    if (result == 0) {
+        char *bin_dir = NULL;
+        if (asprintf(&bin_dir, "%s/bin", src_dir) < 0) bin_dir = NULL;
+
+        artifact_scan.metas = compiled;
+        artifact_scan.meta_count = compiled_count;
+        artifact_scan.since = start_time;
+        artifact_scan.found = 0;
+        artifact_scan.total_size = 0;
+        if (bin_dir != NULL && compiled_count > 0) nftw(bin_dir, report_artifact, 32, FTW_PHYS);
+        for (int i = 0; i < hit_count; i++) {
+            report_cached_artifacts(src_dir, hits[i], hit_keys[i]);
+        }
+
+        int duration = (int)(time(NULL) - start_time);
+        if (artifact_scan.found > 0) {
+            log_success("软件包 %s 编译完成: %d 个产物, %.1f KB, 耗时 %d 秒",
+                        name, artifact_scan.found, artifact_scan.total_size / 1024.0, duration);
+        } else {
+            log_warning("软件包 %s 编译完成，但未在 %s 中找到新的产物 (耗时 %d 秒)",
+                        name, bin_dir ? bin_dir : "bin", duration);
+        }
+        free(bin_dir);
+    }
+
+    if (use_cache) cache_key_context_free(&keys);
+    free(compiled);
+    free(hit_keys);
+    free(hits);
+    free(targets);
+    free_package_index(&index);
+    free_string_list(units, unit_count);
+    return result;
+}
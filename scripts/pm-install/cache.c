@@ -0,0 +1,1008 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <libgen.h>
+#include <limits.h>
+
+#include "pm-install.h"
+#include "../utils/utils.h"
+#include "../utils/sha256.h"
+
+// 影响所有软件包编译结果的 .config 选项（目标平台与工具链）
+static const char *toolchain_options[] = {
+    "CONFIG_TARGET_BOARD=",
+    "CONFIG_TARGET_SUBTARGET=",
+    "CONFIG_TARGET_ARCH_PACKAGES=",
+    "CONFIG_TARGET_OPTIMIZATION=",
+    "CONFIG_GCC_VERSION=",
+    "CONFIG_LIBC=",
+    "CONFIG_USE_MIPS16=",
+    NULL
+};
+
+// 影响软件包构建方式的 OpenWrt 构建系统文件
+static const char *buildsystem_files[] = {
+    "rules.mk",
+    "include/package.mk",
+    "include/package-ipkg.mk",
+    "include/package-pack.mk",
+    "feeds/luci/luci.mk",
+    NULL
+};
+
+typedef struct {
+    char **items;
+    int count;
+    int capacity;
+} PathList;
+
+static void path_list_add(PathList *list, const char *path) {
+    if (list->count >= list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 64;
+        char **items = realloc(list->items, new_capacity * sizeof(char*));
+        if (items == NULL) return;
+        list->items = items;
+        list->capacity = new_capacity;
+    }
+    list->items[list->count++] = strdup(path);
+}
+
+static void path_list_free(PathList *list) {
+    free_string_list(list->items, list->count);
+    memset(list, 0, sizeof(*list));
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// 递归收集目录下的文件（相对路径），跳过 .git 等隐藏目录
+static void collect_tree(const char *root, const char *rel, PathList *list) {
+    char full[PATH_MAX];
+    if (rel[0] == '\0') {
+        snprintf(full, sizeof(full), "%s", root);
+    } else {
+        snprintf(full, sizeof(full), "%s/%s", root, rel);
+    }
+
+    DIR *dir = opendir(full);
+    if (dir == NULL) return;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+        if (strcmp(ent->d_name, ".git") == 0 || strcmp(ent->d_name, ".svn") == 0) continue;
+
+        char child_rel[PATH_MAX];
+        char child_full[PATH_MAX];
+        int len = rel[0] == '\0' ? snprintf(child_rel, sizeof(child_rel), "%s", ent->d_name)
+                                 : snprintf(child_rel, sizeof(child_rel), "%s/%s", rel, ent->d_name);
+        // 超过 PATH_MAX 的路径无法访问，跳过
+        if (len >= (int)sizeof(child_rel) ||
+            snprintf(child_full, sizeof(child_full), "%s/%s", root, child_rel) >= (int)sizeof(child_full)) {
+            continue;
+        }
+
+        struct stat st;
+        if (lstat(child_full, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            collect_tree(root, child_rel, list);
+        } else if (S_ISREG(st.st_mode) || S_ISLNK(st.st_mode)) {
+            path_list_add(list, child_rel);
+        }
+    }
+    closedir(dir);
+}
+
+// 把文件内容（或符号链接目标）加入哈希
+static void hash_file_into(Sha256Ctx *ctx, const char *path) {
+    struct stat st;
+    if (lstat(path, &st) != 0) return;
+
+    if (S_ISLNK(st.st_mode)) {
+        char target[PATH_MAX];
+        ssize_t len = readlink(path, target, sizeof(target) - 1);
+        if (len > 0) sha256_update(ctx, target, (size_t)len);
+        return;
+    }
+
+    char hex[SHA256_HEX_SIZE];
+    if (sha256_file_hex(path, hex) == 0) {
+        sha256_update(ctx, hex, SHA256_HEX_SIZE - 1);
+    }
+}
+
+// 将软件包名称转换为 Kconfig 符号形式: luci-app-foo -> LUCI_APP_FOO
+static void to_config_symbol(const char *name, char *out, size_t size) {
+    size_t i = 0;
+    for (; name[i] && i + 1 < size; i++) {
+        out[i] = name[i] == '-' ? '_' : (char)toupper((unsigned char)name[i]);
+    }
+    out[i] = '\0';
+}
+
+// 判断 .config 中的一行是否与软件包相关
+static bool config_line_matches(const char *line, const PackageMeta *meta) {
+    for (int i = 0; toolchain_options[i]; i++) {
+        if (strncmp(line, toolchain_options[i], strlen(toolchain_options[i])) == 0) return true;
+    }
+
+    for (int i = 0; i < meta->provide_count; i++) {
+        char pattern[512];
+        char symbol[256];
+
+        snprintf(pattern, sizeof(pattern), "CONFIG_PACKAGE_%s", meta->provides[i]);
+        const char *hit = strstr(line, pattern);
+        if (hit != NULL) {
+            char next = hit[strlen(pattern)];
+            if (next == '=' || next == '_' || next == ' ') return true;
+        }
+
+        to_config_symbol(meta->provides[i], symbol, sizeof(symbol));
+        snprintf(pattern, sizeof(pattern), "CONFIG_%s_", symbol);
+        if (strstr(line, pattern) != NULL) return true;
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// feeds 中软件包的版本
+// ---------------------------------------------------------------------------
+
+static int compare_feed_versions(const void *a, const void *b) {
+    return strcmp(((const FeedVersion*)a)->name, ((const FeedVersion*)b)->name);
+}
+
+// 读取 "Package: xxx" / "Version: xxx" 格式的索引
+static int load_feed_index(const char *path, CacheKeyContext *ctx) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return -1;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    char *name = NULL;
+    int capacity = ctx->feed_version_count;
+    int result = 0;
+    while (result == 0 && getline(&line, &line_cap, file) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "Package: ", 9) == 0) {
+            free(name);
+            name = strdup(trim_whitespace(line + 9));
+            if (name == NULL) result = -1;
+        } else if (strncmp(line, "Version: ", 9) == 0 && name != NULL) {
+            if (ctx->feed_version_count >= capacity) {
+                capacity = capacity ? capacity * 2 : 256;
+                FeedVersion *items = realloc(ctx->feed_versions, capacity * sizeof(FeedVersion));
+                if (items == NULL) {
+                    result = -1;
+                    break;
+                }
+                ctx->feed_versions = items;
+            }
+            char *version = strdup(trim_whitespace(line + 9));
+            if (version == NULL) {
+                result = -1;
+                break;
+            }
+            ctx->feed_versions[ctx->feed_version_count].name = name;
+            ctx->feed_versions[ctx->feed_version_count].version = version;
+            ctx->feed_version_count++;
+            name = NULL;
+        }
+    }
+
+    free(name);
+    free(line);
+    fclose(file);
+    return result;
+}
+
+static void load_feed_versions(CacheKeyContext *ctx) {
+    ctx->feeds_loaded = true;
+
+    char pattern[PATH_MAX];
+    snprintf(pattern, sizeof(pattern), "srcs/%s/feeds/*.index", ctx->model);
+    glob_t glob_result;
+    if (glob(pattern, 0, NULL, &glob_result) == 0) {
+        for (size_t i = 0; i < glob_result.gl_pathc; i++) {
+            load_feed_index(glob_result.gl_pathv[i], ctx);
+        }
+        globfree(&glob_result);
+    }
+
+    char packageinfo[PATH_MAX];
+    snprintf(packageinfo, sizeof(packageinfo), "srcs/%s/tmp/.packageinfo", ctx->model);
+    load_feed_index(packageinfo, ctx);
+
+    qsort(ctx->feed_versions, ctx->feed_version_count, sizeof(FeedVersion), compare_feed_versions);
+}
+
+static const char* find_feed_version(CacheKeyContext *ctx, const char *name) {
+    if (!ctx->feeds_loaded) load_feed_versions(ctx);
+    FeedVersion key = {.name = (char*)name};
+    const FeedVersion *found = bsearch(&key, ctx->feed_versions, ctx->feed_version_count,
+                                       sizeof(FeedVersion), compare_feed_versions);
+    return found != NULL ? found->version : NULL;
+}
+
+// ---------------------------------------------------------------------------
+// 内核标识
+// ---------------------------------------------------------------------------
+
+// 提供 kmod-* 或 Makefile 中调用 KernelPackage 的软件包编译内核模块
+static bool is_kernel_package(const PackageMeta *meta) {
+    for (int i = 0; i < meta->provide_count; i++) {
+        if (strncmp(meta->provides[i], "kmod-", 5) == 0) return true;
+    }
+
+    char makefile[PATH_MAX];
+    if (snprintf(makefile, sizeof(makefile), "%s/%s/Makefile", PACKAGES_DIR, meta->dir) >= (int)sizeof(makefile)) {
+        return false;
+    }
+    FILE *file = fopen(makefile, "r");
+    if (file == NULL) return false;
+
+    bool found = false;
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (!found && getline(&line, &line_cap, file) != -1) {
+        found = strstr(line, "KernelPackage") != NULL;
+    }
+    free(line);
+    fclose(file);
+    return found;
+}
+
+static void hash_glob_into(Sha256Ctx *ctx, const char *base, const char *pattern) {
+    char full[PATH_MAX];
+    if (snprintf(full, sizeof(full), "%s/%s", base, pattern) >= (int)sizeof(full)) return;
+
+    glob_t glob_result;
+    if (glob(full, 0, NULL, &glob_result) != 0) return;
+    for (size_t i = 0; i < glob_result.gl_pathc; i++) {
+        const char *rel = glob_result.gl_pathv[i] + strlen(base) + 1;
+        sha256_update(ctx, rel, strlen(rel) + 1);
+        hash_file_into(ctx, glob_result.gl_pathv[i]);
+    }
+    globfree(&glob_result);
+}
+
+// 从 .config 的一行中取出带引号的值: CONFIG_TARGET_BOARD="ramips"
+static void config_value(const char *line, const char *option, char *out, size_t size) {
+    size_t len = strlen(option);
+    if (strncmp(line, option, len) != 0 || line[len] != '=') return;
+    const char *value = line + len + 1;
+    if (*value == '"') value++;
+    snprintf(out, size, "%s", value);
+    out[strcspn(out, "\"\r\n")] = '\0';
+}
+
+// 内核版本与决定 vermagic 的输入：LINUX_VERSION 所在的 include/kernel-*、目标平台 Makefile
+// 中的 KERNEL_PATCHVER、各级内核配置以及 .config 中的内核选项。
+// vermagic 本身在编译内核后才生成，这里只使用编译前就存在的文件
+static int compute_kernel_identity(CacheKeyContext *ctx) {
+    char base[PATH_MAX];
+    char config_path[PATH_MAX];
+    if (snprintf(base, sizeof(base), "srcs/%s", ctx->model) >= (int)sizeof(base) ||
+        snprintf(config_path, sizeof(config_path), "srcs/%s/.config", ctx->model) >= (int)sizeof(config_path)) {
+        return -1;
+    }
+    FILE *config = fopen(config_path, "r");
+    if (config == NULL) return -1;
+
+    Sha256Ctx sha;
+    sha256_init(&sha);
+    char board[128] = "";
+    char subtarget[128] = "";
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, config) != -1) {
+        config_value(line, "CONFIG_TARGET_BOARD", board, sizeof(board));
+        config_value(line, "CONFIG_TARGET_SUBTARGET", subtarget, sizeof(subtarget));
+        if (strncmp(line, "CONFIG_KERNEL_", 14) == 0 || strncmp(line, "CONFIG_LINUX_", 13) == 0) {
+            sha256_update(&sha, line, strlen(line));
+        }
+    }
+    free(line);
+    fclose(config);
+
+    char pattern[PATH_MAX];
+    hash_glob_into(&sha, base, "include/kernel-version.mk");
+    hash_glob_into(&sha, base, "include/kernel-[0-9]*");
+    hash_glob_into(&sha, base, "target/linux/generic/config-*");
+    if (board[0] != '\0') {
+        snprintf(pattern, sizeof(pattern), "target/linux/%s/Makefile", board);
+        hash_glob_into(&sha, base, pattern);
+        snprintf(pattern, sizeof(pattern), "target/linux/%s/config-*", board);
+        hash_glob_into(&sha, base, pattern);
+        if (subtarget[0] != '\0') {
+            snprintf(pattern, sizeof(pattern), "target/linux/%s/%s/config-*", board, subtarget);
+            hash_glob_into(&sha, base, pattern);
+        }
+    }
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_final(&sha, digest);
+    sha256_to_hex(digest, ctx->kernel);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// 缓存键
+// ---------------------------------------------------------------------------
+
+int cache_key_context_init(CacheKeyContext *ctx, const char *model, const PackageIndex *index) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->model = model;
+    ctx->index = index;
+    ctx->keys = malloc((index->count + 1) * sizeof(*ctx->keys));
+    ctx->states = calloc(index->count + 1, 1);
+    if (ctx->keys == NULL || ctx->states == NULL) {
+        cache_key_context_free(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+void cache_key_context_free(CacheKeyContext *ctx) {
+    for (int i = 0; i < ctx->feed_version_count; i++) {
+        free(ctx->feed_versions[i].name);
+        free(ctx->feed_versions[i].version);
+    }
+    free(ctx->feed_versions);
+    free(ctx->keys);
+    free(ctx->states);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+// 依赖的标识：packages/ 中的依赖取其缓存键（递归），feeds 中的依赖取其版本
+static void hash_depends_into(CacheKeyContext *ctx, Sha256Ctx *sha, const PackageMeta *meta) {
+    sha256_update(sha, "depends\n", 8);
+    for (int i = 0; i < meta->depend_count; i++) {
+        const char *dep = meta->depends[i];
+        sha256_update(sha, dep, strlen(dep) + 1);
+
+        const PackageMeta *provider = find_package_by_name(ctx->index, dep);
+        char dep_key[SHA256_HEX_SIZE];
+        if (provider != NULL && provider != meta) {
+            if (package_cache_key(ctx, provider, dep_key) == 0) {
+                sha256_update(sha, dep_key, SHA256_HEX_SIZE - 1);
+            } else if (ctx->states[provider - ctx->index->items] == 1) {
+                log_warning("%s 与 %s 循环依赖，缓存键不包含 %s 的键", meta->dir, provider->dir, provider->dir);
+            }
+        } else if (provider == NULL) {
+            const char *version = find_feed_version(ctx, dep);
+            if (version != NULL) sha256_update(sha, version, strlen(version) + 1);
+        }
+    }
+}
+
+// 计算缓存键: 源码树哈希 + .config 相关选项（含工具链/目标平台）+ 构建系统文件
+// + 依赖的缓存键或版本 + 内核模块的内核标识。
+// 只使用编译前就存在的输入，保证 --cache-restore 与 --cache-store 得到相同的键
+static int compute_key(CacheKeyContext *ctx, const PackageMeta *meta, char key[SHA256_HEX_SIZE]) {
+    const char *model = ctx->model;
+    Sha256Ctx sha;
+    sha256_init(&sha);
+
+    // 1. 软件包源码树
+    // 路径被截断时无法保证键覆盖全部输入，按未命中处理
+    char pkg_root[PATH_MAX];
+    if (snprintf(pkg_root, sizeof(pkg_root), "%s/%s", PACKAGES_DIR, meta->dir) >= (int)sizeof(pkg_root)) {
+        log_warning("路径过长，跳过二进制缓存: %s", meta->dir);
+        return -1;
+    }
+
+    PathList files = {0};
+    collect_tree(pkg_root, "", &files);
+    if (files.count == 0) {
+        path_list_free(&files);
+        return -1;
+    }
+    qsort(files.items, files.count, sizeof(char*), compare_paths);
+
+    sha256_update(&sha, "src\n", 4);
+    for (int i = 0; i < files.count; i++) {
+        char full[PATH_MAX];
+        sha256_update(&sha, files.items[i], strlen(files.items[i]) + 1);
+        if (snprintf(full, sizeof(full), "%s/%s", pkg_root, files.items[i]) >= (int)sizeof(full)) {
+            log_warning("路径过长，跳过二进制缓存: %s/%s", pkg_root, files.items[i]);
+            path_list_free(&files);
+            return -1;
+        }
+        hash_file_into(&sha, full);
+    }
+    path_list_free(&files);
+
+    // 2. .config 中与软件包及目标平台相关的选项
+    char config_path[PATH_MAX];
+    if (snprintf(config_path, sizeof(config_path), "srcs/%s/.config", model) >= (int)sizeof(config_path)) {
+        return -1;
+    }
+    FILE *config = fopen(config_path, "r");
+    if (config == NULL) {
+        log_warning("无法读取 %s，跳过二进制缓存", config_path);
+        return -1;
+    }
+
+    sha256_update(&sha, "config\n", 7);
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, config) != -1) {
+        if (config_line_matches(line, meta)) {
+            sha256_update(&sha, line, strlen(line));
+        }
+    }
+    free(line);
+    fclose(config);
+
+    // 3. 构建系统文件；工具链与目标平台由上面的 .config 选项确定，
+    // 不依赖 staging_dir，重新克隆或 dirclean 后恢复时计算出的键与保存时一致
+    sha256_update(&sha, "buildsystem\n", 12);
+    for (int i = 0; buildsystem_files[i]; i++) {
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "srcs/%s/%s", model, buildsystem_files[i]) >= (int)sizeof(path)) {
+            return -1;
+        }
+        sha256_update(&sha, buildsystem_files[i], strlen(buildsystem_files[i]) + 1);
+        hash_file_into(&sha, path);
+    }
+
+    // 4. 依赖：链接的库或头文件变化后需要重新编译
+    hash_depends_into(ctx, &sha, meta);
+
+    // 5. 内核模块只能加载到 vermagic 相同的内核
+    if (is_kernel_package(meta)) {
+        if (ctx->kernel[0] == '\0' && compute_kernel_identity(ctx) != 0) return -1;
+        sha256_update(&sha, "kernel\n", 7);
+        sha256_update(&sha, ctx->kernel, SHA256_HEX_SIZE - 1);
+    }
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_final(&sha, digest);
+    sha256_to_hex(digest, key);
+    return 0;
+}
+
+int package_cache_key(CacheKeyContext *ctx, const PackageMeta *meta, char key[SHA256_HEX_SIZE]) {
+    int item = (int)(meta - ctx->index->items);
+    switch (ctx->states[item]) {
+        case 2:
+            memcpy(key, ctx->keys[item], SHA256_HEX_SIZE);
+            return 0;
+        case 1:     // 循环依赖，由外层的键覆盖
+        case 3:
+            return -1;
+    }
+
+    ctx->states[item] = 1;
+    int result = compute_key(ctx, meta, ctx->keys[item]);
+    ctx->states[item] = result == 0 ? 2 : 3;
+    if (result == 0) memcpy(key, ctx->keys[item], SHA256_HEX_SIZE);
+    return result;
+}
+
+// 判断编译产物文件名是否属于该软件包
+static bool output_belongs(const char *filename, const PackageMeta *meta) {
+    for (int i = 0; i < meta->provide_count; i++) {
+        size_t len = strlen(meta->provides[i]);
+        if (strncmp(filename, meta->provides[i], len) == 0 && filename[len] == '_') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 递归收集 bin/ 下属于该软件包且不早于 since 的安装包
+static void collect_packages(const char *base, const char *rel, const PackageMeta *meta,
+                             time_t since, PathList *list) {
+    char full[PATH_MAX];
+    snprintf(full, sizeof(full), "%s/%s", base, rel);
+
+    DIR *dir = opendir(full);
+    if (dir == NULL) return;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+
+        char child_rel[PATH_MAX];
+        char child_full[PATH_MAX];
+        if (snprintf(child_rel, sizeof(child_rel), "%s/%s", rel, ent->d_name) >= (int)sizeof(child_rel) ||
+            snprintf(child_full, sizeof(child_full), "%s/%s", base, child_rel) >= (int)sizeof(child_full)) {
+            continue;
+        }
+
+        struct stat st;
+        if (stat(child_full, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            collect_packages(base, child_rel, meta, since, list);
+            continue;
+        }
+
+        size_t len = strlen(ent->d_name);
+        bool is_package = len > 4 && (strcmp(ent->d_name + len - 4, ".ipk") == 0 ||
+                                      strcmp(ent->d_name + len - 4, ".apk") == 0);
+        if (is_package && st.st_mtime >= since && output_belongs(ent->d_name, meta)) {
+            path_list_add(list, child_rel);
+        }
+    }
+    closedir(dir);
+}
+
+// 安装到 staging_dir 的文件列表，每行一个相对于 staging_dir/target-* 的路径（./ 或 / 开头），
+// 只收集文件和符号链接，目录由 tar 解压时自动创建
+static void collect_staged_files(const char *base, const char *list_file, PathList *list) {
+    char root[PATH_MAX];
+    if (snprintf(root, sizeof(root), "%s", list_file) >= (int)sizeof(root)) return;
+    for (int i = 0; i < 2; i++) {
+        char *slash = strrchr(root, '/');
+        if (slash == NULL) return;
+        *slash = '\0';
+    }
+
+    FILE *fp = fopen(list_file, "r");
+    if (fp == NULL) return;
+
+    char line[PATH_MAX];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        const char *name = line;
+        if (strncmp(name, "./", 2) == 0) name += 2;
+        while (*name == '/') name++;
+        if (*name == '\0' || strcmp(name, "..") == 0 || strncmp(name, "../", 3) == 0 ||
+            strstr(name, "/../") != NULL) {
+            continue;
+        }
+
+        char full[PATH_MAX];
+        struct stat st;
+        if (snprintf(full, sizeof(full), "%s/%s", root, name) >= (int)sizeof(full) ||
+            lstat(full, &st) != 0 || S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        path_list_add(list, full + strlen(base) + 1);
+    }
+    fclose(fp);
+}
+
+// 软件包 Makefile 中的 PKG_VERSION，未定义时为空串；值中含变量引用时返回 false
+static bool package_version(const PackageMeta *meta, char *out, size_t size) {
+    char makefile[PATH_MAX];
+    out[0] = '\0';
+    if (snprintf(makefile, sizeof(makefile), "%s/%s/Makefile", PACKAGES_DIR, meta->dir) >= (int)sizeof(makefile)) {
+        return false;
+    }
+    FILE *file = fopen(makefile, "r");
+    if (file == NULL) return false;
+
+    bool literal = true;
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, file) != -1) {
+        char *s = trim_whitespace(line);
+        if (strncmp(s, "PKG_VERSION", 11) != 0) continue;
+        char *p = s + 11;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == ':' || *p == '?') p++;
+        if (*p != '=') continue;
+        p = trim_whitespace(p + 1);
+        literal = strchr(p, '$') == NULL && snprintf(out, size, "%s", p) < (int)size;
+    }
+    free(line);
+    fclose(file);
+    if (!literal) out[0] = '\0';
+    return literal;
+}
+
+// build_dir 中的目录名 <包名>-<后缀> 是否属于该软件包：版本号以数字开头，
+// 以字母开头的后缀是另一个同前缀的软件包（如 qmodem-next-*）
+static bool is_version_suffix(const char *build_dir, const char *name) {
+    const char *dir_name = strrchr(build_dir, '/');
+    dir_name = dir_name != NULL ? dir_name + 1 : build_dir;
+    size_t len = strlen(name);
+    return strncmp(dir_name, name, len) == 0 && dir_name[len] == '-' &&
+           isdigit((unsigned char)dir_name[len + 1]);
+}
+
+// 收集软件包的编译输出: 构建目录中的状态标记、staging 信息与 bin/ 中的安装包
+// 返回最近一次编译完成的时间，没有找到编译标记时返回 0
+static time_t collect_package_outputs(const char *model, const PackageMeta *meta, PathList *list) {
+    char base[PATH_MAX];
+    char pattern[PATH_MAX];
+    char dir_copy[PATH_MAX];
+    time_t built_time = 0;
+    glob_t glob_result;
+
+    snprintf(base, sizeof(base), "srcs/%s", model);
+    snprintf(dir_copy, sizeof(dir_copy), "%s", meta->dir);
+    const char *dir_name = basename(dir_copy);
+
+    // build_dir/target-*/<包名>[-PKG_VERSION]/ 中的 .prepared/.configured/.built 标记和 .pkgdir；
+    // PKG_VERSION 无法直接读出时匹配 <包名>-*，但跳过名称同前缀的其他软件包的构建目录
+    char version[256];
+    char version_suffix[sizeof(version) + 1] = "-*";
+    bool exact_version = package_version(meta, version, sizeof(version));
+    if (exact_version) {
+        if (version[0] != '\0') {
+            snprintf(version_suffix, sizeof(version_suffix), "-%s", version);
+        } else {
+            version_suffix[0] = '\0';
+        }
+    }
+    for (int i = 0; i < meta->provide_count; i++) {
+        const char *suffixes[] = { "", version_suffix };
+        for (int s = 0; s < 2; s++) {
+            if ((s == 1 && suffixes[s][0] == '\0') ||
+                snprintf(pattern, sizeof(pattern), "%s/build_dir/target-*/%s%s/.built",
+                         base, meta->provides[i], suffixes[s]) >= (int)sizeof(pattern) ||
+                glob(pattern, 0, NULL, &glob_result) != 0) {
+                continue;
+            }
+
+            for (size_t j = 0; j < glob_result.gl_pathc; j++) {
+                char build_dir[PATH_MAX];
+                snprintf(build_dir, sizeof(build_dir), "%s", glob_result.gl_pathv[j]);
+                *strrchr(build_dir, '/') = '\0';
+                if (s == 1 && !exact_version && !is_version_suffix(build_dir, meta->provides[i])) continue;
+
+                struct stat st;
+                if (stat(glob_result.gl_pathv[j], &st) == 0 && st.st_mtime > built_time) {
+                    built_time = st.st_mtime;
+                }
+
+                PathList stamps = {0};
+                collect_tree(build_dir, "", &stamps);
+                const char *rel_build = build_dir + strlen(base) + 1;
+                for (int k = 0; k < stamps.count; k++) {
+                    const char *name = stamps.items[k];
+                    if (strncmp(name, ".built", 6) == 0 || strncmp(name, ".prepared", 9) == 0 ||
+                        strncmp(name, ".configured", 11) == 0 || strncmp(name, ".pkgdir/", 8) == 0) {
+                        char rel[PATH_MAX];
+                        snprintf(rel, sizeof(rel), "%s/%s", rel_build, name);
+                        path_list_add(list, rel);
+                    }
+                }
+                path_list_free(&stamps);
+            }
+            globfree(&glob_result);
+        }
+    }
+
+    if (built_time == 0) return 0;
+
+    // staging_dir/target-*/pkginfo/<目录名>.*、packages/<目录名>.list 与 stamp/.<目录名>_installed；
+    // _installed 标记表示文件已安装到 staging_dir，列表中记录的头文件和库必须一起缓存，
+    // 否则清理过 staging_dir 后依赖它的软件包会在缺少这些文件的情况下编译
+    const char *staging_patterns[] = {
+        "%s/staging_dir/target-*/pkginfo/%s.*",
+        "%s/staging_dir/target-*/packages/%s.list",
+        "%s/staging_dir/target-*/stamp/.%s_installed",
+        NULL
+    };
+    for (int i = 0; staging_patterns[i]; i++) {
+        if (snprintf(pattern, sizeof(pattern), staging_patterns[i], base, dir_name) >= (int)sizeof(pattern) ||
+            glob(pattern, 0, NULL, &glob_result) != 0) {
+            continue;
+        }
+        for (size_t j = 0; j < glob_result.gl_pathc; j++) {
+            const char *path = glob_result.gl_pathv[j];
+            size_t len = strlen(path);
+            path_list_add(list, path + strlen(base) + 1);
+            if (len > 5 && strcmp(path + len - 5, ".list") == 0) {
+                collect_staged_files(base, path, list);
+            }
+        }
+        globfree(&glob_result);
+    }
+
+    // bin/ 中本次编译生成的安装包
+    collect_packages(base, "bin", meta, built_time - 1, list);
+    return built_time;
+}
+
+// 目录名以键结尾，被截断时不同的键可能落到同一目录，返回 -1 按未命中处理
+static int get_cache_entry_dir(const PackageMeta *meta, const char *key, char *out, size_t size) {
+    char dir_copy[PATH_MAX];
+    if (snprintf(dir_copy, sizeof(dir_copy), "%s", meta->dir) >= (int)sizeof(dir_copy)) return -1;
+    int len = snprintf(out, size, "%s/%s-%.16s", PKG_CACHE_DIR, basename(dir_copy), key);
+    return len < 0 || (size_t)len >= size ? -1 : 0;
+}
+
+// 读取缓存条目中的 outputs.list（相对于 srcs/<model> 的路径）
+static int read_output_list(const char *entry_dir, PathList *list) {
+    char list_path[PATH_MAX];
+    if (snprintf(list_path, sizeof(list_path), "%s/outputs.list", entry_dir) >= (int)sizeof(list_path)) return -1;
+
+    FILE *fp = fopen(list_path, "r");
+    if (fp == NULL) return -1;
+
+    char line[PATH_MAX];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0') path_list_add(list, line);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static bool is_built_stamp(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return strcmp(slash ? slash + 1 : path, ".built") == 0;
+}
+
+// 构建目录中记录 .built 对应缓存键的文件
+static int key_stamp_path(const char *model, const char *built, char *out, size_t size) {
+    int len = snprintf(out, size, "srcs/%s/%s", model, built);
+    if (len < 0 || (size_t)len >= size) return -1;
+
+    char *slash = strrchr(out, '/');
+    if ((size_t)(slash - out) + sizeof("/.pkgcache_key") > size) return -1;
+    strcpy(slash, "/.pkgcache_key");
+    return 0;
+}
+
+// 判断该键的 .built 是否都已就位（之前恢复或编译过相同的输入）
+static bool outputs_in_place(const char *model, const PathList *list, const char *key) {
+    bool found = false;
+    for (int i = 0; i < list->count; i++) {
+        if (!is_built_stamp(list->items[i])) continue;
+
+        char path[PATH_MAX];
+        char recorded[SHA256_HEX_SIZE] = "";
+        if (snprintf(path, sizeof(path), "srcs/%s/%s", model, list->items[i]) >= (int)sizeof(path) ||
+            !file_exists(path) || key_stamp_path(model, list->items[i], path, sizeof(path)) != 0) {
+            return false;
+        }
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) return false;
+        bool match = fgets(recorded, sizeof(recorded), fp) != NULL && strcmp(recorded, key) == 0;
+        fclose(fp);
+        if (!match) return false;
+        found = true;
+    }
+    return found;
+}
+
+// 在每个 .built 旁记录缓存键，下次恢复时据此跳过
+static void write_key_stamps(const char *model, const PathList *list, const char *key) {
+    for (int i = 0; i < list->count; i++) {
+        char path[PATH_MAX];
+        if (!is_built_stamp(list->items[i]) || key_stamp_path(model, list->items[i], path, sizeof(path)) != 0) {
+            continue;
+        }
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) continue;
+        fputs(key, fp);
+        fclose(fp);
+    }
+}
+
+// 编译输出在依赖链中的次序: 普通文件 < .prepared < .configured < .built < .pkgdir
+// < staging 的 _installed 标记 < bin/ 中的安装包
+static int output_rank(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    size_t len = strlen(name);
+
+    if (strncmp(path, "bin/", 4) == 0) return 6;
+    if (strstr(path, "/stamp/.") != NULL && len > 10 && strcmp(name + len - 10, "_installed") == 0) return 5;
+    if (strstr(path, "/.pkgdir/") != NULL) return 4;
+    if (strcmp(name, ".built") == 0) return 3;
+    if (strncmp(name, ".configured", 11) == 0) return 2;
+    if (strncmp(name, ".prepared", 9) == 0) return 1;
+    return 0;
+}
+
+// 按依赖次序设置解压出的文件时间: 每一级比前一级晚 1 秒，且都不晚于当前时间，
+// 避免 tar 解压顺序导致 .built 比 .configured 旧而让 make 重新编译
+static void touch_outputs(const char *model, const PathList *list) {
+    time_t now = time(NULL);
+    for (int i = 0; i < list->count; i++) {
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "srcs/%s/%s", model, list->items[i]) >= (int)sizeof(path)) continue;
+
+        struct timespec times[2];
+        times[0].tv_sec = times[1].tv_sec = now - 6 + output_rank(list->items[i]);
+        times[0].tv_nsec = times[1].tv_nsec = 0;
+        if (utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW) != 0) {
+            log_warning("无法更新时间戳: %s", path);
+        }
+    }
+}
+
+// 命中缓存时解压编译输出到源码目录，返回 1 表示命中，0 表示未命中
+int package_cache_restore(const char *model, const PackageMeta *meta, const char *key) {
+    char entry_dir[PATH_MAX];
+    char archive[PATH_MAX];
+    if (get_cache_entry_dir(meta, key, entry_dir, sizeof(entry_dir)) != 0 ||
+        snprintf(archive, sizeof(archive), "%s/outputs.tar.gz", entry_dir) >= (int)sizeof(archive)) {
+        return 0;
+    }
+
+    if (!file_exists(archive)) return 0;
+
+    PathList outputs = {0};
+    if (read_output_list(entry_dir, &outputs) != 0 || outputs.count == 0) {
+        log_warning("缓存文件列表缺失: %s", entry_dir);
+        path_list_free(&outputs);
+        return 0;
+    }
+
+    if (outputs_in_place(model, &outputs, key)) {
+        log_info("编译输出已就位，跳过解压: %s (%.16s)", meta->dir, key);
+        path_list_free(&outputs);
+        return 1;
+    }
+
+    char cmd[PATH_MAX * 3];
+    snprintf(cmd, sizeof(cmd), "tar -xzf \"%s\" -C \"srcs/%s\"", archive, model);
+    if (system(cmd) != 0) {
+        log_warning("解压二进制缓存失败: %s", archive);
+        path_list_free(&outputs);
+        return 0;
+    }
+
+    touch_outputs(model, &outputs);
+    write_key_stamps(model, &outputs, key);
+    path_list_free(&outputs);
+
+    log_success("二进制缓存命中: %s (%.16s)", meta->dir, key);
+    return 1;
+}
+
+int package_cache_packages(const PackageMeta *meta, const char *key, char ***packages, int *count) {
+    char entry_dir[PATH_MAX];
+    *packages = NULL;
+    *count = 0;
+    if (get_cache_entry_dir(meta, key, entry_dir, sizeof(entry_dir)) != 0) return -1;
+    PathList outputs = {0};
+    if (read_output_list(entry_dir, &outputs) != 0) return -1;
+
+    for (int i = 0; i < outputs.count; i++) {
+        if (strncmp(outputs.items[i], "bin/", 4) != 0) continue;
+        char **items = realloc(*packages, (*count + 1) * sizeof(char*));
+        if (items == NULL) break;
+        *packages = items;
+        (*packages)[(*count)++] = outputs.items[i];
+        outputs.items[i] = NULL;
+    }
+    path_list_free(&outputs);
+    return 0;
+}
+
+// 保存软件包编译输出到缓存
+int package_cache_store(const char *model, const PackageMeta *meta, const char *key) {
+    char entry_dir[PATH_MAX];
+    char archive[PATH_MAX];
+    if (get_cache_entry_dir(meta, key, entry_dir, sizeof(entry_dir)) != 0 ||
+        snprintf(archive, sizeof(archive), "%s/outputs.tar.gz", entry_dir) >= (int)sizeof(archive)) {
+        return -1;
+    }
+
+    PathList outputs = {0};
+    if (file_exists(archive)) {
+        // 已有相同键的缓存，只记录当前编译输出对应的键
+        if (read_output_list(entry_dir, &outputs) == 0) write_key_stamps(model, &outputs, key);
+        path_list_free(&outputs);
+        return 0;
+    }
+
+    if (collect_package_outputs(model, meta, &outputs) == 0 || outputs.count == 0) {
+        log_warning("未找到 %s 的编译输出，不写入二进制缓存", meta->dir);
+        path_list_free(&outputs);
+        return -1;
+    }
+    qsort(outputs.items, outputs.count, sizeof(char*), compare_paths);
+
+    if (ensure_directory_exists(entry_dir) != 0) {
+        path_list_free(&outputs);
+        return -1;
+    }
+
+    char list_path[PATH_MAX];
+    FILE *list = NULL;
+    if (snprintf(list_path, sizeof(list_path), "%s/outputs.list", entry_dir) < (int)sizeof(list_path)) {
+        list = fopen(list_path, "w");
+    }
+    if (list == NULL) {
+        log_error("无法写入缓存文件列表: %s", list_path);
+        path_list_free(&outputs);
+        return -1;
+    }
+    for (int i = 0; i < outputs.count; i++) {
+        fprintf(list, "%s\n", outputs.items[i]);
+    }
+    fclose(list);
+
+    char abs_list[PATH_MAX];
+    char abs_archive[PATH_MAX];
+    if (realpath(list_path, abs_list) == NULL || realpath(entry_dir, abs_archive) == NULL) {
+        path_list_free(&outputs);
+        return -1;
+    }
+    strncat(abs_archive, "/outputs.tar.gz.tmp", sizeof(abs_archive) - strlen(abs_archive) - 1);
+
+    char cmd[PATH_MAX * 3];
+    snprintf(cmd, sizeof(cmd), "tar -czf \"%s\" -C \"srcs/%s\" -T \"%s\"", abs_archive, model, abs_list);
+    int result = system(cmd);
+    if (result == 0) {
+        char final_archive[PATH_MAX];
+        snprintf(final_archive, sizeof(final_archive), "%s", abs_archive);
+        final_archive[strlen(final_archive) - 4] = '\0';
+        result = rename(abs_archive, final_archive);
+    }
+
+    if (result != 0) {
+        log_error("写入二进制缓存失败: %s", archive);
+        remove(abs_archive);
+        path_list_free(&outputs);
+        return -1;
+    }
+
+    write_key_stamps(model, &outputs, key);
+    log_info("已缓存 %s 的 %d 个编译输出 (%.16s)", meta->dir, outputs.count, key);
+    path_list_free(&outputs);
+    return 0;
+}
+
+// 对 packages.list 解析出的所有软件包执行缓存恢复或保存
+int process_package_caches(const char *model, const char *author, bool store) {
+    char **units = NULL;
+    int unit_count = 0;
+    PackageIndex index;
+    if (load_install_list(model, author, true, &index, &units, &unit_count) != 0) {
+        return 1;
+    }
+
+    CacheKeyContext keys;
+    if (cache_key_context_init(&keys, model, &index) != 0) {
+        free_package_index(&index);
+        free_string_list(units, unit_count);
+        return 1;
+    }
+
+    int hits = 0;
+    int stored = 0;
+    int total = 0;
+
+    for (int i = 0; i < index.count; i++) {
+        const PackageMeta *meta = &index.items[i];
+        bool selected = false;
+        for (int j = 0; j < unit_count && !selected; j++) {
+            size_t len = strlen(units[j]);
+            selected = strncmp(meta->dir, units[j], len) == 0 &&
+                       (meta->dir[len] == '\0' || meta->dir[len] == '/');
+        }
+        if (!selected) continue;
+
+        char key[SHA256_HEX_SIZE];
+        if (package_cache_key(&keys, meta, key) != 0) continue;
+        total++;
+
+        if (store) {
+            if (package_cache_store(model, meta, key) == 0) stored++;
+        } else {
+            hits += package_cache_restore(model, meta, key);
+        }
+    }
+
+    if (store) {
+        log_info("二进制缓存: 检查 %d 个软件包，写入/已存在 %d 个", total, stored);
+    } else {
+        log_info("二进制缓存: 检查 %d 个软件包，命中 %d 个", total, hits);
+    }
+
+    cache_key_context_free(&keys);
+    free_package_index(&index);
+    free_string_list(units, unit_count);
+    return 0;
+}
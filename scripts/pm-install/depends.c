@@ -0,0 +1,743 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <glob.h>
+#include <errno.h>
+#include <libgen.h>
+#include <limits.h>
+
+#include "pm-install.h"
+#include "../utils/utils.h"
+#include "../utils/sha256.h"
+
+#define MAX_SCAN_DEPTH 6
+
+// Makefile 解析缓存条目
+typedef struct {
+    char *path;
+    long long mtime_ns;
+    long long size;
+    char hash[SHA256_HEX_SIZE];
+    bool is_package;
+    char *provides;      // 空格分隔
+    char *depends;       // 空格分隔
+} CacheEntry;
+
+typedef struct {
+    CacheEntry *items;
+    int count;
+    int capacity;
+    bool dirty;
+} DependsCache;
+
+// 简单的字符串哈希集合，用于源码 feeds 中的软件包名称
+typedef struct {
+    char **slots;
+    size_t capacity;
+    size_t count;
+} NameSet;
+
+static uint64_t hash_string(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void name_set_add(NameSet *set, const char *name) {
+    if (set->count * 2 >= set->capacity) {
+        size_t new_capacity = set->capacity ? set->capacity * 2 : 1024;
+        char **new_slots = calloc(new_capacity, sizeof(char*));
+        if (new_slots == NULL) return;
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (set->slots[i] == NULL) continue;
+            size_t pos = hash_string(set->slots[i]) & (new_capacity - 1);
+            while (new_slots[pos] != NULL) pos = (pos + 1) & (new_capacity - 1);
+            new_slots[pos] = set->slots[i];
+        }
+        free(set->slots);
+        set->slots = new_slots;
+        set->capacity = new_capacity;
+    }
+
+    size_t pos = hash_string(name) & (set->capacity - 1);
+    while (set->slots[pos] != NULL) {
+        if (strcmp(set->slots[pos], name) == 0) return;
+        pos = (pos + 1) & (set->capacity - 1);
+    }
+    set->slots[pos] = strdup(name);
+    set->count++;
+}
+
+static bool name_set_contains(const NameSet *set, const char *name) {
+    if (set->capacity == 0) return false;
+    size_t pos = hash_string(name) & (set->capacity - 1);
+    while (set->slots[pos] != NULL) {
+        if (strcmp(set->slots[pos], name) == 0) return true;
+        pos = (pos + 1) & (set->capacity - 1);
+    }
+    return false;
+}
+
+static void name_set_free(NameSet *set) {
+    for (size_t i = 0; i < set->capacity; i++) {
+        free(set->slots[i]);
+    }
+    free(set->slots);
+    memset(set, 0, sizeof(*set));
+}
+
+// 向字符串列表追加元素（去重）
+static void string_list_add(char ***list, int *count, const char *value) {
+    for (int i = 0; i < *count; i++) {
+        if (strcmp((*list)[i], value) == 0) return;
+    }
+    char **new_list = realloc(*list, (*count + 1) * sizeof(char*));
+    if (new_list == NULL) return;
+    *list = new_list;
+    (*list)[(*count)++] = strdup(value);
+}
+
+void free_string_list(char **list, int count) {
+    for (int i = 0; i < count; i++) {
+        free(list[i]);
+    }
+    free(list);
+}
+
+// 将空格分隔的字符串拆分到列表中
+static void split_words(const char *words, char ***list, int *count) {
+    if (words == NULL) return;
+    char *copy = strdup(words);
+    char *saveptr;
+    for (char *tok = strtok_r(copy, " \t", &saveptr); tok; tok = strtok_r(NULL, " \t", &saveptr)) {
+        string_list_add(list, count, tok);
+    }
+    free(copy);
+}
+
+// 将列表拼接为空格分隔的字符串
+static char* join_words(char **list, int count) {
+    size_t len = 1;
+    for (int i = 0; i < count; i++) len += strlen(list[i]) + 1;
+    char *result = malloc(len);
+    result[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        if (i > 0) strcat(result, " ");
+        strcat(result, list[i]);
+    }
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Makefile 解析
+// ---------------------------------------------------------------------------
+
+// 规范化依赖项: 去掉 +、条件前缀和 /host 后缀，无法静态解析的返回 false
+static bool normalize_depend(const char *token, char *out, size_t out_size) {
+    const char *p = token;
+    while (*p == '+') p++;
+
+    if (*p == '\0' || *p == '@' || *p == '!') return false;
+    if (strpbrk(p, "$()|&=<>") != NULL) return false;
+
+    // +PACKAGE_foo:bar 形式的条件依赖
+    const char *colon = strrchr(p, ':');
+    if (colon != NULL) p = colon + 1;
+    if (*p == '\0') return false;
+
+    size_t len = strcspn(p, "/");
+    if (len == 0 || len >= out_size) return false;
+
+    memcpy(out, p, len);
+    out[len] = '\0';
+    return true;
+}
+
+// 匹配 "<name> :=|=|+=|?= <value>" 形式的变量赋值，返回值部分
+static const char* match_assignment(const char *line, const char *name) {
+    size_t name_len = strlen(name);
+    if (strncmp(line, name, name_len) != 0) return NULL;
+
+    const char *p = line + name_len;
+    while (*p == ' ' || *p == '\t') p++;
+
+    if (p[0] == ':' && p[1] == '=') return p + 2;
+    if ((p[0] == '+' || p[0] == '?') && p[1] == '=') return p + 2;
+    if (p[0] == '=') return p + 1;
+    return NULL;
+}
+
+// 解析 Makefile，提取软件包名称与依赖
+static int parse_package_makefile(const char *makefile, const char *dir,
+                                  bool *is_package, char ***provides, int *provide_count,
+                                  char ***depends, int *depend_count) {
+    FILE *file = fopen(makefile, "r");
+    if (file == NULL) return -1;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    char *logical = NULL;
+    size_t logical_len = 0;
+    char pkg_name[256] = "";
+    bool is_luci = false;
+    char **raw_depends = NULL;
+    int raw_count = 0;
+    char **defines = NULL;
+    int define_count = 0;
+
+    *is_package = false;
+
+    ssize_t n;
+    while ((n = getline(&line, &line_cap, file)) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        size_t len = strlen(line);
+
+        // 拼接以反斜杠结尾的续行
+        bool continued = len > 0 && line[len - 1] == '\\';
+        if (continued) line[--len] = ' ';
+
+        char *new_logical = realloc(logical, logical_len + len + 2);
+        if (new_logical == NULL) break;
+        logical = new_logical;
+        memcpy(logical + logical_len, line, len);
+        logical_len += len;
+        logical[logical_len] = '\0';
+        if (continued) continue;
+
+        char *s = trim_whitespace(logical);
+        const char *value;
+
+        if (strstr(s, "BuildPackage") != NULL || strstr(s, "KernelPackage") != NULL) {
+            *is_package = true;
+        }
+        if (strncmp(s, "include", 7) == 0 && strstr(s, "luci.mk") != NULL) {
+            *is_package = true;
+            is_luci = true;
+        }
+
+        if ((value = match_assignment(s, "PKG_NAME")) != NULL) {
+            char *v = trim_whitespace((char*)value);
+            snprintf(pkg_name, sizeof(pkg_name), "%s", v);
+        } else if (strncmp(s, "define Package/", 15) == 0) {
+            char name[256];
+            snprintf(name, sizeof(name), "%s", s + 15);
+            name[strcspn(name, "/ \t")] = '\0';
+            string_list_add(&defines, &define_count, name);
+        } else if ((value = match_assignment(s, "DEPENDS")) != NULL ||
+                   (value = match_assignment(s, "LUCI_DEPENDS")) != NULL ||
+                   (value = match_assignment(s, "PKG_BUILD_DEPENDS")) != NULL) {
+            split_words(value, &raw_depends, &raw_count);
+        }
+
+        logical_len = 0;
+    }
+
+    free(line);
+    free(logical);
+    fclose(file);
+
+    if (*is_package) {
+        // 目录名总是作为别名（LuCI 软件包以目录名为包名）
+        char dir_copy[PATH_MAX];
+        snprintf(dir_copy, sizeof(dir_copy), "%s", dir);
+        string_list_add(provides, provide_count, basename(dir_copy));
+
+        if (!is_luci && pkg_name[0] != '\0' && strchr(pkg_name, '$') == NULL) {
+            string_list_add(provides, provide_count, pkg_name);
+        }
+
+        for (int i = 0; i < define_count; i++) {
+            char name[512];
+            if (strncmp(defines[i], "$(PKG_NAME)", 11) == 0 && pkg_name[0] != '\0') {
+                snprintf(name, sizeof(name), "%s%s", pkg_name, defines[i] + 11);
+            } else {
+                snprintf(name, sizeof(name), "%s", defines[i]);
+            }
+            if (name[0] != '\0' && strchr(name, '$') == NULL) {
+                string_list_add(provides, provide_count, name);
+            }
+        }
+
+        for (int i = 0; i < raw_count; i++) {
+            char dep[256];
+            if (normalize_depend(raw_depends[i], dep, sizeof(dep))) {
+                string_list_add(depends, depend_count, dep);
+            }
+        }
+    }
+
+    free_string_list(defines, define_count);
+    free_string_list(raw_depends, raw_count);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// 解析结果缓存（按 Makefile 内容哈希）
+// ---------------------------------------------------------------------------
+
+static int compare_cache_entry(const void *a, const void *b) {
+    return strcmp(((const CacheEntry*)a)->path, ((const CacheEntry*)b)->path);
+}
+
+static void load_depends_cache(DependsCache *cache) {
+    memset(cache, 0, sizeof(*cache));
+
+    FILE *file = fopen(DEPENDS_CACHE_FILE, "r");
+    if (file == NULL) return;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, file) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+
+        char *fields[7] = {0};
+        char *p = line;
+        int field_count = 0;
+        while (field_count < 7) {
+            fields[field_count++] = p;
+            char *tab = strchr(p, '\t');
+            if (tab == NULL) break;
+            *tab = '\0';
+            p = tab + 1;
+        }
+        if (field_count != 7 || strlen(fields[3]) != SHA256_HEX_SIZE - 1) continue;
+
+        if (cache->count >= cache->capacity) {
+            int new_capacity = cache->capacity ? cache->capacity * 2 : 256;
+            CacheEntry *items = realloc(cache->items, new_capacity * sizeof(CacheEntry));
+            if (items == NULL) break;
+            cache->items = items;
+            cache->capacity = new_capacity;
+        }
+
+        CacheEntry *entry = &cache->items[cache->count++];
+        entry->path = strdup(fields[0]);
+        entry->mtime_ns = atoll(fields[1]);
+        entry->size = atoll(fields[2]);
+        memcpy(entry->hash, fields[3], SHA256_HEX_SIZE);
+        entry->is_package = fields[4][0] == '1';
+        entry->provides = strdup(fields[5]);
+        entry->depends = strdup(fields[6]);
+    }
+
+    free(line);
+    fclose(file);
+    qsort(cache->items, cache->count, sizeof(CacheEntry), compare_cache_entry);
+}
+
+static CacheEntry* find_cache_entry(DependsCache *cache, const char *path) {
+    CacheEntry key = { .path = (char*)path };
+    return bsearch(&key, cache->items, cache->count, sizeof(CacheEntry), compare_cache_entry);
+}
+
+static void save_depends_cache(DependsCache *cache, CacheEntry *fresh, int fresh_count) {
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", DEPENDS_CACHE_FILE);
+
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        log_warning("无法写入依赖缓存: %s", tmp_path);
+        return;
+    }
+
+    for (int i = 0; i < fresh_count; i++) {
+        CacheEntry *e = &fresh[i];
+        fprintf(file, "%s\t%lld\t%lld\t%s\t%d\t%s\t%s\n", e->path, e->mtime_ns, e->size,
+                e->hash, e->is_package ? 1 : 0, e->provides, e->depends);
+    }
+    fclose(file);
+
+    if (rename(tmp_path, DEPENDS_CACHE_FILE) != 0) {
+        log_warning("无法更新依赖缓存: %s", DEPENDS_CACHE_FILE);
+        remove(tmp_path);
+    }
+    cache->dirty = false;
+}
+
+static void free_depends_cache(CacheEntry *items, int count) {
+    for (int i = 0; i < count; i++) {
+        free(items[i].path);
+        free(items[i].provides);
+        free(items[i].depends);
+    }
+    free(items);
+}
+
+// ---------------------------------------------------------------------------
+// packages/ 目录索引
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    PackageIndex *index;
+    DependsCache *old_cache;
+    CacheEntry *fresh;
+    int fresh_count;
+    int fresh_capacity;
+} ScanState;
+
+static void add_fresh_entry(ScanState *state, const CacheEntry *entry) {
+    if (state->fresh_count >= state->fresh_capacity) {
+        int new_capacity = state->fresh_capacity ? state->fresh_capacity * 2 : 256;
+        CacheEntry *items = realloc(state->fresh, new_capacity * sizeof(CacheEntry));
+        if (items == NULL) return;
+        state->fresh = items;
+        state->fresh_capacity = new_capacity;
+    }
+    state->fresh[state->fresh_count++] = *entry;
+}
+
+static void add_index_item(PackageIndex *index, const char *dir, const CacheEntry *entry) {
+    if (index->count >= index->capacity) {
+        int new_capacity = index->capacity ? index->capacity * 2 : 128;
+        PackageMeta *items = realloc(index->items, new_capacity * sizeof(PackageMeta));
+        if (items == NULL) return;
+        index->items = items;
+        index->capacity = new_capacity;
+    }
+
+    PackageMeta *meta = &index->items[index->count++];
+    memset(meta, 0, sizeof(*meta));
+    meta->dir = strdup(dir);
+    split_words(entry->provides, &meta->provides, &meta->provide_count);
+    split_words(entry->depends, &meta->depends, &meta->depend_count);
+}
+
+// 获取 Makefile 的元数据：stat 未变直接复用，内容哈希未变也复用，否则重新解析
+static bool load_makefile_meta(ScanState *state, const char *makefile, const char *dir,
+                               const struct stat *st, CacheEntry *out) {
+    long long mtime_ns = (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+    CacheEntry *cached = find_cache_entry(state->old_cache, makefile);
+
+    memset(out, 0, sizeof(*out));
+    out->path = strdup(makefile);
+    out->mtime_ns = mtime_ns;
+    out->size = (long long)st->st_size;
+
+    if (cached && cached->mtime_ns == mtime_ns && cached->size == out->size) {
+        memcpy(out->hash, cached->hash, SHA256_HEX_SIZE);
+    } else if (sha256_file_hex(makefile, out->hash) != 0) {
+        free(out->path);
+        return false;
+    }
+
+    if (cached && strcmp(cached->hash, out->hash) == 0) {
+        out->is_package = cached->is_package;
+        out->provides = strdup(cached->provides);
+        out->depends = strdup(cached->depends);
+        state->index->cached_count++;
+        return true;
+    }
+
+    char **provides = NULL, **depends = NULL;
+    int provide_count = 0, depend_count = 0;
+    bool is_package = false;
+    if (parse_package_makefile(makefile, dir, &is_package, &provides, &provide_count,
+                               &depends, &depend_count) != 0) {
+        free(out->path);
+        return false;
+    }
+
+    out->is_package = is_package;
+    out->provides = join_words(provides, provide_count);
+    out->depends = join_words(depends, depend_count);
+    free_string_list(provides, provide_count);
+    free_string_list(depends, depend_count);
+    state->index->parsed_count++;
+    state->old_cache->dirty = true;
+    return true;
+}
+
+static void scan_package_dir(ScanState *state, const char *rel_dir, int depth) {
+    char full_dir[PATH_MAX];
+    if (rel_dir[0] == '\0') {
+        snprintf(full_dir, sizeof(full_dir), "%s", PACKAGES_DIR);
+    } else {
+        snprintf(full_dir, sizeof(full_dir), "%s/%s", PACKAGES_DIR, rel_dir);
+    }
+
+    // 目录中存在软件包 Makefile 时不再向下递归（避免扫描 src/ 等源码目录）
+    if (rel_dir[0] != '\0') {
+        char makefile[PATH_MAX];
+        struct stat st;
+        if (snprintf(makefile, sizeof(makefile), "%s/Makefile", full_dir) < (int)sizeof(makefile) &&
+            stat(makefile, &st) == 0 && S_ISREG(st.st_mode)) {
+            CacheEntry entry;
+            if (load_makefile_meta(state, makefile, rel_dir, &st, &entry)) {
+                add_fresh_entry(state, &entry);
+                if (entry.is_package) {
+                    add_index_item(state->index, rel_dir, &entry);
+                    return;
+                }
+            }
+        }
+    }
+
+    if (depth >= MAX_SCAN_DEPTH) return;
+
+    DIR *dir = opendir(full_dir);
+    if (dir == NULL) return;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        if (ent->d_type != DT_DIR && ent->d_type != DT_UNKNOWN && ent->d_type != DT_LNK) continue;
+
+        // 超过 PATH_MAX 的路径无法访问，跳过
+        char child[PATH_MAX];
+        int len = rel_dir[0] == '\0' ? snprintf(child, sizeof(child), "%s", ent->d_name)
+                                     : snprintf(child, sizeof(child), "%s/%s", rel_dir, ent->d_name);
+        if (len >= (int)sizeof(child)) continue;
+
+        if (ent->d_type != DT_DIR) {
+            char child_full[PATH_MAX];
+            if (snprintf(child_full, sizeof(child_full), "%s/%s", PACKAGES_DIR, child) >= (int)sizeof(child_full) ||
+                !dir_exists(child_full)) {
+                continue;
+            }
+        }
+
+        scan_package_dir(state, child, depth + 1);
+    }
+    closedir(dir);
+}
+
+// 按排序后的顺序登记每个软件包名称，同名时保留最先登记（路径靠前）的目录
+static void build_provider_table(PackageIndex *index) {
+    size_t names = 0;
+    for (int i = 0; i < index->count; i++) names += (size_t)index->items[i].provide_count;
+
+    size_t capacity = 64;
+    while (capacity < names * 2) capacity *= 2;
+    index->providers = calloc(capacity, sizeof(ProviderSlot));
+    if (index->providers == NULL) return;
+    index->provider_capacity = capacity;
+
+    for (int i = 0; i < index->count; i++) {
+        const PackageMeta *meta = &index->items[i];
+        for (int j = 0; j < meta->provide_count; j++) {
+            size_t pos = hash_string(meta->provides[j]) & (capacity - 1);
+            while (index->providers[pos].name != NULL &&
+                   strcmp(index->providers[pos].name, meta->provides[j]) != 0) {
+                pos = (pos + 1) & (capacity - 1);
+            }
+            if (index->providers[pos].name == NULL) {
+                index->providers[pos].name = meta->provides[j];
+                index->providers[pos].item = i;
+            }
+        }
+    }
+}
+
+static int compare_meta(const void *a, const void *b) {
+    return strcmp(((const PackageMeta*)a)->dir, ((const PackageMeta*)b)->dir);
+}
+
+// 扫描 packages/ 建立索引，Makefile 解析结果按内容哈希缓存
+int build_package_index(PackageIndex *index) {
+    memset(index, 0, sizeof(*index));
+
+    if (!dir_exists(PACKAGES_DIR)) {
+        log_error("软件包目录不存在: %s", PACKAGES_DIR);
+        return -1;
+    }
+
+    DependsCache cache;
+    load_depends_cache(&cache);
+
+    ScanState state = { .index = index, .old_cache = &cache };
+    scan_package_dir(&state, "", 0);
+
+    // 按目录排序，保证同名软件包优先选择路径靠前的目录
+    qsort(index->items, index->count, sizeof(PackageMeta), compare_meta);
+    build_provider_table(index);
+
+    if (cache.dirty || cache.count != state.fresh_count) {
+        save_depends_cache(&cache, state.fresh, state.fresh_count);
+    }
+
+    free_depends_cache(state.fresh, state.fresh_count);
+    free_depends_cache(cache.items, cache.count);
+
+    log_info("软件包索引: %d 个软件包 (解析 %d 个 Makefile, 缓存命中 %d 个)",
+             index->count, index->parsed_count, index->cached_count);
+    return 0;
+}
+
+void free_package_index(PackageIndex *index) {
+    for (int i = 0; i < index->count; i++) {
+        free(index->items[i].dir);
+        free_string_list(index->items[i].provides, index->items[i].provide_count);
+        free_string_list(index->items[i].depends, index->items[i].depend_count);
+    }
+    free(index->items);
+    free(index->providers);
+    memset(index, 0, sizeof(*index));
+}
+
+const PackageMeta* find_package_by_name(const PackageIndex *index, const char *name) {
+    if (index->provider_capacity == 0) return NULL;
+    size_t pos = hash_string(name) & (index->provider_capacity - 1);
+    while (index->providers[pos].name != NULL) {
+        if (strcmp(index->providers[pos].name, name) == 0) return &index->items[index->providers[pos].item];
+        pos = (pos + 1) & (index->provider_capacity - 1);
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// 源码 feeds 中已有的软件包
+// ---------------------------------------------------------------------------
+
+// 读取 "Package: xxx" 格式的索引，跳过来自 package/<作者>/ 的条目
+static int load_package_names(const char *path, const char *skip_prefix, NameSet *set) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return -1;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    bool skip = false;
+    while (getline(&line, &line_cap, file) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "Source-Makefile: ", 17) == 0) {
+            const char *src = line + 17;
+            if (strncmp(src, "./", 2) == 0) src += 2;
+            skip = skip_prefix && strncmp(src, skip_prefix, strlen(skip_prefix)) == 0;
+        } else if (!skip && strncmp(line, "Package: ", 9) == 0) {
+            name_set_add(set, trim_whitespace(line + 9));
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return 0;
+}
+
+static bool load_feed_names(const char *model, const char *author, NameSet *set) {
+    char pattern[PATH_MAX];
+    char skip_prefix[PATH_MAX];
+    bool found = false;
+
+    snprintf(skip_prefix, sizeof(skip_prefix), "package/%s/", author);
+
+    snprintf(pattern, sizeof(pattern), "srcs/%s/feeds/*.index", model);
+    glob_t glob_result;
+    if (glob(pattern, 0, NULL, &glob_result) == 0) {
+        for (size_t i = 0; i < glob_result.gl_pathc; i++) {
+            if (load_package_names(glob_result.gl_pathv[i], NULL, set) == 0) found = true;
+        }
+        globfree(&glob_result);
+    }
+
+    char packageinfo[PATH_MAX];
+    snprintf(packageinfo, sizeof(packageinfo), "srcs/%s/tmp/.packageinfo", model);
+    if (load_package_names(packageinfo, skip_prefix, set) == 0) found = true;
+
+    return found;
+}
+
+// ---------------------------------------------------------------------------
+// 依赖闭包
+// ---------------------------------------------------------------------------
+
+// 判断目录是否已被闭包中的某个条目覆盖（条目本身或其子目录）
+static bool is_covered(char **closure, int closure_count, const char *dir) {
+    for (int i = 0; i < closure_count; i++) {
+        size_t len = strlen(closure[i]);
+        if (strncmp(dir, closure[i], len) == 0 && (dir[len] == '\0' || dir[len] == '/')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 从 packages.list 的条目出发，解析出需要安装的完整目录集合
+int resolve_package_closure(const char *model, const char *author,
+                            const PackageIndex *index, char **roots, int root_count,
+                            char ***closure, int *closure_count) {
+    *closure = NULL;
+    *closure_count = 0;
+
+    NameSet feed_names = {0};
+    bool have_feeds = load_feed_names(model, author, &feed_names);
+    if (!have_feeds) {
+        log_warning("未找到源码 feeds 索引 (srcs/%s/feeds/*.index)，无法校验外部依赖", model);
+    }
+
+    for (int i = 0; i < root_count; i++) {
+        string_list_add(closure, closure_count, roots[i]);
+    }
+
+    const PackageMeta **queue = malloc((index->count + 1) * sizeof(PackageMeta*));
+    bool *visited = calloc(index->count + 1, sizeof(bool));
+    if (queue == NULL || visited == NULL) {
+        log_error("解析依赖时内存不足");
+        free(queue);
+        free(visited);
+        name_set_free(&feed_names);
+        free_string_list(*closure, *closure_count);
+        *closure = NULL;
+        *closure_count = 0;
+        return -1;
+    }
+    int head = 0, tail = 0;
+
+    for (int i = 0; i < index->count; i++) {
+        if (is_covered(*closure, *closure_count, index->items[i].dir)) {
+            visited[i] = true;
+            queue[tail++] = &index->items[i];
+        }
+    }
+
+    int added = 0;
+    int missing = 0;
+    while (head < tail) {
+        const PackageMeta *meta = queue[head++];
+        for (int i = 0; i < meta->depend_count; i++) {
+            const char *dep = meta->depends[i];
+
+            // packages/ 中的软件包优先，用于覆盖源码 feeds 中的同名包；
+            // 只有 feeds 提供的依赖交给 OpenWrt 处理
+            const PackageMeta *provider = find_package_by_name(index, dep);
+            if (provider == NULL) {
+                if (name_set_contains(&feed_names, dep)) continue;
+                if (have_feeds) {
+                    log_warning("依赖 %s (来自 %s) 既不在 packages/ 中也不在源码 feeds 中",
+                                dep, meta->dir);
+                    missing++;
+                }
+                continue;
+            }
+
+            int idx = (int)(provider - index->items);
+            if (visited[idx]) continue;
+            visited[idx] = true;
+            queue[tail++] = provider;
+
+            if (!is_covered(*closure, *closure_count, provider->dir)) {
+                string_list_add(closure, closure_count, provider->dir);
+                log_info("自动添加依赖: %s (被 %s 依赖)", provider->dir, meta->dir);
+                added++;
+            }
+        }
+    }
+
+    free(queue);
+    free(visited);
+    name_set_free(&feed_names);
+
+    if (added > 0) {
+        log_info("依赖解析完成: 新增 %d 个软件包，共 %d 个", added, *closure_count);
+    }
+    if (missing > 0) {
+        log_warning("有 %d 个依赖无法解析，OpenWrt 编译时可能失败", missing);
+    }
+    return 0;
+}
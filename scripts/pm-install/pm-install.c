@@ -9,11 +9,11 @@
 #include <libgen.h>
 #include <limits.h>
 
+#include "pm-install.h"
 #include "../utils/utils.h"
 #include "../utils/color.h"
 
 #define MAX_LINE_LENGTH 256
-#define MAX_PACKAGES 100
 
 // 打印使用说明
 void print_usage(const char *program_name) {
@@ -23,13 +23,20 @@ void print_usage(const char *program_name) {
     printf("  -l, --list     列出指定型号的所有软件包\n");
     printf("  -c, --clean    清除已安装的软件包\n");
     printf("  -i, --install  安装软件包（默认操作）\n");
+    printf("  -n, --no-deps  不解析软件包 Makefile 中的依赖\n");
+    printf("  -p, --package <名称>  只同步并编译单个软件包 (packages.list 条目或软件包名)\n");
+    printf("  -j, --jobs <数量>     单包编译使用的并行任务数 (默认: CPU 核心数)\n");
+    printf("  -r, --cache-restore   从二进制缓存恢复未变化软件包的编译输出\n");
+    printf("  -s, --cache-store     将已编译软件包的输出保存到二进制缓存\n");
+    printf("      --no-cache        单包编译时不使用二进制缓存\n");
+    printf("  -v, --verbose         单包编译时输出完整的编译日志 (V=s)\n");
     printf("参数:\n");
     printf("  型号:   指定要安装软件包的型号名称 (如: m28c, xr30)\n");
     printf("  作者名: 软件包作者名称，用于定位 packages/作者名/ 目录\n");
 }
 
-// 读取packages.list文件
-int read_package_list(const char *filename, char packages[][PATH_MAX], int *package_count) {
+// 读取packages.list文件，返回的列表由调用者用 free_string_list 释放
+int read_package_list(const char *filename, char ***packages, int *package_count) {
     FILE *file = fopen(filename, "r");
     if (file == NULL) {
         log_error("无法打开文件 %s: %s", filename, strerror(errno));
@@ -37,12 +44,12 @@ int read_package_list(const char *filename, char packages[][PATH_MAX], int *pack
     }
     
     char line[MAX_LINE_LENGTH];
-    *package_count = 0;
-    int line_num = 0;
+    char **list = NULL;
+    int count = 0;
+    int capacity = 0;
+    int result = 0;
     
-    while (fgets(line, sizeof(line), file) != NULL && *package_count < MAX_PACKAGES) {
-        line_num++;
-        
+    while (fgets(line, sizeof(line), file) != NULL) {
         // 跳过注释行和空行
         if (line[0] == '#' || line[0] == '\n') {
             continue;
@@ -52,35 +59,99 @@ int read_package_list(const char *filename, char packages[][PATH_MAX], int *pack
         line[strcspn(line, "\n")] = 0;
         char *trimmed_line = trim_whitespace(line);
         
-        if (strlen(trimmed_line) > 0) {
-            strncpy(packages[*package_count], trimmed_line, PATH_MAX - 1);
-            (*package_count)++;
+        if (strlen(trimmed_line) == 0) {
+            continue;
+        }
+        
+        if (count >= capacity) {
+            int new_capacity = capacity ? capacity * 2 : 16;
+            char **new_list = realloc(list, new_capacity * sizeof(char*));
+            if (new_list == NULL) {
+                result = -1;
+                break;
+            }
+            list = new_list;
+            capacity = new_capacity;
+        }
+        if ((list[count] = strdup(trimmed_line)) == NULL) {
+            result = -1;
+            break;
         }
+        count++;
     }
     
     fclose(file);
+    if (result != 0) {
+        log_error("读取 %s 时内存不足", filename);
+        free_string_list(list, count);
+        return -1;
+    }
+    *packages = list;
+    *package_count = count;
     return 0;
 }
 
-// 列出指定型号的所有软件包
-int list_packages(const char *model, const char *author) {
+// 读取 packages.list 并按需解析依赖闭包，返回需要处理的软件包目录列表
+// index 非空时保留软件包索引供调用者继续使用（由调用者释放）
+int load_install_list(const char *model, const char *author, bool resolve_deps,
+                      PackageIndex *index, char ***packages, int *package_count) {
     char list_path[PATH_MAX];
     snprintf(list_path, sizeof(list_path), "configs/%s/packages.list", model);
     
+    *packages = NULL;
+    *package_count = 0;
+    
     if (!file_exists(list_path)) {
         log_error("型号 %s 的 packages.list 文件不存在: %s", model, list_path);
         return -1;
     }
     
-    char packages[MAX_PACKAGES][PATH_MAX];
+    char **listed = NULL;
+    int listed_count = 0;
+    
+    if (read_package_list(list_path, &listed, &listed_count) != 0) {
+        return -1;
+    }
+    
+    // 调用者未要求索引且无需解析依赖时不扫描 packages/
+    PackageIndex local_index;
+    if (index == NULL && resolve_deps && listed_count > 0) {
+        index = &local_index;
+    }
+    
+    if (index != NULL && build_package_index(index) != 0) {
+        free_string_list(listed, listed_count);
+        return -1;
+    }
+    
+    // 不解析依赖时直接把读取的列表交给调用者
+    if (!resolve_deps || listed_count == 0) {
+        *packages = listed;
+        *package_count = listed_count;
+        return 0;
+    }
+    
+    int result = resolve_package_closure(model, author, index, listed, listed_count,
+                                         packages, package_count);
+    if (index == &local_index) {
+        free_package_index(index);
+    }
+    free_string_list(listed, listed_count);
+    return result;
+}
+
+// 列出指定型号的所有软件包
+int list_packages(const char *model, const char *author, bool resolve_deps) {
+    char **packages = NULL;
     int package_count = 0;
     
-    if (read_package_list(list_path, packages, &package_count) != 0) {
+    if (load_install_list(model, author, resolve_deps, NULL, &packages, &package_count) != 0) {
         return -1;
     }
     
     if (package_count == 0) {
         log_info("型号 %s 没有定义任何软件包", model);
+        free_string_list(packages, package_count);
         return 0;
     }
     
@@ -104,6 +175,7 @@ int list_packages(const char *model, const char *author) {
                path_width, dst_path);
     }
     
+    free_string_list(packages, package_count);
     return 0;
 }
 
@@ -157,24 +229,17 @@ int remove_with_rm(const char *path) {
 }
 
 // 安装指定型号的软件包
-int install_packages(const char *model, const char *author) {
-    char list_path[PATH_MAX];
-    snprintf(list_path, sizeof(list_path), "configs/%s/packages.list", model);
-    
-    if (!file_exists(list_path)) {
-        log_error("型号 %s 的 packages.list 文件不存在: %s", model, list_path);
-        return -1;
-    }
-    
-    char packages[MAX_PACKAGES][PATH_MAX];
+int install_packages(const char *model, const char *author, bool resolve_deps) {
+    char **packages = NULL;
     int package_count = 0;
     
-    if (read_package_list(list_path, packages, &package_count) != 0) {
+    if (load_install_list(model, author, resolve_deps, NULL, &packages, &package_count) != 0) {
         return -1;
     }
     
     if (package_count == 0) {
         log_info("型号 %s 没有定义任何软件包", model);
+        free_string_list(packages, package_count);
         return 0;
     }
     
@@ -207,6 +272,8 @@ int install_packages(const char *model, const char *author) {
         }
     }
     
+    free_string_list(packages, package_count);
+    
     if (fail_count == 0) {
         log_success("所有软件包安装成功 (%d 个)", success_count);
         return 0;
@@ -217,24 +284,17 @@ int install_packages(const char *model, const char *author) {
 }
 
 // 清除已安装的软件包
-int clean_packages(const char *model, const char *author) {
-    char list_path[PATH_MAX];
-    snprintf(list_path, sizeof(list_path), "configs/%s/packages.list", model);
-    
-    if (!file_exists(list_path)) {
-        log_error("型号 %s 的 packages.list 文件不存在: %s", model, list_path);
-        return -1;
-    }
-    
-    char packages[MAX_PACKAGES][PATH_MAX];
+int clean_packages(const char *model, const char *author, bool resolve_deps) {
+    char **packages = NULL;
     int package_count = 0;
     
-    if (read_package_list(list_path, packages, &package_count) != 0) {
+    if (load_install_list(model, author, resolve_deps, NULL, &packages, &package_count) != 0) {
         return -1;
     }
     
     if (package_count == 0) {
         log_info("型号 %s 没有定义任何软件包", model);
+        free_string_list(packages, package_count);
         return 0;
     }
     
@@ -259,6 +319,8 @@ int clean_packages(const char *model, const char *author) {
         }
     }
     
+    free_string_list(packages, package_count);
+    
     // 检查目标目录是否为空，如果为空则删除
     char target_dir[PATH_MAX];
     snprintf(target_dir, sizeof(target_dir), "srcs/%s/package/%s", model, author);
@@ -324,6 +386,13 @@ int main(int argc, char *argv[]) {
     bool list_mode = false;
     bool clean_mode = false;
     bool install_mode = false;
+    bool resolve_deps = true;
+    const char *single_package = NULL;
+    bool cache_restore = false;
+    bool cache_store = false;
+    bool use_cache = true;
+    bool verbose = false;
+    int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
     
     // 解析命令行参数
     for (int i = 1; i < argc; i++) {
@@ -336,6 +405,28 @@ int main(int argc, char *argv[]) {
             clean_mode = true;
         } else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--install") == 0) {
             install_mode = true;
+        } else if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--no-deps") == 0) {
+            resolve_deps = false;
+        } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--package") == 0) {
+            if (i + 1 >= argc) {
+                log_error("%s 需要指定软件包名称", argv[i]);
+                return 1;
+            }
+            single_package = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0) {
+                log_error("%s 需要指定有效的任务数", argv[i]);
+                return 1;
+            }
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--cache-restore") == 0) {
+            cache_restore = true;
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--cache-store") == 0) {
+            cache_store = true;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = false;
+        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
         } else if (argv[i][0] != '-') {
             if (model == NULL) {
                 model = argv[i];
@@ -370,12 +461,21 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    if (single_package != NULL) {
+        return build_single_package(model, author, single_package, jobs > 0 ? jobs : 1,
+                                    use_cache, verbose);
+    }
+    
+    if (cache_restore || cache_store) {
+        return process_package_caches(model, author, cache_store);
+    }
+    
     if (list_mode) {
-        return list_packages(model, author);
+        return list_packages(model, author, resolve_deps);
     } else if (clean_mode) {
-        return clean_packages(model, author);
+        return clean_packages(model, author, resolve_deps);
     } else if (install_mode) {
-        return install_packages(model, author);
+        return install_packages(model, author, resolve_deps);
     }
     
     return 0;
@@ -0,0 +1,85 @@
+#ifndef PM_INSTALL_H
+#define PM_INSTALL_H
+
+#include <stdbool.h>
+#include "../utils/sha256.h"
+
+#define PACKAGES_DIR "packages"
+#define DEPENDS_CACHE_FILE "packages/.pm-depends.cache"
+#define PKG_CACHE_DIR ".pkgcache"
+
+// 单个软件包 Makefile 解析出的元数据
+typedef struct {
+    char *dir;           // 相对 packages/ 的软件包目录
+    char **provides;     // 该目录提供的软件包名称
+    int provide_count;
+    char **depends;      // DEPENDS / LUCI_DEPENDS / PKG_BUILD_DEPENDS 中的依赖
+    int depend_count;
+} PackageMeta;
+
+// 软件包名称哈希表的一项（开放寻址），name 指向 PackageMeta.provides 中的字符串
+typedef struct {
+    const char *name;
+    int item;            // 提供该名称的软件包在 PackageIndex.items 中的下标
+} ProviderSlot;
+
+// packages/ 目录下所有软件包的索引
+typedef struct {
+    PackageMeta *items;
+    int count;
+    int capacity;
+    ProviderSlot *providers;     // 软件包名称 -> 目录，索引建立后一次生成
+    size_t provider_capacity;
+    int parsed_count;    // 本次实际重新解析的 Makefile 数
+    int cached_count;    // 命中缓存的 Makefile 数
+} PackageIndex;
+
+// feeds 索引中的软件包版本
+typedef struct {
+    char *name;
+    char *version;
+} FeedVersion;
+
+// 计算二进制缓存键的上下文：依赖的键按 PackageIndex.items 下标缓存，
+// feeds 中软件包的版本与内核标识只读取一次
+typedef struct {
+    const char *model;
+    const PackageIndex *index;
+    char (*keys)[SHA256_HEX_SIZE];
+    unsigned char *states;      // 0 未计算，1 计算中，2 已计算，3 无法计算
+    FeedVersion *feed_versions; // 按名称排序
+    int feed_version_count;
+    bool feeds_loaded;
+    char kernel[SHA256_HEX_SIZE];   // 空串表示尚未计算
+} CacheKeyContext;
+
+// 函数声明
+// depends.c
+int build_package_index(PackageIndex *index);
+void free_package_index(PackageIndex *index);
+const PackageMeta* find_package_by_name(const PackageIndex *index, const char *name);
+int resolve_package_closure(const char *model, const char *author,
+                            const PackageIndex *index, char **roots, int root_count,
+                            char ***closure, int *closure_count);
+void free_string_list(char **list, int count);
+
+// pm-install.c
+int load_install_list(const char *model, const char *author, bool resolve_deps,
+                      PackageIndex *index, char ***packages, int *package_count);
+int copy_with_cp(const char *src, const char *dst);
+
+// build.c
+int build_single_package(const char *model, const char *author, const char *name,
+                         int jobs, bool use_cache, bool verbose);
+
+// cache.c
+int cache_key_context_init(CacheKeyContext *ctx, const char *model, const PackageIndex *index);
+void cache_key_context_free(CacheKeyContext *ctx);
+int package_cache_key(CacheKeyContext *ctx, const PackageMeta *meta, char key[SHA256_HEX_SIZE]);
+int package_cache_restore(const char *model, const PackageMeta *meta, const char *key);
+int package_cache_store(const char *model, const PackageMeta *meta, const char *key);
+// 缓存条目中记录的 bin/ 下的安装包（相对 srcs/<model>），用 free_string_list 释放
+int package_cache_packages(const PackageMeta *meta, const char *key, char ***packages, int *count);
+int process_package_caches(const char *model, const char *author, bool store);
+
+#endif // PM_INSTALL_H
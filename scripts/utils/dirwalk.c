@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "dirwalk.h"
+
+// getdents64 每次读取的缓冲区大小，一次系统调用可以取回数百个目录项
+#define GETDENTS_BUFFER_SIZE (64 * 1024)
+
+// 内核返回的目录项格式
+struct linux_dirent64 {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct {
+    DirEntry *items;
+    size_t count;
+    size_t capacity;
+} EntryList;
+
+// 线程间共享的待遍历目录队列
+typedef struct {
+    const char *root;
+    char **dirs;            // 相对路径，"" 表示根目录
+    size_t dir_count;
+    size_t dir_capacity;
+    size_t active;          // 正在处理目录的线程数
+    bool failed;
+    EntryList entries;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} WalkQueue;
+
+static int entry_list_add(EntryList *list, char *path, unsigned char type) {
+    if (list->count >= list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        DirEntry *items = realloc(list->items, capacity * sizeof(DirEntry));
+        if (items == NULL) return -1;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count].path = path;
+    list->items[list->count].type = type;
+    list->count++;
+    return 0;
+}
+
+// 调用方持有锁
+static int queue_push(WalkQueue *queue, char *dir) {
+    if (queue->dir_count >= queue->dir_capacity) {
+        size_t capacity = queue->dir_capacity ? queue->dir_capacity * 2 : 64;
+        char **dirs = realloc(queue->dirs, capacity * sizeof(char*));
+        if (dirs == NULL) return -1;
+        queue->dirs = dirs;
+        queue->dir_capacity = capacity;
+    }
+    queue->dirs[queue->dir_count++] = dir;
+    return 0;
+}
+
+static char* relative_join(const char *dir, const char *name) {
+    char *path = NULL;
+    if (dir[0] == '\0') return strdup(name);
+    if (asprintf(&path, "%s/%s", dir, name) < 0) return NULL;
+    return path;
+}
+
+// 读取一个目录，条目先收集到本地列表，最后一次加锁合并
+static int read_directory(WalkQueue *queue, const char *rel, EntryList *local, char ***subdirs,
+                          size_t *subdir_count) {
+    char *path = NULL;
+    if (asprintf(&path, "%s%s%s", queue->root, rel[0] ? "/" : "", rel) < 0) return -1;
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    free(path);
+    if (fd < 0) return 0;   // 无权限或已被删除的目录直接跳过
+
+    char *buffer = malloc(GETDENTS_BUFFER_SIZE);
+    size_t subdir_capacity = 0;
+    int result = buffer != NULL ? 0 : -1;
+
+    while (result == 0) {
+        long n = syscall(SYS_getdents64, fd, buffer, GETDENTS_BUFFER_SIZE);
+        if (n <= 0) break;
+
+        for (long offset = 0; offset < n && result == 0;) {
+            struct linux_dirent64 *entry = (struct linux_dirent64*)(buffer + offset);
+            offset += entry->d_reclen;
+            const char *name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+            unsigned char type = entry->d_type;
+            // 部分文件系统不提供类型，需要单独 stat
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG :
+                           S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+                }
+            }
+
+            char *child = relative_join(rel, name);
+            if (child == NULL || entry_list_add(local, child, type) != 0) {
+                free(child);
+                result = -1;
+                break;
+            }
+            if (type != DT_DIR) continue;
+
+            if (*subdir_count >= subdir_capacity) {
+                subdir_capacity = subdir_capacity ? subdir_capacity * 2 : 16;
+                char **dirs = realloc(*subdirs, subdir_capacity * sizeof(char*));
+                if (dirs == NULL) {
+                    result = -1;
+                    break;
+                }
+                *subdirs = dirs;
+            }
+            (*subdirs)[(*subdir_count)++] = strdup(child);
+            if ((*subdirs)[*subdir_count - 1] == NULL) result = -1;
+        }
+    }
+
+    free(buffer);
+    close(fd);
+    return result;
+}
+
+static void* walk_worker(void *arg) {
+    WalkQueue *queue = arg;
+    EntryList local = {0};
+
+    pthread_mutex_lock(&queue->lock);
+    for (;;) {
+        // 队列为空且没有线程在处理目录时遍历结束
+        while (queue->dir_count == 0 && queue->active > 0 && !queue->failed) {
+            pthread_cond_wait(&queue->cond, &queue->lock);
+        }
+        if (queue->dir_count == 0 || queue->failed) break;
+
+        char *dir = queue->dirs[--queue->dir_count];
+        queue->active++;
+        pthread_mutex_unlock(&queue->lock);
+
+        char **subdirs = NULL;
+        size_t subdir_count = 0;
+        local.count = 0;
+        int result = read_directory(queue, dir, &local, &subdirs, &subdir_count);
+        free(dir);
+
+        pthread_mutex_lock(&queue->lock);
+        for (size_t i = 0; i < subdir_count; i++) {
+            if (result == 0 && subdirs[i] != NULL && queue_push(queue, subdirs[i]) == 0) continue;
+            free(subdirs[i]);
+            result = -1;
+        }
+        free(subdirs);
+        for (size_t i = 0; i < local.count; i++) {
+            if (result == 0 && entry_list_add(&queue->entries, local.items[i].path, local.items[i].type) == 0) {
+                continue;
+            }
+            free(local.items[i].path);
+            result = -1;
+        }
+        if (result != 0) queue->failed = true;
+        queue->active--;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+
+    free(local.items);
+    return NULL;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const DirEntry*)a)->path, ((const DirEntry*)b)->path);
+}
+
+DirTree* dir_tree_walk(const char *root, int threads) {
+    DirTree *tree = calloc(1, sizeof(DirTree));
+    if (tree == NULL) return NULL;
+    tree->root = strdup(root);
+
+    WalkQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    queue.root = root;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.cond, NULL);
+
+    char *start = strdup("");
+    if (tree->root == NULL || start == NULL || queue_push(&queue, start) != 0) {
+        free(start);
+        queue.failed = true;
+    }
+
+    if (!queue.failed) {
+        if (threads < 1) threads = 1;
+        pthread_t *workers = threads > 1 ? malloc((size_t)threads * sizeof(pthread_t)) : NULL;
+        int started = 0;
+        for (int i = 0; workers != NULL && i < threads; i++) {
+            if (pthread_create(&workers[i], NULL, walk_worker, &queue) != 0) break;
+            started++;
+        }
+        if (started == 0) walk_worker(&queue);
+        for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+        free(workers);
+    }
+
+    for (size_t i = 0; i < queue.dir_count; i++) free(queue.dirs[i]);
+    free(queue.dirs);
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.cond);
+
+    tree->entries = queue.entries.items;
+    tree->count = queue.entries.count;
+    if (queue.failed) {
+        dir_tree_free(tree);
+        return NULL;
+    }
+    if (tree->count > 1) qsort(tree->entries, tree->count, sizeof(DirEntry), compare_entries);
+    return tree;
+}
+
+void dir_tree_free(DirTree *tree) {
+    if (tree == NULL) return;
+    for (size_t i = 0; i < tree->count; i++) free(tree->entries[i].path);
+    free(tree->entries);
+    free(tree->root);
+    free(tree);
+}
+
+// ancestor 是否等于 path 或为其上级目录
+static bool path_covers(const char *ancestor, const char *path) {
+    size_t len = strlen(ancestor);
+    if (len > 1 && ancestor[len - 1] == '/') len--;
+    if (strncmp(ancestor, path, len) != 0) return false;
+    return path[len] == '\0' || path[len] == '/' || (len == 1 && ancestor[0] == '/');
+}
+
+const DirTree* dir_tree_cache_get(DirTreeCache *cache, const char *root, int threads) {
+    for (size_t i = 0; i < cache->count; i++) {
+        if (path_covers(cache->trees[i]->root, root)) return cache->trees[i];
+    }
+
+    DirTree *tree = dir_tree_walk(root, threads);
+    if (tree == NULL) return NULL;
+    DirTree **trees = realloc(cache->trees, (cache->count + 1) * sizeof(DirTree*));
+    if (trees == NULL) {
+        dir_tree_free(tree);
+        return NULL;
+    }
+    cache->trees = trees;
+    cache->trees[cache->count++] = tree;
+    return tree;
+}
+
+void dir_tree_cache_free(DirTreeCache *cache) {
+    for (size_t i = 0; i < cache->count; i++) dir_tree_free(cache->trees[i]);
+    free(cache->trees);
+    cache->trees = NULL;
+    cache->count = 0;
+}
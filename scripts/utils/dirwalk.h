@@ -0,0 +1,33 @@
+#ifndef DIRWALK_H
+#define DIRWALK_H
+
+#include <stddef.h>
+
+// 目录树中的一项，path 为相对根目录的路径，type 为 DT_DIR / DT_REG / DT_LNK 等
+typedef struct {
+    char *path;
+    unsigned char type;
+} DirEntry;
+
+// 一次遍历得到的目录树快照，entries 按路径排序
+typedef struct {
+    char *root;
+    DirEntry *entries;
+    size_t count;
+} DirTree;
+
+// 多线程遍历 root 下的全部条目（用 getdents64 批量读取目录），不跟随符号链接
+DirTree* dir_tree_walk(const char *root, int threads);
+void dir_tree_free(DirTree *tree);
+
+// 一次运行中已遍历过的目录树；根目录相同或位于已遍历目录之下时复用快照
+typedef struct {
+    DirTree **trees;
+    size_t count;
+} DirTreeCache;
+
+// 返回覆盖 root 的目录树（树根是 root 本身或其上级目录），没有时遍历 root 并加入缓存
+const DirTree* dir_tree_cache_get(DirTreeCache *cache, const char *root, int threads);
+void dir_tree_cache_free(DirTreeCache *cache);
+
+#endif // DIRWALK_H
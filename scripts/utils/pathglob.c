@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "pathglob.h"
+
+typedef struct {
+    char **items;
+    int count;
+    int capacity;
+} PathList;
+
+static int path_list_add(PathList *list, const char *path) {
+    if (list->count >= list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 64;
+        char **items = realloc(list->items, new_capacity * sizeof(char*));
+        if (items == NULL) return -1;
+        list->items = items;
+        list->capacity = new_capacity;
+    }
+    list->items[list->count] = strdup(path);
+    if (list->items[list->count] == NULL) return -1;
+    list->count++;
+    return 0;
+}
+
+bool path_has_glob(const char *pattern) {
+    return pattern != NULL && strpbrk(pattern, "*?[") != NULL;
+}
+
+// 拼接目录和名称，base 为空表示当前目录
+static char* join_path(const char *base, const char *name) {
+    size_t base_len = strlen(base);
+    size_t name_len = strlen(name);
+    char *path = malloc(base_len + name_len + 2);
+    if (path == NULL) return NULL;
+
+    if (base_len == 0) {
+        memcpy(path, name, name_len + 1);
+    } else if (base[base_len - 1] == '/') {
+        memcpy(path, base, base_len);
+        memcpy(path + base_len, name, name_len + 1);
+    } else {
+        memcpy(path, base, base_len);
+        path[base_len] = '/';
+        memcpy(path + base_len + 1, name, name_len + 1);
+    }
+    return path;
+}
+
+static int glob_components(const char *base, char **comps, int comp_count, int idx, PathList *out);
+
+// 在 base 下按第 idx 级模式继续匹配，base 已确认存在
+static int glob_next(const char *base, char **comps, int comp_count, int idx, PathList *out) {
+    struct stat st;
+
+    if (idx == comp_count) {
+        if (stat(base[0] ? base : ".", &st) == 0 && S_ISREG(st.st_mode)) {
+            return path_list_add(out, base);
+        }
+        return 0;
+    }
+
+    const char *comp = comps[idx];
+
+    // 普通路径段：直接拼接，无需读取目录
+    if (!path_has_glob(comp)) {
+        char *path = join_path(base, comp);
+        if (path == NULL) return -1;
+        int result = 0;
+        if (lstat(path, &st) == 0) {
+            result = glob_components(path, comps, comp_count, idx + 1, out);
+        }
+        free(path);
+        return result;
+    }
+
+    bool recursive = strcmp(comp, "**") == 0;
+
+    // ** 匹配零层目录
+    if (recursive && glob_components(base, comps, comp_count, idx + 1, out) != 0) {
+        return -1;
+    }
+
+    DIR *dir = opendir(base[0] ? base : ".");
+    if (dir == NULL) return 0;
+
+    int result = 0;
+    struct dirent *entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        // 与 shell 一致，通配符不匹配隐藏文件
+        if (name[0] == '.' && comp[0] != '.') continue;
+
+        if (!recursive && fnmatch(comp, name, FNM_PERIOD) != 0) continue;
+
+        char *path = join_path(base, name);
+        if (path == NULL) {
+            result = -1;
+            break;
+        }
+
+        if (recursive) {
+            // ** 匹配一层或多层目录，不跟随符号链接，避免循环
+            bool is_dir = entry->d_type == DT_DIR;
+            if (entry->d_type == DT_UNKNOWN) {
+                is_dir = lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+            }
+            if (is_dir) {
+                result = glob_next(path, comps, comp_count, idx, out);
+            }
+        } else {
+            result = glob_components(path, comps, comp_count, idx + 1, out);
+        }
+        free(path);
+    }
+
+    closedir(dir);
+    return result;
+}
+
+static int glob_components(const char *base, char **comps, int comp_count, int idx, PathList *out) {
+    struct stat st;
+    // 中间路径必须是目录（跟随符号链接）
+    if (idx < comp_count && base[0] && (stat(base, &st) != 0 || !S_ISDIR(st.st_mode))) {
+        return 0;
+    }
+    return glob_next(base, comps, comp_count, idx, out);
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int path_glob(const char *pattern, char ***matches, int *count) {
+    *matches = NULL;
+    *count = 0;
+
+    char *copy = strdup(pattern);
+    if (copy == NULL) return -1;
+
+    // 拆分路径段，忽略连续的斜杠
+    int comp_count = 0;
+    char **comps = malloc((strlen(pattern) / 2 + 2) * sizeof(char*));
+    if (comps == NULL) {
+        free(copy);
+        return -1;
+    }
+    char *saveptr;
+    for (char *tok = strtok_r(copy, "/", &saveptr); tok; tok = strtok_r(NULL, "/", &saveptr)) {
+        // 连续的 ** 等价于一个
+        if (strcmp(tok, "**") == 0 && comp_count > 0 && strcmp(comps[comp_count - 1], "**") == 0) {
+            continue;
+        }
+        comps[comp_count++] = tok;
+    }
+
+    PathList list = {0};
+    int result = glob_components(pattern[0] == '/' ? "/" : "", comps, comp_count, 0, &list);
+
+    free(comps);
+    free(copy);
+
+    if (result != 0) {
+        path_glob_free(list.items, list.count);
+        return -1;
+    }
+
+    // 排序去重（** 可能从不同路径匹配到同一个文件）
+    if (list.count > 1) {
+        qsort(list.items, list.count, sizeof(char*), compare_paths);
+        int unique = 1;
+        for (int i = 1; i < list.count; i++) {
+            if (strcmp(list.items[i], list.items[unique - 1]) == 0) {
+                free(list.items[i]);
+            } else {
+                list.items[unique++] = list.items[i];
+            }
+        }
+        list.count = unique;
+    }
+
+    *matches = list.items;
+    *count = list.count;
+    return 0;
+}
+
+void path_glob_free(char **matches, int count) {
+    for (int i = 0; i < count; i++) {
+        free(matches[i]);
+    }
+    free(matches);
+}
+
+// pattern 和 path 都从某一段的开头开始
+static bool match_from(const char *pattern, const char *path) {
+    while (*pattern == '/') pattern++;
+    while (*path == '/') path++;
+    if (*pattern == '\0') return *path == '\0';
+
+    const char *pattern_end = strchrnul(pattern, '/');
+    size_t pattern_len = pattern_end - pattern;
+
+    if (pattern_len == 2 && pattern[0] == '*' && pattern[1] == '*') {
+        const char *rest = pattern_end;
+        while (*rest == '/') rest++;
+        // 结尾的 ** 匹配其下所有非隐藏的条目
+        if (*rest == '\0') {
+            if (*path == '\0') return false;
+            for (const char *p = path; p != NULL; p = strchr(p, '/')) {
+                if (*p == '/') p++;
+                if (*p == '.') return false;
+            }
+            return true;
+        }
+        // 依次尝试让 ** 吞掉 0、1、2... 层目录，不进入隐藏目录
+        for (const char *p = path;;) {
+            if (match_from(rest, p)) return true;
+            if (*p == '\0' || *p == '.') return false;
+            const char *slash = strchr(p, '/');
+            if (slash == NULL) return false;
+            p = slash + 1;
+        }
+    }
+
+    if (*path == '\0') return false;
+    const char *path_end = strchrnul(path, '/');
+    size_t path_len = path_end - path;
+    char comp[NAME_MAX + 1];
+    char name[NAME_MAX + 1];
+    if (pattern_len > NAME_MAX || path_len > NAME_MAX) return false;
+    memcpy(comp, pattern, pattern_len);
+    comp[pattern_len] = '\0';
+    memcpy(name, path, path_len);
+    name[path_len] = '\0';
+    if (fnmatch(comp, name, FNM_PERIOD) != 0) return false;
+
+    return match_from(pattern_end, path_end);
+}
+
+bool path_match(const char *pattern, const char *path) {
+    return match_from(pattern, path);
+}
+
+// 找到与 open 处 { 配对的 }，并判断其中是否有顶层逗号
+static const char* brace_close(const char *open, bool *has_comma) {
+    int depth = 0;
+    *has_comma = false;
+    for (const char *p = open; *p; p++) {
+        if (*p == '{') {
+            depth++;
+        } else if (*p == '}') {
+            if (--depth == 0) return p;
+        } else if (*p == ',' && depth == 1) {
+            *has_comma = true;
+        }
+    }
+    return NULL;
+}
+
+static int brace_expand(const char *pattern, PathList *out) {
+    // 找到第一组可展开的花括号；没有逗号的 {x} 按字面处理
+    const char *open = NULL;
+    const char *close = NULL;
+    for (const char *p = strchr(pattern, '{'); p != NULL; p = strchr(p + 1, '{')) {
+        bool has_comma;
+        const char *end = brace_close(p, &has_comma);
+        if (end == NULL) break;
+        if (has_comma) {
+            open = p;
+            close = end;
+            break;
+        }
+    }
+    if (open == NULL) return path_list_add(out, pattern);
+
+    size_t prefix_len = open - pattern;
+    const char *suffix = close + 1;
+    const char *alt = open + 1;
+    int depth = 0;
+    for (const char *p = alt; p <= close; p++) {
+        if (*p == '{') {
+            depth++;
+            continue;
+        }
+        if (*p == '}' && depth > 0) {
+            depth--;
+            continue;
+        }
+        if (p != close && (*p != ',' || depth > 0)) continue;
+
+        // alt..p 是一个候选项，拼接后继续展开其余花括号
+        size_t alt_len = p - alt;
+        char *expanded = malloc(prefix_len + alt_len + strlen(suffix) + 1);
+        if (expanded == NULL) return -1;
+        memcpy(expanded, pattern, prefix_len);
+        memcpy(expanded + prefix_len, alt, alt_len);
+        strcpy(expanded + prefix_len + alt_len, suffix);
+        int result = brace_expand(expanded, out);
+        free(expanded);
+        if (result != 0) return -1;
+        alt = p + 1;
+    }
+    return 0;
+}
+
+int path_brace_expand(const char *pattern, char ***patterns, int *count) {
+    PathList list = {0};
+    *patterns = NULL;
+    *count = 0;
+    if (brace_expand(pattern, &list) != 0) {
+        path_glob_free(list.items, list.count);
+        return -1;
+    }
+    *patterns = list.items;
+    *count = list.count;
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef PATHGLOB_H
+#define PATHGLOB_H
+
+#include <stdbool.h>
+
+// 判断路径中是否包含通配符 (* ? [)
+bool path_has_glob(const char *pattern);
+
+// 展开路径模式，只返回普通文件
+// 每一级目录支持 * ? [...]，单独的 ** 匹配任意层（包括零层）目录
+// 结果按字典序排列且去重，由 path_glob_free 释放
+int path_glob(const char *pattern, char ***matches, int *count);
+void path_glob_free(char **matches, int count);
+
+// 判断相对路径是否匹配模式，规则与 path_glob 相同：每段用 fnmatch 匹配，
+// ** 匹配任意层（包括零层）目录，通配符不匹配以 . 开头的隐藏文件和目录
+bool path_match(const char *pattern, const char *path);
+
+// 展开花括号：a/{b,c}/*.{img,bin} 得到 4 个模式，支持嵌套；
+// 没有花括号时返回模式本身。结果由 path_glob_free 释放
+int path_brace_expand(const char *pattern, char ***patterns, int *count);
+
+#endif // PATHGLOB_H
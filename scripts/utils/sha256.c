@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sha256.h"
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// 处理一个 64 字节的数据块
+static void sha256_transform(Sha256Ctx *ctx, const uint8_t block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+    uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t S1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + S1 + ch + K[i] + w[i];
+        uint32_t S0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = S0 + maj;
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d;
+    ctx->state[4] += e; ctx->state[5] += f; ctx->state[6] += g; ctx->state[7] += h;
+}
+
+void sha256_init(Sha256Ctx *ctx) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->bit_count = 0;
+    ctx->buffer_len = 0;
+}
+
+void sha256_update(Sha256Ctx *ctx, const void *data, size_t len) {
+    const uint8_t *p = data;
+    ctx->bit_count += (uint64_t)len * 8;
+
+    // 先补齐缓冲区中残留的数据
+    if (ctx->buffer_len > 0) {
+        size_t need = 64 - ctx->buffer_len;
+        size_t take = len < need ? len : need;
+        memcpy(ctx->buffer + ctx->buffer_len, p, take);
+        ctx->buffer_len += take;
+        p += take;
+        len -= take;
+        if (ctx->buffer_len < 64) return;
+        sha256_transform(ctx, ctx->buffer);
+        ctx->buffer_len = 0;
+    }
+
+    // 直接处理完整的数据块，避免额外拷贝
+    while (len >= 64) {
+        sha256_transform(ctx, p);
+        p += 64;
+        len -= 64;
+    }
+
+    if (len > 0) {
+        memcpy(ctx->buffer, p, len);
+        ctx->buffer_len = len;
+    }
+}
+
+void sha256_final(Sha256Ctx *ctx, uint8_t digest[SHA256_DIGEST_SIZE]) {
+    uint64_t bits = ctx->bit_count;
+    uint8_t pad = 0x80;
+    uint8_t zero = 0;
+
+    // 追加填充位，但不计入消息长度
+    uint64_t saved = ctx->bit_count;
+    sha256_update(ctx, &pad, 1);
+    while (ctx->buffer_len != 56) {
+        sha256_update(ctx, &zero, 1);
+    }
+    ctx->bit_count = saved;
+
+    uint8_t len_be[8];
+    for (int i = 0; i < 8; i++) {
+        len_be[i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+    memcpy(ctx->buffer + 56, len_be, 8);
+    sha256_transform(ctx, ctx->buffer);
+    ctx->buffer_len = 0;
+
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (uint8_t)(ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)ctx->state[i];
+    }
+}
+
+void sha256_to_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0x0f];
+    }
+    hex[SHA256_HEX_SIZE - 1] = '\0';
+}
+
+void sha256_hex(const void *data, size_t len, char hex[SHA256_HEX_SIZE]) {
+    Sha256Ctx ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+    sha256_to_hex(digest, hex);
+}
+
+int sha256_file_hex(const char *path, char hex[SHA256_HEX_SIZE]) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    Sha256Ctx ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    static __thread uint8_t buf[256 * 1024];
+    ssize_t n;
+
+    sha256_init(&ctx);
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        sha256_update(&ctx, buf, (size_t)n);
+    }
+    close(fd);
+    if (n < 0) return -1;
+
+    sha256_final(&ctx, digest);
+    sha256_to_hex(digest, hex);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE 65
+
+// SHA-256 流式计算上下文
+typedef struct {
+    uint32_t state[8];
+    uint64_t bit_count;
+    uint8_t buffer[64];
+    size_t buffer_len;
+} Sha256Ctx;
+
+void sha256_init(Sha256Ctx *ctx);
+void sha256_update(Sha256Ctx *ctx, const void *data, size_t len);
+void sha256_final(Sha256Ctx *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+void sha256_to_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE]);
+
+// 计算内存数据的十六进制摘要
+void sha256_hex(const void *data, size_t len, char hex[SHA256_HEX_SIZE]);
+// 计算文件的十六进制摘要，失败返回 -1
+int sha256_file_hex(const char *path, char hex[SHA256_HEX_SIZE]);
+
+#endif // SHA256_H
@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "treecopy.h"
+#include "sha256.h"
+#include "utils.h"
+
+// copy_file_range 不可用时 read/write 使用的缓冲区大小
+#define COPY_BUFFER_SIZE (1024 * 1024)
+
+static char* join_path(const char *dir, const char *name) {
+    char *path = NULL;
+    size_t len = strlen(dir);
+    const char *sep = len > 0 && dir[len - 1] == '/' ? "" : "/";
+    if (asprintf(&path, "%s%s%s", dir, sep, name) < 0) return NULL;
+    return path;
+}
+
+// 路径的最后一级名称，忽略结尾的斜杠
+static char* path_basename(const char *path) {
+    size_t len = strlen(path);
+    while (len > 1 && path[len - 1] == '/') len--;
+    size_t start = len;
+    while (start > 0 && path[start - 1] != '/') start--;
+    return strndup(path + start, len - start);
+}
+
+int make_dirs(const char *path, mode_t mode) {
+    char *copy = strdup(path);
+    if (copy == NULL) return -1;
+
+    int result = 0;
+    for (char *p = copy + 1; result == 0; p++) {
+        if (*p != '/' && *p != '\0') continue;
+        char saved = *p;
+        *p = '\0';
+
+        struct stat st;
+        if (mkdir(copy, mode) != 0 && errno != EEXIST) {
+            result = -1;
+        } else if (stat(copy, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            result = -1;
+        }
+
+        *p = saved;
+        if (saved == '\0') break;
+    }
+
+    free(copy);
+    return result;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+int remove_tree(const char *path) {
+    return nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// 内核不支持跨文件系统或该文件系统的 copy_file_range 时退回普通读写；
+// 需要摘要时也走这里，读出的数据同时写入目标和摘要上下文
+static int copy_fd_fallback(int in, int out, off_t offset, unsigned long long *copied,
+                            Sha256Ctx *ctx, unsigned long long *progress) {
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    if (buffer == NULL) return -1;
+
+    int result = 0;
+    for (;;) {
+        ssize_t n = pread(in, buffer, COPY_BUFFER_SIZE, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            result = -1;
+            break;
+        }
+        if (n == 0) break;
+
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(out, buffer + done, (size_t)(n - done));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                result = -1;
+                break;
+            }
+            done += w;
+        }
+        if (result != 0) break;
+        if (ctx != NULL) sha256_update(ctx, buffer, (size_t)n);
+        offset += n;
+        *copied += (unsigned long long)n;
+        if (progress != NULL) __atomic_add_fetch(progress, (unsigned long long)n, __ATOMIC_RELAXED);
+    }
+
+    free(buffer);
+    return result;
+}
+
+static int copy_fd(int in, int out, off_t size, unsigned long long *copied,
+                   unsigned long long *progress) {
+    off_t remaining = size;
+    while (remaining > 0) {
+        ssize_t n = copy_file_range(in, NULL, out, NULL, (size_t)remaining, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                errno == EOPNOTSUPP || errno == EPERM) {
+                return copy_fd_fallback(in, out, size - remaining, copied, NULL, progress);
+            }
+            return -1;
+        }
+        // 源文件在复制过程中被截断
+        if (n == 0) break;
+        remaining -= n;
+        *copied += (unsigned long long)n;
+        if (progress != NULL) __atomic_add_fetch(progress, (unsigned long long)n, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+int open_temp_file(const char *dst, char **tmp_path) {
+    if (asprintf(tmp_path, "%s.XXXXXX", dst) < 0) {
+        *tmp_path = NULL;
+        return -1;
+    }
+    int fd = mkostemp(*tmp_path, O_CLOEXEC);
+    if (fd < 0) {
+        free(*tmp_path);
+        *tmp_path = NULL;
+    }
+    return fd;
+}
+
+static int copy_regular_file(const char *src, const char *dst, const struct stat *src_st,
+                             unsigned long long *bytes, char hex[SHA256_HEX_SIZE],
+                             unsigned long long *progress) {
+    int in = open(src, O_RDONLY);
+    if (in < 0) return -1;
+    char *tmp_path = NULL;
+    int out = open_temp_file(dst, &tmp_path);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+
+    unsigned long long copied = 0;
+    int result;
+    if (hex != NULL) {
+        Sha256Ctx ctx;
+        sha256_init(&ctx);
+        result = copy_fd_fallback(in, out, 0, &copied, &ctx, progress);
+        if (result == 0) {
+            uint8_t digest[SHA256_DIGEST_SIZE];
+            sha256_final(&ctx, digest);
+            sha256_to_hex(digest, hex);
+        }
+    } else {
+        result = copy_fd(in, out, src_st->st_size, &copied, progress);
+    }
+
+    if (result == 0) {
+        // 保留权限和时间戳，下次比较时大小和修改时间一致即可直接跳过
+        struct timespec times[2] = { src_st->st_atim, src_st->st_mtim };
+        if (fchmod(out, src_st->st_mode & 07777) != 0 || futimens(out, times) != 0) {
+            result = -1;
+        }
+    }
+    if (close(out) != 0) result = -1;
+    close(in);
+
+    if (result == 0 && rename(tmp_path, dst) != 0) result = -1;
+    if (result != 0) {
+        // 保留失败时的 errno，供调用者报告
+        int error = errno;
+        unlink(tmp_path);
+        errno = error;
+    }
+    free(tmp_path);
+
+    if (result == 0 && bytes != NULL) *bytes += copied;
+    return result;
+}
+
+int copy_file_data(const char *src, const char *dst, const struct stat *src_st,
+                   unsigned long long *bytes) {
+    return copy_regular_file(src, dst, src_st, bytes, NULL, NULL);
+}
+
+int copy_file_data_hash(const char *src, const char *dst, const struct stat *src_st,
+                        unsigned long long *bytes, char hex[SHA256_HEX_SIZE],
+                        unsigned long long *progress) {
+    return copy_regular_file(src, dst, src_st, bytes, hex, progress);
+}
+
+bool file_same_content(const char *src, const struct stat *src_st,
+                       const char *dst, const struct stat *dst_st) {
+    if (src_st->st_size != dst_st->st_size) return false;
+    if (src_st->st_mtim.tv_sec == dst_st->st_mtim.tv_sec &&
+        src_st->st_mtim.tv_nsec == dst_st->st_mtim.tv_nsec) {
+        return true;
+    }
+
+    char src_hash[SHA256_HEX_SIZE];
+    char dst_hash[SHA256_HEX_SIZE];
+    if (sha256_file_hex(src, src_hash) != 0 || sha256_file_hex(dst, dst_hash) != 0 ||
+        strcmp(src_hash, dst_hash) != 0) {
+        return false;
+    }
+
+    struct timespec times[2] = { src_st->st_atim, src_st->st_mtim };
+    utimensat(AT_FDCWD, dst, times, 0);
+    return true;
+}
+
+// 删除与源类型不同的目标（例如目录变成了文件）
+static int remove_existing(const char *dst, TreeCopyStats *stats) {
+    if (remove_tree(dst) != 0) {
+        log_error("无法删除: %s", dst);
+        stats->errors++;
+        return -1;
+    }
+    stats->files_deleted++;
+    return 0;
+}
+
+static void copy_entry(const char *src, const char *dst, const TreeCopyOptions *options,
+                       TreeCopyStats *stats);
+
+// 复制目录内容；镜像模式下删除源中已不存在的条目
+static void copy_directory(const char *src, const char *dst, const struct stat *src_st,
+                           bool dst_exists, const TreeCopyOptions *options, TreeCopyStats *stats) {
+    if (!dst_exists) {
+        if (mkdir(dst, (src_st->st_mode & 07777) | S_IRWXU) != 0) {
+            log_error("无法创建目录: %s", dst);
+            stats->errors++;
+            return;
+        }
+        stats->dirs_created++;
+    }
+
+    DIR *dir = opendir(src);
+    if (dir == NULL) {
+        log_error("无法读取目录: %s", src);
+        stats->errors++;
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char *child_src = join_path(src, entry->d_name);
+        char *child_dst = join_path(dst, entry->d_name);
+        if (child_src != NULL && child_dst != NULL) {
+            copy_entry(child_src, child_dst, options, stats);
+        } else {
+            stats->errors++;
+        }
+        free(child_src);
+        free(child_dst);
+    }
+    closedir(dir);
+
+    if (!options->mirror || !dst_exists) return;
+
+    dir = opendir(dst);
+    if (dir == NULL) return;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char *child_src = join_path(src, entry->d_name);
+        char *child_dst = join_path(dst, entry->d_name);
+        struct stat st;
+        if (child_src != NULL && child_dst != NULL &&
+            lstat(child_src, &st) != 0 && errno == ENOENT) {
+            remove_existing(child_dst, stats);
+        }
+        free(child_src);
+        free(child_dst);
+    }
+    closedir(dir);
+}
+
+static void copy_symlink(const char *src, const char *dst, const struct stat *src_st,
+                         bool dst_exists, const struct stat *dst_st, TreeCopyStats *stats) {
+    size_t size = src_st->st_size > 0 ? (size_t)src_st->st_size + 1 : PATH_MAX;
+    char *target = malloc(size);
+    ssize_t len = target ? readlink(src, target, size - 1) : -1;
+    if (len < 0) {
+        log_error("无法读取符号链接: %s", src);
+        stats->errors++;
+        free(target);
+        return;
+    }
+    target[len] = '\0';
+
+    if (dst_exists && S_ISLNK(dst_st->st_mode)) {
+        char *current = malloc(size);
+        ssize_t current_len = current ? readlink(dst, current, size - 1) : -1;
+        bool same = current_len == len && memcmp(current, target, (size_t)len) == 0;
+        free(current);
+        if (same) {
+            stats->files_unchanged++;
+            free(target);
+            return;
+        }
+    }
+
+    if (dst_exists && remove_existing(dst, stats) != 0) {
+        free(target);
+        return;
+    }
+    if (symlink(target, dst) != 0) {
+        log_error("无法创建符号链接: %s", dst);
+        stats->errors++;
+    } else {
+        stats->files_copied++;
+    }
+    free(target);
+}
+
+static void copy_entry(const char *src, const char *dst, const TreeCopyOptions *options,
+                       TreeCopyStats *stats) {
+    struct stat src_st, dst_st;
+    if (lstat(src, &src_st) != 0) {
+        log_error("无法访问: %s", src);
+        stats->errors++;
+        return;
+    }
+    bool dst_exists = lstat(dst, &dst_st) == 0;
+
+    if (S_ISDIR(src_st.st_mode)) {
+        if (dst_exists && !S_ISDIR(dst_st.st_mode)) {
+            if (remove_existing(dst, stats) != 0) return;
+            dst_exists = false;
+        }
+        copy_directory(src, dst, &src_st, dst_exists, options, stats);
+    } else if (S_ISLNK(src_st.st_mode)) {
+        copy_symlink(src, dst, &src_st, dst_exists, &dst_st, stats);
+    } else if (S_ISREG(src_st.st_mode)) {
+        if (dst_exists && S_ISREG(dst_st.st_mode) &&
+            file_same_content(src, &src_st, dst, &dst_st)) {
+            stats->files_unchanged++;
+            return;
+        }
+        if (dst_exists && S_ISDIR(dst_st.st_mode) && remove_existing(dst, stats) != 0) return;
+
+        if (copy_file_data(src, dst, &src_st, &stats->bytes_copied) == 0) {
+            stats->files_copied++;
+        } else {
+            log_error("复制文件失败: %s -> %s", src, dst);
+            stats->errors++;
+        }
+    } else {
+        log_warning("跳过特殊文件: %s", src);
+    }
+}
+
+int tree_copy(const char *src, const char *dst, const TreeCopyOptions *options,
+              TreeCopyStats *stats) {
+    TreeCopyOptions default_options = {0};
+    if (options == NULL) options = &default_options;
+    memset(stats, 0, sizeof(*stats));
+
+    struct stat st;
+    if (lstat(src, &st) != 0) {
+        log_error("源路径不存在: %s", src);
+        stats->errors++;
+        return -1;
+    }
+
+    // 源是目录时 dst 就是复制结果，不论 dst 是否已存在，重复执行总是同步到同一位置；
+    // 源是文件时与 cp 一致，目标是已存在的目录时复制到其中
+    char *target;
+    bool src_is_dir = S_ISDIR(st.st_mode);
+    if (!src_is_dir && stat(dst, &st) == 0 && S_ISDIR(st.st_mode)) {
+        char *src_name = path_basename(src);
+        target = src_name != NULL ? join_path(dst, src_name) : NULL;
+        free(src_name);
+    } else {
+        target = strdup(dst);
+        // 目标的上级目录不存在时先创建
+        char *slash = target ? strrchr(target, '/') : NULL;
+        if (slash != NULL && slash != target) {
+            *slash = '\0';
+            if (make_dirs(target, 0755) != 0) {
+                log_error("无法创建目录: %s", target);
+                stats->errors++;
+            }
+            *slash = '/';
+        }
+    }
+    if (target == NULL) return -1;
+
+    if (stats->errors == 0) {
+        copy_entry(src, target, options, stats);
+    }
+    free(target);
+    return stats->errors == 0 ? 0 : -1;
+}
@@ -0,0 +1,56 @@
+#ifndef TREECOPY_H
+#define TREECOPY_H
+
+#include <stdbool.h>
+#include <sys/stat.h>
+#include "sha256.h"
+
+// 增量复制选项
+typedef struct {
+    bool mirror;            // 镜像模式：删除目标中源已不存在的文件和目录
+} TreeCopyOptions;
+
+// 增量复制统计
+typedef struct {
+    unsigned long files_copied;
+    unsigned long files_unchanged;
+    unsigned long files_deleted;    // 镜像模式下删除的文件和目录
+    unsigned long dirs_created;
+    unsigned long long bytes_copied;
+    unsigned long errors;
+} TreeCopyStats;
+
+// 递归创建目录（类似 mkdir -p）
+int make_dirs(const char *path, mode_t mode);
+
+// 删除文件或整个目录树，不跟随符号链接
+int remove_tree(const char *path);
+
+// 在 dst 所在目录创建唯一的临时文件 <dst>.XXXXXX（权限 0600），*tmp_path 由调用者释放；
+// 同一目录中的 foo 和 foo.tmp 等文件由不同线程同时写入时不会共用临时文件
+int open_temp_file(const char *dst, char **tmp_path);
+
+// 复制单个普通文件：优先使用 copy_file_range，不支持时退回 read/write
+// 先写临时文件再重命名，保留权限和修改时间；bytes 可为 NULL
+int copy_file_data(const char *src, const char *dst, const struct stat *src_st,
+                   unsigned long long *bytes);
+
+// 同 copy_file_data，但只读取源文件一次，复制的同时计算 SHA-256 摘要
+// progress 不为 NULL 时每写出一段就原子地累加已复制的字节数，供其他线程显示进度
+int copy_file_data_hash(const char *src, const char *dst, const struct stat *src_st,
+                        unsigned long long *bytes, char hex[SHA256_HEX_SIZE],
+                        unsigned long long *progress);
+
+// 目标文件内容是否与源文件一致：大小不同则不一致，大小和修改时间都相同则一致，
+// 仅修改时间不同时比较 SHA-256 摘要（一致时同步目标的修改时间，下次直接命中）
+bool file_same_content(const char *src, const struct stat *src_st,
+                       const char *dst, const struct stat *dst_st);
+
+// 增量复制文件或目录树：源是目录时 dst 就是复制结果（与 cp -r 不同，dst 已存在时
+// 也不会复制到 dst/<src 的名称>），保证重复执行结果相同；源是文件且 dst 是已存在的目录时
+// 复制到 dst/<src 的名称>
+// 只复制内容有差异的文件，符号链接按链接本身复制
+int tree_copy(const char *src, const char *dst, const TreeCopyOptions *options,
+              TreeCopyStats *stats);
+
+#endif // TREECOPY_H
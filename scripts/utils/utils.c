@@ -17,9 +17,10 @@
 // 获取当前时间戳字符串
 static void get_timestamp(char *buffer, size_t buffer_size) {
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
     
-    strftime(buffer, buffer_size, "%Y-%m-%d %H:%M:%S", tm_info);
+    strftime(buffer, buffer_size, "%Y-%m-%d %H:%M:%S", &tm_info);
 }
 
 // 错误日志
@@ -30,6 +31,9 @@ void log_error(const char *format, ...) {
     va_list args;
     va_start(args, format);
     
+    // 锁定 stdout，避免多线程输出的日志行交错
+    flockfile(stdout);
+    
     // 时间戳 + [tag] 部分
     printf(COLOR_TIMESTAMP "[%s]" COLOR_RESET COLOR_BRACKETS "[" LOG_ERROR "Err" COLOR_BRACKETS "]" COLOR_RESET " ", timestamp);
     
@@ -37,6 +41,7 @@ void log_error(const char *format, ...) {
     printf(LOG_ERROR);
     vprintf(format, args);
     printf(COLOR_RESET "\n");
+    funlockfile(stdout);
     
     va_end(args);
 }
@@ -49,11 +54,13 @@ void log_warning(const char *format, ...) {
     va_list args;
     va_start(args, format);
     
+    flockfile(stdout);
     printf(COLOR_TIMESTAMP "[%s]" COLOR_RESET COLOR_BRACKETS "[" LOG_WARNING "Warn" COLOR_BRACKETS "]" COLOR_RESET " ", timestamp);
     
     printf(LOG_WARNING);
     vprintf(format, args);
     printf(COLOR_RESET "\n");
+    funlockfile(stdout);
     
     va_end(args);
 }
@@ -66,11 +73,13 @@ void log_info(const char *format, ...) {
     va_list args;
     va_start(args, format);
     
+    flockfile(stdout);
     printf(COLOR_TIMESTAMP "[%s]" COLOR_RESET COLOR_BRACKETS "[" LOG_INFO "Info" COLOR_BRACKETS "]" COLOR_RESET " ", timestamp);
     
     printf(LOG_INFO);
     vprintf(format, args);
     printf(COLOR_RESET "\n");
+    funlockfile(stdout);
     
     va_end(args);
 }
@@ -84,11 +93,13 @@ void log_debug(const char *format, ...) {
     va_list args;   
     va_start(args, format);
 
+    flockfile(stdout);
     printf(COLOR_TIMESTAMP "[%s]" COLOR_RESET COLOR_BRACKETS "[" LOG_DEBUG "Debug" COLOR_BRACKETS "]" COLOR_RESET " ", timestamp);
     
     printf(LOG_DEBUG);
     vprintf(format, args);
     printf(COLOR_RESET "\n");
+    funlockfile(stdout);
 
     va_end(args);
 #endif
@@ -102,11 +113,13 @@ void log_success(const char *format, ...) {
     va_list args;
     va_start(args, format);
     
+    flockfile(stdout);
     printf(COLOR_TIMESTAMP "[%s]" COLOR_RESET COLOR_BRACKETS "[" LOG_SUCCESS "Success" COLOR_BRACKETS "]" COLOR_RESET " ", timestamp);
     
     printf(LOG_SUCCESS);
     vprintf(format, args);
     printf(COLOR_RESET "\n");
+    funlockfile(stdout);
     
     va_end(args);
 }
@@ -242,4 +255,24 @@ char* get_project_root(void) {
     }
     
     return strdup("."); // 默认返回当前目录
-}
\ No newline at end of file
+}
+
+void json_write_string(FILE *file, const char *str) {
+    fputc('"', file);
+    for (const unsigned char *p = (const unsigned char*)str; *p; p++) {
+        switch (*p) {
+            case '"':  fputs("\\\"", file); break;
+            case '\\': fputs("\\\\", file); break;
+            case '\n': fputs("\\n", file); break;
+            case '\r': fputs("\\r", file); break;
+            case '\t': fputs("\\t", file); break;
+            default:
+                if (*p < 0x20) {
+                    fprintf(file, "\\u%04x", *p);
+                } else {
+                    fputc(*p, file);
+                }
+        }
+    }
+    fputc('"', file);
+}
@@ -2,6 +2,7 @@
 #define UTILS_H
 
 #include <stdbool.h>
+#include <stdio.h>
 
 void log_error(const char *format, ...);
 void log_warning(const char *format, ...);
@@ -18,4 +19,6 @@ char* trim_whitespace(char *str);
 int get_terminal_width(void);
 char* get_project_root(void);
 int ensure_directory_exists(const char *path);
+// 以 JSON 字符串格式（带引号并转义）输出
+void json_write_string(FILE *file, const char *str);
 #endif // UTILS_H
\ No newline at end of file
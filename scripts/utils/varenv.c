@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "varenv.h"
+#include "utils.h"
+
+typedef enum {
+    VAR_PENDING,
+    VAR_VISITING,
+    VAR_DONE
+} VarState;
+
+typedef struct {
+    char *name;
+    char *raw;          // 配置中的原始值
+    char *value;        // 展开后的值，未展开时为 NULL
+    bool literal;
+    VarState state;
+} VarEntry;
+
+typedef struct {
+    char *token;
+    size_t len;
+    char *value;
+} VarToken;
+
+struct VarEnv {
+    VarEntry *slots;
+    size_t capacity;
+    size_t count;
+    VarToken *tokens;
+    int token_count;
+    bool token_first[256];  // 字面量标记的首字符，用于快速跳过普通字符
+};
+
+// 展开时使用的可增长字符串
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} StrBuf;
+
+static int strbuf_append(StrBuf *sb, const char *data, size_t len) {
+    if (sb->len + len + 1 > sb->cap) {
+        size_t new_cap = sb->cap ? sb->cap * 2 : 64;
+        while (new_cap < sb->len + len + 1) new_cap *= 2;
+        char *new_data = realloc(sb->data, new_cap);
+        if (new_data == NULL) return -1;
+        sb->data = new_data;
+        sb->cap = new_cap;
+    }
+    memcpy(sb->data + sb->len, data, len);
+    sb->len += len;
+    sb->data[sb->len] = '\0';
+    return 0;
+}
+
+static uint32_t hash_name(const char *name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// 查找变量所在的槽位，未找到时返回应插入的空槽位
+static VarEntry* find_slot(const VarEnv *env, const char *name, size_t len) {
+    size_t mask = env->capacity - 1;
+    size_t i = hash_name(name, len) & mask;
+    while (env->slots[i].name != NULL) {
+        if (strncmp(env->slots[i].name, name, len) == 0 && env->slots[i].name[len] == '\0') {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return &env->slots[i];
+}
+
+static int grow_table(VarEnv *env) {
+    VarEntry *old_slots = env->slots;
+    size_t old_capacity = env->capacity;
+
+    env->capacity = old_capacity * 2;
+    env->slots = calloc(env->capacity, sizeof(VarEntry));
+    if (env->slots == NULL) {
+        env->slots = old_slots;
+        env->capacity = old_capacity;
+        return -1;
+    }
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i].name != NULL) {
+            *find_slot(env, old_slots[i].name, strlen(old_slots[i].name)) = old_slots[i];
+        }
+    }
+    free(old_slots);
+    return 0;
+}
+
+VarEnv* varenv_new(void) {
+    VarEnv *env = calloc(1, sizeof(VarEnv));
+    if (env == NULL) return NULL;
+    env->capacity = 64;
+    env->slots = calloc(env->capacity, sizeof(VarEntry));
+    if (env->slots == NULL) {
+        free(env);
+        return NULL;
+    }
+    return env;
+}
+
+void varenv_free(VarEnv *env) {
+    if (env == NULL) return;
+    for (size_t i = 0; i < env->capacity; i++) {
+        free(env->slots[i].name);
+        free(env->slots[i].raw);
+        free(env->slots[i].value);
+    }
+    for (int i = 0; i < env->token_count; i++) {
+        free(env->tokens[i].token);
+        free(env->tokens[i].value);
+    }
+    free(env->slots);
+    free(env->tokens);
+    free(env);
+}
+
+// 任何定义发生变化后，之前的展开结果都需要重新计算
+static void reset_resolved(VarEnv *env) {
+    for (size_t i = 0; i < env->capacity; i++) {
+        free(env->slots[i].value);
+        env->slots[i].value = NULL;
+        env->slots[i].state = VAR_PENDING;
+    }
+}
+
+static int define_variable(VarEnv *env, const char *name, const char *value, bool literal) {
+    if ((env->count + 1) * 10 >= env->capacity * 7 && grow_table(env) != 0) {
+        return -1;
+    }
+
+    char *raw = strdup(value ? value : "");
+    if (raw == NULL) return -1;
+
+    VarEntry *entry = find_slot(env, name, strlen(name));
+    if (entry->name == NULL) {
+        entry->name = strdup(name);
+        if (entry->name == NULL) {
+            free(raw);
+            return -1;
+        }
+        env->count++;
+    }
+    free(entry->raw);
+    entry->raw = raw;
+    entry->literal = literal;
+
+    reset_resolved(env);
+    return 0;
+}
+
+int varenv_set(VarEnv *env, const char *name, const char *value) {
+    return define_variable(env, name, value, false);
+}
+
+int varenv_set_literal(VarEnv *env, const char *name, const char *value) {
+    return define_variable(env, name, value, true);
+}
+
+int varenv_set_token(VarEnv *env, const char *token, const char *value) {
+    if (token == NULL || token[0] == '\0') return -1;
+
+    for (int i = 0; i < env->token_count; i++) {
+        if (strcmp(env->tokens[i].token, token) == 0) {
+            char *new_value = strdup(value ? value : "");
+            if (new_value == NULL) return -1;
+            free(env->tokens[i].value);
+            env->tokens[i].value = new_value;
+            reset_resolved(env);
+            return 0;
+        }
+    }
+
+    VarToken *tokens = realloc(env->tokens, (env->token_count + 1) * sizeof(VarToken));
+    if (tokens == NULL) return -1;
+    env->tokens = tokens;
+
+    VarToken *entry = &env->tokens[env->token_count];
+    entry->token = strdup(token);
+    entry->len = strlen(token);
+    entry->value = strdup(value ? value : "");
+    if (entry->token == NULL || entry->value == NULL) {
+        free(entry->token);
+        free(entry->value);
+        return -1;
+    }
+    env->token_count++;
+    env->token_first[(unsigned char)token[0]] = true;
+
+    reset_resolved(env);
+    return 0;
+}
+
+static void resolve_entry(VarEnv *env, VarEntry *entry, int *cycles);
+
+// 单遍展开；cycles 不为 NULL 时处于解析阶段，遇到未展开的变量会先展开它
+static char* expand_string(VarEnv *env, const char *str, int *cycles) {
+    StrBuf sb = {0};
+    const char *s = str;
+    const char *plain = s;  // 尚未输出的普通字符起点
+
+    if (strbuf_append(&sb, "", 0) != 0) return NULL;
+
+    while (*s) {
+        if (s[0] == '$' && s[1] == '{') {
+            const char *end = strchr(s + 2, '}');
+            if (end == NULL) break;
+
+            VarEntry *entry = find_slot(env, s + 2, (size_t)(end - s - 2));
+            if (entry->name == NULL) {
+                // 变量未定义，保留原样
+                s = end + 1;
+                continue;
+            }
+
+            if (cycles != NULL && entry->state == VAR_PENDING) {
+                resolve_entry(env, entry, cycles);
+            } else if (cycles != NULL && entry->state == VAR_VISITING) {
+                log_error("变量循环引用: ${%s}", entry->name);
+                (*cycles)++;
+                s = end + 1;
+                continue;
+            }
+
+            strbuf_append(&sb, plain, (size_t)(s - plain));
+            const char *value = entry->value ? entry->value : entry->raw;
+            strbuf_append(&sb, value, strlen(value));
+            s = end + 1;
+            plain = s;
+            continue;
+        }
+
+        if (env->token_first[(unsigned char)*s]) {
+            bool matched = false;
+            for (int i = 0; i < env->token_count; i++) {
+                if (strncmp(s, env->tokens[i].token, env->tokens[i].len) == 0) {
+                    strbuf_append(&sb, plain, (size_t)(s - plain));
+                    strbuf_append(&sb, env->tokens[i].value, strlen(env->tokens[i].value));
+                    s += env->tokens[i].len;
+                    plain = s;
+                    matched = true;
+                    break;
+                }
+            }
+            if (matched) continue;
+        }
+        s++;
+    }
+
+    strbuf_append(&sb, plain, strlen(plain));
+    return sb.data;
+}
+
+// 深度优先展开：依赖的变量先于引用它的变量展开，每个变量只展开一次
+static void resolve_entry(VarEnv *env, VarEntry *entry, int *cycles) {
+    if (entry->state == VAR_DONE) return;
+
+    if (entry->literal) {
+        entry->value = strdup(entry->raw);
+        entry->state = VAR_DONE;
+        return;
+    }
+
+    entry->state = VAR_VISITING;
+    entry->value = expand_string(env, entry->raw, cycles);
+    entry->state = VAR_DONE;
+}
+
+int varenv_resolve(VarEnv *env) {
+    int cycles = 0;
+    reset_resolved(env);
+    for (size_t i = 0; i < env->capacity; i++) {
+        if (env->slots[i].name != NULL) {
+            resolve_entry(env, &env->slots[i], &cycles);
+        }
+    }
+    return cycles;
+}
+
+const char* varenv_get(const VarEnv *env, const char *name) {
+    const VarEntry *entry = find_slot(env, name, strlen(name));
+    if (entry->name == NULL) return NULL;
+    return entry->value ? entry->value : entry->raw;
+}
+
+int varenv_count(const VarEnv *env) {
+    return (int)env->count;
+}
+
+char* varenv_expand(const VarEnv *env, const char *str) {
+    if (str == NULL) return NULL;
+    return expand_string((VarEnv*)env, str, NULL);
+}
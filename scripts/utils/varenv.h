@@ -0,0 +1,33 @@
+#ifndef VARENV_H
+#define VARENV_H
+
+#include <stdbool.h>
+
+// 配置文件变量环境
+// 变量保存在哈希表中；所有定义在 varenv_resolve 中按依赖顺序一次性展开，
+// 之后每次 varenv_expand 只需单遍扫描，不再递归
+typedef struct VarEnv VarEnv;
+
+VarEnv* varenv_new(void);
+void varenv_free(VarEnv *env);
+
+// 定义变量，值中可以引用其他变量 ${NAME}；同名变量后定义的覆盖先定义的
+int varenv_set(VarEnv *env, const char *name, const char *value);
+// 定义不再展开的变量（如命令行传入的路径），同样覆盖同名定义
+int varenv_set_literal(VarEnv *env, const char *name, const char *value);
+// 定义字面量标记（如 __BUILD_TIME__），在变量值和展开的字符串中原样替换
+int varenv_set_token(VarEnv *env, const char *token, const char *value);
+
+// 按依赖关系展开所有变量定义，返回检测到的循环引用数
+// 处于循环中的变量保留未展开的引用
+int varenv_resolve(VarEnv *env);
+
+// 获取变量展开后的值，未定义返回 NULL
+const char* varenv_get(const VarEnv *env, const char *name);
+int varenv_count(const VarEnv *env);
+
+// 单遍展开字符串中的 ${NAME} 引用和字面量标记，未定义的变量保留原样
+// 返回新分配的字符串，由调用者释放
+char* varenv_expand(const VarEnv *env, const char *str);
+
+#endif // VARENV_H